@@ -0,0 +1,193 @@
+/* audio_filter.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/audio_resample.h"
+
+/*
+ * Per track audio processing between sync and the audio encoder.
+ *
+ * Sample rate conversion and gain used to run inside sync, which
+ * serializes all streams of a job.  Each track that needs them now gets
+ * its own work object and thread, sync only fixes timestamps.
+ */
+
+static int  audio_filter_init( hb_work_object_t *, hb_job_t * );
+static int  audio_filter_work( hb_work_object_t *, hb_buffer_t **,
+                               hb_buffer_t ** );
+static void audio_filter_close( hb_work_object_t * );
+
+hb_work_object_t hb_audio_filter =
+{
+    WORK_AUDIO_FILTER,
+    "Audio filter",
+    audio_filter_init,
+    audio_filter_work,
+    audio_filter_close
+};
+
+struct hb_work_private_s
+{
+    hb_audio_resample_t * resample;
+    float                 gain_factor;
+    int64_t               next_pts;     // start of the next output buffer
+    int64_t               next_in_pts;  // expected start of the next input
+};
+
+int hb_audio_filter_needed( hb_audio_t * audio )
+{
+    return !(audio->config.out.codec & HB_ACODEC_PASS_FLAG) &&
+           (audio->config.in.samplerate != audio->config.out.samplerate ||
+            audio->config.out.gain != 0.0);
+}
+
+/*
+ * Simple loops over contiguous floats without aliasing, so that the
+ * compiler vectorizes them.
+ */
+static void apply_gain_clip( float * restrict samples, int count, float gain )
+{
+    int ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        float sample = samples[ii] * gain;
+        sample       = sample < 1.f  ? sample : 1.f;
+        sample       = sample > -1.f ? sample : -1.f;
+        samples[ii]  = sample;
+    }
+}
+
+static void apply_gain( float * restrict samples, int count, float gain )
+{
+    int ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        samples[ii] *= gain;
+    }
+}
+
+static int audio_filter_init( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv    = calloc(1, sizeof(hb_work_private_t));
+    hb_audio_t        * audio = w->audio;
+
+    if (pv == NULL)
+    {
+        return 1;
+    }
+    w->private_data = pv;
+    pv->next_pts    = AV_NOPTS_VALUE;
+    pv->next_in_pts = AV_NOPTS_VALUE;
+    pv->gain_factor = pow(10, audio->config.out.gain / 20);
+
+    if (audio->config.in.samplerate != audio->config.out.samplerate)
+    {
+        /* Initialize samplerate conversion */
+        pv->resample =
+            hb_audio_resample_init(AV_SAMPLE_FMT_FLT,
+                                   audio->config.out.samplerate,
+                                   audio->config.out.mixdown,
+                                   audio->config.out.normalize_mix_level);
+        if (pv->resample == NULL)
+        {
+            hb_error("audio filter: audio 0x%x resample init failed",
+                     audio->id);
+            return 1;
+        }
+        hb_audio_resample_set_sample_rate(pv->resample,
+                                          audio->config.in.samplerate);
+        if (hb_audio_resample_update(pv->resample))
+        {
+            hb_error("audio filter: audio 0x%x resample update failed",
+                     audio->id);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void audio_filter_close( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    if (pv == NULL)
+    {
+        return;
+    }
+    hb_audio_resample_free(pv->resample);
+    free(pv);
+    w->private_data = NULL;
+}
+
+static int audio_filter_work( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                              hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv    = w->private_data;
+    hb_audio_t        * audio = w->audio;
+    hb_buffer_t       * buf   = *buf_in;
+
+    if (buf->s.flags & HB_BUF_FLAG_EOF)
+    {
+        *buf_out = buf;
+        *buf_in  = NULL;
+        return HB_WORK_DONE;
+    }
+
+    *buf_in = NULL;
+    if (pv->resample != NULL)
+    {
+        /* do sample rate conversion */
+        hb_buffer_t * out;
+        int           nsamples, sample_size;
+
+        // sync delivers continuous audio, only follow its timestamps
+        // again if it ever jumps
+        if (pv->next_in_pts == AV_NOPTS_VALUE ||
+            llabs(buf->s.start - pv->next_in_pts) > 90)
+        {
+            pv->next_pts = buf->s.start;
+        }
+        pv->next_in_pts = buf->s.start + buf->s.duration;
+
+        sample_size = hb_mixdown_get_discrete_channel_count(
+                        audio->config.out.mixdown ) * sizeof( float );
+
+        nsamples = buf->size / sample_size;
+        out = hb_audio_resample(pv->resample,
+                                (const uint8_t **)&buf->data, nsamples);
+        hb_buffer_close(&buf);
+        if (out == NULL)
+        {
+            *buf_out = NULL;
+            return HB_WORK_OK;
+        }
+        out->s.type      = AUDIO_BUF;
+        out->s.frametype = HB_FRAME_AUDIO;
+        out->s.start     = pv->next_pts;
+        out->s.stop      = pv->next_pts + out->s.duration;
+        pv->next_pts     = out->s.stop;
+        buf = out;
+    }
+    if (audio->config.out.gain > 0.0)
+    {
+        apply_gain_clip((float*)buf->data, buf->size / sizeof(float),
+                  pv->gain_factor);
+    }
+    else if (audio->config.out.gain < 0.0)
+    {
+        apply_gain((float*)buf->data, buf->size / sizeof(float), pv->gain_factor);
+    }
+
+    *buf_out = buf;
+
+    return HB_WORK_OK;
+}
@@ -29,6 +29,7 @@ hb_filter_object_t hb_filter_avfilter =
     .work          = avfilter_work,
     .close         = avfilter_close,
     .info          = avfilter_info,
+    .high_depth    = 1,
 };
 
 int  hb_avfilter_null_work( hb_filter_object_t * filter,
@@ -13,24 +13,35 @@
 
 #include "libbluray/bluray.h"
 
+#define BD_READ_PACKETS 64
+
 struct hb_bd_s
 {
     char                    * path;
     BLURAY                  * bd;
     int                       title_count;
     BLURAY_TITLE_INFO      ** title_info;
+    int                       title_info_shared; // owned by another hb_bd_t
     const BLURAY_DISC_INFO  * disc_info;
     int64_t                   duration;
     hb_stream_t             * stream;
     int                       chapter;
     int                       next_chap;
     hb_handle_t             * h;
+
+    // Packets are read two aligned units (32 packets each) at a time and
+    // handed out one by one.  Events libbluray queues during a read are
+    // seen with the first packet of the read, same granularity as
+    // libbluray's own unit reads.
+    uint8_t                   pkt_buf[BD_READ_PACKETS * 192];
+    int                       pkt_len;
+    int                       pkt_pos;
 };
 
 /***********************************************************************
  * Local prototypes
  **********************************************************************/
-static int           next_packet( BLURAY *bd, uint8_t *pkt );
+static int           next_packet( hb_bd_t *d, uint8_t **pkt );
 static int title_info_compare_mpls(const void *, const void *);
 
 /***********************************************************************
@@ -80,6 +91,41 @@ fail:
     return NULL;
 }
 
+/***********************************************************************
+ * hb_bd_dup
+ ***********************************************************************
+ * Opens the disc of 'src' again so that titles can be read through
+ * both handles at the same time.  The title info is shared with 'src',
+ * which must be closed last.
+ **********************************************************************/
+hb_bd_t * hb_bd_dup( hb_bd_t * src )
+{
+    hb_bd_t * d;
+
+    d = calloc( sizeof( hb_bd_t ), 1 );
+    if ( d == NULL )
+    {
+        return NULL;
+    }
+    d->h = src->h;
+    d->bd = bd_open( src->path, NULL );
+    if ( d->bd == NULL ||
+         bd_get_titles( d->bd, TITLES_RELEVANT, 0 ) != src->title_count )
+    {
+        hb_error( "bd: could not open %s again", src->path );
+        if( d->bd ) bd_close( d->bd );
+        free( d );
+        return NULL;
+    }
+    d->title_count = src->title_count;
+    d->title_info = src->title_info;
+    d->title_info_shared = 1;
+    d->disc_info = bd_get_disc_info(d->bd);
+    d->path = strdup( src->path );
+
+    return d;
+}
+
 /***********************************************************************
  * hb_bd_title_count
  **********************************************************************/
@@ -683,6 +729,7 @@ int hb_bd_start( hb_bd_t * d, hb_title_t *title )
     // Calling bd_get_event initializes libbluray event queue.
     bd_select_title( d->bd, d->title_info[title->index - 1]->idx );
     bd_get_event( d->bd, &event );
+    d->pkt_len = d->pkt_pos = 0;
     d->chapter = 0;
     d->next_chap = 1;
     d->stream = hb_bd_stream_open( d->h, title );
@@ -713,6 +760,7 @@ int hb_bd_seek( hb_bd_t * d, float f )
     uint64_t pos = f * d->duration;
 
     bd_seek_time(d->bd, pos);
+    d->pkt_len = d->pkt_pos = 0;
     d->next_chap = bd_get_current_chapter( d->bd ) + 1;
     hb_ts_stream_reset(d->stream);
     return 1;
@@ -721,6 +769,7 @@ int hb_bd_seek( hb_bd_t * d, float f )
 int hb_bd_seek_pts( hb_bd_t * d, uint64_t pts )
 {
     bd_seek_time(d->bd, pts);
+    d->pkt_len = d->pkt_pos = 0;
     d->next_chap = bd_get_current_chapter( d->bd ) + 1;
     hb_ts_stream_reset(d->stream);
     return 1;
@@ -730,6 +779,7 @@ int hb_bd_seek_chapter( hb_bd_t * d, int c )
 {
     d->next_chap = c;
     bd_seek_chapter( d->bd, c - 1 );
+    d->pkt_len = d->pkt_pos = 0;
     hb_ts_stream_reset(d->stream);
     return 1;
 }
@@ -744,7 +794,7 @@ hb_buffer_t * hb_bd_read( hb_bd_t * d )
     int result;
     int error_count = 0;
     int retry_count = 0;
-    uint8_t buf[192];
+    uint8_t *buf;
     BD_EVENT event;
     uint64_t pos;
     hb_buffer_t * out = NULL;
@@ -753,7 +803,7 @@ hb_buffer_t * hb_bd_read( hb_bd_t * d )
     while ( 1 )
     {
         discontinuity = 0;
-        result = next_packet( d->bd, buf );
+        result = next_packet( d, &buf );
         while ( bd_get_event( d->bd, &event ) )
         {
             switch ( event.event )
@@ -863,7 +913,7 @@ void hb_bd_close( hb_bd_t ** _d )
     hb_bd_t * d = *_d;
     int ii;
 
-    if ( d->title_info )
+    if ( d->title_info && !d->title_info_shared )
     {
         for ( ii = 0; ii < d->title_count; ii++ )
             bd_free_title_info( d->title_info[ii] );
@@ -905,21 +955,25 @@ static int have_ts_sync(const uint8_t *buf, int psize)
            check_ts_sync(&buf[6*psize]) && check_ts_sync(&buf[7*psize]);
 }
 
+// Must hold a full read of next_packet() plus a few packets
 #define MAX_HOLE 192*80
 
-static uint64_t align_to_next_packet(BLURAY *bd, uint8_t *pkt)
+static uint64_t align_to_next_packet(hb_bd_t *d)
 {
+    BLURAY  *bd = d->bd;
     int      result;
     uint8_t  buf[MAX_HOLE];
     uint64_t pos = 0;
-    uint64_t start = bd_tell(bd);
+    uint64_t start;
     uint64_t orig;
-    uint64_t off = 192;
-
-    memcpy(buf, pkt, 192);
-    if ( start >= 192 ) {
-        start -= 192;
-    }
+    uint64_t off;
+
+    // Search starts at the packet that lost sync and includes the rest
+    // of what next_packet() already read
+    off = d->pkt_len - d->pkt_pos + 192;
+    memcpy(buf, d->pkt_buf + d->pkt_pos - 192, off);
+    d->pkt_len = d->pkt_pos = 0;
+    start = bd_tell(bd) - off;
     orig = start;
 
     while (1)
@@ -975,29 +1029,43 @@ static uint64_t align_to_next_packet(BLURAY *bd, uint8_t *pkt)
     return start - orig + pos;
 }
 
-static int next_packet( BLURAY *bd, uint8_t *pkt )
+static int next_packet( hb_bd_t *d, uint8_t **pkt )
 {
     int result;
 
     while ( 1 )
     {
-        result = bd_read( bd, pkt, 192 );
-        if ( result < 0 )
-        {
-            return -1;
-        }
-        if ( result < 192 )
+        if ( d->pkt_len - d->pkt_pos < 192 )
         {
-            return 0;
+            // keep a partial packet, reads are not guaranteed to end on
+            // a packet boundary
+            int left = d->pkt_len - d->pkt_pos;
+            memmove( d->pkt_buf, d->pkt_buf + d->pkt_pos, left );
+            d->pkt_len = left;
+            d->pkt_pos = 0;
+            result = bd_read( d->bd, d->pkt_buf + left,
+                              sizeof(d->pkt_buf) - left );
+            if ( result < 0 )
+            {
+                d->pkt_len = 0;
+                return -1;
+            }
+            d->pkt_len += result;
+            if ( d->pkt_len < 192 )
+            {
+                return 0;
+            }
         }
+        *pkt = d->pkt_buf + d->pkt_pos;
+        d->pkt_pos += 192;
         // Sync byte is byte 4.  0-3 are timestamp.
-        if (pkt[4] == 0x47)
+        if ((*pkt)[4] == 0x47)
         {
             return 1;
         }
         // lost sync - back up to where we started then try to re-establish.
-        uint64_t pos = bd_tell(bd);
-        uint64_t pos2 = align_to_next_packet(bd, pkt);
+        uint64_t pos = bd_tell(d->bd) - (d->pkt_len - d->pkt_pos);
+        uint64_t pos2 = align_to_next_packet(d);
         if (pos2 < 0)
         {
             return -1;
@@ -0,0 +1,248 @@
+/* blur.c
+
+   Copyright (c) 2002 Rémi Guyomarch <rguyom at pobox.com>
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/blur.h"
+
+// Scratch rows have room for a whole vector past the end of the plane
+#define BLUR_PAD 32
+
+static void blur_filter_c(hb_blur_t *blur, const uint8_t *src, uint8_t *dst,
+                          const int width, const int height, const int stride)
+{
+    uint32_t **SC = blur->SC;
+    uint32_t SR[2 * HB_BLUR_STEPS_MAX],
+             Tmp1,
+             Tmp2;
+    const uint8_t *src2 = src; // avoid gcc warning
+    int32_t res;
+    int x, y, z;
+    int amount        = blur->amount;
+    int steps         = blur->steps;
+    int scalebits     = blur->scalebits;
+    int32_t halfscale = blur->halfscale;
+
+    for (y = 0; y < 2 * steps; y++)
+    {
+        memset(SC[y], 0, sizeof(SC[y][0]) * (width + 2 * steps));
+    }
+
+    for (y = -steps; y < height + steps; y++)
+    {
+        if (y < height)
+        {
+            src2 = src;
+        }
+
+        memset(SR, 0, sizeof(SR[0]) * (2 * steps - 1));
+
+        for (x = -steps; x < width + steps; x++)
+        {
+            Tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width - 1] : src2[x];
+
+            for (z = 0; z < steps * 2; z += 2)
+            {
+                Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
+                Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
+            }
+
+            for (z = 0; z < steps * 2; z += 2)
+            {
+                Tmp2 = SC[z + 0][x + steps] + Tmp1; SC[z + 0][x + steps] = Tmp1;
+                Tmp1 = SC[z + 1][x + steps] + Tmp2; SC[z + 1][x + steps] = Tmp2;
+            }
+
+            if (x >= steps && y >= steps)
+            {
+                const uint8_t * srx = src - steps * stride + x - steps;
+                uint8_t       * dsx = dst - steps * stride + x - steps;
+
+                res = (((int32_t)*srx -
+                      (int32_t)((Tmp1 + halfscale) >> scalebits)) * amount) >> 16;
+                res = blur->mode == HB_BLUR_SMOOTH ? *srx - res : *srx + res;
+                *dsx = res > blur->max ? blur->max :
+                       res < blur->min ? blur->min : (uint8_t)res;
+            }
+        }
+
+        if (y >= 0)
+        {
+            dst += stride;
+            src += stride;
+        }
+    }
+}
+
+static void blur_filter_16_c(hb_blur_t *blur, const uint8_t *_src,
+                             uint8_t *_dst, const int width,
+                             const int height, const int _stride)
+{
+    uint64_t **SC = (uint64_t **)blur->SC;
+    uint64_t SR[2 * HB_BLUR_STEPS_MAX_16],
+             Tmp1,
+             Tmp2;
+    const uint16_t *src = (const uint16_t *)_src;
+    uint16_t       *dst = (uint16_t *)_dst;
+    const uint16_t *src2 = src; // avoid gcc warning
+    const int stride  = _stride / 2;
+    int64_t res;
+    int x, y, z;
+    int amount        = blur->amount;
+    int steps         = blur->steps;
+    int scalebits     = blur->scalebits;
+    int64_t halfscale = (int64_t)1 << (scalebits - 1);
+
+    for (y = 0; y < 2 * steps; y++)
+    {
+        memset(SC[y], 0, sizeof(SC[y][0]) * (width + 2 * steps));
+    }
+
+    for (y = -steps; y < height + steps; y++)
+    {
+        if (y < height)
+        {
+            src2 = src;
+        }
+
+        memset(SR, 0, sizeof(SR[0]) * (2 * steps - 1));
+
+        for (x = -steps; x < width + steps; x++)
+        {
+            Tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width - 1] : src2[x];
+
+            for (z = 0; z < steps * 2; z += 2)
+            {
+                Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
+                Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
+            }
+
+            for (z = 0; z < steps * 2; z += 2)
+            {
+                Tmp2 = SC[z + 0][x + steps] + Tmp1; SC[z + 0][x + steps] = Tmp1;
+                Tmp1 = SC[z + 1][x + steps] + Tmp2; SC[z + 1][x + steps] = Tmp2;
+            }
+
+            if (x >= steps && y >= steps)
+            {
+                const uint16_t * srx = src - steps * stride + x - steps;
+                uint16_t       * dsx = dst - steps * stride + x - steps;
+
+                res = (((int64_t)*srx -
+                      (int64_t)((Tmp1 + halfscale) >> scalebits)) * amount) >> 16;
+                res = blur->mode == HB_BLUR_SMOOTH ? *srx - res : *srx + res;
+                *dsx = res > blur->max ? blur->max :
+                       res < blur->min ? blur->min : (uint16_t)res;
+            }
+        }
+
+        if (y >= 0)
+        {
+            dst += stride;
+            src += stride;
+        }
+    }
+}
+
+hb_blur_t * hb_blur_init(int width, int depth, int steps, int amount,
+                         int mode)
+{
+    hb_blur_t *blur = calloc(1, sizeof(hb_blur_t));
+    size_t     sc_size;
+    int        z, k;
+
+    if (blur == NULL)
+    {
+        return NULL;
+    }
+    steps           = MIN(MAX(steps, 1), depth > 8 ? HB_BLUR_STEPS_MAX_16 :
+                                                     HB_BLUR_STEPS_MAX);
+    blur->width     = width;
+    blur->depth     = depth;
+    blur->steps     = steps;
+    blur->amount    = amount;
+    blur->mode      = mode;
+    blur->min       = mode == HB_BLUR_SMOOTH ? 16  << (depth - 8) : 0;
+    blur->max       = mode == HB_BLUR_SMOOTH ? 240 << (depth - 8) :
+                                               (1 << depth) - 1;
+    blur->scalebits = steps * 4;
+    // The 16 bit kernel rounds its 64 bit sums itself
+    blur->halfscale = depth > 8 ? 0 : 1 << (blur->scalebits - 1);
+    blur->filter    = depth > 8 ? blur_filter_16_c : blur_filter_c;
+    sc_size         = depth > 8 ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    for (z = 0; z < 2 * steps; z++)
+    {
+        blur->SC[z] = malloc(sc_size * (width + 2 * steps + BLUR_PAD));
+        if (blur->SC[z] == NULL)
+        {
+            hb_blur_close(&blur);
+            return NULL;
+        }
+    }
+    blur->coef = malloc(sizeof(*(blur->coef)) * (2 * steps + 1));
+    blur->line = malloc(width + 2 * steps + BLUR_PAD);
+    blur->row  = malloc(sizeof(*(blur->row)) * (width + BLUR_PAD));
+    if (blur->coef == NULL || blur->line == NULL || blur->row == NULL)
+    {
+        hb_blur_close(&blur);
+        return NULL;
+    }
+
+    // 2 * steps passes of (1 1) add up to the binomial coefficients
+    blur->coef[0] = 1;
+    for (k = 1; k <= 2 * steps; k++)
+    {
+        blur->coef[k] = blur->coef[k - 1] * (2 * steps - k + 1) / k;
+    }
+
+#if defined(ARCH_X86)
+    if (depth == 8)
+    {
+        hb_blur_init_x86(blur);
+    }
+#endif
+
+    return blur;
+}
+
+void hb_blur_close(hb_blur_t **_blur)
+{
+    hb_blur_t *blur = *_blur;
+    int        z;
+
+    if (blur == NULL)
+    {
+        return;
+    }
+    for (z = 0; z < 2 * blur->steps; z++)
+    {
+        free(blur->SC[z]);
+    }
+    free(blur->coef);
+    free(blur->line);
+    free(blur->row);
+    free(blur);
+    *_blur = NULL;
+}
+
+void hb_blur_filter(hb_blur_t *blur, const uint8_t *src, uint8_t *dst,
+                    int width, int height, int stride)
+{
+    if (!blur->amount)
+    {
+        if (src != dst)
+        {
+            memcpy(dst, src, stride*height);
+        }
+
+        return;
+    }
+    blur->filter(blur, src, dst, width, height, stride);
+}
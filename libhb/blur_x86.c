@@ -0,0 +1,214 @@
+/* blur_x86.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include "libavutil/cpu.h"
+#include "handbrake/blur.h"
+
+// The kernels are compiled for AVX2 only and are selected at runtime,
+// the rest of libhb keeps its baseline flags
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_BLUR_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(HAVE_BLUR_AVX2)
+
+// Above this the sums need more than 32 bits, left to the C code
+#define BLUR_AVX2_STEPS_MAX 7
+// Below this the row sums fit 16 bits
+#define BLUR_AVX2_STEPS_16  4
+
+/*
+ * The row passes are done at once with the binomial kernel, 16 pixels per
+ * vector while the sums fit 16 bits.  The column passes keep the cascade
+ * of the C code, 8 columns per vector.  Sums are the same as the C code.
+ */
+TARGET_AVX2
+static void blur_row16_avx2(const hb_blur_t *blur, int width)
+{
+    const uint8_t *line = blur->line;
+    uint32_t      *row  = blur->row;
+    const int      taps = 2 * blur->steps + 1;
+    __m256i        coef[2 * BLUR_AVX2_STEPS_16 + 1];
+    int            x, k;
+
+    for (k = 0; k < taps; k++)
+    {
+        coef[k] = _mm256_set1_epi16(blur->coef[k]);
+    }
+    for (x = 0; x < width; x += 16)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        for (k = 0; k < taps; k++)
+        {
+            __m256i p = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *)(line + x + k)));
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(p, coef[k]));
+        }
+        _mm256_storeu_si256((__m256i *)(row + x),
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(sum)));
+        _mm256_storeu_si256((__m256i *)(row + x + 8),
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(sum, 1)));
+    }
+}
+
+TARGET_AVX2
+static void blur_row32_avx2(const hb_blur_t *blur, int width)
+{
+    const uint8_t *line = blur->line;
+    uint32_t      *row  = blur->row;
+    const int      taps = 2 * blur->steps + 1;
+    __m256i        coef[2 * BLUR_AVX2_STEPS_MAX + 1];
+    int            x, k;
+
+    for (k = 0; k < taps; k++)
+    {
+        coef[k] = _mm256_set1_epi32(blur->coef[k]);
+    }
+    for (x = 0; x < width; x += 8)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        for (k = 0; k < taps; k++)
+        {
+            __m256i p = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i *)(line + x + k)));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(p, coef[k]));
+        }
+        _mm256_storeu_si256((__m256i *)(row + x), sum);
+    }
+}
+
+TARGET_AVX2
+static void blur_filter_avx2(hb_blur_t *blur, const uint8_t *src, uint8_t *dst,
+                             const int width, const int height,
+                             const int stride)
+{
+    uint32_t     **SC        = blur->SC;
+    uint8_t       *line      = blur->line;
+    const int      steps     = blur->steps;
+    const __m128i  scalebits = _mm_cvtsi32_si128(blur->scalebits);
+    const __m256i  halfscale = _mm256_set1_epi32(blur->halfscale);
+    const __m256i  amount    = _mm256_set1_epi32(blur->amount);
+    const __m256i  min       = _mm256_set1_epi32(blur->min);
+    const __m256i  max       = _mm256_set1_epi32(blur->max);
+    const int      smooth    = blur->mode == HB_BLUR_SMOOTH;
+    int            x, y, z;
+
+    for (z = 0; z < 2 * steps; z++)
+    {
+        memset(SC[z], 0, sizeof(SC[z][0]) * (width + 8));
+    }
+
+    for (y = -steps; y < height + steps; y++)
+    {
+        const uint8_t *in = src + stride * (y < 0       ? 0 :
+                                            y >= height ? height - 1 : y);
+
+        // Repeat the edge pixels, the kernels read whole vectors past the
+        // end of the row
+        memset(line, in[0], steps);
+        memcpy(line + steps, in, width);
+        memset(line + steps + width, in[width - 1], steps + 16);
+
+        if (steps <= BLUR_AVX2_STEPS_16)
+        {
+            blur_row16_avx2(blur, width);
+        }
+        else
+        {
+            blur_row32_avx2(blur, width);
+        }
+
+        const uint8_t *srx = src + stride * (y - steps);
+        uint8_t       *dsx = dst + stride * (y - steps);
+
+        for (x = 0; x < width; x += 8)
+        {
+            __m256i t1 = _mm256_loadu_si256((const __m256i *)(blur->row + x));
+            __m256i t2;
+
+            for (z = 0; z < steps * 2; z += 2)
+            {
+                __m256i *sc0 = (__m256i *)(SC[z + 0] + x);
+                __m256i *sc1 = (__m256i *)(SC[z + 1] + x);
+
+                t2 = _mm256_add_epi32(_mm256_loadu_si256(sc0), t1);
+                _mm256_storeu_si256(sc0, t1);
+                t1 = _mm256_add_epi32(_mm256_loadu_si256(sc1), t2);
+                _mm256_storeu_si256(sc1, t2);
+            }
+
+            if (y < steps)
+            {
+                continue;
+            }
+
+            // Last pixels of the row go through a copy so nothing past
+            // the end of the plane is touched
+            int     n = width - x < 8 ? width - x : 8;
+            uint8_t tail[8];
+            __m128i s8;
+
+            if (n < 8)
+            {
+                memcpy(tail, srx + x, n);
+                s8 = _mm_loadl_epi64((const __m128i *)tail);
+            }
+            else
+            {
+                s8 = _mm_loadl_epi64((const __m128i *)(srx + x));
+            }
+
+            __m256i s = _mm256_cvtepu8_epi32(s8);
+            __m256i b = _mm256_srl_epi32(_mm256_add_epi32(t1, halfscale),
+                                         scalebits);
+            __m256i d = _mm256_srai_epi32(
+                _mm256_mullo_epi32(_mm256_sub_epi32(s, b), amount), 16);
+            __m256i r = smooth ? _mm256_sub_epi32(s, d) :
+                                 _mm256_add_epi32(s, d);
+
+            r = _mm256_max_epi32(_mm256_min_epi32(r, max), min);
+
+            __m128i r16 = _mm_packs_epi32(_mm256_castsi256_si128(r),
+                                          _mm256_extracti128_si256(r, 1));
+            __m128i r8  = _mm_packus_epi16(r16, r16);
+
+            if (n < 8)
+            {
+                _mm_storel_epi64((__m128i *)tail, r8);
+                memcpy(dsx + x, tail, n);
+            }
+            else
+            {
+                _mm_storel_epi64((__m128i *)(dsx + x), r8);
+            }
+        }
+    }
+}
+
+#endif // HAVE_BLUR_AVX2
+
+void hb_blur_init_x86(hb_blur_t *blur)
+{
+#if defined(HAVE_BLUR_AVX2)
+    int cpu_flags = av_get_cpu_flags();
+
+    if ((cpu_flags & AV_CPU_FLAG_AVX2) && blur->steps <= BLUR_AVX2_STEPS_MAX)
+    {
+        blur->filter = blur_filter_avx2;
+    }
+#endif
+}
+
+#endif // ARCH_X86
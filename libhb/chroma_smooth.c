@@ -9,6 +9,8 @@
  */
 
 #include "handbrake/handbrake.h"
+#include "handbrake/hbffmpeg.h"
+#include "handbrake/blur.h"
 
 #define CHROMA_SMOOTH_STRENGTH_DEFAULT 0.25
 #define CHROMA_SMOOTH_SIZE_DEFAULT 7
@@ -24,13 +26,11 @@ typedef struct
 
     int        steps;
     int        amount;
-    int        scalebits;
-    int32_t    halfscale;
 } chroma_smooth_plane_context_t;
 
 typedef struct
 {
-    uint32_t * SC[CHROMA_SMOOTH_SIZE_MAX - 1];
+    hb_blur_t * blur;
 } chroma_smooth_thread_context_t;
 
 typedef chroma_smooth_thread_context_t chroma_smooth_thread_context3_t[3];
@@ -64,6 +64,7 @@ hb_filter_object_t hb_filter_chroma_smooth =
 {
     .id                = HB_FILTER_CHROMA_SMOOTH,
     .enforce_order     = 1,
+    .high_depth        = 1,
     .name              = "Chroma Smooth",
     .settings          = NULL,
     .init              = chroma_smooth_init,
@@ -74,85 +75,6 @@ hb_filter_object_t hb_filter_chroma_smooth =
     .settings_template = chroma_smooth_template,
 };
 
-static void chroma_smooth(const uint8_t *src,
-                          uint8_t *dst,
-                          const int width,
-                          const int height,
-                          const int stride,
-                          chroma_smooth_plane_context_t * ctx,
-                          chroma_smooth_thread_context_t * tctx)
-{
-    uint32_t **SC = tctx->SC;
-    uint32_t SR[CHROMA_SMOOTH_SIZE_MAX - 1],
-             Tmp1,
-             Tmp2;
-    const uint8_t *src2 = src; // avoid gcc warning
-    int32_t res;
-    int x, y, z;
-    int amount        = ctx->amount;
-    int steps         = ctx->steps;
-    int scalebits     = ctx->scalebits;
-    int32_t halfscale = ctx->halfscale;
-
-    if (!amount)
-    {
-        if (src != dst)
-        {
-            memcpy(dst, src, stride*height);
-        }
-
-        return;
-    }
-
-    for (y = 0; y < 2 * steps; y++)
-    {
-        memset(SC[y], 0, sizeof(SC[y][0]) * (width + 2 * steps));
-    }
-
-    for (y = -steps; y < height + steps; y++)
-    {
-        if (y < height)
-        {
-            src2 = src;
-        }
-
-        memset(SR, 0, sizeof(SR[0]) * (2 * steps - 1));
-
-        for (x = -steps; x < width + steps; x++)
-        {
-            Tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width - 1] : src2[x];
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
-                Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
-            }
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SC[z + 0][x + steps] + Tmp1; SC[z + 0][x + steps] = Tmp1;
-                Tmp1 = SC[z + 1][x + steps] + Tmp2; SC[z + 1][x + steps] = Tmp2;
-            }
-
-            if (x >= steps && y >= steps)
-            {
-                const uint8_t * srx = src - steps * stride + x - steps;
-                uint8_t       * dsx = dst - steps * stride + x - steps;
-
-                res = (int32_t)*srx - ((((int32_t)*srx -
-                      (int32_t)((Tmp1 + halfscale) >> scalebits)) * amount) >> 16);
-                *dsx = res > 240 ? 240 : res < 16 ? 16 : (uint8_t)res;
-            }
-        }
-
-        if (y >= 0)
-        {
-            dst += stride;
-            src += stride;
-        }
-    }
-}
-
 static int chroma_smooth_init(hb_filter_object_t *filter,
                               hb_filter_init_t   *init)
 {
@@ -197,7 +119,8 @@ static int chroma_smooth_init(hb_filter_object_t *filter,
     {
         chroma_smooth_plane_context_t * ctx = &pv->plane_ctx[c];
 
-        ctx->width = init->geometry.width;
+        ctx->pix_fmt = init->pix_fmt;
+        ctx->width   = init->geometry.width;
 
         // Replace unset values with defaults
         if (ctx->strength == -1)
@@ -221,16 +144,12 @@ static int chroma_smooth_init(hb_filter_object_t *filter,
             // Chroma
             ctx->amount    = ctx->strength * 65536.0;
             ctx->steps     = ctx->size / 2;
-            ctx->scalebits = ctx->steps * 4;
-            ctx->halfscale = 1 << (ctx->scalebits - 1);
         }
         else
         {
             // Luma
             ctx->amount    = 0;
             ctx->steps     = 0;
-            ctx->scalebits = 0;
-            ctx->halfscale = 0;
         }
     }
 
@@ -245,22 +164,13 @@ static int chroma_smooth_init(hb_filter_object_t *filter,
 
 static void chroma_smooth_thread_close(hb_filter_private_t *pv)
 {
-    int c, z;
+    int c;
     for (c = 0; c < 3; c++)
     {
-        chroma_smooth_plane_context_t * ctx = &pv->plane_ctx[c];
         for (int t = 0; t < pv->threads; t++)
         {
             chroma_smooth_thread_context_t * tctx = &pv->thread_ctx[t][c];
-
-            if (c)
-            {
-                for (z = 0; z < 2 * ctx->steps; z++)
-                {
-                    free(tctx->SC[z]);
-                    tctx->SC[z] = NULL;
-                }
-            }
+            hb_blur_close(&tctx->blur);
         }
     }
     free(pv->thread_ctx);
@@ -276,7 +186,8 @@ static int chroma_smooth_init_thread(hb_filter_object_t *filter, int threads)
     for (int c = 0; c < 3; c++)
     {
         chroma_smooth_plane_context_t * ctx = &pv->plane_ctx[c];
-        int w = hb_image_width(ctx->pix_fmt, ctx->width, c);
+        int w     = hb_image_width(ctx->pix_fmt, ctx->width, c);
+        int depth = hb_get_bit_depth(ctx->pix_fmt);
 
         for (int t = 0; t < threads; t++)
         {
@@ -284,17 +195,13 @@ static int chroma_smooth_init_thread(hb_filter_object_t *filter, int threads)
 
             if (c)
             {
-                int z;
-                for (z = 0; z < 2 * ctx->steps; z++)
+                tctx->blur = hb_blur_init(w, depth, ctx->steps,
+                                          ctx->amount, HB_BLUR_SMOOTH);
+                if (tctx->blur == NULL)
                 {
-                    tctx->SC[z] = malloc(sizeof(*(tctx->SC[z])) *
-                                         (w + 2 * ctx->steps));
-                    if (tctx->SC[z] == NULL)
-                    {
-                        hb_error("Chroma Smooth calloc failed");
-                        chroma_smooth_close(filter);
-                        return -1;
-                    }
+                    hb_error("Chroma Smooth calloc failed");
+                    chroma_smooth_close(filter);
+                    return -1;
                 }
             }
         }
@@ -335,15 +242,21 @@ static int chroma_smooth_work_thread(hb_filter_object_t *filter,
     int c;
     for (c = 0; c < 3; c++)
     {
-        chroma_smooth_plane_context_t  * ctx  = &pv->plane_ctx[c];
         chroma_smooth_thread_context_t * tctx = &pv->thread_ctx[thread][c];
 
-        chroma_smooth(in->plane[c].data,
-                      out->plane[c].data,
-                      in->plane[c].width,
-                      in->plane[c].height,
-                      in->plane[c].stride,
-                      ctx, tctx);
+        if (tctx->blur == NULL)
+        {
+            // Luma is copied as is
+            memcpy(out->plane[c].data, in->plane[c].data,
+                   in->plane[c].stride * in->plane[c].height);
+            continue;
+        }
+        hb_blur_filter(tctx->blur,
+                       in->plane[c].data,
+                       out->plane[c].data,
+                       in->plane[c].width,
+                       in->plane[c].height,
+                       in->plane[c].stride);
     }
 
     out->s = in->s;
@@ -28,6 +28,7 @@ hb_filter_object_t hb_filter_colorspace =
     .work              = hb_avfilter_null_work,
     .close             = hb_avfilter_alias_close,
     .settings_template = colorspace_template,
+    .high_depth        = 1,
 };
 
 static int colorspace_init(hb_filter_object_t * filter, hb_filter_init_t * init)
@@ -29,14 +29,13 @@ Original "Faster" settings:
 #define FILTER_ERODE_DILATE 2
 
 #include "handbrake/handbrake.h"
-#include "handbrake/taskset.h"
+#include "handbrake/hbffmpeg.h"
+#include "handbrake/threadpool.h"
 
-typedef struct decomb_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
+typedef struct decomb_segment_s {
     int segment_start[3];
     int segment_height[3];
-} decomb_thread_arg_t;
+} decomb_segment_t;
 
 struct hb_filter_private_s
 {
@@ -58,7 +57,12 @@ struct hb_filter_private_s
     int                comb_detect_ready;
 
     hb_buffer_t      * ref[3];
-    int                ref_used[3];
+
+    // High bit depth frames are detected on the 8 most significant bits
+    // of their luma, reduced into ref8 as a first pipeline stage
+    int                depth;
+    hb_buffer_t      * ref8[3];
+    int                ref8_ready[3];
 
     /* Make buffers to store a comb masks. */
     hb_buffer_t      * mask;
@@ -71,11 +75,9 @@ struct hb_filter_private_s
     int                cpu_count;
     int                segment_height[3];
 
-    taskset_t          decomb_filter_taskset; // Threads for comb detection
-    taskset_t          decomb_check_taskset;  // Threads for comb check
-    taskset_t          mask_filter_taskset; // Threads for decomb mask filter
-    taskset_t          mask_erode_taskset;  // Threads for decomb mask erode
-    taskset_t          mask_dilate_taskset; // Threads for decomb mask dilate
+    decomb_segment_t * segments;       // Row bands for detection and
+                                       // mask filtering - one per CPU
+    decomb_segment_t * check_segments; // Row bands for comb check
 
     hb_buffer_list_t   out_list;
 
@@ -112,6 +114,7 @@ hb_filter_object_t hb_filter_comb_detect =
     .work              = comb_detect_work,
     .close             = comb_detect_close,
     .settings_template = comb_detect_template,
+    .high_depth        = 1,
 };
 
 static void draw_mask_box( hb_filter_private_t * pv )
@@ -168,6 +171,59 @@ static void apply_mask_line( uint8_t * srcp,
     }
 }
 
+static void apply_mask_line_16( uint16_t * srcp,
+                                uint8_t  * mskp,
+                                int width, int depth )
+{
+    int x;
+
+    for (x = 0; x < width; x++)
+    {
+        if (mskp[x] == 1)
+        {
+            srcp[x] = (1 << depth) - 1;
+        }
+        if (mskp[x] == 128)
+        {
+            srcp[x] = 128 << (depth - 8);
+        }
+    }
+}
+
+// apply_mask() for high bit depth frames, mask values are scaled to depth
+static void apply_mask_16(hb_filter_private_t * pv, hb_buffer_t * b,
+                          hb_buffer_t * m)
+{
+    int pp, yy, xx;
+    int shift = pv->depth - 8;
+
+    for (pp = 0; pp < 3; pp++)
+    {
+        uint8_t * dstp = b->plane[pp].data;
+        uint8_t * mskp = m->plane[pp].data;
+
+        for (yy = 0; yy < m->plane[pp].height; yy++)
+        {
+            uint16_t * dst = (uint16_t*)dstp;
+
+            if (!(pv->mode & MODE_COMPOSITE))
+            {
+                for (xx = 0; xx < m->plane[pp].width; xx++)
+                {
+                    dst[xx] = (pp == 0 ? mskp[xx] : 128) << shift;
+                }
+            }
+            if (pp == 0)
+            {
+                apply_mask_line_16(dst, mskp, m->plane[pp].width, pv->depth);
+            }
+
+            dstp += b->plane[pp].stride;
+            mskp += m->plane[pp].stride;
+        }
+    }
+}
+
 static void apply_mask(hb_filter_private_t * pv, hb_buffer_t * b)
 {
     /* draw_boxes */
@@ -184,6 +240,11 @@ static void apply_mask(hb_filter_private_t * pv, hb_buffer_t * b)
     {
         m = pv->mask;
     }
+    if (pv->depth > 8)
+    {
+        apply_mask_16(pv, b, m);
+        return;
+    }
     for (pp = 0; pp < 3; pp++)
     {
         uint8_t * dstp = b->plane[pp].data;
@@ -212,15 +273,20 @@ static void apply_mask(hb_filter_private_t * pv, hb_buffer_t * b)
 
 static void store_ref(hb_filter_private_t * pv, hb_buffer_t * b)
 {
-    // Free unused buffer
-    if (!pv->ref_used[0])
+    hb_buffer_close(&pv->ref[0]);
+    memmove(&pv->ref[0], &pv->ref[1], sizeof(pv->ref[0]) * 2 );
+    pv->ref[2] = b;
+
+    if (pv->depth > 8)
     {
-        hb_buffer_close(&pv->ref[0]);
+        // Recycle the oldest reduced frame for the new one
+        hb_buffer_t * ref8 = pv->ref8[0];
+        memmove(&pv->ref8[0], &pv->ref8[1], sizeof(pv->ref8[0]) * 2 );
+        memmove(&pv->ref8_ready[0], &pv->ref8_ready[1],
+                sizeof(pv->ref8_ready[0]) * 2 );
+        pv->ref8[2]       = ref8;
+        pv->ref8_ready[2] = 0;
     }
-    memmove(&pv->ref[0],      &pv->ref[1],      sizeof(pv->ref[0])      * 2 );
-    memmove(&pv->ref_used[0], &pv->ref_used[1], sizeof(pv->ref_used[0]) * 2 );
-    pv->ref[2]      = b;
-    pv->ref_used[2] = 0;
 }
 
 static void reset_combing_results( hb_filter_private_t * pv )
@@ -433,14 +499,16 @@ static void detect_gamma_combed_segment( hb_filter_private_t * pv,
     float athresh         = (float)pv->spatial_threshold / (float)255;
     float athresh6        = 6 *athresh;
 
+    hb_buffer_t ** ref = pv->depth > 8 ? pv->ref8 : pv->ref;
+
     /* One pas for Y, one pass for U, one pass for V */
     int pp;
     for (pp = 0; pp < 1; pp++)
     {
         int x, y;
-        int stride  = pv->ref[0]->plane[pp].stride;
-        int width   = pv->ref[0]->plane[pp].width;
-        int height  = pv->ref[0]->plane[pp].height;
+        int stride  = ref[0]->plane[pp].stride;
+        int width   = ref[0]->plane[pp].width;
+        int height  = ref[0]->plane[pp].height;
 
         /* Comb detection has to start at y = 2 and end at
            y = height - 2, because it needs to examine
@@ -460,9 +528,9 @@ static void detect_gamma_combed_segment( hb_filter_private_t * pv,
 
             /* We need to examine a column of 5 pixels
                in the prev, cur, and next frames.      */
-            uint8_t * prev = &pv->ref[0]->plane[pp].data[y * stride];
-            uint8_t * cur  = &pv->ref[1]->plane[pp].data[y * stride];
-            uint8_t * next = &pv->ref[2]->plane[pp].data[y * stride];
+            uint8_t * prev = &ref[0]->plane[pp].data[y * stride];
+            uint8_t * cur  = &ref[1]->plane[pp].data[y * stride];
+            uint8_t * next = &ref[2]->plane[pp].data[y * stride];
             uint8_t * mask = &pv->mask->plane[pp].data[y * stride];
 
             memset(mask, 0, stride);
@@ -545,14 +613,16 @@ static void detect_combed_segment( hb_filter_private_t * pv,
     int athresh_squared = athresh * athresh;
     int athresh6        = 6 * athresh;
 
+    hb_buffer_t ** ref = pv->depth > 8 ? pv->ref8 : pv->ref;
+
     /* One pas for Y, one pass for U, one pass for V */
     int pp;
     for (pp = 0; pp < 1; pp++)
     {
         int x, y;
-        int stride  = pv->ref[0]->plane[pp].stride;
-        int width   = pv->ref[0]->plane[pp].width;
-        int height  = pv->ref[0]->plane[pp].height;
+        int stride  = ref[0]->plane[pp].stride;
+        int width   = ref[0]->plane[pp].width;
+        int height  = ref[0]->plane[pp].height;
 
         /* Comb detection has to start at y = 2 and end at
            y = height - 2, because it needs to examine
@@ -572,9 +642,9 @@ static void detect_combed_segment( hb_filter_private_t * pv,
 
             /* We need to examine a column of 5 pixels
                in the prev, cur, and next frames.      */
-            uint8_t * prev = &pv->ref[0]->plane[pp].data[y * stride];
-            uint8_t * cur  = &pv->ref[1]->plane[pp].data[y * stride];
-            uint8_t * next = &pv->ref[2]->plane[pp].data[y * stride];
+            uint8_t * prev = &ref[0]->plane[pp].data[y * stride];
+            uint8_t * cur  = &ref[1]->plane[pp].data[y * stride];
+            uint8_t * next = &ref[2]->plane[pp].data[y * stride];
             uint8_t * mask = &pv->mask->plane[pp].data[y * stride];
 
             memset(mask, 0, stride);
@@ -664,415 +734,316 @@ static void detect_combed_segment( hb_filter_private_t * pv,
     }
 }
 
-static void mask_dilate_thread( void *thread_args_v )
+/*
+ * Reduce the luma of the frames not yet reduced to 8 bits in this
+ * segment, detection then runs on pv->ref8.
+ */
+static void reduce_depth_segment( void *opaque, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->segments[segment];
+    int segment_start = seg->segment_start[0];
+    int segment_stop  = segment_start + seg->segment_height[0];
+    int shift = pv->depth - 8;
+    int ii, xx, yy;
 
-    hb_deep_log(3, "mask dilate thread started for segment %d", segment);
-
-    while (1)
+    for (ii = 0; ii < 3; ii++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_dilate_taskset, segment );
-
-        if (taskset_thread_stop(&pv->mask_dilate_taskset, segment))
+        if (pv->ref8_ready[ii])
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            continue;
         }
 
-        int xx, yy, pp;
-
-        int count;
-        int dilation_threshold = 4;
+        int width      = pv->ref[ii]->plane[0].width;
+        int src_stride = pv->ref[ii]->plane[0].stride;
+        int dst_stride = pv->ref8[ii]->plane[0].stride;
+        uint8_t * src  = &pv->ref[ii]->plane[0].data[segment_start * src_stride];
+        uint8_t * dst  = &pv->ref8[ii]->plane[0].data[segment_start * dst_stride];
 
-        for (pp = 0; pp < 1; pp++)
+        for (yy = segment_start; yy < segment_stop; yy++)
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            const uint16_t * srcp = (const uint16_t*)src;
 
-            if (segment_stop == height)
+            for (xx = 0; xx < width; xx++)
             {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
-
-            uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
-
-            for (yy = start; yy < stop; yy++)
-            {
-                for (xx = 1; xx < width - 1; xx++)
-                {
-                    if (cur[xx])
-                    {
-                        dst[xx] = 1;
-                        continue;
-                    }
-
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
-
-                    dst[xx] = count >= dilation_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = srcp[xx] >> shift;
             }
+            src += src_stride;
+            dst += dst_stride;
         }
-
-        taskset_thread_complete( &pv->mask_dilate_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_dilate_taskset, segment );
 }
 
-static void mask_erode_thread( void *thread_args_v )
+static void mask_dilate_segment( void *opaque, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    int xx, yy, pp;
 
-    hb_deep_log(3, "mask erode thread started for segment %d", segment);
+    int count;
+    int dilation_threshold = 4;
 
-    while (1)
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_erode_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        if (taskset_thread_stop( &pv->mask_erode_taskset, segment ))
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int erosion_threshold = 2;
-
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
 
-            for (yy = start; yy < stop; yy++)
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
             {
-                for (xx = 1; xx < width - 1; xx++)
+                if (cur[xx])
                 {
-                    if (cur[xx] == 0)
-                    {
-                        dst[xx] = 0;
-                        continue;
-                    }
+                    dst[xx] = 1;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= erosion_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= dilation_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_erode_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_erode_taskset, segment );
 }
 
-static void mask_filter_thread( void *thread_args_v )
+static void mask_erode_segment( void *opaque, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    int xx, yy, pp;
 
-    hb_deep_log(3, "mask filter thread started for segment %d", segment);
+    int count;
+    int erosion_threshold = 2;
 
-    while (1)
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_filter_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
 
-        if (taskset_thread_stop( &pv->mask_filter_taskset, segment ))
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
+
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            int width = pv->mask->plane[pp].width;
-            int height = pv->mask->plane[pp].height;
-            int stride = pv->mask->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height - 1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
-            uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
-            uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
-                &pv->mask_filtered->plane[pp].data[c * stride + 1] :
-                &pv->mask_temp->plane[pp].data[c * stride + 1] ;
+        uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
 
-            for (yy = start; yy < stop; yy++)
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
             {
-                for (xx = 1; xx < width - 1; xx++)
+                if (cur[xx] == 0)
                 {
-                    int h_count, v_count;
+                    dst[xx] = 0;
+                    continue;
+                }
 
-                    h_count = cur[xx-1] & cur[xx] & cur[xx+1];
-                    v_count = curp[xx] & cur[xx] & curn[xx];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    if (pv->filter_mode == FILTER_CLASSIC)
-                    {
-                        dst[xx] = h_count;
-                    }
-                    else
-                    {
-                        dst[xx] = h_count & v_count;
-                    }
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= erosion_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_filter_taskset, segment );
 }
 
-static void decomb_check_thread( void *thread_args_v )
+static void mask_filter_segment( void *opaque, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    hb_deep_log(3, "decomb check thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_check_taskset, segment );
+        int width = pv->mask->plane[pp].width;
+        int height = pv->mask->plane[pp].height;
+        int stride = pv->mask->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        if (taskset_thread_stop( &pv->decomb_check_taskset, segment ))
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
+        }
+        else
+        {
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
         }
 
-        segment_start = thread_args->segment_start[0];
-        segment_stop = segment_start + thread_args->segment_height[0];
-
-        if (pv->mode & MODE_FILTER)
+        if (segment_stop == height)
         {
-            check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
+            stop = height - 1;
         }
         else
         {
-            check_combing_mask(pv, segment, segment_start, segment_stop);
+            stop = segment_stop;
         }
 
-        taskset_thread_complete( &pv->decomb_check_taskset, segment );
+        uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
+        uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
+        uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
+            &pv->mask_filtered->plane[pp].data[c * stride + 1] :
+            &pv->mask_temp->plane[pp].data[c * stride + 1] ;
+
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
+            {
+                int h_count, v_count;
+
+                h_count = cur[xx-1] & cur[xx] & cur[xx+1];
+                v_count = curp[xx] & cur[xx] & curn[xx];
+
+                if (pv->filter_mode == FILTER_CLASSIC)
+                {
+                    dst[xx] = h_count;
+                }
+                else
+                {
+                    dst[xx] = h_count & v_count;
+                }
+            }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
+        }
     }
+}
 
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_check_taskset, segment );
+static void decomb_check_segment( void *opaque, int segment )
+{
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->check_segments[segment];
+    int segment_start, segment_stop;
+
+    segment_start = seg->segment_start[0];
+    segment_stop = segment_start + seg->segment_height[0];
+
+    if (pv->mode & MODE_FILTER)
+    {
+        check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
+    }
+    else
+    {
+        check_combing_mask(pv, segment, segment_start, segment_stop);
+    }
 }
 
 /*
- * comb detect this segment of all three planes in a single thread.
+ * comb detect this segment of all three planes in a single slice
+ * of the thread pool.
  */
-static void decomb_filter_thread( void *thread_args_v )
+static void decomb_filter_segment( void *opaque, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    hb_filter_private_t * pv = opaque;
+    decomb_segment_t * seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    hb_deep_log(3, "decomb filter thread started for segment %d", segment);
-
-    while (1)
+    /*
+     * Process segment (for now just from luma)
+     */
+    int pp;
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_filter_taskset, segment );
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        if (taskset_thread_stop( &pv->decomb_filter_taskset, segment ))
+        if (pv->mode & MODE_GAMMA)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            detect_gamma_combed_segment( pv, segment_start, segment_stop );
         }
-
-        /*
-         * Process segment (for now just from luma)
-         */
-        int pp;
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (pv->mode & MODE_GAMMA)
-            {
-                detect_gamma_combed_segment( pv, segment_start, segment_stop );
-            }
-            else
-            {
-                detect_combed_segment( pv, segment_start, segment_stop );
-            }
+            detect_combed_segment( pv, segment_start, segment_stop );
         }
-
-        taskset_thread_complete( &pv->decomb_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_filter_taskset, segment );
 }
 
 static int comb_segmenter( hb_filter_private_t * pv )
@@ -1081,20 +1052,33 @@ static int comb_segmenter( hb_filter_private_t * pv )
      * Now that all data for decomb detection is ready for
      * our threads, fire them off and wait for their completion.
      */
-    taskset_cycle( &pv->decomb_filter_taskset );
+    hb_parallel_func_t * stages[6];
+    int                  stage_count = 0;
 
+    /*
+     * Detection and mask filtering are pipelined by row band, a band
+     * of the next stage runs as soon as its neighbours are ready.
+     */
+    if (pv->depth > 8)
+    {
+        stages[stage_count++] = reduce_depth_segment;
+    }
+    stages[stage_count++] = decomb_filter_segment;
     if (pv->mode & MODE_FILTER)
     {
-        taskset_cycle( &pv->mask_filter_taskset );
+        stages[stage_count++] = mask_filter_segment;
         if (pv->filter_mode == FILTER_ERODE_DILATE)
         {
-            taskset_cycle( &pv->mask_erode_taskset );
-            taskset_cycle( &pv->mask_dilate_taskset );
-            taskset_cycle( &pv->mask_erode_taskset );
+            stages[stage_count++] = mask_erode_segment;
+            stages[stage_count++] = mask_dilate_segment;
+            stages[stage_count++] = mask_erode_segment;
         }
     }
+    hb_parallel_pipeline(stage_count, stages, pv->cpu_count, pv);
+    pv->ref8_ready[0] = pv->ref8_ready[1] = pv->ref8_ready[2] = 1;
+
     reset_combing_results(pv);
-    taskset_cycle(&pv->decomb_check_taskset);
+    hb_parallel_for(pv->comb_check_nthreads, decomb_check_segment, pv);
     return check_combing_results(pv);
 }
 
@@ -1140,6 +1124,13 @@ static int comb_detect_init( hb_filter_object_t * filter,
 
     pv->cpu_count = hb_get_cpu_count();
 
+    // Pipelined mask stages read one row of the neighbouring bands,
+    // so no band may be empty
+    if (pv->cpu_count > init->geometry.height / 4)
+    {
+        pv->cpu_count = MAX(1, init->geometry.height / 4);
+    }
+
     // Make segment sizes an even number of lines
     int height = hb_image_height(init->pix_fmt, init->geometry.height, 0);
     // each segment of each plane must begin on an even row.
@@ -1147,68 +1138,64 @@ static int comb_detect_init( hb_filter_object_t * filter,
     pv->segment_height[1] = hb_image_height(init->pix_fmt, pv->segment_height[0], 1);
     pv->segment_height[2] = hb_image_height(init->pix_fmt, pv->segment_height[0], 2);
 
-    /* Allocate buffers to store comb masks. */
-    pv->mask = hb_frame_buffer_init(init->pix_fmt,
+    int ii, pp;
+
+    /* Allocate buffers to store comb masks.  Masks and reduced frames are
+       8 bit whatever the input depth, their strides match. */
+    int mask_pix_fmt = init->pix_fmt;
+    pv->depth = hb_get_bit_depth(init->pix_fmt);
+    if (pv->depth > 8)
+    {
+        mask_pix_fmt = AV_PIX_FMT_YUV420P;
+        for (ii = 0; ii < 3; ii++)
+        {
+            pv->ref8[ii] = hb_frame_buffer_init(mask_pix_fmt,
+                                init->geometry.width, init->geometry.height);
+        }
+    }
+    pv->mask = hb_frame_buffer_init(mask_pix_fmt,
                                 init->geometry.width, init->geometry.height);
-    pv->mask_filtered = hb_frame_buffer_init(init->pix_fmt,
+    pv->mask_filtered = hb_frame_buffer_init(mask_pix_fmt,
                                 init->geometry.width, init->geometry.height);
-    pv->mask_temp = hb_frame_buffer_init(init->pix_fmt,
+    pv->mask_temp = hb_frame_buffer_init(mask_pix_fmt,
                                 init->geometry.width, init->geometry.height);
     memset(pv->mask->data, 0, pv->mask->size);
     memset(pv->mask_filtered->data, 0, pv->mask_filtered->size);
     memset(pv->mask_temp->data, 0, pv->mask_temp->size);
 
-    int ii;
-
     /*
-     * Create comb detection taskset.
+     * Split the frame into row bands for comb detection and mask filtering.
      */
-    if (taskset_init( &pv->decomb_filter_taskset, pv->cpu_count,
-                      sizeof( decomb_thread_arg_t ) ) == 0)
+    pv->segments = calloc(pv->cpu_count, sizeof(decomb_segment_t));
+    if (pv->segments == NULL)
     {
-        hb_error( "decomb could not initialize taskset" );
+        hb_error( "comb detect could not allocate segments" );
+        return -1;
     }
 
-    decomb_thread_arg_t *decomb_prev_thread_args = NULL;
     for (ii = 0; ii < pv->cpu_count; ii++)
     {
-        decomb_thread_arg_t *thread_args;
+        decomb_segment_t *seg = &pv->segments[ii];
 
-        thread_args = taskset_thread_args( &pv->decomb_filter_taskset, ii );
-        thread_args->pv = pv;
-        thread_args->segment = ii;
-
-        int pp;
         for (pp = 0; pp < 3; pp++)
         {
-            if (decomb_prev_thread_args != NULL)
+            if (ii > 0)
             {
-                thread_args->segment_start[pp] =
-                    decomb_prev_thread_args->segment_start[pp] +
-                    decomb_prev_thread_args->segment_height[pp];
+                seg->segment_start[pp] = seg[-1].segment_start[pp] +
+                                         seg[-1].segment_height[pp];
             }
             if (ii == pv->cpu_count - 1)
             {
                 /*
                  * Final segment
                  */
-                thread_args->segment_height[pp] =
+                seg->segment_height[pp] =
                     hb_image_height(init->pix_fmt, init->geometry.height, pp) -
-                    thread_args->segment_start[pp];
+                    seg->segment_start[pp];
             } else {
-                thread_args->segment_height[pp] = pv->segment_height[pp];
+                seg->segment_height[pp] = pv->segment_height[pp];
             }
         }
-
-        if (taskset_thread_spawn( &pv->decomb_filter_taskset, ii,
-                                 "decomb_filter_segment",
-                                 decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "decomb could not spawn thread" );
-        }
-
-        decomb_prev_thread_args = thread_args;
     }
 
     pv->comb_check_nthreads = init->geometry.height / pv->block_height;
@@ -1219,31 +1206,26 @@ static int comb_detect_init( hb_filter_object_t * filter,
     pv->block_score = calloc(pv->comb_check_nthreads, sizeof(int));
 
     /*
-     * Create comb check taskset.
+     * Split the frame into row bands for the comb check.
      */
-    if (taskset_init( &pv->decomb_check_taskset, pv->comb_check_nthreads,
-                      sizeof( decomb_thread_arg_t ) ) == 0)
+    pv->check_segments = calloc(pv->comb_check_nthreads,
+                                sizeof(decomb_segment_t));
+    if (pv->block_score == NULL || pv->check_segments == NULL)
     {
-        hb_error( "decomb check could not initialize taskset" );
+        hb_error( "comb detect could not allocate check segments" );
+        return -1;
     }
 
-    decomb_prev_thread_args = NULL;
     for (ii = 0; ii < pv->comb_check_nthreads; ii++)
     {
-        decomb_thread_arg_t *thread_args;
+        decomb_segment_t *seg = &pv->check_segments[ii];
 
-        thread_args = taskset_thread_args( &pv->decomb_check_taskset, ii);
-        thread_args->pv = pv;
-        thread_args->segment = ii;
-
-        int pp;
         for (pp = 0; pp < 3; pp++)
         {
-            if (decomb_prev_thread_args != NULL)
+            if (ii > 0)
             {
-                thread_args->segment_start[pp] =
-                    decomb_prev_thread_args->segment_start[pp] +
-                    decomb_prev_thread_args->segment_height[pp];
+                seg->segment_start[pp] = seg[-1].segment_start[pp] +
+                                         seg[-1].segment_height[pp];
             }
 
             // Make segment height a multiple of block_height
@@ -1257,174 +1239,11 @@ static int comb_detect_init( hb_filter_object_t * filter,
                 /*
                  * Final segment
                  */
-                thread_args->segment_height[pp] =
+                seg->segment_height[pp] =
                     hb_image_height(init->pix_fmt, init->geometry.height, pp) -
-                    thread_args->segment_start[pp];
+                    seg->segment_start[pp];
             } else {
-                thread_args->segment_height[pp] = h;
-            }
-        }
-
-        if (taskset_thread_spawn( &pv->decomb_check_taskset, ii,
-                                  "decomb_check_segment",
-                                  decomb_check_thread,
-                                  HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "decomb check could not spawn thread" );
-        }
-
-        decomb_prev_thread_args = thread_args;
-    }
-
-    if (pv->mode & MODE_FILTER)
-    {
-        if (taskset_init( &pv->mask_filter_taskset, pv->cpu_count,
-                          sizeof( decomb_thread_arg_t ) ) == 0)
-        {
-            hb_error( "mask filter could not initialize taskset" );
-        }
-
-        decomb_prev_thread_args = NULL;
-        for (ii = 0; ii < pv->cpu_count; ii++)
-        {
-            decomb_thread_arg_t *thread_args;
-
-            thread_args = taskset_thread_args( &pv->mask_filter_taskset, ii );
-            thread_args->pv = pv;
-            thread_args->segment = ii;
-
-            int pp;
-            for (pp = 0; pp < 3; pp++)
-            {
-                if (decomb_prev_thread_args != NULL)
-                {
-                    thread_args->segment_start[pp] =
-                        decomb_prev_thread_args->segment_start[pp] +
-                        decomb_prev_thread_args->segment_height[pp];
-                }
-
-                if (ii == pv->cpu_count - 1)
-                {
-                    /*
-                     * Final segment
-                     */
-                    thread_args->segment_height[pp] =
-                        hb_image_height(init->pix_fmt, init->geometry.height, pp) -
-                        thread_args->segment_start[pp];
-                } else {
-                    thread_args->segment_height[pp] = pv->segment_height[pp];
-                }
-            }
-
-            if (taskset_thread_spawn( &pv->mask_filter_taskset, ii,
-                                     "mask_filter_segment",
-                                     mask_filter_thread,
-                                     HB_NORMAL_PRIORITY ) == 0)
-            {
-                hb_error( "mask filter could not spawn thread" );
-            }
-
-            decomb_prev_thread_args = thread_args;
-        }
-
-        if (pv->filter_mode == FILTER_ERODE_DILATE)
-        {
-            if (taskset_init( &pv->mask_erode_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0)
-            {
-                hb_error( "mask erode could not initialize taskset" );
-            }
-
-            decomb_prev_thread_args = NULL;
-            for (ii = 0; ii < pv->cpu_count; ii++)
-            {
-                decomb_thread_arg_t *thread_args;
-
-                thread_args = taskset_thread_args( &pv->mask_erode_taskset, ii );
-                thread_args->pv = pv;
-                thread_args->segment = ii;
-
-                int pp;
-                for (pp = 0; pp < 3; pp++)
-                {
-                    if (decomb_prev_thread_args != NULL)
-                    {
-                        thread_args->segment_start[pp] =
-                            decomb_prev_thread_args->segment_start[pp] +
-                            decomb_prev_thread_args->segment_height[pp];
-                    }
-
-                    if (ii == pv->cpu_count - 1)
-                    {
-                        /*
-                         * Final segment
-                         */
-                        thread_args->segment_height[pp] =
-                            hb_image_height(init->pix_fmt, init->geometry.height, pp) -
-                            thread_args->segment_start[pp];
-                    } else {
-                        thread_args->segment_height[pp] = pv->segment_height[pp];
-                    }
-                }
-
-                if (taskset_thread_spawn( &pv->mask_erode_taskset, ii,
-                                         "mask_erode_segment",
-                                         mask_erode_thread,
-                                         HB_NORMAL_PRIORITY ) == 0)
-                {
-                    hb_error( "mask erode could not spawn thread" );
-                }
-
-                decomb_prev_thread_args = thread_args;
-            }
-
-            if (taskset_init( &pv->mask_dilate_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0)
-            {
-                hb_error( "mask dilate could not initialize taskset" );
-            }
-
-            decomb_prev_thread_args = NULL;
-            for (ii = 0; ii < pv->cpu_count; ii++)
-            {
-                decomb_thread_arg_t *thread_args;
-
-                thread_args = taskset_thread_args( &pv->mask_dilate_taskset, ii );
-                thread_args->pv = pv;
-                thread_args->segment = ii;
-
-                int pp;
-                for (pp = 0; pp < 3; pp++)
-                {
-                    if (decomb_prev_thread_args != NULL)
-                    {
-                        thread_args->segment_start[pp] =
-                            decomb_prev_thread_args->segment_start[pp] +
-                            decomb_prev_thread_args->segment_height[pp];
-                    }
-
-                    if (ii == pv->cpu_count - 1)
-                    {
-                        /*
-                         * Final segment
-                         */
-                        thread_args->segment_height[pp] =
-                            hb_image_height(init->pix_fmt, init->geometry.height, pp) -
-                            thread_args->segment_start[pp];
-                    } else {
-                        thread_args->segment_height[pp] = pv->segment_height[pp];
-                    }
-                }
-
-                if (taskset_thread_spawn( &pv->mask_dilate_taskset, ii,
-                                         "mask_dilate_segment",
-                                         mask_dilate_thread,
-                                         HB_NORMAL_PRIORITY ) == 0)
-                {
-                    hb_error( "mask dilate could not spawn thread" );
-                }
-
-                decomb_prev_thread_args = thread_args;
+                seg->segment_height[pp] = h;
             }
         }
     }
@@ -1444,28 +1263,14 @@ static void comb_detect_close( hb_filter_object_t * filter )
     hb_log("comb detect: heavy %i | light %i | uncombed %i | total %i",
            pv->comb_heavy,  pv->comb_light,  pv->comb_none, pv->frames);
 
-    taskset_fini( &pv->decomb_filter_taskset );
-    taskset_fini( &pv->decomb_check_taskset );
-
-    if (pv->mode & MODE_FILTER)
-    {
-        taskset_fini( &pv->mask_filter_taskset );
-        if (pv->filter_mode == FILTER_ERODE_DILATE)
-        {
-            taskset_fini( &pv->mask_erode_taskset );
-            taskset_fini( &pv->mask_dilate_taskset );
-        }
-    }
-
     /* Cleanup reference buffers. */
     int ii;
     for (ii = 0; ii < 3; ii++)
     {
-        if (!pv->ref_used[ii])
-        {
-            hb_buffer_close(&pv->ref[ii]);
-        }
+        hb_buffer_close(&pv->ref[ii]);
+        hb_buffer_close(&pv->ref8[ii]);
     }
+    hb_buffer_list_close(&pv->out_list);
 
     /* Cleanup combing masks. */
     hb_buffer_close(&pv->mask);
@@ -1473,6 +1278,8 @@ static void comb_detect_close( hb_filter_object_t * filter )
     hb_buffer_close(&pv->mask_temp);
 
     free(pv->block_score);
+    free(pv->segments);
+    free(pv->check_segments);
     free( pv );
     filter->private_data = NULL;
 }
@@ -1508,9 +1315,12 @@ static void process_frame( hb_filter_private_t * pv )
     }
     else
     {
-        pv->ref_used[1] = 1;
-        pv->ref[1]->s.combed = combed;
-        hb_buffer_list_append(&pv->out_list, pv->ref[1]);
+        // Pass along a copy-on-write reference, the original stays in
+        // the ref list for the next two frames
+        hb_buffer_t * out;
+        out = hb_buffer_shared_dup(pv->ref[1]);
+        out->s.combed = combed;
+        hb_buffer_list_append(&pv->out_list, out);
     }
 }
 
@@ -1526,7 +1336,7 @@ static int comb_detect_work( hb_filter_object_t * filter,
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
         // Duplicate last frame and process refs
-        store_ref(pv, hb_buffer_dup(pv->ref[2]));
+        store_ref(pv, hb_buffer_shared_dup(pv->ref[2]));
         if (pv->ref[0] != NULL)
         {
             process_frame(pv);
@@ -1536,12 +1346,19 @@ static int comb_detect_work( hb_filter_object_t * filter,
         return HB_FILTER_DONE;
     }
 
+    // Pad the rows below the picture for decomb while the frame is still
+    // private.  Once it is shared with the output, padding it takes a copy.
+    if (hb_buffer_is_writable(in))
+    {
+        hb_frame_buffer_fill_stride(in);
+    }
+
     // comb detect requires 3 buffers, prev, cur, and next.  For the first
     // frame, there can be no prev, so we duplicate the first frame.
     if (!pv->comb_detect_ready)
     {
         // If not ready, store duplicate ref and return HB_FILTER_DELAY
-        store_ref(pv, hb_buffer_dup(in));
+        store_ref(pv, hb_buffer_shared_dup(in));
         store_ref(pv, in);
         pv->comb_detect_ready = 1;
         // Wait for next
@@ -1551,13 +1368,6 @@ static int comb_detect_work( hb_filter_object_t * filter,
     store_ref(pv, in);
     process_frame(pv);
 
-    // Output buffers may also be in comb detect's internal ref list.
-    // Since buffers are not reference counted, we must wait until
-    // we are certain they are no longer in the ref list before sending
-    // down the pipeline where they will ultimately get closed.
-    if (hb_buffer_list_count(&pv->out_list) > 3)
-    {
-        *buf_out = hb_buffer_list_rem_head(&pv->out_list);
-    }
+    *buf_out = hb_buffer_list_clear(&pv->out_list);
     return HB_FILTER_OK;
 }
@@ -3838,6 +3838,57 @@ int hb_output_color_matrix(hb_job_t * job)
         return job->color_matrix;
 }
 
+/*
+ * Expected duration of the encoded range of the title in 90KHz ticks
+ */
+int64_t hb_job_get_duration(hb_job_t * job)
+{
+    int64_t duration, total_duration, extra_duration = 0;
+    int     ii;
+
+    if (job->frame_to_stop)
+    {
+        return (int64_t)job->frame_to_stop * 90000 * job->title->vrate.den /
+                                                     job->title->vrate.num;
+    }
+    if (job->pts_to_stop)
+    {
+        return job->pts_to_stop;
+    }
+
+    total_duration = 0;
+    for (ii = 0; ii <= hb_list_count(job->list_chapter); ii++)
+    {
+        hb_chapter_t * chapter;
+        chapter = hb_list_item(job->list_chapter, ii - 1);
+        if (chapter != NULL)
+        {
+            total_duration += chapter->duration;
+        }
+    }
+    // Some titles are longer than the sum duration of their
+    // chapters.  Account for this extra duration.
+    if (job->title->duration > total_duration)
+    {
+        extra_duration = job->title->duration - total_duration;
+    }
+    duration = 0;
+    for (ii = job->chapter_start; ii <= job->chapter_end; ii++)
+    {
+        hb_chapter_t * chapter;
+        chapter = hb_list_item(job->list_chapter, ii - 1);
+        if (chapter != NULL)
+        {
+            duration += chapter->duration;
+        }
+    }
+    if (job->chapter_end == hb_list_count(job->list_chapter))
+    {
+        duration += extra_duration;
+    }
+    return duration;
+}
+
 static void job_clean( hb_job_t * job )
 {
     if (job)
@@ -8,6 +8,7 @@
  */
 
 #include "handbrake/common.h"
+#include "handbrake/hbffmpeg.h"
 #include "handbrake/avfilter_priv.h"
 
 static int crop_scale_init(hb_filter_object_t * filter,
@@ -31,6 +32,7 @@ hb_filter_object_t hb_filter_crop_scale =
     .close             = hb_avfilter_alias_close,
     .info              = crop_scale_info,
     .settings_template = crop_scale_template,
+    .high_depth        = 1,
 };
 
 static const char * color_format_range(enum AVPixelFormat format, int range)
@@ -142,9 +144,9 @@ static int crop_scale_init(hb_filter_object_t * filter, hb_filter_init_t * init)
     avfilter   = hb_dict_init();
     avsettings = hb_dict_init();
 
-    // TODO: Support other pix formats
-    // Force output to YUV420P for until other formats are supported
-    hb_dict_set(avsettings, "pix_fmts", hb_value_string("yuv420p"));
+    // Keep the pipeline format, 8 bit or high bit depth 4:2:0
+    hb_dict_set(avsettings, "pix_fmts",
+                hb_value_string(av_get_pix_fmt_name(init->pix_fmt)));
     hb_dict_set(avfilter, "format", avsettings);
     hb_value_array_append(avfilters, avfilter);
 
@@ -460,7 +460,8 @@ static int decavcodecaWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     // libavcodec/mpeg12dec.c requires buffers to be zero padded.
     // If not zero padded, it can get stuck in an infinite loop.
     // It's likely there are other decoders that expect the same.
-    if (in->data != NULL)
+    // Wrapped packets (alloc 0) come with zeroed padding already.
+    if (in->data != NULL && in->alloc > in->size)
     {
         memset(in->data + in->size, 0, in->alloc - in->size);
     }
@@ -652,8 +653,7 @@ static int decavcodecaBSInfo( hb_work_object_t *w, const hb_buffer_t *buf,
         return -1;
     }
 
-    static char codec_name[64];
-    info->name =  strncpy( codec_name, codec->name, sizeof(codec_name)-1 );
+    info->name = codec->name;
 
     AVCodecContext *context      = avcodec_alloc_context3(codec);
     AVCodecParserContext *parser = NULL;
@@ -1207,7 +1207,8 @@ int reinit_video_filters(hb_work_private_t * pv)
         hb_avfilter_append_dict(filters, "scale", settings);
 
         settings = hb_dict_init();
-        hb_dict_set(settings, "pix_fmts", hb_value_string("yuv420p"));
+        hb_dict_set(settings, "pix_fmts",
+                    hb_value_string(av_get_pix_fmt_name(pix_fmt)));
         hb_avfilter_append_dict(filters, "format", settings);
     }
     if (pv->title->rotation != HB_ROTATION_0)
@@ -1697,7 +1698,8 @@ static int decavcodecvWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     // libavcodec/mpeg12dec.c requires buffers to be zero padded.
     // If not zero padded, it can get stuck in an infinite loop.
     // It's likely there are other decoders that expect the same.
-    if (in->data != NULL)
+    // Wrapped packets (alloc 0) come with zeroed padding already.
+    if (in->data != NULL && in->alloc > in->size)
     {
         memset(in->data + in->size, 0, in->alloc - in->size);
     }
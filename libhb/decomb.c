@@ -57,14 +57,11 @@ which will feed EEDI2 interpolations to yadif.
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
 #include "handbrake/eedi2.h"
-#include "handbrake/taskset.h"
+#include "handbrake/threadpool.h"
 #include "handbrake/decomb.h"
 
 #define PARITY_DEFAULT   -1
 
-#define MIN3(a,b,c) MIN(MIN(a,b),c)
-#define MAX3(a,b,c) MAX(MAX(a,b),c)
-
 // Some names to correspond to the pv->eedi_half array's contents
 #define SRCPF 0
 #define MSKPF 1
@@ -86,22 +83,16 @@ struct yadif_arguments_s {
 
 typedef struct yadif_arguments_s yadif_arguments_t;
 
-typedef struct eedi2_thread_arg_s {
-    hb_filter_private_t *pv;
-    int plane;
-} eedi2_thread_arg_t;
-
-typedef struct yadif_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
+typedef struct yadif_segment_s {
     int segment_start[3];
     int segment_height[3];
-} yadif_thread_arg_t;
+} yadif_segment_t;
 
 struct hb_filter_private_s
 {
     // Decomb parameters
     int              mode;
+    int              depth;     // Bits per sample, > 8 for 16 bit samples
 
     /* Make buffers to store a comb masks. */
     hb_buffer_t    * mask;
@@ -144,10 +135,14 @@ struct hb_filter_private_s
     int                 cpu_count;
     int                 segment_height[3];
 
-    taskset_t           yadif_taskset;     // Threads for Yadif - one per CPU
-    yadif_arguments_t * yadif_arguments;   // Arguments to thread for work
+    yadif_segment_t   * yadif_segments;    // Yadif rows - one band per CPU
+    yadif_arguments_t   yadif_arguments;   // Arguments for the frame's work
 
-    taskset_t           eedi2_taskset;     // Threads for eedi2 - one per plane
+    DecombFunctions     functions;
+
+    EEDI2Functions      eedi2_functions;
+    int                 eedi2_bands;       // EEDI2 rows - one band per CPU
+    int                 eedi2_step;        // EEDI2 step being run
 
     hb_buffer_list_t    out_list;
 
@@ -187,43 +182,12 @@ hb_filter_object_t hb_filter_decomb =
     .work              = hb_decomb_work,
     .close             = hb_decomb_close,
     .settings_template = decomb_template,
+    .high_depth        = 1,
 };
 
-// Borrowed from libav
-#define times4(x) x, x, x, x
-#define times1024(x) times4(times4(times4(times4(times4(x)))))
-
-static const uint8_t hb_crop_table[256 + 2 * 1024] = {
-times1024(0x00),
-0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,0x0B,0x0C,0x0D,0x0E,0x0F,
-0x10,0x11,0x12,0x13,0x14,0x15,0x16,0x17,0x18,0x19,0x1A,0x1B,0x1C,0x1D,0x1E,0x1F,
-0x20,0x21,0x22,0x23,0x24,0x25,0x26,0x27,0x28,0x29,0x2A,0x2B,0x2C,0x2D,0x2E,0x2F,
-0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37,0x38,0x39,0x3A,0x3B,0x3C,0x3D,0x3E,0x3F,
-0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x4B,0x4C,0x4D,0x4E,0x4F,
-0x50,0x51,0x52,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x5B,0x5C,0x5D,0x5E,0x5F,
-0x60,0x61,0x62,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x6B,0x6C,0x6D,0x6E,0x6F,
-0x70,0x71,0x72,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x7B,0x7C,0x7D,0x7E,0x7F,
-0x80,0x81,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8A,0x8B,0x8C,0x8D,0x8E,0x8F,
-0x90,0x91,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0x9B,0x9C,0x9D,0x9E,0x9F,
-0xA0,0xA1,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xAB,0xAC,0xAD,0xAE,0xAF,
-0xB0,0xB1,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xBB,0xBC,0xBD,0xBE,0xBF,
-0xC0,0xC1,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xCB,0xCC,0xCD,0xCE,0xCF,
-0xD0,0xD1,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xDB,0xDC,0xDD,0xDE,0xDF,
-0xE0,0xE1,0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xEB,0xEC,0xED,0xEE,0xEF,
-0xF0,0xF1,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA,0xFB,0xFC,0xFD,0xFE,0xFF,
-times1024(0xFF)
-};
-
-static inline int cubic_interpolate_pixel( int y0, int y1, int y2, int y3 )
-{
-    /* From http://www.neuron2.net/library/cubicinterp.html */
-    int result = ( y0 * -3 ) + ( y1 * 23 ) + ( y2 * 23 ) + ( y3 * -3 );
-    result = hb_crop_table[(result / 40) + 1024];
-
-    return result;
-}
-
 static void cubic_interpolate_line(
+        const DecombFunctions *functions,
+        int depth,
         uint8_t *dst,
         uint8_t *cur,
         int width,
@@ -231,57 +195,57 @@ static void cubic_interpolate_line(
         int stride,
         int y)
 {
-    int w = width;
-    int x;
-
-    for( x = 0; x < w; x++)
-    {
-        int a, b, c, d;
-        a = b = c = d = 0;
+    const uint8_t *a, *b, *c, *d;
 
-        if( y >= 3 )
-        {
-            /* Normal top*/
-            a = cur[-3*stride];
-            b = cur[-stride];
-        }
-        else if( y == 2 || y == 1 )
-        {
-            /* There's only one sample above this pixel, use it twice. */
-            a = cur[-stride];
-            b = cur[-stride];
-        }
-        else if( y == 0 )
-        {
-            /* No samples above, triple up on the one below. */
-            a = cur[+stride];
-            b = cur[+stride];
-        }
+    a = b = c = d = NULL;
 
-        if( y <= ( height - 4 ) )
-        {
-            /* Normal bottom*/
-            c = cur[+stride];
-            d = cur[3*stride];
-        }
-        else if( y == ( height - 3 ) || y == ( height - 2 ) )
-        {
-            /* There's only one sample below, use it twice. */
-            c = cur[+stride];
-            d = cur[+stride];
-        }
-        else if( y == height - 1)
-        {
-            /* No samples below, triple up on the one above. */
-            c = cur[-stride];
-            d = cur[-stride];
-        }
+    if( y >= 3 )
+    {
+        /* Normal top*/
+        a = cur - 3*stride;
+        b = cur - stride;
+    }
+    else if( y == 2 || y == 1 )
+    {
+        /* There's only one sample above this pixel, use it twice. */
+        a = cur - stride;
+        b = cur - stride;
+    }
+    else if( y == 0 )
+    {
+        /* No samples above, triple up on the one below. */
+        a = cur + stride;
+        b = cur + stride;
+    }
 
-        dst[0] = cubic_interpolate_pixel( a, b, c, d );
+    if( y <= ( height - 4 ) )
+    {
+        /* Normal bottom*/
+        c = cur + stride;
+        d = cur + 3*stride;
+    }
+    else if( y == ( height - 3 ) || y == ( height - 2 ) )
+    {
+        /* There's only one sample below, use it twice. */
+        c = cur + stride;
+        d = cur + stride;
+    }
+    else if( y == height - 1)
+    {
+        /* No samples below, triple up on the one above. */
+        c = cur - stride;
+        d = cur - stride;
+    }
 
-        dst++;
-        cur++;
+    if (depth > 8)
+    {
+        decomb_cubic_interpolate_line_16((uint16_t*)dst, (const uint16_t*)a,
+                                         (const uint16_t*)b, (const uint16_t*)c,
+                                         (const uint16_t*)d, width,
+                                         (1 << depth) - 1);
+        return;
     }
+    functions->cubic_interpolate_line(dst, a, b, c, d, width);
 }
 
 static void store_ref(hb_filter_private_t * pv, hb_buffer_t * b)
@@ -291,23 +255,9 @@ static void store_ref(hb_filter_private_t * pv, hb_buffer_t * b)
     pv->ref[2] = b;
 }
 
-static inline int blend_filter_pixel(filter_param_t *filter, int up2, int up1, int current, int down1, int down2)
-{
-    /* Low-pass 5-tap filter */
-    int result = 0;
-
-    result += up2 * filter->tap[0];
-    result += up1 * filter->tap[1];
-    result += current * filter->tap[2];
-    result += down1 * filter->tap[3];
-    result += down2 * filter->tap[4];
-    result >>= filter->normalize;
-
-    result = hb_crop_table[result + 1024];
-    return result;
-}
-
-static void blend_filter_line(filter_param_t *filter,
+static void blend_filter_line(const DecombFunctions *functions,
+                               int depth,
+                               filter_param_t *filter,
                                uint8_t *dst,
                                uint8_t *cur,
                                int width,
@@ -315,8 +265,6 @@ static void blend_filter_line(filter_param_t *filter,
                                int stride,
                                int y)
 {
-    int w = width;
-    int x;
     int up1, up2, down1, down2;
 
     if (y > 1 && y < (height - 2))
@@ -360,19 +308,58 @@ static void blend_filter_line(filter_param_t *filter,
         return;
     }
 
-    for( x = 0; x < w; x++)
+    const uint8_t *rows[5] = { cur + up2, cur + up1, cur,
+                               cur + down1, cur + down2 };
+    if (depth > 8)
     {
-        /* Low-pass 5-tap filter */
-        dst[0] = blend_filter_pixel(filter, cur[up2], cur[up1], cur[0],
-                                    cur[down1], cur[down2] );
-        dst++;
-        cur++;
+        const uint16_t *rows16[5];
+        int ii;
+
+        for (ii = 0; ii < 5; ii++)
+        {
+            rows16[ii] = (const uint16_t*)rows[ii];
+        }
+        decomb_blend_filter_line_16((uint16_t*)dst, rows16, filter->tap,
+                                    filter->normalize, width,
+                                    (1 << depth) - 1);
+        return;
     }
+    functions->blend_filter_line(dst, rows, filter->tap, filter->normalize,
+                                 width);
 }
 
-// This function calls all the eedi2 filters in sequence for a given plane.
-// It outputs the final interpolated image to pv->eedi_full[DST2PF].
-static void eedi2_interpolate_plane( hb_filter_private_t * pv, int plane )
+// The eedi2 filters are run in steps.  Each step splits every plane into
+// row bands, a step reads only what the previous steps wrote, so the bands
+// of a step run concurrently.
+enum
+{
+    EEDI2_STEP_EDGE_MASK,
+    EEDI2_STEP_ERODE,
+    EEDI2_STEP_DILATE,
+    EEDI2_STEP_ERODE2,
+    EEDI2_STEP_REMOVE_GAPS,
+    EEDI2_STEP_DIRECTIONS,
+    EEDI2_STEP_FILTER_DIR_MAP,
+    EEDI2_STEP_EXPAND_DIR_MAP,
+    EEDI2_STEP_FILTER_MAP,
+    EEDI2_STEP_MARK_DIRECTIONS_2X,
+    EEDI2_STEP_FILTER_DIR_MAP_2X,
+    EEDI2_STEP_EXPAND_DIR_MAP_2X,
+    EEDI2_STEP_FILL_GAPS_2X,
+    EEDI2_STEP_FILL_GAPS_2X2,
+    EEDI2_STEP_INTERPOLATE,
+    EEDI2_STEP_PP_FILTER_DIR_MAP_2X,
+    EEDI2_STEP_PP_EXPAND_DIR_MAP_2X,
+    EEDI2_STEP_PP_POST_PROCESS,
+    EEDI2_STEP_PP_CORNERS,
+    EEDI2_STEPS
+};
+
+// Runs one eedi2 step on a row band of a plane, half_y0 .. half_y1 of the
+// half-height field, y0 .. y1 of the full-height frame.
+// The steps output the final interpolated image to pv->eedi_full[DST2PF].
+static void eedi2_interpolate_band( hb_filter_private_t * pv, int step, int plane,
+                                    int half_y0, int half_y1, int y0, int y1 )
 {
     /* We need all these pointers. No, seriously.
        I swear. It's not a joke. They're used.
@@ -391,113 +378,155 @@ static void eedi2_interpolate_plane( hb_filter_private_t * pv, int plane )
     int * cxy = pv->cxy;
     int * tmpc = pv->tmpc;
 
+    const EEDI2Functions * functions = &pv->eedi2_functions;
+
     int pitch = pv->eedi_full[0]->plane[plane].stride;
     int height = pv->eedi_full[0]->plane[plane].height;
     int width = pv->eedi_full[0]->plane[plane].width;
     int half_height = pv->eedi_half[0]->plane[plane].height;
 
-    // edge mask
-    eedi2_build_edge_mask( mskp, pitch, srcp, pitch,
-                     pv->magnitude_threshold, pv->variance_threshold, pv->laplacian_threshold,
-                     half_height, width );
-    eedi2_erode_edge_mask( mskp, pitch, tmpp, pitch, pv->erosion_threshold, half_height, width );
-    eedi2_dilate_edge_mask( tmpp, pitch, mskp, pitch, pv->dilation_threshold, half_height, width );
-    eedi2_erode_edge_mask( mskp, pitch, tmpp, pitch, pv->erosion_threshold, half_height, width );
-    eedi2_remove_small_gaps( tmpp, pitch, mskp, pitch, half_height, width );
-
-    // direction mask
-    eedi2_calc_directions( plane, mskp, pitch, srcp, pitch, tmpp, pitch,
-                     pv->maximum_search_distance, pv->noise_threshold,
-                     half_height, width );
-    eedi2_filter_dir_map( mskp, pitch, tmpp, pitch, dstp, pitch, half_height, width );
-    eedi2_expand_dir_map( mskp, pitch, dstp, pitch, tmpp, pitch, half_height, width );
-    eedi2_filter_map( mskp, pitch, tmpp, pitch, dstp, pitch, half_height, width );
-
-    // upscale 2x vertically
-    eedi2_upscale_by_2( srcp, dst2p, half_height, pitch );
-    eedi2_upscale_by_2( dstp, tmp2p2, half_height, pitch );
-    eedi2_upscale_by_2( mskp, msk2p, half_height, pitch );
-
-    // upscale the direction mask
-    eedi2_mark_directions_2x( msk2p, pitch, tmp2p2, pitch, tmp2p, pitch, pv->tff, height, width );
-    eedi2_filter_dir_map_2x( msk2p, pitch, tmp2p, pitch,  dst2mp, pitch, pv->tff, height, width );
-    eedi2_expand_dir_map_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff, height, width );
-    eedi2_fill_gaps_2x( msk2p, pitch, tmp2p, pitch, dst2mp, pitch, pv->tff, height, width );
-    eedi2_fill_gaps_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff, height, width );
-
-    // interpolate a full-size plane
-    eedi2_interpolate_lattice( plane, tmp2p, pitch, dst2p, pitch, tmp2p2, pitch, pv->tff,
-                         pv->noise_threshold, height, width );
-
-    if( pv->post_processing == 1 || pv->post_processing == 3 )
-    {
-        // make sure the edge directions are consistent
-        eedi2_bit_blit( tmp2p2, pitch, tmp2p, pitch, width, height );
-        eedi2_filter_dir_map_2x( msk2p, pitch, tmp2p, pitch, dst2mp, pitch, pv->tff, height, width );
-        eedi2_expand_dir_map_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff, height, width );
-        eedi2_post_process( tmp2p, pitch, tmp2p2, pitch, dst2p, pitch, pv->tff, height, width );
-    }
-    if( pv->post_processing == 2 || pv->post_processing == 3 )
+    switch( step )
     {
-        // filter junctions and corners
-        eedi2_gaussian_blur1( srcp, pitch, tmpp, pitch, srcp, pitch, half_height, width );
-        eedi2_calc_derivatives( srcp, pitch, half_height, width, cx2, cy2, cxy );
-        eedi2_gaussian_blur_sqrt2( cx2, tmpc, cx2, pitch, half_height, width);
-        eedi2_gaussian_blur_sqrt2( cy2, tmpc, cy2, pitch, half_height, width);
-        eedi2_gaussian_blur_sqrt2( cxy, tmpc, cxy, pitch, half_height, width);
-        eedi2_post_process_corner( cx2, cy2, cxy, pitch, tmp2p2, pitch, dst2p, pitch, height, width, pv->tff );
-    }
-}
+        // edge mask
+        case EEDI2_STEP_EDGE_MASK:
+            functions->build_edge_mask( mskp, pitch, srcp, pitch,
+                             pv->magnitude_threshold, pv->variance_threshold, pv->laplacian_threshold,
+                             half_height, width, half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_ERODE:
+        case EEDI2_STEP_ERODE2:
+            functions->erode_edge_mask( mskp, pitch, tmpp, pitch, pv->erosion_threshold,
+                                        half_height, width, half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_DILATE:
+            functions->dilate_edge_mask( tmpp, pitch, mskp, pitch, pv->dilation_threshold,
+                                         half_height, width, half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_REMOVE_GAPS:
+            eedi2_remove_small_gaps( tmpp, pitch, mskp, pitch, half_height, width,
+                                     half_y0, half_y1 );
+            break;
 
-/*
- *  eedi2 interpolate this plane in a single thread.
- */
-static void eedi2_filter_thread( void *thread_args_v )
-{
-    hb_filter_private_t * pv;
-    int plane;
-    eedi2_thread_arg_t *thread_args = thread_args_v;
+        // direction mask
+        case EEDI2_STEP_DIRECTIONS:
+            functions->calc_directions( plane, mskp, pitch, srcp, pitch, tmpp, pitch,
+                             pv->maximum_search_distance, pv->noise_threshold,
+                             half_height, width, half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_FILTER_DIR_MAP:
+            eedi2_filter_dir_map( mskp, pitch, tmpp, pitch, dstp, pitch, half_height, width,
+                                  half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_EXPAND_DIR_MAP:
+            eedi2_expand_dir_map( mskp, pitch, dstp, pitch, tmpp, pitch, half_height, width,
+                                  half_y0, half_y1 );
+            break;
+        case EEDI2_STEP_FILTER_MAP:
+            eedi2_filter_map( mskp, pitch, tmpp, pitch, dstp, pitch, half_height, width,
+                              half_y0, half_y1 );
+
+            // upscale 2x vertically, the band's rows of dstp are final
+            eedi2_upscale_by_2( srcp + half_y0 * pitch, dst2p + 2 * half_y0 * pitch,
+                                half_y1 - half_y0, pitch );
+            eedi2_upscale_by_2( dstp + half_y0 * pitch, tmp2p2 + 2 * half_y0 * pitch,
+                                half_y1 - half_y0, pitch );
+            eedi2_upscale_by_2( mskp + half_y0 * pitch, msk2p + 2 * half_y0 * pitch,
+                                half_y1 - half_y0, pitch );
+            break;
 
-    pv = thread_args->pv;
-    plane = thread_args->plane;
+        // upscale the direction mask
+        case EEDI2_STEP_MARK_DIRECTIONS_2X:
+            eedi2_mark_directions_2x( msk2p, pitch, tmp2p2, pitch, tmp2p, pitch, pv->tff,
+                                      height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_FILTER_DIR_MAP_2X:
+            eedi2_filter_dir_map_2x( msk2p, pitch, tmp2p, pitch,  dst2mp, pitch, pv->tff,
+                                     height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_EXPAND_DIR_MAP_2X:
+            eedi2_expand_dir_map_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff,
+                                     height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_FILL_GAPS_2X:
+            eedi2_fill_gaps_2x( msk2p, pitch, tmp2p, pitch, dst2mp, pitch, pv->tff,
+                                height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_FILL_GAPS_2X2:
+            eedi2_fill_gaps_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff,
+                                height, width, y0, y1 );
+            break;
 
-    hb_deep_log(3, "eedi2 thread started for plane %d", plane);
+        // interpolate a full-size plane, the last band does the whole plane.
+        // Near the left and right edges the lattice reads past the ends of
+        // its rows, into the rows interpolated before and after it.
+        case EEDI2_STEP_INTERPOLATE:
+            if( y1 == height )
+            {
+                eedi2_interpolate_lattice( plane, tmp2p, pitch, dst2p, pitch, tmp2p2, pitch, pv->tff,
+                                           pv->noise_threshold, height, width );
+                if( pv->post_processing == 1 || pv->post_processing == 3 )
+                {
+                    eedi2_bit_blit( tmp2p2, pitch, tmp2p, pitch, width, height );
+                }
+            }
+            break;
 
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->eedi2_taskset, plane );
+        // make sure the edge directions are consistent
+        case EEDI2_STEP_PP_FILTER_DIR_MAP_2X:
+            eedi2_filter_dir_map_2x( msk2p, pitch, tmp2p, pitch, dst2mp, pitch, pv->tff,
+                                     height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_PP_EXPAND_DIR_MAP_2X:
+            eedi2_expand_dir_map_2x( msk2p, pitch, dst2mp, pitch, tmp2p, pitch, pv->tff,
+                                     height, width, y0, y1 );
+            break;
+        case EEDI2_STEP_PP_POST_PROCESS:
+            eedi2_post_process( tmp2p, pitch, tmp2p2, pitch, dst2p, pitch, pv->tff,
+                                height, width, y0, y1 );
+            break;
 
-        if( taskset_thread_stop( &pv->eedi2_taskset, plane ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
+        // filter junctions and corners, the last band does the whole plane
+        case EEDI2_STEP_PP_CORNERS:
+            if( y1 == height )
+            {
+                eedi2_gaussian_blur1( srcp, pitch, tmpp, pitch, srcp, pitch, half_height, width );
+                eedi2_calc_derivatives( srcp, pitch, half_height, width, cx2, cy2, cxy );
+                eedi2_gaussian_blur_sqrt2( cx2, tmpc, cx2, pitch, half_height, width);
+                eedi2_gaussian_blur_sqrt2( cy2, tmpc, cy2, pitch, half_height, width);
+                eedi2_gaussian_blur_sqrt2( cxy, tmpc, cxy, pitch, half_height, width);
+                eedi2_post_process_corner( cx2, cy2, cxy, pitch, tmp2p2, pitch, dst2p, pitch, height, width, pv->tff );
+            }
             break;
-        }
+    }
+}
 
-        /*
-         * Process plane
-         */
-        eedi2_interpolate_plane( pv, plane );
+/*
+ *  eedi2 interpolate one row band of one plane in a slice of the thread pool.
+ */
+static void eedi2_filter_band( void * opaque, int index )
+{
+    hb_filter_private_t * pv = opaque;
+    const int bands = pv->eedi2_bands;
+    const int plane = index / bands;
+    const int band  = index % bands;
 
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->eedi2_taskset, plane );
-    }
+    int height      = pv->eedi_full[0]->plane[plane].height;
+    int half_height = pv->eedi_half[0]->plane[plane].height;
+    int half_y0     = half_height * band / bands;
+    int half_y1     = half_height * ( band + 1 ) / bands;
 
-    taskset_thread_complete( &pv->eedi2_taskset, plane );
+    // The last band takes the odd full-height row, if any
+    eedi2_interpolate_band( pv, pv->eedi2_step, plane, half_y0, half_y1,
+                            2 * half_y0, band == bands - 1 ? height : 2 * half_y1 );
 }
 
 // Sets up the input field planes for EEDI2 in pv->eedi_half[SRCPF]
-// and then runs eedi2_filter_thread for each plane.
+// and then runs each step of eedi2_interpolate_band for each band of
+// each plane.
 static void eedi2_planer( hb_filter_private_t * pv )
 {
     /* Copy the first field from the source to a half-height frame. */
-    int pp;
+    int pp, step;
     for( pp = 0;  pp < 3; pp++ )
     {
         int pitch = pv->ref[1]->plane[pp].stride;
@@ -510,46 +539,27 @@ static void eedi2_planer( hb_filter_private_t * pv )
     }
 
     /*
-     * Now that all data is ready for our threads, fire them off
-     * and wait for their completion.
+     * Now that all data is ready, run the steps one after the other,
+     * the bands of a step in parallel.
      */
-    taskset_cycle( &pv->eedi2_taskset );
+    for( step = 0; step < EEDI2_STEPS; step++ )
+    {
+        if( step >= EEDI2_STEP_PP_FILTER_DIR_MAP_2X &&
+            step <= EEDI2_STEP_PP_POST_PROCESS &&
+            pv->post_processing != 1 && pv->post_processing != 3 )
+        {
+            continue;
+        }
+        if( step == EEDI2_STEP_PP_CORNERS &&
+            pv->post_processing != 2 && pv->post_processing != 3 )
+        {
+            continue;
+        }
+        pv->eedi2_step = step;
+        hb_parallel_for( 3 * pv->eedi2_bands, eedi2_filter_band, pv );
+    }
 }
 
-/* EDDI: Edge Directed Deinterlacing Interpolation
-   Checks 4 different slopes to see if there is more similarity along a diagonal
-   than there was vertically. If a diagonal is more similar, then it indicates
-   an edge, so interpolate along that instead of a vertical line, using either
-   linear or cubic interpolation depending on mode. */
-#define YADIF_CHECK(j) {\
-        int score = ABS(cur[-stride-1+j] - cur[+stride-1-j])\
-                      + ABS(cur[-stride  +j] - cur[+stride  -j])\
-                      + ABS(cur[-stride+1+j] - cur[+stride+1-j]);\
-        if( score < spatial_score ){\
-            spatial_score = score;\
-            if( ( pv->mode & MODE_DECOMB_CUBIC ) && !vertical_edge )\
-            {\
-                switch(j)\
-                {\
-                    case -1:\
-                        spatial_pred = cubic_interpolate_pixel(cur[-3 * stride - 3], cur[-stride -1], cur[+stride + 1], cur[3* stride + 3] );\
-                    break;\
-                    case -2:\
-                        spatial_pred = cubic_interpolate_pixel( ( ( cur[-3*stride - 4] + cur[-stride - 4] ) / 2 ) , cur[-stride -2], cur[+stride + 2], ( ( cur[3*stride + 4] + cur[stride + 4] ) / 2 ) );\
-                    break;\
-                    case 1:\
-                        spatial_pred = cubic_interpolate_pixel(cur[-3 * stride +3], cur[-stride +1], cur[+stride - 1], cur[3* stride -3] );\
-                    break;\
-                    case 2:\
-                        spatial_pred = cubic_interpolate_pixel(( ( cur[-3*stride + 4] + cur[-stride + 4] ) / 2 ), cur[-stride +2], cur[+stride - 2], ( ( cur[3*stride - 4] + cur[stride - 4] ) / 2 ) );\
-                    break;\
-                }\
-            }\
-            else\
-            {\
-                spatial_pred = ( cur[-stride +j] + cur[+stride -j] ) >>1;\
-            }\
-
 static void yadif_filter_line(
        hb_filter_private_t * pv,
        uint8_t             * dst,
@@ -563,132 +573,63 @@ static void yadif_filter_line(
        int                   parity,
        int                   y)
 {
-    /* While prev and next point to the previous and next frames,
-       prev2 and next2 will shift depending on the parity, usually 1.
-       They are the previous and next fields, the fields temporally adjacent
-       to the other field in the current frame--the one not being filtered.  */
-    uint8_t *prev2 = parity ? prev : cur ;
-    uint8_t *next2 = parity ? cur  : next;
-
-    int x;
-    int eedi2_mode = ( pv->mode & MODE_DECOMB_EEDI2 );
-
-    /* We can replace spatial_pred with this interpolation*/
-    uint8_t * eedi2_guess = NULL;
-    if (eedi2_mode)
-    {
-        eedi2_guess = &pv->eedi_full[DST2PF]->plane[plane].data[y*stride];
-    }
+    const DecombFunctions * functions = &pv->functions;
+    int cubic = pv->mode & MODE_DECOMB_CUBIC;
+    int vertical_edge = 0;
 
     /* Decomb's cubic interpolation can only function when there are
        three samples above and below, so regress to yadif's traditional
        two-tap interpolation when filtering at the top and bottom edges. */
-    int vertical_edge = 0;
     if( ( y < 3 ) || ( y > ( height - 4 ) )  )
         vertical_edge = 1;
 
-    for( x = 0; x < width; x++)
+    if (pv->depth > 8)
     {
-        /* Pixel above*/
-        int c              = cur[-stride];
-        /* Temporal average: the current location in the adjacent fields */
-        int d              = (prev2[0] + next2[0])>>1;
-        /* Pixel below */
-        int e              = cur[+stride];
-
-        /* How the current pixel changes between the adjacent fields */
-        int temporal_diff0 = ABS(prev2[0] - next2[0]);
-        /* The average of how much the pixels above and below change from the frame before to now. */
-        int temporal_diff1 = ( ABS(prev[-stride] - cur[-stride]) + ABS(prev[+stride] - cur[+stride]) ) >> 1;
-        /* The average of how much the pixels above and below change from now to the next frame. */
-        int temporal_diff2 = ( ABS(next[-stride] - cur[-stride]) + ABS(next[+stride] - cur[+stride]) ) >> 1;
-        /* For the actual difference, use the largest of the previous average diffs. */
-        int diff           = MAX3(temporal_diff0>>1, temporal_diff1, temporal_diff2);
-
-        int spatial_pred;
-
-        if( eedi2_mode )
-        {
-            /* Who needs yadif's spatial predictions when we can have EEDI2's? */
-            spatial_pred = eedi2_guess[0];
-            eedi2_guess++;
-        }
-        else // Yadif spatial interpolation
-        {
-            /* SAD of how the pixel-1, the pixel, and the pixel+1 change from the line above to below. */
-            int spatial_score  = ABS(cur[-stride-1] - cur[+stride-1]) + ABS(cur[-stride]-cur[+stride]) +
-                                         ABS(cur[-stride+1] - cur[+stride+1]) - 1;
-
-            /* Spatial pred is either a bilinear or cubic vertical interpolation. */
-            if( ( pv->mode & MODE_DECOMB_CUBIC ) && !vertical_edge)
-            {
-                spatial_pred = cubic_interpolate_pixel( cur[-3*stride], cur[-stride], cur[+stride], cur[3*stride] );
-            }
-            else
-            {
-                spatial_pred = (c+e)>>1;
-            }
-
-            // YADIF_CHECK requires a margin to avoid invalid memory access.
-            // In MODE_DECOMB_CUBIC, margin needed is 2 + ABS(param).
-            // Else, the margin needed is 1 + ABS(param).
-            int margin = 2;
-            if (pv->mode & MODE_DECOMB_CUBIC)
-                margin = 3;
-
-            if (x >= margin && x <= width - (margin + 1))
-            {
-                YADIF_CHECK(-1)
-                if (x >= margin + 1 && x <= width - (margin + 2))
-                    YADIF_CHECK(-2) }} }}
-            }
-            if (x >= margin && x <= width - (margin + 1))
-            {
-                YADIF_CHECK(1)
-                if (x >= margin + 1 && x <= width - (margin + 2))
-                    YADIF_CHECK(2) }} }}
-            }
-        }
-
-        /* Temporally adjust the spatial prediction by
-           comparing against lines in the adjacent fields. */
-        int b = (prev2[-2*stride] + next2[-2*stride])>>1;
-        int f = (prev2[+2*stride] + next2[+2*stride])>>1;
-
-        /* Find the median value */
-        int max = MAX3(d-e, d-c, MIN(b-c, f-e));
-        int min = MIN3(d-e, d-c, MAX(b-c, f-e));
-        diff = MAX3( diff, min, -max );
+        // No EEDI2 at high bit depth
+        decomb_yadif_filter_line_16((uint16_t*)dst, (const uint16_t*)prev,
+                                    (const uint16_t*)cur, (const uint16_t*)next,
+                                    cubic, vertical_edge, width, stride / 2,
+                                    parity, (1 << pv->depth) - 1);
+        return;
+    }
 
-        if( spatial_pred > d + diff )
-        {
-            spatial_pred = d + diff;
-        }
-        else if( spatial_pred < d - diff )
-        {
-            spatial_pred = d - diff;
-        }
+    /* We can replace spatial_pred with this interpolation*/
+    uint8_t * eedi2_guess = NULL;
+    if (pv->mode & MODE_DECOMB_EEDI2)
+    {
+        eedi2_guess = &pv->eedi_full[DST2PF]->plane[plane].data[y*stride];
+    }
 
-        dst[0] = spatial_pred;
+    /* Pixels closer to the sides than the widest YADIF_CHECK skip some
+       checks, they are left to the C code. */
+    int start = cubic ? 4 : 3;
+    int stop  = width - start;
 
-        dst++;
-        cur++;
-        prev++;
-        next++;
-        prev2++;
-        next2++;
+    if (functions->yadif_filter_line == decomb_yadif_filter_line_c ||
+        stop - start < 16)
+    {
+        start = stop = 0;
     }
+    decomb_yadif_filter_line_c(dst, prev, cur, next, eedi2_guess, cubic,
+                               vertical_edge, width, stride, parity, 0, start);
+    functions->yadif_filter_line(dst, prev, cur, next, eedi2_guess, cubic,
+                                 vertical_edge, width, stride, parity,
+                                 start, stop);
+    decomb_yadif_filter_line_c(dst, prev, cur, next, eedi2_guess, cubic,
+                               vertical_edge, width, stride, parity,
+                               stop, width);
 }
 
 /*
- * deinterlace this segment of all three planes in a single thread.
+ * deinterlace this segment of all three planes in a single slice
+ * of the thread pool.
  */
-static void yadif_decomb_filter_thread( void *thread_args_v )
+static void yadif_decomb_filter_segment( void * opaque, int segment )
 {
-    yadif_arguments_t *yadif_work = NULL;
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    yadif_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = opaque;
+    yadif_arguments_t *yadif_work = &pv->yadif_arguments;
+    yadif_segment_t *yadif_segment = &pv->yadif_segments[segment];
+    int segment_start, segment_stop;
     filter_param_t filter;
 
     filter.tap[0] = -1;
@@ -698,137 +639,111 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
     filter.tap[4] = -1;
     filter.normalize = 3;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    hb_buffer_t *dst;
+    int parity, tff, mode;
 
-    hb_deep_log(3, "yadif thread started for segment %d", segment);
+    mode = yadif_work->mode;
+    dst = yadif_work->dst;
+    tff = yadif_work->tff;
+    parity = yadif_work->parity;
 
-    while (1)
+    int pp;
+    for (pp = 0; pp < 3; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
-
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        yadif_work = &pv->yadif_arguments[segment];
+        int yy;
+        int width = dst->plane[pp].width;
+        int stride = dst->plane[pp].stride;
+        int height = dst->plane[pp].height_stride;
+        int penultimate = height - 2;
+        int row_size = pv->depth > 8 ? width * 2 : width;
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_buffer_t *dst;
-        int parity, tff, mode;
+        segment_start = yadif_segment->segment_start[pp];
+        segment_stop = segment_start + yadif_segment->segment_height[pp];
 
-        mode = pv->yadif_arguments[segment].mode;
-        dst = yadif_work->dst;
-        tff = yadif_work->tff;
-        parity = yadif_work->parity;
+        // Filter parity lines
+        int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        uint8_t *dst2 = &dst->plane[pp].data[start * stride];
+        uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
+        uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
 
-        int pp;
-        for (pp = 0; pp < 3; pp++)
+        if (mode == MODE_DECOMB_BLEND)
         {
-            int yy;
-            int width = dst->plane[pp].width;
-            int stride = dst->plane[pp].stride;
-            int height = dst->plane[pp].height_stride;
-            int penultimate = height - 2;
-
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            // Filter parity lines
-            int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            uint8_t *dst2 = &dst->plane[pp].data[start * stride];
-            uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
-            uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
-
-            if (mode == MODE_DECOMB_BLEND)
+            /* These will be useful if we ever do temporal blending. */
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                /* These will be useful if we ever do temporal blending. */
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* This line gets blend filtered, not yadif filtered. */
-                    blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* This line gets blend filtered, not yadif filtered. */
+                blend_filter_line(&pv->functions, pv->depth, &filter, dst2, cur,
+                                  width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (mode == MODE_DECOMB_CUBIC)
+        }
+        else if (mode == MODE_DECOMB_CUBIC)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* Just apply vertical cubic interpolation */
-                    cubic_interpolate_line(dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* Just apply vertical cubic interpolation */
+                cubic_interpolate_line(&pv->functions, pv->depth, dst2, cur,
+                                       width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (mode & MODE_DECOMB_YADIF)
+        }
+        else if (mode & MODE_DECOMB_YADIF)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
+                if( yy > 1 && yy < penultimate )
                 {
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        // This isn't the top or bottom,
-                        // proceed as normal to yadif
-                        yadif_filter_line(pv, dst2, prev, cur, next, pp,
-                                          width, height, stride,
-                                          parity ^ tff, yy);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        int yp = (yy ^ parity) * stride;
-                        memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
-                    }
-                    dst2 += stride * 2;
-                    prev += stride * 2;
-                    cur += stride * 2;
-                    next += stride * 2;
+                    // This isn't the top or bottom,
+                    // proceed as normal to yadif
+                    yadif_filter_line(pv, dst2, prev, cur, next, pp,
+                                      width, height, stride,
+                                      parity ^ tff, yy);
                 }
-            }
-            else
-            {
-                // No combing, copy frame
-                for( yy = start; yy < segment_stop; yy += 2 )
+                else
                 {
-                    memcpy(dst2, cur, width);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    int yp = (yy ^ parity) * stride;
+                    memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], row_size);
                 }
+                dst2 += stride * 2;
+                prev += stride * 2;
+                cur += stride * 2;
+                next += stride * 2;
             }
-
-            // Copy unfiltered lines
-            start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            dst2 = &dst->plane[pp].data[start * stride];
-            prev = &pv->ref[0]->plane[pp].data[start * stride];
-            cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            next = &pv->ref[2]->plane[pp].data[start * stride];
+        }
+        else
+        {
+            // No combing, copy frame
             for( yy = start; yy < segment_stop; yy += 2 )
             {
-                memcpy(dst2, cur, width);
+                memcpy(dst2, cur, row_size);
                 dst2 += stride * 2;
                 cur += stride * 2;
             }
         }
-        taskset_thread_complete( &pv->yadif_taskset, segment );
-    }
 
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->yadif_taskset, segment );
+        // Copy unfiltered lines
+        start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        dst2 = &dst->plane[pp].data[start * stride];
+        prev = &pv->ref[0]->plane[pp].data[start * stride];
+        cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        next = &pv->ref[2]->plane[pp].data[start * stride];
+        for( yy = start; yy < segment_stop; yy += 2 )
+        {
+            memcpy(dst2, cur, row_size);
+            dst2 += stride * 2;
+            cur += stride * 2;
+        }
+    }
 }
 
 static void yadif_filter( hb_filter_private_t * pv,
@@ -902,23 +817,18 @@ static void yadif_filter( hb_filter_private_t * pv,
         }
         else
         {
-            int segment;
-
-            for( segment = 0; segment < pv->cpu_count; segment++ )
-            {
-                /*
-                 * Setup the work for this plane.
-                 */
-                pv->yadif_arguments[segment].parity = parity;
-                pv->yadif_arguments[segment].tff = tff;
-                pv->yadif_arguments[segment].dst = dst;
-                pv->yadif_arguments[segment].mode = mode;
-            }
+            /*
+             * Setup the work for this frame.
+             */
+            pv->yadif_arguments.parity = parity;
+            pv->yadif_arguments.tff = tff;
+            pv->yadif_arguments.dst = dst;
+            pv->yadif_arguments.mode = mode;
 
             /*
-             * Allow the taskset threads to make one pass over the data.
+             * Let the thread pool make one pass over the data.
              */
-            taskset_cycle( &pv->yadif_taskset );
+            hb_parallel_for( pv->cpu_count, yadif_decomb_filter_segment, pv );
 
             /*
              * Entire frame is now deinterlaced.
@@ -928,7 +838,7 @@ static void yadif_filter( hb_filter_private_t * pv,
     else
     {
         /*  Just passing through... */
-        pv->yadif_arguments[0].mode = mode; // 0
+        pv->yadif_arguments.mode = mode; // 0
         hb_buffer_copy(dst, pv->ref[1]);
     }
 }
@@ -989,6 +899,22 @@ static int hb_decomb_init( hb_filter_object_t * filter,
         }
     }
 
+    // EEDI2 is 8 bit only, sanitize_pix_fmt() in work.c keeps the chain
+    // at 8 bit when it is enabled
+    pv->depth = hb_get_bit_depth(init->pix_fmt);
+    if (pv->depth > 8 && (pv->mode & MODE_DECOMB_EEDI2))
+    {
+        hb_error("decomb: EEDI2 does not support %d bit samples", pv->depth);
+        return -1;
+    }
+
+    pv->functions.yadif_filter_line      = decomb_yadif_filter_line_c;
+    pv->functions.cubic_interpolate_line = decomb_cubic_interpolate_line_c;
+    pv->functions.blend_filter_line      = decomb_blend_filter_line_c;
+#if defined(ARCH_X86)
+    decomb_init_x86(&pv->functions);
+#endif
+
     pv->cpu_count = hb_get_cpu_count();
 
     // Make segment sizes an even number of lines
@@ -1002,6 +928,15 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     int ii;
     if( pv->mode & MODE_DECOMB_EEDI2 )
     {
+        pv->eedi2_functions.build_edge_mask  = eedi2_build_edge_mask;
+        pv->eedi2_functions.erode_edge_mask  = eedi2_erode_edge_mask;
+        pv->eedi2_functions.dilate_edge_mask = eedi2_dilate_edge_mask;
+        pv->eedi2_functions.calc_directions  = eedi2_calc_directions;
+#if defined(ARCH_X86)
+        eedi2_init_x86(&pv->eedi2_functions);
+#endif
+        pv->eedi2_bands = pv->cpu_count;
+
         /* Allocate half-height eedi2 buffers */
         for( ii = 0; ii < 4; ii++ )
         {
@@ -1018,68 +953,46 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     }
 
     /*
-     * Setup yadif taskset.
+     * Setup yadif segments.
      */
-    pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->cpu_count );
-    if( pv->yadif_arguments == NULL ||
-        taskset_init( &pv->yadif_taskset, pv->cpu_count,
-                      sizeof( yadif_thread_arg_t ) ) == 0 )
+    pv->yadif_segments = calloc( pv->cpu_count, sizeof( yadif_segment_t ) );
+    if( pv->yadif_segments == NULL )
     {
-        hb_error( "yadif could not initialize taskset" );
+        hb_error( "yadif could not allocate segments" );
+        return -1;
     }
 
-    yadif_thread_arg_t *yadif_prev_thread_args = NULL;
+    yadif_segment_t *yadif_prev_segment = NULL;
     for( ii = 0; ii < pv->cpu_count; ii++ )
     {
-        yadif_thread_arg_t *thread_args;
-
-        thread_args = taskset_thread_args( &pv->yadif_taskset, ii );
-        thread_args->pv = pv;
-        thread_args->segment = ii;
+        yadif_segment_t *yadif_segment = &pv->yadif_segments[ii];
 
         int pp;
         for (pp = 0; pp < 3; pp++)
         {
-            if (yadif_prev_thread_args != NULL)
+            if (yadif_prev_segment != NULL)
             {
-                thread_args->segment_start[pp] =
-                    yadif_prev_thread_args->segment_start[pp] +
-                    yadif_prev_thread_args->segment_height[pp];
+                yadif_segment->segment_start[pp] =
+                    yadif_prev_segment->segment_start[pp] +
+                    yadif_prev_segment->segment_height[pp];
             }
             if( ii == pv->cpu_count - 1 )
             {
                 /*
                  * Final segment
                  */
-                thread_args->segment_height[pp] =
+                yadif_segment->segment_height[pp] =
                     ((hb_image_height(init->pix_fmt, init->geometry.height, pp)
-                     + 3) & ~3) - thread_args->segment_start[pp];
+                     + 3) & ~3) - yadif_segment->segment_start[pp];
             } else {
-                thread_args->segment_height[pp] = pv->segment_height[pp];
+                yadif_segment->segment_height[pp] = pv->segment_height[pp];
             }
         }
-        pv->yadif_arguments[ii].dst = NULL;
-        if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                 "yadif_filter_segment",
-                                 yadif_decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "yadif could not spawn thread" );
-        }
-        yadif_prev_thread_args = thread_args;
+        yadif_prev_segment = yadif_segment;
     }
 
     if( pv->mode & MODE_DECOMB_EEDI2 )
     {
-        /*
-         * Create eedi2 taskset.
-         */
-        if( taskset_init( &pv->eedi2_taskset, /*thread_count*/3,
-                          sizeof( eedi2_thread_arg_t ) ) == 0 )
-        {
-            hb_error( "eedi2 could not initialize taskset" );
-        }
-
         if( pv->post_processing > 1 )
         {
             int stride;
@@ -1102,24 +1015,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             else
                 hb_log("EEDI2: successfully malloced derivative arrays");
         }
-
-        for( ii = 0; ii < 3; ii++ )
-        {
-            eedi2_thread_arg_t *eedi2_thread_args;
-
-            eedi2_thread_args = taskset_thread_args( &pv->eedi2_taskset, ii );
-
-            eedi2_thread_args->pv = pv;
-            eedi2_thread_args->plane = ii;
-
-            if( taskset_thread_spawn( &pv->eedi2_taskset, ii,
-                                      "eedi2_filter_segment",
-                                      eedi2_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "eedi2 could not spawn thread" );
-            }
-        }
     }
 
     pv->output = *init;
@@ -1140,13 +1035,6 @@ static void hb_decomb_close( hb_filter_object_t * filter )
     hb_log("decomb: deinterlaced %i | blended %i | unfiltered %i | total %i",
            pv->deinterlaced, pv->blended, pv->unfiltered, pv->frames);
 
-    taskset_fini( &pv->yadif_taskset );
-
-    if( pv->mode & MODE_DECOMB_EEDI2 )
-    {
-        taskset_fini( &pv->eedi2_taskset );
-    }
-
     /* Cleanup reference buffers. */
     int ii;
     for (ii = 0; ii < 3; ii++)
@@ -1181,41 +1069,19 @@ static void hb_decomb_close( hb_filter_object_t * filter )
     /*
      * free memory for yadif structs
      */
-    free( pv->yadif_arguments );
+    free( pv->yadif_segments );
 
     free( pv );
     filter->private_data = NULL;
 }
 
-// Fill rows above height with copy of last row to prevent color distortion
-// during blending
-static void fill_stride(hb_buffer_t * buf)
-{
-    int pp, ii;
-
-    for (pp = 0; pp < 3; pp++)
-    {
-        uint8_t * src, * dst;
-
-        src = buf->plane[pp].data + (buf->plane[pp].height - 1) *
-              buf->plane[pp].stride;
-        dst = buf->plane[pp].data + buf->plane[pp].height *
-              buf->plane[pp].stride;
-        for (ii = 0; ii < 3; ii++)
-        {
-            memcpy(dst, src, buf->plane[pp].stride);
-            dst += buf->plane[pp].stride;
-        }
-    }
-}
-
 static void process_frame( hb_filter_private_t * pv )
 {
     if ((pv->mode & MODE_DECOMB_SELECTIVE) &&
         pv->ref[1]->s.combed == HB_COMB_NONE)
     {
-        // Input buffer is not combed.  Just make a dup of it.
-        hb_buffer_t * buf = hb_buffer_dup(pv->ref[1]);
+        // Input buffer is not combed.  Just pass along a reference to it.
+        hb_buffer_t * buf = hb_buffer_shared_dup(pv->ref[1]);
         hb_buffer_list_append(&pv->out_list, buf);
         pv->frames++;
         pv->unfiltered++;
@@ -1293,7 +1159,7 @@ static int hb_decomb_work( hb_filter_object_t * filter,
         if (pv->ref[2] != NULL)
         {
             // Duplicate last frame and process refs
-            store_ref(pv, hb_buffer_dup(pv->ref[2]));
+            store_ref(pv, hb_buffer_shared_dup(pv->ref[2]));
             process_frame(pv);
         }
         hb_buffer_list_append(&pv->out_list, in);
@@ -1301,14 +1167,21 @@ static int hb_decomb_work( hb_filter_object_t * filter,
         return HB_FILTER_DONE;
     }
 
-    fill_stride(in);
+    // Fill rows below height with copy of last row to prevent color
+    // distortion during blending.  comb_detect usually did this already.
+    if (hb_frame_buffer_fill_stride(in) < 0)
+    {
+        hb_error("decomb: out of memory");
+        hb_buffer_close(&in);
+        return HB_FILTER_FAILED;
+    }
 
     // yadif requires 3 buffers, prev, cur, and next.  For the first
     // frame, there can be no prev, so we duplicate the first frame.
     if (!pv->yadif_ready)
     {
         // If yadif is not ready, store another ref and return HB_FILTER_DELAY
-        store_ref(pv, hb_buffer_dup(in));
+        store_ref(pv, hb_buffer_shared_dup(in));
         store_ref(pv, in);
         pv->yadif_ready = 1;
         // Wait for next
@@ -1322,10 +1195,14 @@ static int hb_decomb_work( hb_filter_object_t * filter,
     return HB_FILTER_OK;
 }
 
-void hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src)
+int hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src)
 {
     int pp;
     filter_param_t filter;
+    DecombFunctions functions;
+
+    // Only used for previews, the C code is fast enough
+    functions.blend_filter_line = decomb_blend_filter_line_c;
 
     filter.tap[0] = -1;
     filter.tap[1] = 4;
@@ -1334,7 +1211,10 @@ void hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src)
     filter.tap[4] = -1;
     filter.normalize = 3;
 
-    fill_stride(src);
+    if (hb_frame_buffer_fill_stride(src) < 0)
+    {
+        return -1;
+    }
     for (pp = 0; pp < 3; pp++)
     {
         int yy;
@@ -1353,10 +1233,12 @@ void hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src)
             memcpy(pdst, psrc, width);
             pdst += stride;
             psrc += stride;
-            blend_filter_line(&filter, pdst, psrc, width, height, stride, yy + 1);
+            blend_filter_line(&functions, 8, &filter, pdst, psrc,
+                              width, height, stride, yy + 1);
             pdst += stride;
             psrc += stride;
         }
     }
+    return 0;
 }
 
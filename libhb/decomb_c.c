@@ -0,0 +1,416 @@
+/* decomb_c.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+
+   The yadif algorithm was created by Michael Niedermayer.
+*/
+
+/*
+ * Portable line kernels of decomb.  The 8 bit ones are the reference
+ * for the x86 kernels, see test/kernels/decomb_test.c.
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/decomb.h"
+
+#define MIN3(a,b,c) MIN(MIN(a,b),c)
+#define MAX3(a,b,c) MAX(MAX(a,b),c)
+
+// Borrowed from libav
+#define times4(x) x, x, x, x
+#define times1024(x) times4(times4(times4(times4(times4(x)))))
+
+static const uint8_t hb_crop_table[256 + 2 * 1024] = {
+times1024(0x00),
+0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0A,0x0B,0x0C,0x0D,0x0E,0x0F,
+0x10,0x11,0x12,0x13,0x14,0x15,0x16,0x17,0x18,0x19,0x1A,0x1B,0x1C,0x1D,0x1E,0x1F,
+0x20,0x21,0x22,0x23,0x24,0x25,0x26,0x27,0x28,0x29,0x2A,0x2B,0x2C,0x2D,0x2E,0x2F,
+0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37,0x38,0x39,0x3A,0x3B,0x3C,0x3D,0x3E,0x3F,
+0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4A,0x4B,0x4C,0x4D,0x4E,0x4F,
+0x50,0x51,0x52,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5A,0x5B,0x5C,0x5D,0x5E,0x5F,
+0x60,0x61,0x62,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6A,0x6B,0x6C,0x6D,0x6E,0x6F,
+0x70,0x71,0x72,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7A,0x7B,0x7C,0x7D,0x7E,0x7F,
+0x80,0x81,0x82,0x83,0x84,0x85,0x86,0x87,0x88,0x89,0x8A,0x8B,0x8C,0x8D,0x8E,0x8F,
+0x90,0x91,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9A,0x9B,0x9C,0x9D,0x9E,0x9F,
+0xA0,0xA1,0xA2,0xA3,0xA4,0xA5,0xA6,0xA7,0xA8,0xA9,0xAA,0xAB,0xAC,0xAD,0xAE,0xAF,
+0xB0,0xB1,0xB2,0xB3,0xB4,0xB5,0xB6,0xB7,0xB8,0xB9,0xBA,0xBB,0xBC,0xBD,0xBE,0xBF,
+0xC0,0xC1,0xC2,0xC3,0xC4,0xC5,0xC6,0xC7,0xC8,0xC9,0xCA,0xCB,0xCC,0xCD,0xCE,0xCF,
+0xD0,0xD1,0xD2,0xD3,0xD4,0xD5,0xD6,0xD7,0xD8,0xD9,0xDA,0xDB,0xDC,0xDD,0xDE,0xDF,
+0xE0,0xE1,0xE2,0xE3,0xE4,0xE5,0xE6,0xE7,0xE8,0xE9,0xEA,0xEB,0xEC,0xED,0xEE,0xEF,
+0xF0,0xF1,0xF2,0xF3,0xF4,0xF5,0xF6,0xF7,0xF8,0xF9,0xFA,0xFB,0xFC,0xFD,0xFE,0xFF,
+times1024(0xFF)
+};
+
+static inline int cubic_interpolate_pixel( int y0, int y1, int y2, int y3 )
+{
+    /* From http://www.neuron2.net/library/cubicinterp.html */
+    int result = ( y0 * -3 ) + ( y1 * 23 ) + ( y2 * 23 ) + ( y3 * -3 );
+    result = hb_crop_table[(result / 40) + 1024];
+
+    return result;
+}
+
+void decomb_cubic_interpolate_line_c(uint8_t       *dst,
+                                     const uint8_t *a,
+                                     const uint8_t *b,
+                                     const uint8_t *c,
+                                     const uint8_t *d,
+                                     int            width)
+{
+    int x;
+
+    for( x = 0; x < width; x++)
+    {
+        dst[x] = cubic_interpolate_pixel( a[x], b[x], c[x], d[x] );
+    }
+}
+
+/*
+ * 16 bit sample versions of the C kernels for high bit depth frames.
+ * They clamp to max, the largest value at the frame's depth.
+ */
+static inline int cubic_interpolate_pixel_16( int y0, int y1, int y2, int y3,
+                                              int max )
+{
+    int result = ( y0 * -3 ) + ( y1 * 23 ) + ( y2 * 23 ) + ( y3 * -3 );
+    result /= 40;
+
+    return result < 0 ? 0 : result > max ? max : result;
+}
+
+void decomb_cubic_interpolate_line_16(uint16_t       *dst,
+                                      const uint16_t *a,
+                                      const uint16_t *b,
+                                      const uint16_t *c,
+                                      const uint16_t *d,
+                                      int             width,
+                                      int             max)
+{
+    int x;
+
+    for( x = 0; x < width; x++)
+    {
+        dst[x] = cubic_interpolate_pixel_16( a[x], b[x], c[x], d[x], max );
+    }
+}
+
+void decomb_blend_filter_line_c(uint8_t        *dst,
+                                const uint8_t **rows,
+                                const int      *tap,
+                                int             normalize,
+                                int             width)
+{
+    int x;
+
+    for( x = 0; x < width; x++)
+    {
+        /* Low-pass 5-tap filter */
+        int result = rows[0][x] * tap[0] +
+                     rows[1][x] * tap[1] +
+                     rows[2][x] * tap[2] +
+                     rows[3][x] * tap[3] +
+                     rows[4][x] * tap[4];
+
+        dst[x] = hb_crop_table[(result >> normalize) + 1024];
+    }
+}
+
+void decomb_blend_filter_line_16(uint16_t        *dst,
+                                 const uint16_t **rows,
+                                 const int       *tap,
+                                 int              normalize,
+                                 int              width,
+                                 int              max)
+{
+    int x;
+
+    for( x = 0; x < width; x++)
+    {
+        /* Low-pass 5-tap filter */
+        int result = rows[0][x] * tap[0] +
+                     rows[1][x] * tap[1] +
+                     rows[2][x] * tap[2] +
+                     rows[3][x] * tap[3] +
+                     rows[4][x] * tap[4];
+
+        result >>= normalize;
+        dst[x] = result < 0 ? 0 : result > max ? max : result;
+    }
+}
+
+/* EDDI: Edge Directed Deinterlacing Interpolation
+   Checks 4 different slopes to see if there is more similarity along a diagonal
+   than there was vertically. If a diagonal is more similar, then it indicates
+   an edge, so interpolate along that instead of a vertical line, using either
+   linear or cubic interpolation depending on mode. */
+#define YADIF_CHECK(j) {\
+        int score = ABS(cur[-stride-1+j] - cur[+stride-1-j])\
+                      + ABS(cur[-stride  +j] - cur[+stride  -j])\
+                      + ABS(cur[-stride+1+j] - cur[+stride+1-j]);\
+        if( score < spatial_score ){\
+            spatial_score = score;\
+            if( cubic && !vertical_edge )\
+            {\
+                switch(j)\
+                {\
+                    case -1:\
+                        spatial_pred = YADIF_CUBIC(cur[-3 * stride - 3], cur[-stride -1], cur[+stride + 1], cur[3* stride + 3] );\
+                    break;\
+                    case -2:\
+                        spatial_pred = YADIF_CUBIC( ( ( cur[-3*stride - 4] + cur[-stride - 4] ) / 2 ) , cur[-stride -2], cur[+stride + 2], ( ( cur[3*stride + 4] + cur[stride + 4] ) / 2 ) );\
+                    break;\
+                    case 1:\
+                        spatial_pred = YADIF_CUBIC(cur[-3 * stride +3], cur[-stride +1], cur[+stride - 1], cur[3* stride -3] );\
+                    break;\
+                    case 2:\
+                        spatial_pred = YADIF_CUBIC(( ( cur[-3*stride + 4] + cur[-stride + 4] ) / 2 ), cur[-stride +2], cur[+stride - 2], ( ( cur[3*stride - 4] + cur[stride - 4] ) / 2 ) );\
+                    break;\
+                }\
+            }\
+            else\
+            {\
+                spatial_pred = ( cur[-stride +j] + cur[+stride -j] ) >>1;\
+            }\
+
+#define YADIF_CUBIC(y0, y1, y2, y3) cubic_interpolate_pixel(y0, y1, y2, y3)
+
+void decomb_yadif_filter_line_c(uint8_t       *dst,
+                                const uint8_t *prev,
+                                const uint8_t *cur,
+                                const uint8_t *next,
+                                const uint8_t *eedi2_guess,
+                                int            cubic,
+                                int            vertical_edge,
+                                int            width,
+                                int            stride,
+                                int            parity,
+                                int            start,
+                                int            stop)
+{
+    /* While prev and next point to the previous and next frames,
+       prev2 and next2 will shift depending on the parity, usually 1.
+       They are the previous and next fields, the fields temporally adjacent
+       to the other field in the current frame--the one not being filtered.  */
+    const uint8_t *prev2 = parity ? prev : cur ;
+    const uint8_t *next2 = parity ? cur  : next;
+
+    int x;
+
+    dst   += start;
+    prev  += start;
+    cur   += start;
+    next  += start;
+    prev2 += start;
+    next2 += start;
+    if (eedi2_guess != NULL)
+    {
+        eedi2_guess += start;
+    }
+
+    for( x = start; x < stop; x++)
+    {
+        /* Pixel above*/
+        int c              = cur[-stride];
+        /* Temporal average: the current location in the adjacent fields */
+        int d              = (prev2[0] + next2[0])>>1;
+        /* Pixel below */
+        int e              = cur[+stride];
+
+        /* How the current pixel changes between the adjacent fields */
+        int temporal_diff0 = ABS(prev2[0] - next2[0]);
+        /* The average of how much the pixels above and below change from the frame before to now. */
+        int temporal_diff1 = ( ABS(prev[-stride] - cur[-stride]) + ABS(prev[+stride] - cur[+stride]) ) >> 1;
+        /* The average of how much the pixels above and below change from now to the next frame. */
+        int temporal_diff2 = ( ABS(next[-stride] - cur[-stride]) + ABS(next[+stride] - cur[+stride]) ) >> 1;
+        /* For the actual difference, use the largest of the previous average diffs. */
+        int diff           = MAX3(temporal_diff0>>1, temporal_diff1, temporal_diff2);
+
+        int spatial_pred;
+
+        if( eedi2_guess != NULL )
+        {
+            /* Who needs yadif's spatial predictions when we can have EEDI2's? */
+            spatial_pred = eedi2_guess[0];
+            eedi2_guess++;
+        }
+        else // Yadif spatial interpolation
+        {
+            /* SAD of how the pixel-1, the pixel, and the pixel+1 change from the line above to below. */
+            int spatial_score  = ABS(cur[-stride-1] - cur[+stride-1]) + ABS(cur[-stride]-cur[+stride]) +
+                                         ABS(cur[-stride+1] - cur[+stride+1]) - 1;
+
+            /* Spatial pred is either a bilinear or cubic vertical interpolation. */
+            if( cubic && !vertical_edge)
+            {
+                spatial_pred = cubic_interpolate_pixel( cur[-3*stride], cur[-stride], cur[+stride], cur[3*stride] );
+            }
+            else
+            {
+                spatial_pred = (c+e)>>1;
+            }
+
+            // YADIF_CHECK requires a margin to avoid invalid memory access.
+            // In MODE_DECOMB_CUBIC, margin needed is 2 + ABS(param).
+            // Else, the margin needed is 1 + ABS(param).
+            int margin = 2;
+            if (cubic)
+                margin = 3;
+
+            if (x >= margin && x <= width - (margin + 1))
+            {
+                YADIF_CHECK(-1)
+                if (x >= margin + 1 && x <= width - (margin + 2))
+                    YADIF_CHECK(-2) }} }}
+            }
+            if (x >= margin && x <= width - (margin + 1))
+            {
+                YADIF_CHECK(1)
+                if (x >= margin + 1 && x <= width - (margin + 2))
+                    YADIF_CHECK(2) }} }}
+            }
+        }
+
+        /* Temporally adjust the spatial prediction by
+           comparing against lines in the adjacent fields. */
+        int b = (prev2[-2*stride] + next2[-2*stride])>>1;
+        int f = (prev2[+2*stride] + next2[+2*stride])>>1;
+
+        /* Find the median value */
+        int max = MAX3(d-e, d-c, MIN(b-c, f-e));
+        int min = MIN3(d-e, d-c, MAX(b-c, f-e));
+        diff = MAX3( diff, min, -max );
+
+        if( spatial_pred > d + diff )
+        {
+            spatial_pred = d + diff;
+        }
+        else if( spatial_pred < d - diff )
+        {
+            spatial_pred = d - diff;
+        }
+
+        dst[0] = spatial_pred;
+
+        dst++;
+        cur++;
+        prev++;
+        next++;
+        prev2++;
+        next2++;
+    }
+}
+
+#undef YADIF_CUBIC
+#define YADIF_CUBIC(y0, y1, y2, y3) cubic_interpolate_pixel_16(y0, y1, y2, y3, pixel_max)
+
+// decomb_yadif_filter_line_c() for 16 bit samples without EEDI2, for the whole
+// line.  stride is in samples.
+void decomb_yadif_filter_line_16(uint16_t       *dst,
+                                 const uint16_t *prev,
+                                 const uint16_t *cur,
+                                 const uint16_t *next,
+                                 int             cubic,
+                                 int             vertical_edge,
+                                 int             width,
+                                 int             stride,
+                                 int             parity,
+                                 int             pixel_max)
+{
+    /* While prev and next point to the previous and next frames,
+       prev2 and next2 will shift depending on the parity, usually 1.
+       They are the previous and next fields, the fields temporally adjacent
+       to the other field in the current frame--the one not being filtered.  */
+    const uint16_t *prev2 = parity ? prev : cur ;
+    const uint16_t *next2 = parity ? cur  : next;
+
+    int x;
+
+    for( x = 0; x < width; x++)
+    {
+        /* Pixel above*/
+        int c              = cur[-stride];
+        /* Temporal average: the current location in the adjacent fields */
+        int d              = (prev2[0] + next2[0])>>1;
+        /* Pixel below */
+        int e              = cur[+stride];
+
+        /* How the current pixel changes between the adjacent fields */
+        int temporal_diff0 = ABS(prev2[0] - next2[0]);
+        /* The average of how much the pixels above and below change from the frame before to now. */
+        int temporal_diff1 = ( ABS(prev[-stride] - cur[-stride]) + ABS(prev[+stride] - cur[+stride]) ) >> 1;
+        /* The average of how much the pixels above and below change from now to the next frame. */
+        int temporal_diff2 = ( ABS(next[-stride] - cur[-stride]) + ABS(next[+stride] - cur[+stride]) ) >> 1;
+        /* For the actual difference, use the largest of the previous average diffs. */
+        int diff           = MAX3(temporal_diff0>>1, temporal_diff1, temporal_diff2);
+
+        int spatial_pred;
+
+        /* SAD of how the pixel-1, the pixel, and the pixel+1 change from the line above to below. */
+        int spatial_score  = ABS(cur[-stride-1] - cur[+stride-1]) + ABS(cur[-stride]-cur[+stride]) +
+                                     ABS(cur[-stride+1] - cur[+stride+1]) - 1;
+
+        /* Spatial pred is either a bilinear or cubic vertical interpolation. */
+        if( cubic && !vertical_edge)
+        {
+            spatial_pred = cubic_interpolate_pixel_16( cur[-3*stride], cur[-stride], cur[+stride], cur[3*stride], pixel_max );
+        }
+        else
+        {
+            spatial_pred = (c+e)>>1;
+        }
+
+        // YADIF_CHECK requires a margin to avoid invalid memory access.
+        // In MODE_DECOMB_CUBIC, margin needed is 2 + ABS(param).
+        // Else, the margin needed is 1 + ABS(param).
+        int margin = 2;
+        if (cubic)
+            margin = 3;
+
+        if (x >= margin && x <= width - (margin + 1))
+        {
+            YADIF_CHECK(-1)
+            if (x >= margin + 1 && x <= width - (margin + 2))
+                YADIF_CHECK(-2) }} }}
+        }
+        if (x >= margin && x <= width - (margin + 1))
+        {
+            YADIF_CHECK(1)
+            if (x >= margin + 1 && x <= width - (margin + 2))
+                YADIF_CHECK(2) }} }}
+        }
+
+        /* Temporally adjust the spatial prediction by
+           comparing against lines in the adjacent fields. */
+        int b = (prev2[-2*stride] + next2[-2*stride])>>1;
+        int f = (prev2[+2*stride] + next2[+2*stride])>>1;
+
+        /* Find the median value */
+        int max = MAX3(d-e, d-c, MIN(b-c, f-e));
+        int min = MIN3(d-e, d-c, MAX(b-c, f-e));
+        diff = MAX3( diff, min, -max );
+
+        if( spatial_pred > d + diff )
+        {
+            spatial_pred = d + diff;
+        }
+        else if( spatial_pred < d - diff )
+        {
+            spatial_pred = d - diff;
+        }
+
+        dst[0] = spatial_pred;
+
+        dst++;
+        cur++;
+        prev++;
+        next++;
+        prev2++;
+        next2++;
+    }
+}
+
+#undef YADIF_CUBIC
@@ -0,0 +1,604 @@
+/* decomb_x86.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include "libavutil/cpu.h"
+#include "handbrake/decomb.h"
+
+// The kernels are compiled for SSE4.1 and AVX2 only and are selected at
+// runtime, the rest of libhb keeps its baseline flags
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_DECOMB_SSE4
+#define HAVE_DECOMB_AVX2
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+ * All kernels work on 16 (AVX2) or 8 (SSE4.1) pixels widened to 16 bits,
+ * every intermediate value fits.  The last pixels of a line are done by a
+ * block ending at the last pixel, lines shorter than a block fall back to
+ * scalar code.  SSE4.1 is the first tier with the pblendvb the yadif
+ * direction checks select with.
+ */
+
+static inline int cubic_interpolate_pixel(int y0, int y1, int y2, int y3)
+{
+    int result = (y0 * -3) + (y1 * 23) + (y2 * 23) + (y3 * -3);
+
+    result /= 40;
+    return result < 0 ? 0 : result > 255 ? 255 : result;
+}
+
+#if defined(HAVE_DECOMB_AVX2)
+
+TARGET_AVX2
+static inline __m256i load16(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+// Saturates to 0 .. 255 like hb_crop_table
+TARGET_AVX2
+static inline void store16(uint8_t *p, __m256i v)
+{
+    _mm_storeu_si128((__m128i *)p,
+                     _mm_packus_epi16(_mm256_castsi256_si128(v),
+                                      _mm256_extracti128_si256(v, 1)));
+}
+
+TARGET_AVX2
+static inline __m256i absdiff16(__m256i a, __m256i b)
+{
+    return _mm256_abs_epi16(_mm256_sub_epi16(a, b));
+}
+
+TARGET_AVX2
+static inline __m256i avg16(__m256i a, __m256i b)
+{
+    return _mm256_srli_epi16(_mm256_add_epi16(a, b), 1);
+}
+
+/*
+ * (-3 * y0 + 23 * y1 + 23 * y2 - 3 * y3) / 40 clamped to 0 .. 255.  The
+ * sum is at most 11730; negative sums give 0 whatever the rounding, the
+ * others are divided exactly by multiplying with 2^18 / 40 rounded up.
+ */
+TARGET_AVX2
+static inline __m256i cubic16(__m256i y0, __m256i y1, __m256i y2, __m256i y3)
+{
+    __m256i sum = _mm256_sub_epi16(
+        _mm256_mullo_epi16(_mm256_add_epi16(y1, y2), _mm256_set1_epi16(23)),
+        _mm256_mullo_epi16(_mm256_add_epi16(y0, y3), _mm256_set1_epi16(3)));
+
+    sum = _mm256_max_epi16(sum, _mm256_setzero_si256());
+    sum = _mm256_srli_epi16(_mm256_mulhi_epu16(sum, _mm256_set1_epi16(6554)), 2);
+
+    return _mm256_min_epi16(sum, _mm256_set1_epi16(255));
+}
+
+TARGET_AVX2
+static void cubic_interpolate_line_avx2(uint8_t       *dst,
+                                        const uint8_t *a,
+                                        const uint8_t *b,
+                                        const uint8_t *c,
+                                        const uint8_t *d,
+                                        int            width)
+{
+    int x;
+
+    for (x = 0; x < width; x += 16)
+    {
+        if (x + 16 > width)
+        {
+            if (width < 16)
+            {
+                break;
+            }
+            x = width - 16;
+        }
+        store16(dst + x, cubic16(load16(a + x), load16(b + x),
+                                 load16(c + x), load16(d + x)));
+    }
+
+    for (; x < width; x++)
+    {
+        dst[x] = cubic_interpolate_pixel(a[x], b[x], c[x], d[x]);
+    }
+}
+
+TARGET_AVX2
+static void blend_filter_line_avx2(uint8_t        *dst,
+                                   const uint8_t **rows,
+                                   const int      *tap,
+                                   int             normalize,
+                                   int             width)
+{
+    __m256i coef[5];
+    int     x = 0, k, taps = 0;
+
+    for (k = 0; k < 5; k++)
+    {
+        coef[k] = _mm256_set1_epi16(tap[k]);
+        taps   += tap[k] < 0 ? -tap[k] : tap[k];
+    }
+
+    // The sums must fit 16 bits, they do by far for the decomb taps
+    if (taps * 255 <= INT16_MAX)
+    {
+        for (x = 0; x < width; x += 16)
+        {
+            if (x + 16 > width)
+            {
+                if (width < 16)
+                {
+                    break;
+                }
+                x = width - 16;
+            }
+
+            __m256i sum = _mm256_setzero_si256();
+            for (k = 0; k < 5; k++)
+            {
+                sum = _mm256_add_epi16(sum,
+                        _mm256_mullo_epi16(load16(rows[k] + x), coef[k]));
+            }
+            store16(dst + x, _mm256_srai_epi16(sum, normalize));
+        }
+    }
+
+    for (; x < width; x++)
+    {
+        int result = rows[0][x] * tap[0] +
+                     rows[1][x] * tap[1] +
+                     rows[2][x] * tap[2] +
+                     rows[3][x] * tap[3] +
+                     rows[4][x] * tap[4];
+
+        result >>= normalize;
+        dst[x] = result < 0 ? 0 : result > 255 ? 255 : result;
+    }
+}
+
+// Takes the prediction and score of the direction where the score is lower
+#define YADIF_CHECK16(mask, sc, pred_j)                                     \
+    {                                                                       \
+        mask  = _mm256_and_si256(mask, _mm256_cmpgt_epi16(score, sc));      \
+        score = _mm256_blendv_epi8(score, sc, mask);                        \
+        pred  = _mm256_blendv_epi8(pred, pred_j, mask);                     \
+    }
+
+/*
+ * Same as decomb_yadif_filter_line_c() for pixels far enough from the sides that
+ * all the spatial checks apply.  A direction is only checked for the
+ * pixels where it could win, the others keep their prediction.
+ */
+TARGET_AVX2
+static void yadif_filter_line_avx2(uint8_t       *dst,
+                                   const uint8_t *prev,
+                                   const uint8_t *cur,
+                                   const uint8_t *next,
+                                   const uint8_t *eedi2_guess,
+                                   int            cubic,
+                                   int            vertical_edge,
+                                   int            width,
+                                   int            stride,
+                                   int            parity,
+                                   int            start,
+                                   int            stop)
+{
+    const uint8_t *prev2 = parity ? prev : cur;
+    const uint8_t *next2 = parity ? cur  : next;
+    const int      cubic_pred = cubic && !vertical_edge;
+    const __m256i  ones = _mm256_set1_epi16(-1);
+    int            x;
+
+    for (x = start; x < stop; x += 16)
+    {
+        if (x + 16 > stop)
+        {
+            x = stop - 16;
+        }
+
+        const uint8_t *up = cur + x - stride;
+        const uint8_t *dn = cur + x + stride;
+
+        __m256i c  = load16(up);
+        __m256i e  = load16(dn);
+        __m256i p2 = load16(prev2 + x);
+        __m256i n2 = load16(next2 + x);
+        __m256i d  = avg16(p2, n2);
+
+        __m256i td0 = absdiff16(p2, n2);
+        __m256i td1 = _mm256_srli_epi16(
+            _mm256_add_epi16(absdiff16(load16(prev + x - stride), c),
+                             absdiff16(load16(prev + x + stride), e)), 1);
+        __m256i td2 = _mm256_srli_epi16(
+            _mm256_add_epi16(absdiff16(load16(next + x - stride), c),
+                             absdiff16(load16(next + x + stride), e)), 1);
+        __m256i diff = _mm256_max_epi16(_mm256_srli_epi16(td0, 1),
+                                        _mm256_max_epi16(td1, td2));
+        __m256i pred;
+
+        if (eedi2_guess != NULL)
+        {
+            pred = load16(eedi2_guess + x);
+        }
+        else
+        {
+            __m256i um3 = load16(up - 3), dm3 = load16(dn - 3);
+            __m256i um2 = load16(up - 2), dm2 = load16(dn - 2);
+            __m256i um1 = load16(up - 1), dm1 = load16(dn - 1);
+            __m256i up1 = load16(up + 1), dp1 = load16(dn + 1);
+            __m256i up2 = load16(up + 2), dp2 = load16(dn + 2);
+            __m256i up3 = load16(up + 3), dp3 = load16(dn + 3);
+            __m256i pm1, pm2, pp1, pp2, mask;
+
+            __m256i score = _mm256_add_epi16(
+                _mm256_add_epi16(absdiff16(um1, dm1), absdiff16(c, e)),
+                _mm256_add_epi16(absdiff16(up1, dp1), ones));
+
+            if (cubic_pred)
+            {
+                const uint8_t *up3s = cur + x - 3 * stride;
+                const uint8_t *dn3s = cur + x + 3 * stride;
+
+                pred = cubic16(load16(up3s), c, e, load16(dn3s));
+                pm1  = cubic16(load16(up3s - 3), um1, dp1, load16(dn3s + 3));
+                pm2  = cubic16(avg16(load16(up3s - 4), load16(up - 4)), um2, dp2,
+                               avg16(load16(dn3s + 4), load16(dn + 4)));
+                pp1  = cubic16(load16(up3s + 3), up1, dm1, load16(dn3s - 3));
+                pp2  = cubic16(avg16(load16(up3s + 4), load16(up + 4)), up2, dm2,
+                               avg16(load16(dn3s - 4), load16(dn - 4)));
+            }
+            else
+            {
+                pred = avg16(c, e);
+                pm1  = avg16(um1, dp1);
+                pm2  = avg16(um2, dp2);
+                pp1  = avg16(up1, dm1);
+                pp2  = avg16(up2, dm2);
+            }
+
+            // Directions -1 then -2
+            mask = ones;
+            YADIF_CHECK16(mask, _mm256_add_epi16(
+                _mm256_add_epi16(absdiff16(um2, e), absdiff16(um1, dp1)),
+                absdiff16(c, dp2)), pm1)
+            YADIF_CHECK16(mask, _mm256_add_epi16(
+                _mm256_add_epi16(absdiff16(um3, dp1), absdiff16(um2, dp2)),
+                absdiff16(um1, dp3)), pm2)
+
+            // Directions 1 then 2
+            mask = ones;
+            YADIF_CHECK16(mask, _mm256_add_epi16(
+                _mm256_add_epi16(absdiff16(c, dm2), absdiff16(up1, dm1)),
+                absdiff16(up2, e)), pp1)
+            YADIF_CHECK16(mask, _mm256_add_epi16(
+                _mm256_add_epi16(absdiff16(up1, dm3), absdiff16(up2, dm2)),
+                absdiff16(up3, dm1)), pp2)
+        }
+
+        // Temporally adjust the spatial prediction
+        __m256i b = avg16(load16(prev2 + x - 2 * stride),
+                          load16(next2 + x - 2 * stride));
+        __m256i f = avg16(load16(prev2 + x + 2 * stride),
+                          load16(next2 + x + 2 * stride));
+        __m256i de = _mm256_sub_epi16(d, e);
+        __m256i dc = _mm256_sub_epi16(d, c);
+        __m256i bc = _mm256_sub_epi16(b, c);
+        __m256i fe = _mm256_sub_epi16(f, e);
+        __m256i max = _mm256_max_epi16(_mm256_max_epi16(de, dc),
+                                       _mm256_min_epi16(bc, fe));
+        __m256i min = _mm256_min_epi16(_mm256_min_epi16(de, dc),
+                                       _mm256_max_epi16(bc, fe));
+
+        diff = _mm256_max_epi16(_mm256_max_epi16(diff, min),
+                                _mm256_sub_epi16(_mm256_setzero_si256(), max));
+        pred = _mm256_max_epi16(pred, _mm256_sub_epi16(d, diff));
+        pred = _mm256_min_epi16(pred, _mm256_add_epi16(d, diff));
+
+        store16(dst + x, pred);
+    }
+}
+
+#endif // HAVE_DECOMB_AVX2
+
+#if defined(HAVE_DECOMB_SSE4)
+
+TARGET_SSE4
+static inline __m128i load8(const uint8_t *p)
+{
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)p));
+}
+
+// Saturates to 0 .. 255 like hb_crop_table
+TARGET_SSE4
+static inline void store8(uint8_t *p, __m128i v)
+{
+    _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(v, v));
+}
+
+TARGET_SSE4
+static inline __m128i absdiff8(__m128i a, __m128i b)
+{
+    return _mm_abs_epi16(_mm_sub_epi16(a, b));
+}
+
+TARGET_SSE4
+static inline __m128i avg8(__m128i a, __m128i b)
+{
+    return _mm_srli_epi16(_mm_add_epi16(a, b), 1);
+}
+
+// See cubic16()
+TARGET_SSE4
+static inline __m128i cubic8(__m128i y0, __m128i y1, __m128i y2, __m128i y3)
+{
+    __m128i sum = _mm_sub_epi16(
+        _mm_mullo_epi16(_mm_add_epi16(y1, y2), _mm_set1_epi16(23)),
+        _mm_mullo_epi16(_mm_add_epi16(y0, y3), _mm_set1_epi16(3)));
+
+    sum = _mm_max_epi16(sum, _mm_setzero_si128());
+    sum = _mm_srli_epi16(_mm_mulhi_epu16(sum, _mm_set1_epi16(6554)), 2);
+
+    return _mm_min_epi16(sum, _mm_set1_epi16(255));
+}
+
+TARGET_SSE4
+static void cubic_interpolate_line_sse4(uint8_t       *dst,
+                                        const uint8_t *a,
+                                        const uint8_t *b,
+                                        const uint8_t *c,
+                                        const uint8_t *d,
+                                        int            width)
+{
+    int x;
+
+    for (x = 0; x < width; x += 8)
+    {
+        if (x + 8 > width)
+        {
+            if (width < 8)
+            {
+                break;
+            }
+            x = width - 8;
+        }
+        store8(dst + x, cubic8(load8(a + x), load8(b + x),
+                               load8(c + x), load8(d + x)));
+    }
+
+    for (; x < width; x++)
+    {
+        dst[x] = cubic_interpolate_pixel(a[x], b[x], c[x], d[x]);
+    }
+}
+
+TARGET_SSE4
+static void blend_filter_line_sse4(uint8_t        *dst,
+                                   const uint8_t **rows,
+                                   const int      *tap,
+                                   int             normalize,
+                                   int             width)
+{
+    __m128i coef[5];
+    int     x = 0, k, taps = 0;
+
+    for (k = 0; k < 5; k++)
+    {
+        coef[k] = _mm_set1_epi16(tap[k]);
+        taps   += tap[k] < 0 ? -tap[k] : tap[k];
+    }
+
+    if (taps * 255 <= INT16_MAX)
+    {
+        for (x = 0; x < width; x += 8)
+        {
+            if (x + 8 > width)
+            {
+                if (width < 8)
+                {
+                    break;
+                }
+                x = width - 8;
+            }
+
+            __m128i sum = _mm_setzero_si128();
+            for (k = 0; k < 5; k++)
+            {
+                sum = _mm_add_epi16(sum,
+                        _mm_mullo_epi16(load8(rows[k] + x), coef[k]));
+            }
+            store8(dst + x, _mm_srai_epi16(sum, normalize));
+        }
+    }
+
+    for (; x < width; x++)
+    {
+        int result = rows[0][x] * tap[0] +
+                     rows[1][x] * tap[1] +
+                     rows[2][x] * tap[2] +
+                     rows[3][x] * tap[3] +
+                     rows[4][x] * tap[4];
+
+        result >>= normalize;
+        dst[x] = result < 0 ? 0 : result > 255 ? 255 : result;
+    }
+}
+
+#define YADIF_CHECK8(mask, sc, pred_j)                                      \
+    {                                                                       \
+        mask  = _mm_and_si128(mask, _mm_cmpgt_epi16(score, sc));            \
+        score = _mm_blendv_epi8(score, sc, mask);                           \
+        pred  = _mm_blendv_epi8(pred, pred_j, mask);                        \
+    }
+
+// See yadif_filter_line_avx2()
+TARGET_SSE4
+static void yadif_filter_line_sse4(uint8_t       *dst,
+                                   const uint8_t *prev,
+                                   const uint8_t *cur,
+                                   const uint8_t *next,
+                                   const uint8_t *eedi2_guess,
+                                   int            cubic,
+                                   int            vertical_edge,
+                                   int            width,
+                                   int            stride,
+                                   int            parity,
+                                   int            start,
+                                   int            stop)
+{
+    const uint8_t *prev2 = parity ? prev : cur;
+    const uint8_t *next2 = parity ? cur  : next;
+    const int      cubic_pred = cubic && !vertical_edge;
+    const __m128i  ones = _mm_set1_epi16(-1);
+    int            x;
+
+    for (x = start; x < stop; x += 8)
+    {
+        if (x + 8 > stop)
+        {
+            x = stop - 8;
+        }
+
+        const uint8_t *up = cur + x - stride;
+        const uint8_t *dn = cur + x + stride;
+
+        __m128i c  = load8(up);
+        __m128i e  = load8(dn);
+        __m128i p2 = load8(prev2 + x);
+        __m128i n2 = load8(next2 + x);
+        __m128i d  = avg8(p2, n2);
+
+        __m128i td0 = absdiff8(p2, n2);
+        __m128i td1 = _mm_srli_epi16(
+            _mm_add_epi16(absdiff8(load8(prev + x - stride), c),
+                             absdiff8(load8(prev + x + stride), e)), 1);
+        __m128i td2 = _mm_srli_epi16(
+            _mm_add_epi16(absdiff8(load8(next + x - stride), c),
+                             absdiff8(load8(next + x + stride), e)), 1);
+        __m128i diff = _mm_max_epi16(_mm_srli_epi16(td0, 1),
+                                     _mm_max_epi16(td1, td2));
+        __m128i pred;
+
+        if (eedi2_guess != NULL)
+        {
+            pred = load8(eedi2_guess + x);
+        }
+        else
+        {
+            __m128i um3 = load8(up - 3), dm3 = load8(dn - 3);
+            __m128i um2 = load8(up - 2), dm2 = load8(dn - 2);
+            __m128i um1 = load8(up - 1), dm1 = load8(dn - 1);
+            __m128i up1 = load8(up + 1), dp1 = load8(dn + 1);
+            __m128i up2 = load8(up + 2), dp2 = load8(dn + 2);
+            __m128i up3 = load8(up + 3), dp3 = load8(dn + 3);
+            __m128i pm1, pm2, pp1, pp2, mask;
+
+            __m128i score = _mm_add_epi16(
+                _mm_add_epi16(absdiff8(um1, dm1), absdiff8(c, e)),
+                _mm_add_epi16(absdiff8(up1, dp1), ones));
+
+            if (cubic_pred)
+            {
+                const uint8_t *up3s = cur + x - 3 * stride;
+                const uint8_t *dn3s = cur + x + 3 * stride;
+
+                pred = cubic8(load8(up3s), c, e, load8(dn3s));
+                pm1  = cubic8(load8(up3s - 3), um1, dp1, load8(dn3s + 3));
+                pm2  = cubic8(avg8(load8(up3s - 4), load8(up - 4)), um2, dp2,
+                              avg8(load8(dn3s + 4), load8(dn + 4)));
+                pp1  = cubic8(load8(up3s + 3), up1, dm1, load8(dn3s - 3));
+                pp2  = cubic8(avg8(load8(up3s + 4), load8(up + 4)), up2, dm2,
+                              avg8(load8(dn3s - 4), load8(dn - 4)));
+            }
+            else
+            {
+                pred = avg8(c, e);
+                pm1  = avg8(um1, dp1);
+                pm2  = avg8(um2, dp2);
+                pp1  = avg8(up1, dm1);
+                pp2  = avg8(up2, dm2);
+            }
+
+            // Directions -1 then -2
+            mask = ones;
+            YADIF_CHECK8(mask, _mm_add_epi16(
+                _mm_add_epi16(absdiff8(um2, e), absdiff8(um1, dp1)),
+                absdiff8(c, dp2)), pm1)
+            YADIF_CHECK8(mask, _mm_add_epi16(
+                _mm_add_epi16(absdiff8(um3, dp1), absdiff8(um2, dp2)),
+                absdiff8(um1, dp3)), pm2)
+
+            // Directions 1 then 2
+            mask = ones;
+            YADIF_CHECK8(mask, _mm_add_epi16(
+                _mm_add_epi16(absdiff8(c, dm2), absdiff8(up1, dm1)),
+                absdiff8(up2, e)), pp1)
+            YADIF_CHECK8(mask, _mm_add_epi16(
+                _mm_add_epi16(absdiff8(up1, dm3), absdiff8(up2, dm2)),
+                absdiff8(up3, dm1)), pp2)
+        }
+
+        // Temporally adjust the spatial prediction
+        __m128i b = avg8(load8(prev2 + x - 2 * stride),
+                          load8(next2 + x - 2 * stride));
+        __m128i f = avg8(load8(prev2 + x + 2 * stride),
+                          load8(next2 + x + 2 * stride));
+        __m128i de = _mm_sub_epi16(d, e);
+        __m128i dc = _mm_sub_epi16(d, c);
+        __m128i bc = _mm_sub_epi16(b, c);
+        __m128i fe = _mm_sub_epi16(f, e);
+        __m128i max = _mm_max_epi16(_mm_max_epi16(de, dc),
+                                    _mm_min_epi16(bc, fe));
+        __m128i min = _mm_min_epi16(_mm_min_epi16(de, dc),
+                                    _mm_max_epi16(bc, fe));
+
+        diff = _mm_max_epi16(_mm_max_epi16(diff, min),
+                             _mm_sub_epi16(_mm_setzero_si128(), max));
+        pred = _mm_max_epi16(pred, _mm_sub_epi16(d, diff));
+        pred = _mm_min_epi16(pred, _mm_add_epi16(d, diff));
+
+        store8(dst + x, pred);
+    }
+}
+
+#endif // HAVE_DECOMB_SSE4
+
+void decomb_init_x86(DecombFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HAVE_DECOMB_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->yadif_filter_line      = yadif_filter_line_avx2;
+        functions->cubic_interpolate_line = cubic_interpolate_line_avx2;
+        functions->blend_filter_line      = blend_filter_line_avx2;
+        hb_log("Decomb using AVX2 optimizations");
+        return;
+    }
+#endif
+#if defined(HAVE_DECOMB_SSE4)
+    if (cpu_flags & AV_CPU_FLAG_SSE4)
+    {
+        functions->yadif_filter_line      = yadif_filter_line_sse4;
+        functions->cubic_interpolate_line = cubic_interpolate_line_sse4;
+        functions->blend_filter_line      = blend_filter_line_sse4;
+        hb_log("Decomb using SSE4.1 optimizations");
+    }
+#endif
+}
+
+#endif // ARCH_X86
@@ -28,6 +28,7 @@ hb_filter_object_t hb_filter_deinterlace =
     .work              = hb_avfilter_null_work,
     .close             = hb_avfilter_alias_close,
     .settings_template = deint_template,
+    .high_depth        = 1,
 };
 
 /* Deinterlace Settings
@@ -19,6 +19,7 @@
 
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
+#include "handbrake/threadpool.h"
 
 #define HQDN3D_SPATIAL_LUMA_DEFAULT    4.0f
 #define HQDN3D_SPATIAL_CHROMA_DEFAULT  3.0f
@@ -27,9 +28,13 @@
 struct hb_filter_private_s
 {
     short            hqdn3d_coef[6][512*16];
-    unsigned short * hqdn3d_line;
+    unsigned short * hqdn3d_rows[3];    // spatial pass of the frame
     unsigned short * hqdn3d_frame[3];
 
+    int              segment_count;
+    hb_buffer_t    * src;
+    hb_buffer_t    * dst;
+
     hb_filter_init_t input;
     hb_filter_init_t output;
 };
@@ -83,141 +88,255 @@ static void hqdn3d_precalc_coef( short * ct,
 
 static inline unsigned int hqdn3d_lowpass_mul( int prev_mul,
                                                int curr_mul,
-                                               short * coef )
+                                               const short * coef )
 {
     int d = (prev_mul - curr_mul)>>4;
     return curr_mul + coef[d];
 }
 
-static void hqdn3d_denoise_temporal( unsigned char * frame_src,
-                                     unsigned char * frame_dst,
-                                     unsigned short * frame_ant,
-                                     int w, int h,
-                                     short * temporal)
+static void hqdn3d_temporal_row( const unsigned char * src,
+                                 unsigned short * frame_ant,
+                                 unsigned char * dst,
+                                 int n,
+                                 const short * temporal )
 {
-    int x, y;
+    int x;
     unsigned int tmp;
 
-    temporal += 0x1000;
-
-    for( y = 0; y < h; y++ )
+    for( x = 0; x < n; x++ )
     {
-        for( x = 0; x < w; x++ )
-        {
-            frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                     frame_src[x]<<8,
-                                                     temporal );
-            frame_dst[x] = (tmp+0x7F)>>8;
-        }
-
-        frame_src += w;
-        frame_dst += w;
-        frame_ant += w;
+        frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
+                                                 src[x]<<8,
+                                                 temporal );
+        dst[x] = (tmp+0x7F)>>8;
     }
 }
 
-static void hqdn3d_denoise_spatial( unsigned char * frame_src,
-                                    unsigned char * frame_dst,
-                                    unsigned short * line_ant,
-                                    unsigned short * frame_ant,
-                                    int w, int h,
-                                    short * spatial,
-                                    short * temporal )
+static void hqdn3d_spatial_row( const unsigned short * above,
+                                unsigned short * row,
+                                unsigned short * frame_ant,
+                                unsigned char * dst,
+                                int n,
+                                const short * spatial,
+                                const short * temporal )
 {
-    int x, y;
-    unsigned int pixel_ant;
+    int x;
     unsigned int tmp;
 
-    spatial  += 0x1000;
-    temporal += 0x1000;
-
-    /* First line has no top neighbor. Only left one for each tmp and last frame */
-    pixel_ant = frame_src[0]<<8;
-    for ( x = 0; x < w; x++)
+    for( x = 0; x < n; x++ )
     {
-        line_ant[x] = tmp = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
-                                                            frame_src[x]<<8,
-                                                            spatial );
+        row[x] = tmp =       hqdn3d_lowpass_mul( above[x],
+                                                 row[x],
+                                                 spatial );
         frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
                                                  tmp,
                                                  temporal );
-        frame_dst[x] = (tmp+0x7F)>>8;
+        dst[x] = (tmp+0x7F)>>8;
     }
+}
+
+/*
+ * The spatial lowpass runs left to right along each row, then top to
+ * bottom down each column.  The horizontal pass is done for all rows
+ * first, which leaves rows independent in the horizontal pass and
+ * columns independent in the vertical and temporal passes, so both can
+ * be split among threads with the same result as a single pass.
+ */
+static void hqdn3d_horizontal( const unsigned char * frame_src,
+                               unsigned short * row,
+                               int w,
+                               int first,
+                               const short * spatial )
+{
+    int x;
+    unsigned int pixel_ant = frame_src[0]<<8;
 
-    for( y = 1; y < h; y++ )
+    /* First line has no top neighbor, its first pixel is filtered once more */
+    if( first )
     {
-        frame_src += w;
-        frame_dst += w;
-        frame_ant += w;
-        pixel_ant = frame_src[0]<<8;
-        for ( x = 0; x < w-1; x++ )
-        {
-            line_ant[x] = tmp =  hqdn3d_lowpass_mul( line_ant[x],
-                                                     pixel_ant,
-                                                     spatial );
-            pixel_ant =          hqdn3d_lowpass_mul( pixel_ant,
-                                                     frame_src[x+1]<<8,
-                                                     spatial );
-            frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                     tmp,
-                                                     temporal );
-            frame_dst[x] = (tmp+0x7F)>>8;
-        }
-        line_ant[x] = tmp =  hqdn3d_lowpass_mul( line_ant[x],
-                                                 pixel_ant,
+        pixel_ant = hqdn3d_lowpass_mul( pixel_ant, frame_src[0]<<8, spatial );
+    }
+    row[0] = pixel_ant;
+    for( x = 1; x < w; x++ )
+    {
+        row[x] = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
+                                                 frame_src[x]<<8,
                                                  spatial );
+    }
+}
+
+/*
+ * Four rows at a time.  Each row is a chain of dependent table lookups,
+ * interleaving independent chains keeps the CPU busy while it waits.
+ */
+static void hqdn3d_horizontal4( const unsigned char * frame_src,
+                                unsigned short * row,
+                                int w,
+                                const short * spatial )
+{
+    const unsigned char * src0 = frame_src;
+    const unsigned char * src1 = frame_src + w;
+    const unsigned char * src2 = frame_src + 2*w;
+    const unsigned char * src3 = frame_src + 3*w;
+    unsigned short * row0 = row;
+    unsigned short * row1 = row + w;
+    unsigned short * row2 = row + 2*w;
+    unsigned short * row3 = row + 3*w;
+    unsigned int pixel_ant0 = src0[0]<<8, pixel_ant1 = src1[0]<<8;
+    unsigned int pixel_ant2 = src2[0]<<8, pixel_ant3 = src3[0]<<8;
+    int x;
+
+    row0[0] = pixel_ant0;
+    row1[0] = pixel_ant1;
+    row2[0] = pixel_ant2;
+    row3[0] = pixel_ant3;
+    for( x = 1; x < w; x++ )
+    {
+        row0[x] = pixel_ant0 = hqdn3d_lowpass_mul( pixel_ant0, src0[x]<<8,
+                                                   spatial );
+        row1[x] = pixel_ant1 = hqdn3d_lowpass_mul( pixel_ant1, src1[x]<<8,
+                                                   spatial );
+        row2[x] = pixel_ant2 = hqdn3d_lowpass_mul( pixel_ant2, src2[x]<<8,
+                                                   spatial );
+        row3[x] = pixel_ant3 = hqdn3d_lowpass_mul( pixel_ant3, src3[x]<<8,
+                                                   spatial );
+    }
+}
+
+static void hqdn3d_first_row( unsigned short * row,
+                              unsigned short * frame_ant,
+                              unsigned char * dst,
+                              int n,
+                              const short * temporal )
+{
+    int x;
+    unsigned int tmp;
+
+    for( x = 0; x < n; x++ )
+    {
         frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                 tmp,
+                                                 row[x],
                                                  temporal );
-        frame_dst[x] = (tmp+0x7F)>>8;
+        dst[x] = (tmp+0x7F)>>8;
     }
 }
 
-static void hqdn3d_denoise( unsigned char * frame_src,
-                            unsigned char * frame_dst,
-                            unsigned short * line_ant,
-                            unsigned short ** frame_ant_ptr,
-                            int w,
-                            int h,
-                            short * spatial,
-                            short * temporal )
+static unsigned short * hqdn3d_init_frame( unsigned char * frame_src,
+                                           int w, int h )
 {
     int x, y;
-    unsigned short* frame_ant = (*frame_ant_ptr);
+    unsigned short * frame_ant, * ant;
 
-    if( !frame_ant)
+    frame_ant = ant = malloc( w*h*sizeof(unsigned short) );
+    if( frame_ant == NULL )
+    {
+        return NULL;
+    }
+    for( y = 0; y < h; y++, frame_src += w, ant += w )
     {
-        unsigned char * src = frame_src;
-        (*frame_ant_ptr) = frame_ant = malloc( w*h*sizeof(unsigned short) );
-        for ( y = 0; y < h; y++, frame_src += w, frame_ant += w )
+        for( x = 0; x < w; x++ )
         {
-            for( x = 0; x < w; x++ )
-            {
-                frame_ant[x] = frame_src[x]<<8;
-            }
+            ant[x] = frame_src[x]<<8;
         }
-        frame_src = src;
-        frame_ant = *frame_ant_ptr;
     }
+    return frame_ant;
+}
+
+/*
+ * Horizontal pass over a band of rows of each plane
+ */
+static void hqdn3d_horizontal_segment( void * opaque, int segment )
+{
+    hb_filter_private_t * pv = opaque;
+    hb_buffer_t * in = pv->src;
+    int c, y, y0, y1, w, h;
 
-    /* If no spatial coefficients, do temporal denoise only */
-    if( spatial[0] )
+    for( c = 0; c < 3; c++ )
     {
-        hqdn3d_denoise_spatial( frame_src,
-                                frame_dst,
-                                line_ant,
-                                frame_ant,
-                                w, h,
-                                spatial,
-                                temporal );
+        short * spatial = pv->hqdn3d_coef[c * 2];
+
+        /* If no spatial coefficients, do temporal denoise only */
+        if( !spatial[0] )
+        {
+            continue;
+        }
+        w  = in->plane[c].stride;
+        h  = in->plane[c].height;
+        y0 = h * segment / pv->segment_count;
+        y1 = h * (segment + 1) / pv->segment_count;
+        y  = y0;
+        if( y == 0 && y < y1 )
+        {
+            hqdn3d_horizontal( in->plane[c].data, pv->hqdn3d_rows[c],
+                               w, 1, spatial + 0x1000 );
+            y++;
+        }
+        for( ; y + 4 <= y1; y += 4 )
+        {
+            hqdn3d_horizontal4( in->plane[c].data + y * w,
+                                pv->hqdn3d_rows[c] + y * w,
+                                w, spatial + 0x1000 );
+        }
+        for( ; y < y1; y++ )
+        {
+            hqdn3d_horizontal( in->plane[c].data + y * w,
+                               pv->hqdn3d_rows[c] + y * w,
+                               w, 0, spatial + 0x1000 );
+        }
     }
-    else
+}
+
+/*
+ * Vertical and temporal pass over a stripe of columns of each plane
+ */
+static void hqdn3d_vertical_segment( void * opaque, int segment )
+{
+    hb_filter_private_t * pv = opaque;
+    hb_buffer_t * in = pv->src, * out = pv->dst;
+    int c, y, x0, x1, w, h, units;
+
+    for( c = 0; c < 3; c++ )
     {
-        hqdn3d_denoise_temporal( frame_src,
-                                 frame_dst,
-                                 frame_ant,
-                                 w, h,
-                                 temporal);
+        short * spatial  = pv->hqdn3d_coef[c * 2] + 0x1000;
+        short * temporal = pv->hqdn3d_coef[c * 2 + 1] + 0x1000;
+        unsigned short * frame_ant = pv->hqdn3d_frame[c];
+        unsigned short * row = pv->hqdn3d_rows[c];
+
+        w = in->plane[c].stride;
+        h = in->plane[c].height;
+
+        // Stripes are a multiple of 32 pixels wide so that threads
+        // rarely share cache lines
+        units = (w + 31) / 32;
+        x0 = MIN(w, units * segment / pv->segment_count * 32);
+        x1 = MIN(w, units * (segment + 1) / pv->segment_count * 32);
+        if( x0 >= x1 )
+        {
+            continue;
+        }
+
+        if( !spatial[-0x1000] )
+        {
+            for( y = 0; y < h; y++ )
+            {
+                hqdn3d_temporal_row( in->plane[c].data + y * w + x0,
+                                     frame_ant + y * w + x0,
+                                     out->plane[c].data + y * w + x0,
+                                     x1 - x0, temporal );
+            }
+            continue;
+        }
+
+        hqdn3d_first_row( row + x0, frame_ant + x0,
+                          out->plane[c].data + x0, x1 - x0, temporal );
+        for( y = 1; y < h; y++ )
+        {
+            hqdn3d_spatial_row( row + (y - 1) * w + x0,
+                                row + y * w + x0,
+                                frame_ant + y * w + x0,
+                                out->plane[c].data + y * w + x0,
+                                x1 - x0, spatial, temporal );
+        }
     }
 }
 
@@ -265,6 +384,8 @@ static int hb_denoise_init( hb_filter_object_t * filter,
     hqdn3d_precalc_coef( pv->hqdn3d_coef[4], spatial_chroma_r );
     hqdn3d_precalc_coef( pv->hqdn3d_coef[5], temporal_chroma_r );
 
+    pv->segment_count = hb_get_cpu_count();
+
     pv->output = *init;
 
     return 0;
@@ -279,25 +400,12 @@ static void hb_denoise_close( hb_filter_object_t * filter )
         return;
     }
 
-	if( pv->hqdn3d_line )
-    {
-        free( pv->hqdn3d_line );
-        pv->hqdn3d_line = NULL;
-    }
-	if( pv->hqdn3d_frame[0] )
-    {
-        free( pv->hqdn3d_frame[0] );
-        pv->hqdn3d_frame[0] = NULL;
-    }
-	if( pv->hqdn3d_frame[1] )
-    {
-        free( pv->hqdn3d_frame[1] );
-        pv->hqdn3d_frame[1] = NULL;
-    }
-	if( pv->hqdn3d_frame[2] )
+    int c;
+
+    for( c = 0; c < 3; c++ )
     {
-        free( pv->hqdn3d_frame[2] );
-        pv->hqdn3d_frame[2] = NULL;
+        free( pv->hqdn3d_rows[c] );
+        free( pv->hqdn3d_frame[c] );
     }
 
     free( pv );
@@ -325,26 +433,36 @@ static int hb_denoise_work( hb_filter_object_t * filter,
     out->f.color_range    = pv->output.color_range ;
 
 
-    if( !pv->hqdn3d_line )
-    {
-        pv->hqdn3d_line = malloc( in->plane[0].stride * sizeof(unsigned short) );
-    }
-
-    int c, coef_index;
+    int c, w, h;
 
     for ( c = 0; c < 3; c++ )
     {
-        coef_index = c * 2;
-        hqdn3d_denoise( in->plane[c].data,
-                        out->plane[c].data,
-                        pv->hqdn3d_line,
-                        &pv->hqdn3d_frame[c],
-                        in->plane[c].stride,
-                        in->plane[c].height,
-                        pv->hqdn3d_coef[coef_index],
-                        pv->hqdn3d_coef[coef_index+1] );
+        w = in->plane[c].stride;
+        h = in->plane[c].height;
+        if( !pv->hqdn3d_frame[c] )
+        {
+            pv->hqdn3d_frame[c] = hqdn3d_init_frame( in->plane[c].data, w, h );
+        }
+        if( !pv->hqdn3d_rows[c] && pv->hqdn3d_coef[c * 2][0] )
+        {
+            pv->hqdn3d_rows[c] = malloc( w*h*sizeof(unsigned short) );
+        }
+        if( !pv->hqdn3d_frame[c] ||
+            ( !pv->hqdn3d_rows[c] && pv->hqdn3d_coef[c * 2][0] ) )
+        {
+            hb_error( "denoise: out of memory" );
+            hb_buffer_close( &out );
+            return HB_FILTER_FAILED;
+        }
     }
 
+    pv->src = in;
+    pv->dst = out;
+    hb_parallel_for( pv->segment_count, hqdn3d_horizontal_segment, pv );
+    hb_parallel_for( pv->segment_count, hqdn3d_vertical_segment, pv );
+    pv->src = NULL;
+    pv->dst = NULL;
+
     out->s = in->s;
     *buf_out = out;
 
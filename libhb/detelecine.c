@@ -17,6 +17,7 @@
  */
 
 #define PULLUP_FMT_Y         1
+#define PULLUP_FMT_Y16       2
 #define PULLUP_HAVE_BREAKS   1
 #define PULLUP_HAVE_AFFINITY 2
 #define PULLUP_BREAK_LEFT    1
@@ -61,6 +62,7 @@ struct pullup_context
 {
     /* Public interface */
     int format;
+    int depth;
     int nplanes;
     int *bpp, *w, *h, *stride, *background;
     unsigned int cpu;
@@ -122,6 +124,7 @@ hb_filter_object_t hb_filter_detelecine =
     .work              = hb_detelecine_work,
     .close             = hb_detelecine_close,
     .settings_template = detelecine_template,
+    .high_depth        = 1,
 };
 
 /*
@@ -173,6 +176,60 @@ static int pullup_var_y( unsigned char * a, unsigned char * b, int s )
     return 4*var;
 }
 
+/*
+ * 16 bit sample variants, s is still a stride in bytes.  The metrics are
+ * scaled to 8 bit samples by pullup_compute_metric() so that the break
+ * and affinity thresholds apply.
+ */
+static int pullup_diff_y16( unsigned char * a8, unsigned char * b8, int s )
+{
+    uint16_t *a = (uint16_t*)a8, *b = (uint16_t*)b8;
+    int i, j, diff = 0;
+    s >>= 1;
+    for( i = 4; i; i-- )
+    {
+        for( j = 0; j < 8; j++ )
+        {
+            diff += PULLUP_ABS( a[j]-b[j] );
+        }
+        a+=s; b+=s;
+    }
+    return diff;
+}
+
+static int pullup_licomb_y16( unsigned char * a8, unsigned char * b8, int s )
+{
+    uint16_t *a = (uint16_t*)a8, *b = (uint16_t*)b8;
+    int i, j, diff = 0;
+    s >>= 1;
+    for( i = 4; i; i-- )
+    {
+        for( j = 0; j < 8; j++ )
+        {
+            diff += PULLUP_ABS( (a[j]<<1) - b[j-s] - b[j] )
+                  + PULLUP_ABS( (b[j]<<1) - a[j] - a[j+s] );
+        }
+        a+=s; b+=s;
+    }
+    return diff;
+}
+
+static int pullup_var_y16( unsigned char * a8, unsigned char * b8, int s )
+{
+    uint16_t *a = (uint16_t*)a8, *b = (uint16_t*)b8;
+    int i, j, var = 0;
+    s >>= 1;
+    for( i = 3; i; i-- )
+    {
+        for( j = 0; j < 8; j++ )
+        {
+            var += PULLUP_ABS( a[j]-a[j+s] );
+        }
+        a+=s; b+=s;
+    }
+    return 4*var;
+}
+
 static void pullup_alloc_metrics( struct pullup_context * c,
                                   struct pullup_field * f )
 {
@@ -191,6 +248,7 @@ static void pullup_compute_metric( struct pullup_context * c,
     unsigned char *a, *b;
     int x, y;
     int mp    = c->metric_plane;
+    int shift = c->depth - 8;
     int xstep = c->bpp[mp];
     int ystep = c->stride[mp]<<3;
     int s     = c->stride[mp]<<1; /* field stride */
@@ -212,7 +270,7 @@ static void pullup_compute_metric( struct pullup_context * c,
     {
         for( x = 0; x < w; x += xstep )
         {
-            *dest++ = func( a + x, b + x, s );
+            *dest++ = func( a + x, b + x, s ) >> shift;
         }
         a += ystep; b += ystep;
     }
@@ -567,6 +625,12 @@ void pullup_init_context( struct pullup_context * c )
         c->comb = pullup_licomb_y;
         c->var  = pullup_var_y;
     }
+    else if( c->format == PULLUP_FMT_Y16 )
+    {
+        c->diff = pullup_diff_y16;
+        c->comb = pullup_licomb_y16;
+        c->var  = pullup_var_y16;
+    }
 }
 
 void pullup_free_context( struct pullup_context * c )
@@ -847,12 +911,14 @@ static int hb_detelecine_init( hb_filter_object_t * filter,
     hb_dict_extract_int(&ctx->metric_plane, filter->settings, "plane");
     hb_dict_extract_int(&ctx->parity, filter->settings, "parity");
 
-    ctx->format = PULLUP_FMT_Y;
+    ctx->depth = hb_get_bit_depth( init->pix_fmt );
+    ctx->format = ctx->depth > 8 ? PULLUP_FMT_Y16 : PULLUP_FMT_Y;
     ctx->nplanes = 4;
 
     pullup_preinit_context( ctx );
 
-    ctx->bpp[0] = ctx->bpp[1] = ctx->bpp[2] = 8;
+    // Bytes per 8 pixel metric block
+    ctx->bpp[0] = ctx->bpp[1] = ctx->bpp[2] = ctx->depth > 8 ? 16 : 8;
     ctx->background[1] = ctx->background[2] = 128;
 
     ctx->w[0]      = init->geometry.width;
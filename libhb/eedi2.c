@@ -79,6 +79,17 @@ void eedi2_sort_metrics( int *order, const int length )
     }
 }
 
+/**
+ * First row of a band processed by a loop over every second row
+ * @param first First row of the loop over the whole plane
+ * @param y_start First row of the band
+ */
+static int eedi2_band_start( int first, int y_start )
+{
+    int y = MAX( first, y_start );
+    return y + ( ( y - first ) & 1 );
+}
+
 /**
  * Bitblits an image plane (overwrites one bitmap with another)
  * @param dtsp Pointer to destination bitmap
@@ -165,22 +176,31 @@ void eedi2_upscale_by_2( uint8_t * srcp, uint8_t * dstp, int height, int pitch )
  * @param lthresh Laplacian threshold, ensures edges are still prominent in the 2nd spatial derivative of the srcp plane (20 is a good default value)
  * @param height Height of half-height single-field frame
  * @param width Width of srcp bitmap rows, as opposed to the padded stride in src_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_build_edge_mask( uint8_t * dstp, int dst_pitch, uint8_t *srcp, int src_pitch,
-                            int mthresh, int lthresh, int vthresh, int height, int width )
+                            int mthresh, int lthresh, int vthresh, int height, int width,
+                            int y_start, int y_stop )
 {
     int x, y;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
     mthresh = mthresh * 10;
     vthresh = vthresh * 81;
 
-    memset( dstp, 0, ( height / 2 ) * dst_pitch );
+    if( y_start < MIN( y_stop, height / 2 ) )
+    {
+        memset( dstp + y_start * dst_pitch, 0,
+                ( MIN( y_stop, height / 2 ) - y_start ) * dst_pitch );
+    }
 
-    srcp += src_pitch;
-    dstp += dst_pitch;
+    srcp += src_pitch * ystart;
+    dstp += dst_pitch * ystart;
     unsigned char *srcpp = srcp-src_pitch;
     unsigned char *srcpn = srcp+src_pitch;
-    for( y = 1; y < height - 1; ++y )
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 1; x < width-1; ++x )
         {
@@ -244,19 +264,25 @@ void eedi2_build_edge_mask( uint8_t * dstp, int dst_pitch, uint8_t *srcp, int sr
  * @param dstr Dilation threshold, ensures a pixel is only retained as an edge in dstp if this number of adjacent pixels or greater are also edges in mskp (4 is a good default value)
  * @param height Height of half-height field-sized frame
  * @param width Width of mskp bitmap rows, as opposed to the pdded stride in msk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_dilate_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
-                             int dstr, int height, int width )
+                             int dstr, int height, int width,
+                             int y_start, int y_stop )
 {
     int x, y;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, mskp, msk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    mskp + y_start * msk_pitch, msk_pitch, width, y_stop - y_start );
 
-    mskp += msk_pitch;
+    mskp += msk_pitch * ystart;
     unsigned char *mskpp = mskp - msk_pitch;
     unsigned char *mskpn = mskp + msk_pitch;
-    dstp += dst_pitch;
-    for( y = 1; y < height - 1; ++y )
+    dstp += dst_pitch * ystart;
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -292,19 +318,25 @@ void eedi2_dilate_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int ds
  * @param estr Erosion threshold, ensures a pixel isn't retained as an edge in dstp if fewer than this number of adjacent pixels are also edges in mskp (2 is a good default value)
  * @param height Height of half-height field-sized frame
  * @param width Width of mskp bitmap rows, as opposed to the pdded stride in msk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_erode_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
-                            int estr, int height, int width )
+                            int estr, int height, int width,
+                            int y_start, int y_stop )
 {
     int x, y;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, mskp, msk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    mskp + y_start * msk_pitch, msk_pitch, width, y_stop - y_start );
 
-    mskp += msk_pitch;
+    mskp += msk_pitch * ystart;
     unsigned char *mskpp = mskp - msk_pitch;
     unsigned char *mskpn = mskp + msk_pitch;
-    dstp += dst_pitch;
-    for ( y = 1; y < height - 1; ++y )
+    dstp += dst_pitch * ystart;
+    for ( y = ystart; y < ystop; ++y )
     {
         for ( x = 1; x < width - 1; ++x )
         {
@@ -341,17 +373,22 @@ void eedi2_erode_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst
  * @param dst_pitch Stride of dstp
  * @param height Height of half-height field-sized frame
  * @param width Width of mskp bitmap rows, as opposed to the pdded stride in msk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_remove_small_gaps( uint8_t * mskp, int msk_pitch, uint8_t * dstp, int dst_pitch,
-                              int height, int width )
+                              int height, int width, int y_start, int y_stop )
 {
     int x, y;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, mskp, msk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    mskp + y_start * msk_pitch, msk_pitch, width, y_stop - y_start );
 
-    mskp += msk_pitch;
-    dstp += dst_pitch;
-    for( y = 1; y < height - 1; ++y )
+    mskp += msk_pitch * ystart;
+    dstp += dst_pitch * ystart;
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 3; x < width - 3; ++x )
         {
@@ -379,28 +416,63 @@ void eedi2_remove_small_gaps( uint8_t * mskp, int msk_pitch, uint8_t * dstp, int
 }
 
 /**
- * Calculates spatial direction vectors for the edges. This is EEDI2's timesink, and can be thought of as YADIF_CHECK on steroids, as both try to discern which angle a given edge follows
- * @param plane The plane of the image being processed, to know to reduce maxd for chroma planes (HandBrake only works with YUV420 video so it is assumed they are half-height)
- * @param mskp Pointer to the source edge mask being read from
+ * Picks the direction of an edge pixel from the best directions found by the metrics of eedi2_calc_directions
+ * @param dira Best direction over rows y-2 .. y+1, -5000 if none
+ * @param dirb Best direction over rows y-1 .. y+1, -5000 if none
+ * @param dirc Best direction over rows y-1 .. y+2, -5000 if none
+ * @param dird Best direction of the upward row pairs, -5000 if none
+ * @param dire Best direction of the downward row pairs, -5000 if none
+ * @return Direction mask value of the pixel
+ */
+int eedi2_direction_median( int dira, int dirb, int dirc, int dird, int dire )
+{
+    int order[5], k=0, i;
+    if( dira != -5000 ) order[k++] = dira;
+    if( dirb != -5000 ) order[k++] = dirb;
+    if( dirc != -5000 ) order[k++] = dirc;
+    if( dird != -5000 ) order[k++] = dird;
+    if( dire != -5000 ) order[k++] = dire;
+    if( k > 1 )
+    {
+        eedi2_sort_metrics( order, k );
+        const int mid = ( k & 1 ) ?
+                            order[k>>1] :
+                            ( order[(k-1)>>1] + order[k>>1] + 1 ) >> 1;
+        const int tlim = MAX( eedi2_limlut[abs(mid)] >> 2, 2 );
+        int sum = 0, count = 0;
+        for( i = 0; i < k; ++i )
+        {
+            if( abs( order[i] - mid ) <= tlim )
+            {
+                ++count;
+                sum += order[i];
+            }
+        }
+        if( count > 1 )
+            return 128 + ( (int)( (float)sum / (float)count ) * 4 );
+    }
+    return 128;
+}
+
+/**
+ * Calculates the spatial direction vector of one edge pixel for eedi2_calc_directions
+ * @param plane The plane of the image being processed
+ * @param mskp Pointer to row y of the source edge mask
  * @param msk_pitch Stride of mskp
- * @param srcp Pointer to the source image being filtered
+ * @param srcp Pointer to row y of the source image
  * @param src_pitch Stride of srcp
- * @param dstp Pointer to the destination to store the dilated edge mask
- * @param dst_pitch Stride of dstp
- * @param maxd Maximum pixel distance to search (24 is a good default value)
- * @param nt Noise threshold (50 is a good default value)
+ * @param x Column of the pixel
+ * @param y Row of the pixel
+ * @param maxd Maximum pixel distance to search
+ * @param nt Noise threshold
  * @param height Height of half-height field-sized frame
- * @param width Width of srcp bitmap rows, as opposed to the pdded stride in src_pitch
+ * @param width Width of srcp bitmap rows
+ * @return Direction mask value of the pixel
  */
-void eedi2_calc_directions( const int plane, uint8_t * mskp, int msk_pitch, uint8_t * srcp, int src_pitch,
-                            uint8_t * dstp, int dst_pitch, int maxd, int nt, int height, int width  )
+int eedi2_calc_direction( const int plane, uint8_t * mskp, int msk_pitch, uint8_t * srcp, int src_pitch,
+                          int x, int y, int maxd, int nt, int height, int width )
 {
-    int x, y, u, i;
-
-    memset( dstp, 255, dst_pitch * height );
-    mskp += msk_pitch;
-    dstp += dst_pitch;
-    srcp += src_pitch;
+    int u;
     unsigned char *src2p = srcp - src_pitch * 2;
     unsigned char *srcpp = srcp - src_pitch;
     unsigned char *srcpn = srcp + src_pitch;
@@ -409,140 +481,140 @@ void eedi2_calc_directions( const int plane, uint8_t * mskp, int msk_pitch, uint
     unsigned char *mskpn = mskp + msk_pitch;
     const int maxdt = plane == 0 ? maxd : ( maxd >> 1 );
 
-    for( y = 1; y < height - 1; ++y )
+    const int startu = MAX( -x + 1, -maxdt );
+    const int stopu = MIN( width - 2 - x, maxdt );
+    int minb = MIN( 13 * nt,
+                    ( abs( srcp[x] - srcpn[x] ) +
+                      abs( srcp[x] - srcpp[x] ) ) * 6 );
+    int mina = MIN( 19 * nt,
+                    ( abs( srcp[x] - srcpn[x] ) +
+                      abs( srcp[x] - srcpp[x] ) ) * 9 );
+    int minc = mina;
+    int mind = minb;
+    int mine = minb;
+    int dira = -5000, dirb = -5000, dirc = -5000, dird = -5000, dire = -5000;
+    for( u = startu; u <= stopu; ++u )
     {
-        for( x = 1; x < width - 1; ++x )
+        if( y == 1 ||
+              mskpp[x-1+u] == 0xFF || mskpp[x+u] == 0xFF || mskpp[x+1+u] == 0xFF )
         {
-            if( mskp[x] != 0xFF || ( mskp[x-1] != 0xFF && mskp[x+1] != 0xFF ) )
-                continue;
-            const int startu = MAX( -x + 1, -maxdt );
-            const int stopu = MIN( width - 2 - x, maxdt );
-            int minb = MIN( 13 * nt,
-                            ( abs( srcp[x] - srcpn[x] ) +
-                              abs( srcp[x] - srcpp[x] ) ) * 6 );
-            int mina = MIN( 19 * nt,
-                            ( abs( srcp[x] - srcpn[x] ) +
-                              abs( srcp[x] - srcpp[x] ) ) * 9 );
-            int minc = mina;
-            int mind = minb;
-            int mine = minb;
-            int dira = -5000, dirb = -5000, dirc = -5000, dird = -5000, dire = -5000;
-            for( u = startu; u <= stopu; ++u )
+            if( y == height - 2 ||
+                mskpn[x-1-u] == 0xFF || mskpn[x-u] == 0xFF || mskpn[x+1-u] == 0xFF )
             {
-                if( y == 1 ||
-                      mskpp[x-1+u] == 0xFF || mskpp[x+u] == 0xFF || mskpp[x+1+u] == 0xFF )
+                const int diffsn = abs(  srcp[x-1] - srcpn[x-1-u] ) +
+                                   abs(  srcp[x]   - srcpn[x-u] )   +
+                                   abs(  srcp[x+1] - srcpn[x+1-u] );
+
+                const int diffsp = abs(  srcp[x-1] - srcpp[x-1+u] ) +
+                                   abs(  srcp[x]   - srcpp[x+u] )   +
+                                   abs(  srcp[x+1] - srcpp[x+1+u] );
+
+                const int diffps = abs( srcpp[x-1] -  srcp[x-1-u] ) +
+                                   abs( srcpp[x]   -  srcp[x-u] )   +
+                                   abs( srcpp[x+1] -  srcp[x+1-u] );
+
+                const int diffns = abs( srcpn[x-1] -  srcp[x-1+u] ) +
+                                   abs( srcpn[x]   -  srcp[x+u] )   +
+                                   abs( srcpn[x+1] -  srcp[x+1+u] );
+
+                const int diff = diffsn + diffsp + diffps + diffns;
+                int diffd = diffsp + diffns;
+                int diffe = diffsn + diffps;
+                if( diff < minb )
+                {
+                    dirb = u;
+                    minb = diff;
+                }
+                if( __builtin_expect( y > 1, 1) )
                 {
-                    if( y == height - 2 ||
-                        mskpn[x-1-u] == 0xFF || mskpn[x-u] == 0xFF || mskpn[x+1-u] == 0xFF )
+                    const int diff2pp = abs( src2p[x-1] - srcpp[x-1-u] ) +
+                                    abs( src2p[x]   - srcpp[x-u] )   +
+                                    abs( src2p[x+1] - srcpp[x+1-u] );
+                    const int diffp2p = abs( srcpp[x-1] - src2p[x-1+u] ) +
+                                    abs( srcpp[x]   - src2p[x+u] )   +
+                                    abs( srcpp[x+1] - src2p[x+1+u] );
+                    const int diffa = diff + diff2pp + diffp2p;
+                    diffd += diffp2p;
+                    diffe += diff2pp;
+                    if( diffa < mina )
                     {
-                        const int diffsn = abs(  srcp[x-1] - srcpn[x-1-u] ) +
-                                           abs(  srcp[x]   - srcpn[x-u] )   +
-                                           abs(  srcp[x+1] - srcpn[x+1-u] );
-
-                        const int diffsp = abs(  srcp[x-1] - srcpp[x-1+u] ) +
-                                           abs(  srcp[x]   - srcpp[x+u] )   +
-                                           abs(  srcp[x+1] - srcpp[x+1+u] );
-
-                        const int diffps = abs( srcpp[x-1] -  srcp[x-1-u] ) +
-                                           abs( srcpp[x]   -  srcp[x-u] )   +
-                                           abs( srcpp[x+1] -  srcp[x+1-u] );
-
-                        const int diffns = abs( srcpn[x-1] -  srcp[x-1+u] ) +
-                                           abs( srcpn[x]   -  srcp[x+u] )   +
-                                           abs( srcpn[x+1] -  srcp[x+1+u] );
-
-                        const int diff = diffsn + diffsp + diffps + diffns;
-                        int diffd = diffsp + diffns;
-                        int diffe = diffsn + diffps;
-                        if( diff < minb )
-                        {
-                            dirb = u;
-                            minb = diff;
-                        }
-                        if( __builtin_expect( y > 1, 1) )
-                        {
-                            const int diff2pp = abs( src2p[x-1] - srcpp[x-1-u] ) +
-                                            abs( src2p[x]   - srcpp[x-u] )   +
-                                            abs( src2p[x+1] - srcpp[x+1-u] );
-                            const int diffp2p = abs( srcpp[x-1] - src2p[x-1+u] ) +
-                                            abs( srcpp[x]   - src2p[x+u] )   +
-                                            abs( srcpp[x+1] - src2p[x+1+u] );
-                            const int diffa = diff + diff2pp + diffp2p;
-                            diffd += diffp2p;
-                            diffe += diff2pp;
-                            if( diffa < mina )
-                            {
-                                dira = u;
-                                mina = diffa;
-                            }
-                        }
-                        if( __builtin_expect( y < height-2, 1) )
-                        {
-                            const int diff2nn = abs( src2n[x-1] - srcpn[x-1+u] ) +
-                                                abs( src2n[x]   - srcpn[x+u] )   +
-                                                abs( src2n[x+1] - srcpn[x+1+u] );
-                            const int diffn2n = abs( srcpn[x-1] - src2n[x-1-u] ) +
-                                                abs( srcpn[x]   - src2n[x-u] )   +
-                                                abs( srcpn[x+1] - src2n[x+1-u] );
-                            const int diffc = diff + diff2nn + diffn2n;
-                            diffd += diff2nn;
-                            diffe += diffn2n;
-                            if( diffc < minc )
-                            {
-                                dirc = u;
-                                minc = diffc;
-                            }
-                        }
-                        if( diffd < mind )
-                        {
-                            dird = u;
-                            mind = diffd;
-                        }
-                        if( diffe < mine )
-                        {
-                            dire = u;
-                            mine = diffe;
-                        }
+                        dira = u;
+                        mina = diffa;
                     }
                 }
-            }
-            int order[5], k=0;
-            if( dira != -5000 ) order[k++] = dira;
-            if( dirb != -5000 ) order[k++] = dirb;
-            if( dirc != -5000 ) order[k++] = dirc;
-            if( dird != -5000 ) order[k++] = dird;
-            if( dire != -5000 ) order[k++] = dire;
-            if( k > 1 )
-            {
-                eedi2_sort_metrics( order, k );
-                const int mid = ( k & 1 ) ?
-                                    order[k>>1] :
-                                    ( order[(k-1)>>1] + order[k>>1] + 1 ) >> 1;
-                const int tlim = MAX( eedi2_limlut[abs(mid)] >> 2, 2 );
-                int sum = 0, count = 0;
-                for( i = 0; i < k; ++i )
+                if( __builtin_expect( y < height-2, 1) )
                 {
-                    if( abs( order[i] - mid ) <= tlim )
+                    const int diff2nn = abs( src2n[x-1] - srcpn[x-1+u] ) +
+                                        abs( src2n[x]   - srcpn[x+u] )   +
+                                        abs( src2n[x+1] - srcpn[x+1+u] );
+                    const int diffn2n = abs( srcpn[x-1] - src2n[x-1-u] ) +
+                                        abs( srcpn[x]   - src2n[x-u] )   +
+                                        abs( srcpn[x+1] - src2n[x+1-u] );
+                    const int diffc = diff + diff2nn + diffn2n;
+                    diffd += diff2nn;
+                    diffe += diffn2n;
+                    if( diffc < minc )
                     {
-                        ++count;
-                        sum += order[i];
+                        dirc = u;
+                        minc = diffc;
                     }
                 }
-                if( count > 1 )
-                    dstp[x] = 128 + ( (int)( (float)sum / (float)count ) * 4 );
-                else
-                    dstp[x] = 128;
+                if( diffd < mind )
+                {
+                    dird = u;
+                    mind = diffd;
+                }
+                if( diffe < mine )
+                {
+                    dire = u;
+                    mine = diffe;
+                }
             }
-            else dstp[x] = 128;
         }
-        mskpp += msk_pitch;
+    }
+    return eedi2_direction_median( dira, dirb, dirc, dird, dire );
+}
+
+/**
+ * Calculates spatial direction vectors for the edges. This is EEDI2's timesink, and can be thought of as YADIF_CHECK on steroids, as both try to discern which angle a given edge follows
+ * @param plane The plane of the image being processed, to know to reduce maxd for chroma planes (HandBrake only works with YUV420 video so it is assumed they are half-height)
+ * @param mskp Pointer to the source edge mask being read from
+ * @param msk_pitch Stride of mskp
+ * @param srcp Pointer to the source image being filtered
+ * @param src_pitch Stride of srcp
+ * @param dstp Pointer to the destination to store the dilated edge mask
+ * @param dst_pitch Stride of dstp
+ * @param maxd Maximum pixel distance to search (24 is a good default value)
+ * @param nt Noise threshold (50 is a good default value)
+ * @param height Height of half-height field-sized frame
+ * @param width Width of srcp bitmap rows, as opposed to the pdded stride in src_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
+ */
+void eedi2_calc_directions( const int plane, uint8_t * mskp, int msk_pitch, uint8_t * srcp, int src_pitch,
+                            uint8_t * dstp, int dst_pitch, int maxd, int nt, int height, int width,
+                            int y_start, int y_stop )
+{
+    int x, y;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
+
+    memset( dstp + y_start * dst_pitch, 255, dst_pitch * ( y_stop - y_start ) );
+    mskp += msk_pitch * ystart;
+    dstp += dst_pitch * ystart;
+    srcp += src_pitch * ystart;
+
+    for( y = ystart; y < ystop; ++y )
+    {
+        for( x = 1; x < width - 1; ++x )
+        {
+            if( mskp[x] != 0xFF || ( mskp[x-1] != 0xFF && mskp[x+1] != 0xFF ) )
+                continue;
+            dstp[x] = eedi2_calc_direction( plane, mskp, msk_pitch, srcp, src_pitch,
+                                            x, y, maxd, nt, height, width );
+        }
         mskp += msk_pitch;
-        mskpn += msk_pitch;
-        src2p += src_pitch;
-        srcpp += src_pitch;
         srcp += src_pitch;
-        srcpn += src_pitch;
-        src2n += src_pitch;
         dstp += dst_pitch;
     }
 }
@@ -557,21 +629,27 @@ void eedi2_calc_directions( const int plane, uint8_t * mskp, int msk_pitch, uint
  * @param dst_pitch Stride of dstp
  * @param height Height of half-height field-sized frame
  * @param width Width of mskp bitmap rows, as opposed to the pdded stride in msk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_filter_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                       uint8_t * dstp, int dst_pitch, int height, int width )
+                       uint8_t * dstp, int dst_pitch, int height, int width,
+                       int y_start, int y_stop )
 {
     int x, y, j;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
 
-    mskp += msk_pitch;
-    dmskp += dmsk_pitch;
-    dstp += dst_pitch;
+    mskp += msk_pitch * ystart;
+    dmskp += dmsk_pitch * ystart;
+    dstp += dst_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch;
     unsigned char *dmskpn = dmskp + dmsk_pitch;
 
-    for( y = 1; y < height - 1; ++y )
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -661,20 +739,26 @@ void eedi2_filter_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_
  * @param dst_pitch Stride of dstp
  * @param height Height of half_height field-sized frame
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_filter_dir_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                           uint8_t * dstp, int dst_pitch, int height, int width )
+                           uint8_t * dstp, int dst_pitch, int height, int width,
+                           int y_start, int y_stop )
 {
     int x, y, i;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
 
-    dmskp += dmsk_pitch;
+    dmskp += dmsk_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch;
     unsigned char *dmskpn = dmskp + dmsk_pitch;
-    dstp += dst_pitch;
-    mskp += msk_pitch;
-    for( y = 1; y < height - 1; ++y )
+    dstp += dst_pitch * ystart;
+    mskp += msk_pitch * ystart;
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -732,20 +816,26 @@ void eedi2_filter_dir_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int d
  * @param dst_pitch Stride of dstp
  * @param height Height of half-height field-sized frame
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_expand_dir_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                           uint8_t * dstp, int dst_pitch, int height, int width )
+                           uint8_t * dstp, int dst_pitch, int height, int width,
+                           int y_start, int y_stop )
 {
     int x, y, i;
+    const int ystart = MAX( 1, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
 
-    dmskp += dmsk_pitch;
+    dmskp += dmsk_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch;
     unsigned char *dmskpn = dmskp + dmsk_pitch;
-    dstp += dst_pitch;
-    mskp += msk_pitch;
-    for( y = 1; y < height - 1; ++y )
+    dstp += dst_pitch * ystart;
+    mskp += msk_pitch * ystart;
+    for( y = ystart; y < ystop; ++y )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -795,18 +885,23 @@ void eedi2_expand_dir_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int d
  * @param tff Whether or not the frame parity is Top Field First
  * @param height Height of the full-frame output
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_mark_directions_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                               uint8_t * dstp, int dst_pitch, int tff, int height, int width )
+                               uint8_t * dstp, int dst_pitch, int tff, int height, int width,
+                               int y_start, int y_stop )
 {
     int x, y, i;
-    memset( dstp, 255, dst_pitch * height );
-    dstp  += dst_pitch  * ( 2 - tff );
-    dmskp += dmsk_pitch * ( 1 - tff );
-    mskp  += msk_pitch  * ( 1 - tff );
+    const int ystart = eedi2_band_start( 2 - tff, y_start );
+    const int ystop = MIN( height - 1, y_stop );
+    memset( dstp + y_start * dst_pitch, 255, dst_pitch * ( y_stop - y_start ) );
+    dstp  += dst_pitch  * ystart;
+    dmskp += dmsk_pitch * ( ystart - 1 );
+    mskp  += msk_pitch  * ( ystart - 1 );
     unsigned char *dmskpn = dmskp + dmsk_pitch * 2;
     unsigned char *mskpn = mskp + msk_pitch * 2;
-    for( y = 2 - tff; y < height - 1; y += 2 )
+    for( y = ystart; y < ystop; y += 2 )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -867,19 +962,25 @@ void eedi2_mark_directions_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, i
  * @param field Field to filter
  * @param height Height of the full-frame output
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_filter_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                              uint8_t * dstp, int dst_pitch, int field, int height, int width )
+                              uint8_t * dstp, int dst_pitch, int field, int height, int width,
+                              int y_start, int y_stop )
 {
     int x, y, i;
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
-    dmskp += dmsk_pitch * ( 2 - field );
+    const int ystart = eedi2_band_start( 2 - field, y_start );
+    const int ystop = MIN( height - 1, y_stop );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
+    dmskp += dmsk_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch * 2;
     unsigned char *dmskpn = dmskp + dmsk_pitch * 2;
-    mskp += msk_pitch * ( 1 - field );
+    mskp += msk_pitch * ( ystart - 1 );
     unsigned char *mskpn = mskp + msk_pitch * 2;
-    dstp += dst_pitch * ( 2 - field );
-    for( y = 2 - field; y < height - 1; y += 2 )
+    dstp += dst_pitch * ystart;
+    for( y = ystart; y < ystop; y += 2 )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -944,21 +1045,27 @@ void eedi2_filter_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, in
  * @param field Field to filter
  * @param height Height of the full-frame output
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_expand_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                              uint8_t * dstp, int dst_pitch, int field, int height, int width )
+                              uint8_t * dstp, int dst_pitch, int field, int height, int width,
+                              int y_start, int y_stop )
 {
     int x, y, i;
+    const int ystart = eedi2_band_start( 2 - field, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
 
-    dmskp += dmsk_pitch * ( 2 - field );
+    dmskp += dmsk_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch * 2;
     unsigned char *dmskpn = dmskp + dmsk_pitch * 2;
-    mskp += msk_pitch * ( 1 - field );
+    mskp += msk_pitch * ( ystart - 1 );
     unsigned char *mskpn = mskp + msk_pitch * 2;
-    dstp += dst_pitch * ( 2 - field );
-    for( y = 2 - field; y < height - 1; y += 2)
+    dstp += dst_pitch * ystart;
+    for( y = ystart; y < ystop; y += 2)
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -1014,23 +1121,29 @@ void eedi2_expand_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, in
  * @param field Field to filter
  * @param height Height of the full-frame output
  * @param width Width of dmskp bitmap rows, as opposed to the pdded stride in dmsk_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_fill_gaps_2x( uint8_t *mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch,
-                         uint8_t * dstp, int dst_pitch, int field, int height, int width )
+                         uint8_t * dstp, int dst_pitch, int field, int height, int width,
+                         int y_start, int y_stop )
 {
     int x, y, j;
+    const int ystart = eedi2_band_start( 2 - field, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    eedi2_bit_blit( dstp, dst_pitch, dmskp, dmsk_pitch, width, height );
+    eedi2_bit_blit( dstp + y_start * dst_pitch, dst_pitch,
+                    dmskp + y_start * dmsk_pitch, dmsk_pitch, width, y_stop - y_start );
 
-    dmskp += dmsk_pitch * ( 2 - field );
+    dmskp += dmsk_pitch * ystart;
     unsigned char *dmskpp = dmskp - dmsk_pitch * 2;
     unsigned char *dmskpn = dmskp + dmsk_pitch * 2;
-    mskp += msk_pitch * ( 1 - field );
+    mskp += msk_pitch * ( ystart - 1 );
     unsigned char *mskpp = mskp - msk_pitch * 2;
     unsigned char *mskpn = mskp + msk_pitch * 2;
     unsigned char *mskpnn = mskpn + msk_pitch * 2;
-    dstp += dst_pitch * ( 2 - field );
-    for( y = 2 - field; y < height - 1; y += 2 )
+    dstp += dst_pitch * ystart;
+    for( y = ystart; y < ystop; y += 2 )
     {
         for( x = 1; x < width - 1; ++x )
         {
@@ -1322,18 +1435,23 @@ void eedi2_interpolate_lattice( const int plane, uint8_t * dmskp, int dmsk_pitch
  * @param field Field to filter
  * @param height Height of the full-frame output
  * @param width Width of dstp bitmap rows, as opposed to the pdded stride in src_pitch
+ * @param y_start First row of dstp to write
+ * @param y_stop Row after the last row of dstp to write
  */
 void eedi2_post_process( uint8_t * nmskp, int nmsk_pitch, uint8_t * omskp, int omsk_pitch,
-                         uint8_t * dstp, int src_pitch, int field, int height, int width )
+                         uint8_t * dstp, int src_pitch, int field, int height, int width,
+                         int y_start, int y_stop )
 {
     int x, y;
+    const int ystart = eedi2_band_start( 2 - field, y_start );
+    const int ystop = MIN( height - 1, y_stop );
 
-    nmskp += ( 2 - field ) * nmsk_pitch;
-    omskp += ( 2 - field ) * omsk_pitch;
-    dstp += ( 2 - field ) * src_pitch;
+    nmskp += ystart * nmsk_pitch;
+    omskp += ystart * omsk_pitch;
+    dstp += ystart * src_pitch;
     unsigned char *srcpp = dstp - src_pitch;
     unsigned char *srcpn = dstp + src_pitch;
-    for( y = 2 - field; y < height - 1; y += 2 )
+    for( y = ystart; y < ystop; y += 2 )
     {
         for( x = 0; x < width; ++x )
         {
@@ -0,0 +1,501 @@
+/* eedi2_x86.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include "libavutil/cpu.h"
+#include "handbrake/eedi2.h"
+
+// The kernels are compiled for AVX2 only and are selected at runtime,
+// the rest of libhb keeps its baseline flags
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_EEDI2_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(HAVE_EEDI2_AVX2)
+
+/*
+ * The kernels give the same masks as the C functions in eedi2.c.  Masks
+ * are worked on 32 pixels at a time, the edge and direction searches on
+ * 16 pixels widened to 16 bits.  The last pixels of a row are done by a
+ * block ending at the last pixel, rows shorter than a block fall back to
+ * the C functions.
+ */
+
+TARGET_AVX2
+static inline __m128i absdiff8(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+TARGET_AVX2
+static inline __m128i load8(const uint8_t *p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+TARGET_AVX2
+static inline __m256i load16(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi16(load8(p));
+}
+
+// 0xFFFF where 16 mask bytes are 0xFF
+TARGET_AVX2
+static inline __m256i is_edge16(__m128i m)
+{
+    return _mm256_cvtepi8_epi16(_mm_cmpeq_epi8(m, _mm_set1_epi8(-1)));
+}
+
+// |a[ii - 1] - b[ii - 1]| + |a[ii] - b[ii]| + |a[ii + 1] - b[ii + 1]|
+// for the 16 pixels at a
+TARGET_AVX2
+static inline __m256i sad3(const uint8_t *a, const uint8_t *b)
+{
+    return _mm256_add_epi16(
+        _mm256_add_epi16(_mm256_cvtepu8_epi16(absdiff8(load8(a - 1), load8(b - 1))),
+                         _mm256_cvtepu8_epi16(absdiff8(load8(a), load8(b)))),
+        _mm256_cvtepu8_epi16(absdiff8(load8(a + 1), load8(b + 1))));
+}
+
+// Number of the 8 neighbors of the 32 pixels at p that are 0xFF
+TARGET_AVX2
+static inline __m256i count_edges(const uint8_t *p, int pitch)
+{
+    const __m256i ff = _mm256_set1_epi8(-1);
+    __m256i count = _mm256_setzero_si256();
+    int ii;
+
+    const uint8_t *n[8] = { p - pitch - 1, p - pitch, p - pitch + 1,
+                            p - 1,                    p + 1,
+                            p + pitch - 1, p + pitch, p + pitch + 1 };
+    for (ii = 0; ii < 8; ii++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)n[ii]);
+        count = _mm256_sub_epi8(count, _mm256_cmpeq_epi8(v, ff));
+    }
+    return count;
+}
+
+TARGET_AVX2
+static void dilate_edge_mask_avx2(uint8_t *mskp, int msk_pitch,
+                                  uint8_t *dstp, int dst_pitch,
+                                  int dstr, int height, int width,
+                                  int y_start, int y_stop)
+{
+    const int ystart = MAX(1, y_start);
+    const int ystop  = MIN(height - 1, y_stop);
+    int       x, y;
+
+    if (width < 34)
+    {
+        eedi2_dilate_edge_mask(mskp, msk_pitch, dstp, dst_pitch, dstr,
+                               height, width, y_start, y_stop);
+        return;
+    }
+
+    eedi2_bit_blit(dstp + y_start * dst_pitch, dst_pitch,
+                   mskp + y_start * msk_pitch, msk_pitch,
+                   width, y_stop - y_start);
+
+    // count >= dstr for counts of 0 .. 8
+    const __m256i thresh = _mm256_set1_epi8(MIN(MAX(dstr, 0), 9) - 1);
+    const __m256i zero   = _mm256_setzero_si256();
+
+    for (y = ystart; y < ystop; y++)
+    {
+        uint8_t *m = mskp + y * msk_pitch;
+        uint8_t *d = dstp + y * dst_pitch;
+
+        for (x = 1; x < width - 1; x += 32)
+        {
+            if (x + 32 > width - 1)
+            {
+                x = width - 1 - 32;
+            }
+            __m256i v    = _mm256_loadu_si256((const __m256i *)(m + x));
+            __m256i grow = _mm256_and_si256(
+                _mm256_cmpeq_epi8(v, zero),
+                _mm256_cmpgt_epi8(count_edges(m + x, msk_pitch), thresh));
+            _mm256_storeu_si256((__m256i *)(d + x), _mm256_or_si256(v, grow));
+        }
+    }
+}
+
+TARGET_AVX2
+static void erode_edge_mask_avx2(uint8_t *mskp, int msk_pitch,
+                                 uint8_t *dstp, int dst_pitch,
+                                 int estr, int height, int width,
+                                 int y_start, int y_stop)
+{
+    const int ystart = MAX(1, y_start);
+    const int ystop  = MIN(height - 1, y_stop);
+    int       x, y;
+
+    if (width < 34)
+    {
+        eedi2_erode_edge_mask(mskp, msk_pitch, dstp, dst_pitch, estr,
+                              height, width, y_start, y_stop);
+        return;
+    }
+
+    eedi2_bit_blit(dstp + y_start * dst_pitch, dst_pitch,
+                   mskp + y_start * msk_pitch, msk_pitch,
+                   width, y_stop - y_start);
+
+    // count < estr for counts of 0 .. 8
+    const __m256i thresh = _mm256_set1_epi8(MIN(MAX(estr, 0), 9));
+    const __m256i ff     = _mm256_set1_epi8(-1);
+
+    for (y = ystart; y < ystop; y++)
+    {
+        uint8_t *m = mskp + y * msk_pitch;
+        uint8_t *d = dstp + y * dst_pitch;
+
+        for (x = 1; x < width - 1; x += 32)
+        {
+            if (x + 32 > width - 1)
+            {
+                x = width - 1 - 32;
+            }
+            __m256i v      = _mm256_loadu_si256((const __m256i *)(m + x));
+            __m256i shrink = _mm256_and_si256(
+                _mm256_cmpeq_epi8(v, ff),
+                _mm256_cmpgt_epi8(thresh, count_edges(m + x, msk_pitch)));
+            _mm256_storeu_si256((__m256i *)(d + x), _mm256_andnot_si256(shrink, v));
+        }
+    }
+}
+
+// 0xFF where the three pixels of a column differ by less than 10
+TARGET_AVX2
+static inline __m128i flat8(__m128i pp, __m128i p, __m128i pn)
+{
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i d = _mm_max_epu8(_mm_max_epu8(absdiff8(pp, p), absdiff8(p, pn)),
+                             absdiff8(pp, pn));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(d, nine), zero);
+}
+
+// a * a + b * b of 16 pairs of 16 bit values, to 32 bits, in the order
+// _mm256_packs_epi32 puts back
+TARGET_AVX2
+static inline void sumsq2(__m256i a, __m256i b, __m256i *lo, __m256i *hi)
+{
+    __m256i l = _mm256_unpacklo_epi16(a, b);
+    __m256i h = _mm256_unpackhi_epi16(a, b);
+
+    *lo = _mm256_add_epi32(*lo, _mm256_madd_epi16(l, l));
+    *hi = _mm256_add_epi32(*hi, _mm256_madd_epi16(h, h));
+}
+
+TARGET_AVX2
+static void build_edge_mask_avx2(uint8_t *dstp, int dst_pitch,
+                                 uint8_t *srcp, int src_pitch,
+                                 int mthresh, int lthresh, int vthresh,
+                                 int height, int width,
+                                 int y_start, int y_stop)
+{
+    const int ystart = MAX(1, y_start);
+    const int ystop  = MIN(height - 1, y_stop);
+    int       x, y;
+
+    if (width < 18)
+    {
+        eedi2_build_edge_mask(dstp, dst_pitch, srcp, src_pitch,
+                              mthresh, lthresh, vthresh, height, width,
+                              y_start, y_stop);
+        return;
+    }
+
+    if (y_start < MIN(y_stop, height / 2))
+    {
+        memset(dstp + y_start * dst_pitch, 0,
+               (MIN(y_stop, height / 2) - y_start) * dst_pitch);
+    }
+
+    const __m256i mag  = _mm256_set1_epi32(mthresh * 10);
+    const __m256i var  = _mm256_set1_epi32(vthresh * 81);
+    const __m256i lap  = _mm256_set1_epi16(MIN(MAX(lthresh, -32768), 32767));
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (y = ystart; y < ystop; y++)
+    {
+        const uint8_t *sp = srcp + y * src_pitch;
+        const uint8_t *pp = sp - src_pitch;
+        const uint8_t *pn = sp + src_pitch;
+        uint8_t       *d  = dstp + y * dst_pitch;
+
+        for (x = 1; x < width - 1; x += 16)
+        {
+            if (x + 16 > width - 1)
+            {
+                x = width - 1 - 16;
+            }
+
+            __m128i flat = _mm_or_si128(
+                flat8(load8(pp + x), load8(sp + x), load8(pn + x)),
+                _mm_and_si128(
+                    flat8(load8(pp + x - 1), load8(sp + x - 1), load8(pn + x - 1)),
+                    flat8(load8(pp + x + 1), load8(sp + x + 1), load8(pn + x + 1))));
+            if (_mm_movemask_epi8(flat) == 0xFFFF)
+            {
+                continue;
+            }
+
+            __m256i a[9] = { load16(pp + x - 1), load16(pp + x), load16(pp + x + 1),
+                             load16(sp + x - 1), load16(sp + x), load16(sp + x + 1),
+                             load16(pn + x - 1), load16(pn + x), load16(pn + x + 1) };
+            __m256i sum = zero, sq_lo = zero, sq_hi = zero, s2_lo = zero, s2_hi = zero;
+            int     ii;
+
+            for (ii = 0; ii < 9; ii++)
+            {
+                sum = _mm256_add_epi16(sum, a[ii]);
+            }
+            for (ii = 0; ii < 8; ii += 2)
+            {
+                sumsq2(a[ii], a[ii + 1], &sq_lo, &sq_hi);
+            }
+            sumsq2(a[8], zero, &sq_lo, &sq_hi);
+            sumsq2(sum, zero, &s2_lo, &s2_hi);
+
+            // 9 * sumsq - sum * sum >= vthresh
+            __m256i v_lo = _mm256_sub_epi32(
+                _mm256_add_epi32(_mm256_slli_epi32(sq_lo, 3), sq_lo), s2_lo);
+            __m256i v_hi = _mm256_sub_epi32(
+                _mm256_add_epi32(_mm256_slli_epi32(sq_hi, 3), sq_hi), s2_hi);
+            __m256i smooth = _mm256_packs_epi32(_mm256_cmpgt_epi32(var, v_lo),
+                                                _mm256_cmpgt_epi32(var, v_hi));
+
+            // Ix * Ix + Iy * Iy >= mthresh
+            __m256i ix = _mm256_sub_epi16(a[5], a[3]);
+            __m256i iy = _mm256_max_epi16(
+                _mm256_max_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a[1], a[7])),
+                                 _mm256_abs_epi16(_mm256_sub_epi16(a[1], a[4]))),
+                _mm256_abs_epi16(_mm256_sub_epi16(a[4], a[7])));
+            __m256i g_lo = zero, g_hi = zero;
+            sumsq2(ix, iy, &g_lo, &g_hi);
+            __m256i weak = _mm256_packs_epi32(_mm256_cmpgt_epi32(mag, g_lo),
+                                              _mm256_cmpgt_epi32(mag, g_hi));
+
+            // |Ixx| + |Iyy| >= lthresh
+            __m256i c2  = _mm256_add_epi16(a[4], a[4]);
+            __m256i ixx = _mm256_sub_epi16(_mm256_add_epi16(a[3], a[5]), c2);
+            __m256i iyy = _mm256_sub_epi16(_mm256_add_epi16(a[1], a[7]), c2);
+            __m256i blunt = _mm256_cmpgt_epi16(
+                lap, _mm256_add_epi16(_mm256_abs_epi16(ixx), _mm256_abs_epi16(iyy)));
+
+            // Pixels failing the tests keep the mask they have
+            __m256i fail = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cvtepi8_epi16(flat), smooth),
+                _mm256_and_si256(weak, blunt));
+            __m128i keep = _mm_packs_epi16(_mm256_castsi256_si128(fail),
+                                           _mm256_extracti128_si256(fail, 1));
+            _mm_storeu_si128((__m128i *)(d + x),
+                             _mm_or_si128(load8(d + x),
+                                          _mm_andnot_si128(keep, _mm_set1_epi8(-1))));
+        }
+    }
+}
+
+TARGET_AVX2
+static inline void update_direction(__m256i *min, __m256i *dir, __m256i diff,
+                                    __m256i u, __m256i valid)
+{
+    __m256i lt = _mm256_and_si256(_mm256_cmpgt_epi16(*min, diff), valid);
+
+    *min = _mm256_blendv_epi8(*min, diff, lt);
+    *dir = _mm256_blendv_epi8(*dir, u, lt);
+}
+
+TARGET_AVX2
+static inline __m256i set1_sat16(int v)
+{
+    return _mm256_set1_epi16(MIN(MAX(v, -32768), 32767));
+}
+
+/*
+ * Searches the directions of 16 pixels at once.  Each metric sums at
+ * most 6 * 3 absolute differences, 4590, so the minimums saturated to 16
+ * bits compare the same.  Lanes keep their first minimum like the C loop.
+ */
+TARGET_AVX2
+static void calc_directions_avx2(const int plane, uint8_t *mskp, int msk_pitch,
+                                 uint8_t *srcp, int src_pitch,
+                                 uint8_t *dstp, int dst_pitch,
+                                 int maxd, int nt, int height, int width,
+                                 int y_start, int y_stop)
+{
+    const int ystart = MAX(1, y_start);
+    const int ystop  = MIN(height - 1, y_stop);
+    const int maxdt  = plane == 0 ? maxd : (maxd >> 1);
+    // Pixels whose whole search stays inside the row
+    const int xv0    = maxdt + 1;
+    const int xv1    = width - 1 - maxdt;
+    int       x, y, u, ii;
+
+    memset(dstp + y_start * dst_pitch, 255, dst_pitch * (y_stop - y_start));
+
+    const __m256i ntb  = set1_sat16(13 * nt);
+    const __m256i nta  = set1_sat16(19 * nt);
+    const __m256i none = _mm256_set1_epi16(-5000);
+    const __m128i ff   = _mm_set1_epi8(-1);
+
+    for (y = ystart; y < ystop; y++)
+    {
+        uint8_t *m     = mskp + y * msk_pitch;
+        uint8_t *mp    = m - msk_pitch;
+        uint8_t *mn    = m + msk_pitch;
+        uint8_t *s     = srcp + y * src_pitch;
+        uint8_t *s2p   = s - 2 * src_pitch;
+        uint8_t *sp    = s - src_pitch;
+        uint8_t *sn    = s + src_pitch;
+        uint8_t *s2n   = s + 2 * src_pitch;
+        uint8_t *d     = dstp + y * dst_pitch;
+        const int top    = y == 1;
+        const int bottom = y == height - 2;
+
+        for (x = 1; x < width - 1; x++)
+        {
+            if (x >= xv0 && x + 16 <= xv1)
+            {
+                __m128i c    = _mm_cmpeq_epi8(load8(m + x), ff);
+                __m128i side = _mm_or_si128(_mm_cmpeq_epi8(load8(m + x - 1), ff),
+                                            _mm_cmpeq_epi8(load8(m + x + 1), ff));
+                int active = _mm_movemask_epi8(_mm_and_si128(c, side));
+                if (active == 0)
+                {
+                    x += 15;
+                    continue;
+                }
+
+                __m256i sv   = load16(s + x);
+                __m256i base = _mm256_add_epi16(
+                    _mm256_abs_epi16(_mm256_sub_epi16(sv, load16(sn + x))),
+                    _mm256_abs_epi16(_mm256_sub_epi16(sv, load16(sp + x))));
+                __m256i base3 = _mm256_add_epi16(base, _mm256_add_epi16(base, base));
+                __m256i minb = _mm256_min_epi16(ntb, _mm256_add_epi16(base3, base3));
+                __m256i mina = _mm256_min_epi16(nta, _mm256_add_epi16(base3,
+                                   _mm256_add_epi16(base3, base3)));
+                __m256i minc = mina, mind = minb, mine = minb;
+                __m256i dira = none, dirb = none, dirc = none, dird = none, dire = none;
+
+                for (u = -maxdt; u <= maxdt; u++)
+                {
+                    __m256i valid = _mm256_set1_epi16(-1);
+                    if (!top)
+                    {
+                        valid = _mm256_or_si256(
+                            _mm256_or_si256(is_edge16(load8(mp + x - 1 + u)),
+                                            is_edge16(load8(mp + x + u))),
+                            is_edge16(load8(mp + x + 1 + u)));
+                    }
+                    if (!bottom)
+                    {
+                        valid = _mm256_and_si256(valid, _mm256_or_si256(
+                            _mm256_or_si256(is_edge16(load8(mn + x - 1 - u)),
+                                            is_edge16(load8(mn + x - u))),
+                            is_edge16(load8(mn + x + 1 - u))));
+                    }
+                    if (_mm256_testz_si256(valid, valid))
+                    {
+                        continue;
+                    }
+
+                    const __m256i uv = _mm256_set1_epi16(u);
+                    __m256i diffsn = sad3(s + x,  sn + x - u);
+                    __m256i diffsp = sad3(s + x,  sp + x + u);
+                    __m256i diffps = sad3(sp + x, s + x - u);
+                    __m256i diffns = sad3(sn + x, s + x + u);
+                    __m256i diff   = _mm256_add_epi16(_mm256_add_epi16(diffsn, diffsp),
+                                                      _mm256_add_epi16(diffps, diffns));
+                    __m256i diffd  = _mm256_add_epi16(diffsp, diffns);
+                    __m256i diffe  = _mm256_add_epi16(diffsn, diffps);
+
+                    update_direction(&minb, &dirb, diff, uv, valid);
+                    if (!top)
+                    {
+                        __m256i diff2pp = sad3(s2p + x, sp + x - u);
+                        __m256i diffp2p = sad3(sp + x,  s2p + x + u);
+                        update_direction(&mina, &dira,
+                                         _mm256_add_epi16(diff,
+                                             _mm256_add_epi16(diff2pp, diffp2p)),
+                                         uv, valid);
+                        diffd = _mm256_add_epi16(diffd, diffp2p);
+                        diffe = _mm256_add_epi16(diffe, diff2pp);
+                    }
+                    if (!bottom)
+                    {
+                        __m256i diff2nn = sad3(s2n + x, sn + x + u);
+                        __m256i diffn2n = sad3(sn + x,  s2n + x - u);
+                        update_direction(&minc, &dirc,
+                                         _mm256_add_epi16(diff,
+                                             _mm256_add_epi16(diff2nn, diffn2n)),
+                                         uv, valid);
+                        diffd = _mm256_add_epi16(diffd, diff2nn);
+                        diffe = _mm256_add_epi16(diffe, diffn2n);
+                    }
+                    update_direction(&mind, &dird, diffd, uv, valid);
+                    update_direction(&mine, &dire, diffe, uv, valid);
+                }
+
+                int16_t da[16], db[16], dc[16], dd[16], de[16];
+                _mm256_storeu_si256((__m256i *)da, dira);
+                _mm256_storeu_si256((__m256i *)db, dirb);
+                _mm256_storeu_si256((__m256i *)dc, dirc);
+                _mm256_storeu_si256((__m256i *)dd, dird);
+                _mm256_storeu_si256((__m256i *)de, dire);
+                for (ii = 0; ii < 16; ii++)
+                {
+                    if (active & (1 << ii))
+                    {
+                        d[x + ii] = eedi2_direction_median(da[ii], db[ii], dc[ii],
+                                                           dd[ii], de[ii]);
+                    }
+                }
+                x += 15;
+                continue;
+            }
+
+            if (m[x] != 0xFF || (m[x - 1] != 0xFF && m[x + 1] != 0xFF))
+            {
+                continue;
+            }
+            d[x] = eedi2_calc_direction(plane, m, msk_pitch, s, src_pitch,
+                                        x, y, maxd, nt, height, width);
+        }
+    }
+}
+
+#endif // HAVE_EEDI2_AVX2
+
+void eedi2_init_x86(EEDI2Functions *functions)
+{
+#if defined(HAVE_EEDI2_AVX2)
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->build_edge_mask  = build_edge_mask_avx2;
+        functions->erode_edge_mask  = erode_edge_mask_avx2;
+        functions->dilate_edge_mask = dilate_edge_mask_avx2;
+        functions->calc_directions  = calc_directions_avx2;
+        hb_log("EEDI2 using AVX2 optimizations");
+    }
+#endif
+}
+
+#endif // ARCH_X86
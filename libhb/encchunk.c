@@ -0,0 +1,387 @@
+/* encchunk.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"
+
+/*
+ * Chunked video encoding.
+ *
+ * The video is cut into consecutive ranges of frames (chunks).  Every
+ * chunk is encoded by a fresh instance of the job's video encoder running
+ * in its own thread, so it starts with an IDR frame and does not reference
+ * any other chunk.  Each chunk queues all of its raw frames, so the next
+ * chunk can be fed while the previous ones are still encoding, and up to
+ * job->encode_chunks chunks are encoded at the same time.  The job's memory
+ * budget limits the frames queued in all of them together.  The packets of
+ * the chunks are passed on in order, which splices them into one
+ * continuous stream for the muxer.  All instances are opened with the same
+ * settings and therefore produce the same parameter sets; the muxer uses
+ * the ones of the first chunk.
+ */
+
+int  encchunkInit( hb_work_object_t *, hb_job_t * );
+int  encchunkWork( hb_work_object_t *, hb_buffer_t **, hb_buffer_t ** );
+void encchunkClose( hb_work_object_t * );
+
+hb_work_object_t hb_encchunk =
+{
+    WORK_ENCCHUNK,
+    "Chunked video encoder",
+    encchunkInit,
+    encchunkWork,
+    encchunkClose
+};
+
+// Target length of a chunk.  A chunk ends early at a chapter mark once it
+// is half this long, the chapter frame has to be an IDR frame anyway.
+#define CHUNK_SECONDS 10
+
+typedef struct
+{
+    int                index;
+    int                frames;    // frames sent to the encoder so far
+    int64_t            start;     // pts of the first frame
+    int64_t            dts_shift; // added to the decode timestamps
+    int                drained;   // packets passed on so far
+    hb_work_object_t * encoder;
+    hb_esconfig_t      config;    // parameter sets of chunks after the first
+    hb_thread_t      * thread;
+} encchunk_t;
+
+struct hb_work_private_s
+{
+    hb_job_t   * job;
+    int          chunk_frames;
+    int          chunk_count;    // number of chunks started
+    hb_list_t  * chunks;         // chunks being encoded, oldest first
+    encchunk_t * current;        // chunk receiving frames
+    int64_t      init_delay;     // encoder delay of the first chunk
+};
+
+/*
+ * Runs one chunk's encoder until it has flushed its last packet.
+ */
+static void chunk_loop( void * _c )
+{
+    encchunk_t       * chunk = _c;
+    hb_work_object_t * w     = chunk->encoder;
+    hb_buffer_t      * in, * out;
+
+    while (!*w->done && w->status != HB_WORK_DONE)
+    {
+        in = hb_fifo_get_wait(w->fifo_in);
+        if (in == NULL)
+        {
+            continue;
+        }
+        out = NULL;
+        w->status = w->work(w, &in, &out);
+        hb_buffer_close(&in);
+        if (out != NULL)
+        {
+            // fifo_out holds a whole chunk, this never waits
+            hb_fifo_push(w->fifo_out, out);
+        }
+    }
+    if (*w->done)
+    {
+        hb_fifo_wake_all();
+    }
+}
+
+static void chunk_close( encchunk_t ** _chunk )
+{
+    encchunk_t * chunk = *_chunk;
+
+    if (chunk == NULL)
+    {
+        return;
+    }
+    if (chunk->thread != NULL)
+    {
+        hb_thread_close(&chunk->thread);
+    }
+    if (chunk->encoder != NULL)
+    {
+        if (chunk->encoder->private_data != NULL)
+        {
+            chunk->encoder->close(chunk->encoder);
+        }
+        hb_fifo_close(&chunk->encoder->fifo_in);
+        hb_fifo_close(&chunk->encoder->fifo_out);
+        free(chunk->encoder);
+    }
+    free(chunk);
+    *_chunk = NULL;
+}
+
+static encchunk_t * chunk_open( hb_work_object_t * w )
+{
+    hb_work_private_t * pv  = w->private_data;
+    hb_job_t          * job = pv->job;
+    encchunk_t        * chunk;
+
+    chunk = calloc(1, sizeof(encchunk_t));
+    if (chunk == NULL)
+    {
+        hb_error("encchunk: chunk allocation failed");
+        return NULL;
+    }
+    chunk->index   = pv->chunk_count;
+    chunk->encoder = hb_video_encoder(job->h, job->vcodec);
+    if (chunk->encoder == NULL)
+    {
+        free(chunk);
+        return NULL;
+    }
+    chunk->encoder->private_data = NULL;
+    chunk->encoder->done         = w->done;
+    chunk->encoder->die          = w->die;
+    chunk->encoder->config       = chunk->index == 0 ? w->config :
+                                                       &chunk->config;
+    // Room for the whole chunk and its EOF, so that feeding the chunk
+    // doesn't wait for its encoder unless the memory budget is used up
+    chunk->encoder->fifo_in  = hb_fifo_init_spsc(pv->chunk_frames + 1, 1);
+    chunk->encoder->fifo_out = hb_fifo_init_spsc(pv->chunk_frames + 2, 1);
+    if (chunk->encoder->fifo_in == NULL || chunk->encoder->fifo_out == NULL)
+    {
+        hb_error("encchunk: chunk %d fifo allocation failed", chunk->index);
+        chunk_close(&chunk);
+        return NULL;
+    }
+    hb_fifo_set_budget(chunk->encoder->fifo_in, job->budget);
+    hb_fifo_set_done(chunk->encoder->fifo_in, w->done, w->die);
+    hb_fifo_set_done(chunk->encoder->fifo_out, w->done, w->die);
+
+    if (chunk->encoder->init(chunk->encoder, job))
+    {
+        hb_error("encchunk: chunk %d encoder initialization failed",
+                 chunk->index);
+        chunk_close(&chunk);
+        return NULL;
+    }
+    chunk->thread = hb_thread_init("encchunk", chunk_loop, chunk,
+                                   HB_LOW_PRIORITY);
+    hb_list_add(pv->chunks, chunk);
+    pv->chunk_count++;
+
+    hb_deep_log(2, "encchunk: chunk %d started", chunk->index);
+
+    return chunk;
+}
+
+/*
+ * No more frames for the current chunk, let its encoder flush.
+ */
+static void chunk_end( hb_work_private_t * pv )
+{
+    if (pv->current != NULL)
+    {
+        hb_fifo_push(pv->current->encoder->fifo_in, hb_buffer_eof_init());
+        pv->current = NULL;
+    }
+}
+
+/*
+ * Moves the packets the oldest chunk has produced to 'list' and closes
+ * the chunk once it is complete.  Returns 1 if the chunk was closed.
+ */
+static int chunk_drain( hb_work_object_t * w, hb_buffer_list_t * list,
+                        int wait )
+{
+    hb_work_private_t * pv    = w->private_data;
+    encchunk_t        * chunk = hb_list_item(pv->chunks, 0);
+    hb_buffer_t       * buf;
+
+    if (chunk == NULL)
+    {
+        return 0;
+    }
+    while (!*w->done)
+    {
+        if (wait)
+        {
+            buf = hb_fifo_get_wait(chunk->encoder->fifo_out);
+        }
+        else
+        {
+            buf = hb_fifo_get(chunk->encoder->fifo_out);
+        }
+        if (buf == NULL)
+        {
+            if (!wait)
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (buf->s.flags & HB_BUF_FLAG_EOF)
+        {
+            hb_buffer_close(&buf);
+            break;
+        }
+        // Each encoder starts its decode timestamps its own delay before
+        // the chunk's first frame, the first packet has the lowest one.
+        // The muxer compensates the delay of the first chunk only, so move
+        // the timestamps of the others to the same delay.  This keeps them
+        // increasing across the splice with their original spacing.
+        if (buf->s.renderOffset != AV_NOPTS_VALUE)
+        {
+            if (chunk->drained == 0)
+            {
+                int64_t delay = chunk->start - buf->s.renderOffset;
+                if (chunk->index == 0)
+                {
+                    pv->init_delay = delay;
+                }
+                chunk->dts_shift = delay - pv->init_delay;
+            }
+            buf->s.renderOffset += chunk->dts_shift;
+        }
+        chunk->drained++;
+        hb_buffer_list_append(list, buf);
+    }
+
+    hb_deep_log(2, "encchunk: chunk %d complete", chunk->index);
+    hb_list_rem(pv->chunks, chunk);
+    chunk_close(&chunk);
+
+    return 1;
+}
+
+int encchunkInit( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv = calloc(1, sizeof(hb_work_private_t));
+
+    w->private_data = pv;
+    pv->job         = job;
+    pv->chunks      = hb_list_init();
+
+    pv->chunk_frames = (int64_t)CHUNK_SECONDS * job->vrate.num /
+                       job->vrate.den;
+    if (pv->chunk_frames < 1)
+    {
+        pv->chunk_frames = 1;
+    }
+
+    // Share the CPUs between the encoder instances, which all run at the
+    // same time as long as frames arrive faster than one of them encodes
+    job->encode_threads = hb_get_cpu_count() / job->encode_chunks;
+    if (job->encode_threads < 1)
+    {
+        job->encode_threads = 1;
+    }
+
+    hb_log("encchunk: %d concurrent chunks of up to %d frames, "
+           "%d threads each", job->encode_chunks, pv->chunk_frames,
+           job->encode_threads);
+    if (hb_memory_budget_limit(job->budget) <= 0)
+    {
+        hb_log("encchunk: no memory budget, up to %d raw frames may be "
+               "queued", job->encode_chunks * pv->chunk_frames);
+    }
+
+    // The first chunk fills in the stream's parameter sets before the
+    // muxer is initialized
+    pv->current = chunk_open(w);
+    if (pv->current == NULL)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+void encchunkClose( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+    encchunk_t        * chunk;
+
+    if (pv == NULL)
+    {
+        return;
+    }
+    while ((chunk = hb_list_item(pv->chunks, 0)) != NULL)
+    {
+        hb_list_rem(pv->chunks, chunk);
+        chunk_close(&chunk);
+    }
+    hb_list_close(&pv->chunks);
+    free(pv);
+    w->private_data = NULL;
+}
+
+int encchunkWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                  hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_buffer_t       * in = *buf_in;
+    hb_buffer_list_t    list;
+
+    hb_buffer_list_clear(&list);
+    *buf_in = NULL;
+
+    if (in->s.flags & HB_BUF_FLAG_EOF)
+    {
+        chunk_end(pv);
+        while (chunk_drain(w, &list, 1));
+        hb_buffer_list_append(&list, in);
+        *buf_out = hb_buffer_list_clear(&list);
+        return HB_WORK_DONE;
+    }
+
+    if (pv->current != NULL && in->s.new_chap > 0 &&
+        pv->current->frames >= pv->chunk_frames / 2)
+    {
+        chunk_end(pv);
+    }
+    if (pv->current == NULL)
+    {
+        // Wait for the oldest chunk when all encoders are busy
+        if (hb_list_count(pv->chunks) >= pv->job->encode_chunks)
+        {
+            chunk_drain(w, &list, 1);
+        }
+        pv->current = chunk_open(w);
+        if (pv->current == NULL)
+        {
+            hb_buffer_close(&in);
+            *buf_out = hb_buffer_list_clear(&list);
+            *w->done = 1;
+            return HB_WORK_ERROR;
+        }
+    }
+
+    while (!*w->done)
+    {
+        if (hb_fifo_full_wait(pv->current->encoder->fifo_in))
+        {
+            if (pv->current->frames == 0)
+            {
+                pv->current->start = in->s.start;
+            }
+            hb_fifo_push(pv->current->encoder->fifo_in, in);
+            in = NULL;
+            break;
+        }
+        // Keep the muxer fed while waiting
+        chunk_drain(w, &list, 0);
+    }
+    hb_buffer_close(&in);
+
+    if (++pv->current->frames >= pv->chunk_frames)
+    {
+        chunk_end(pv);
+    }
+
+    while (chunk_drain(w, &list, 0));
+    *buf_out = hb_buffer_list_clear(&list);
+
+    return HB_WORK_OK;
+}
@@ -11,6 +11,7 @@
 
 #include "handbrake/handbrake.h"
 #include "handbrake/hb_dict.h"
+#include "handbrake/hbffmpeg.h"
 #include "handbrake/encx264.h"
 
 int  encx264Init( hb_work_object_t *, hb_job_t * );
@@ -393,6 +394,14 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
     param.vui.i_transfer  = hb_output_color_transfer(job);
     param.vui.i_colmatrix = hb_output_color_matrix(job);
 
+    /* Chunked encoding runs several instances side by side, share the CPUs
+     * between them rather than letting each one use all of them.  x264's
+     * automatic setting is 1.5 threads per CPU, keep that ratio. */
+    if (job->encode_threads > 0)
+    {
+        param.i_threads = MAX(1, job->encode_threads * 3 / 2);
+    }
+
     /* place job->encoder_options in an hb_dict_t for convenience */
     hb_dict_t * x264_opts = NULL;
     if (job->encoder_options != NULL && *job->encoder_options)
@@ -755,8 +764,11 @@ static hb_buffer_t *x264_encode( hb_work_object_t *w, hb_buffer_t *in )
     hb_buffer_t       *tmp = NULL;
 
     /* Point x264 at our current buffers Y(UV) data.  */
-    if (pv->pic_in.img.i_csp & X264_CSP_HIGH_DEPTH)
+    if ((pv->pic_in.img.i_csp & X264_CSP_HIGH_DEPTH) &&
+        hb_get_bit_depth(in->f.fmt) != pv->api->bit_depth)
     {
+        // 8 bit frames are expanded, frames filtered at the encoder's
+        // depth are passed through as is
         tmp = expand_buf(pv->api->bit_depth, in);
         pv->pic_in.img.i_stride[0] = tmp->plane[0].stride;
         pv->pic_in.img.i_stride[1] = tmp->plane[1].stride;
@@ -13,6 +13,7 @@
 
 #include "handbrake/handbrake.h"
 #include "handbrake/hb_dict.h"
+#include "handbrake/hbffmpeg.h"
 #include "handbrake/h265_common.h"
 #include "x265.h"
 
@@ -194,6 +195,20 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
         goto fail;
     }
 
+    /*
+     * Chunked encoding runs several instances side by side, limit the
+     * thread pool of each one to its share of the CPUs.
+     */
+    if (job->encode_threads > 0)
+    {
+        char pools[12];
+        snprintf(pools, sizeof(pools), "%d", job->encode_threads);
+        if (param_parse(pv, param, "pools", pools))
+        {
+            goto fail;
+        }
+    }
+
     /* iterate through x265_opts and parse the options */
     hb_dict_t *x265_opts;
     x265_opts = hb_encopts_to_dict(job->encoder_options, job->vcodec);
@@ -477,7 +492,7 @@ static hb_buffer_t* x265_encode(hb_work_object_t *w, hb_buffer_t *in)
     pic_in.planes[2] = in->plane[2].data;
     pic_in.poc       = pv->frames_in++;
     pic_in.pts       = in->s.start;
-    pic_in.bitDepth  = 8;
+    pic_in.bitDepth  = hb_get_bit_depth(in->f.fmt);
 
     if (in->s.new_chap && job->chapter_markers)
     {
@@ -10,6 +10,7 @@
 #include "libavcodec/avcodec.h"
 
 #include "handbrake/handbrake.h"
+#include "handbrake/threadpool.h"
 #if HB_PROJECT_FEATURE_QSV
 #include "handbrake/qsv_libav.h"
 #endif
@@ -50,6 +51,30 @@ struct hb_fifo_s
     hb_buffer_t  * first;
     hb_buffer_t  * last;
 
+    // Single producer, single consumer fifos pass buffers through a
+    // lock free ring.  'lock' is then only taken to sleep, to wake the
+    // other side, or when the producer overruns the ring.  In that case
+    // buffers queue on 'first' / 'last' until the consumer drains them.
+    int            spsc;
+    hb_buffer_t ** ring;
+    uint32_t       ring_mask;
+    uint32_t       ring_head;   // written by the consumer only
+    uint32_t       ring_tail;   // written by the producer only
+    uint32_t       overflow;    // number of buffers on the overflow list
+
+    // The stop flags of the job using a spsc fifo.  When they are set,
+    // a side that has to wait sleeps until the other side wakes it
+    // (or hb_fifo_wake_all() does) instead of checking back every
+    // FIFO_TIMEOUT milliseconds.
+    volatile int * done;
+    volatile int * die;
+
+    // Bytes queued in this fifo are charged to 'budget'.  While the
+    // budget is exhausted, the fifo is reported full as soon as it holds
+    // a single buffer.  Every fifo can always accept one buffer, so
+    // the pipeline keeps draining towards the muxer and can't deadlock.
+    hb_memory_budget_t * budget;
+
 #if defined(HB_FIFO_DEBUG)
     // Fifo list for debugging
     hb_fifo_t    * next;
@@ -63,6 +88,29 @@ static hb_fifo_t fifo_list =
 };
 #endif
 
+// Bytes of buffers queued in fifos.  A job budget charges its parent,
+// the process budget, as well.  Limits of 0 mean unlimited.
+struct hb_memory_budget_s
+{
+    int64_t              limit;
+    int64_t              bytes;
+    int64_t              peak;
+    hb_memory_budget_t * parent;
+};
+
+static hb_memory_budget_t process_budget;
+
+// Spsc fifos with stop flags, see hb_fifo_set_done()
+static struct
+{
+    hb_lock_t * lock;
+    hb_list_t * list;
+} spsc_fifos;
+
+// Producers blocked by the budget poll at this interval, since the fifo
+// that eventually frees memory is usually not the one they wait on.
+#define BUDGET_TIMEOUT 20
+
 /* we round the requested buffer size up to the next power of 2 so there can
  * be at most 32 possible pools when the size is a 32 bit int. To avoid a lot
  * of slow & error-prone run-time checking we allow for all 32. */
@@ -77,12 +125,49 @@ static hb_fifo_t fifo_list =
  * too much memory. */
 #define BUFFER_POOL_MAX_ELEMENTS 32
 
+#if !defined(HB_NO_BUFFER_POOL)
+/* each thread keeps a small magazine of free buffers per pool in front of
+ * the shared pool fifos, like the per-cpu caches of a slab allocator. most
+ * allocations are satisfied from, and most frees returned to, the calling
+ * thread's magazine without taking a lock. an empty or full magazine
+ * exchanges half its capacity with the shared pool under a single lock.
+ * magazines are bounded in bytes so idle threads don't hoard frames. */
+#define BUFFER_MAGAZINE_MAX   8
+#define BUFFER_MAGAZINE_BYTES (1 << 24)
+
+typedef struct
+{
+    uint64_t allocs;        // requests for a buffer from this pool
+    uint64_t magazine_hits; // satisfied by the thread's magazine
+    uint64_t pool_hits;     // satisfied by the shared pool
+    uint64_t locks;         // shared pool lock acquisitions
+    uint64_t contended;     // acquisitions that found the lock held
+} buffer_pool_stats_t;
+
+typedef struct
+{
+    int                 count[MAX_BUFFER_POOLS];
+    hb_buffer_t       * buf[MAX_BUFFER_POOLS][BUFFER_MAGAZINE_MAX];
+    buffer_pool_stats_t stats[MAX_BUFFER_POOLS];
+} buffer_magazine_t;
+#endif
+
 struct hb_buffer_pools_s
 {
     int64_t allocated;
+    int64_t frame_copied;   // bytes of picture data copied between buffers
+    int64_t frame_shared;   // bytes of picture data passed by reference
+    int64_t packet_shared;  // bytes of packet data passed by reference
     hb_lock_t *lock;
 #if !defined(HB_NO_BUFFER_POOL)
     hb_fifo_t *pool[MAX_BUFFER_POOLS];
+    hb_tls_t  *magazines;
+    // statistics of threads that have exited, protected by 'lock'
+    buffer_pool_stats_t stats[MAX_BUFFER_POOLS];
+    // peak number of bytes held by each shared pool
+    int64_t    held_peak[MAX_BUFFER_POOLS];
+    // bytes currently held by all shared pools
+    int64_t    held;
 #endif
 #if defined(HB_BUFFER_DEBUG)
     hb_list_t *alloc_list;
@@ -94,11 +179,26 @@ struct hb_buffer_pools_s
 static int hb_fifo_contains( hb_fifo_t *f, hb_buffer_t *b );
 #endif
 
+static const hb_buffer_t buffer_template =
+{
+    .s.start        = AV_NOPTS_VALUE,
+    .s.stop         = AV_NOPTS_VALUE,
+    .s.renderOffset = AV_NOPTS_VALUE,
+    .s.scr_sequence = -1,
+};
+
+#if !defined(HB_NO_BUFFER_POOL)
+static void buffer_magazine_free( void * opaque );
+#endif
+
 void hb_buffer_pool_init( void )
 {
     buffers.lock = hb_lock_init();
     buffers.allocated = 0;
 
+    spsc_fifos.lock = hb_lock_init();
+    spsc_fifos.list = hb_list_init();
+
 #if defined(HB_BUFFER_DEBUG)
     buffers.alloc_list = hb_list_init();
 #endif
@@ -123,6 +223,9 @@ void hb_buffer_pool_init( void )
         buffers.pool[i] = hb_fifo_init(BUFFER_POOL_MAX_ELEMENTS, 1);
         buffers.pool[i]->buffer_size = 1 << i;
     }
+
+    // Without thread local storage every request goes to the shared pools
+    buffers.magazines = hb_tls_init(buffer_magazine_free);
 #endif
 }
 
@@ -269,13 +372,70 @@ void fifo_list_validate( void )
 #endif
 #endif
 
+static void buffer_free( hb_buffer_t * b );
+#if !defined(HB_NO_BUFFER_POOL)
+static void buffer_magazine_flush( buffer_magazine_t * m );
+
+static void buffer_pool_log_stats( void )
+{
+    int ii;
+
+    for (ii = BUFFER_POOL_FIRST; ii <= BUFFER_POOL_LAST; ii++)
+    {
+        buffer_pool_stats_t * s = &buffers.stats[ii];
+
+        if (s->allocs == 0)
+        {
+            continue;
+        }
+        hb_log("buffers: pool %8d: %"PRIu64" allocs, %.1f%% magazine hits, "
+               "%.1f%% pool hits, %"PRIu64" locks, %.1f%% contended, "
+               "%"PRId64" KiB peak held", 1 << ii, s->allocs,
+               100. * s->magazine_hits / s->allocs,
+               100. * s->pool_hits / s->allocs, s->locks,
+               s->locks ? 100. * s->contended / s->locks : 0.,
+               buffers.held_peak[ii] / 1024);
+    }
+    memset(buffers.stats, 0, sizeof(buffers.stats));
+    memset(buffers.held_peak, 0, sizeof(buffers.held_peak));
+}
+#endif
+
+#if !defined(HB_NO_BUFFER_POOL)
+// Returns the calling thread's magazine to the shared pools
+static void buffer_magazine_flush_thread( void * opaque, int index )
+{
+    buffer_magazine_t * m = hb_tls_get(buffers.magazines);
+
+    if (m != NULL)
+    {
+        buffer_magazine_flush(m);
+    }
+}
+#endif
+
 void hb_buffer_pool_free( void )
 {
     int i;
     int64_t freed = 0;
 
+#if !defined(HB_NO_BUFFER_POOL)
+    // Job threads have already returned their magazines when they
+    // exited.  Thread pool threads live on, have them return theirs,
+    // and return the calling thread's as well.
+    if (buffers.magazines != NULL)
+    {
+        hb_thread_pool_broadcast(buffer_magazine_flush_thread, NULL);
+        buffer_magazine_flush_thread(NULL, 0);
+    }
+#endif
+
     hb_lock(buffers.lock);
 
+#if !defined(HB_NO_BUFFER_POOL)
+    buffer_pool_log_stats();
+#endif
+
 #if defined(HB_BUFFER_DEBUG)
     hb_deep_log(2, "leaked %d buffers", hb_list_count(buffers.alloc_list));
     for (i = 0; i < hb_list_count(buffers.alloc_list); i++)
@@ -308,6 +468,7 @@ void hb_buffer_pool_free( void )
                     buffers.pool[i]->buffer_size);
         }
     }
+    hb_atomic_store(&buffers.held, 0);
 #endif
 
 #if defined(HB_BUFFER_DEBUG) && defined(HB_NO_BUFFER_POOL)
@@ -323,25 +484,277 @@ void hb_buffer_pool_free( void )
 
     hb_deep_log( 2, "Allocated %"PRId64" bytes of buffers on this pass and Freed %"PRId64" bytes, "
            "%"PRId64" bytes leaked", buffers.allocated, freed, buffers.allocated - freed);
-    buffers.allocated = 0;
+    if (buffers.frame_copied || buffers.frame_shared)
+    {
+        hb_log("buffers: %"PRId64" bytes of frame data copied, "
+               "%"PRId64" bytes shared", buffers.frame_copied,
+               buffers.frame_shared);
+    }
+    if (buffers.packet_shared)
+    {
+        hb_log("buffers: %"PRId64" bytes of packet data shared",
+               buffers.packet_shared);
+    }
+    buffers.allocated     = 0;
+    buffers.frame_copied  = 0;
+    buffers.frame_shared  = 0;
+    buffers.packet_shared = 0;
     hb_unlock(buffers.lock);
 }
 
-static hb_fifo_t *size_to_pool( int size )
+static int size_to_pool_index( int size )
 {
-#if !defined(HB_NO_BUFFER_POOL)
     int i;
     for ( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i )
     {
         if ( size <= (1 << i) )
         {
-            return buffers.pool[i];
+            return i;
         }
     }
+    return -1;
+}
+
+static hb_fifo_t *size_to_pool( int size )
+{
+#if !defined(HB_NO_BUFFER_POOL)
+    int i = size_to_pool_index( size );
+    if ( i >= 0 )
+    {
+        return buffers.pool[i];
+    }
 #endif
     return NULL;
 }
 
+#if !defined(HB_NO_BUFFER_POOL)
+static int magazine_size( int ii )
+{
+    return MIN(BUFFER_MAGAZINE_MAX, BUFFER_MAGAZINE_BYTES >> ii);
+}
+
+static buffer_magazine_t * get_magazine( void )
+{
+    buffer_magazine_t * m;
+
+    if (buffers.magazines == NULL)
+    {
+        return NULL;
+    }
+    m = hb_tls_get(buffers.magazines);
+    if (m == NULL)
+    {
+        m = calloc(sizeof(buffer_magazine_t), 1);
+        hb_tls_set(buffers.magazines, m);
+    }
+    return m;
+}
+
+static void pool_lock( hb_fifo_t * pool, buffer_pool_stats_t * stats )
+{
+    if (!hb_trylock(pool->lock))
+    {
+        stats->contended++;
+        hb_lock(pool->lock);
+    }
+    stats->locks++;
+}
+
+static void pool_push_locked( int ii, hb_buffer_t * b )
+{
+    hb_fifo_t * pool = buffers.pool[ii];
+
+    b->next = pool->first;
+    if (pool->first == NULL)
+    {
+        pool->last = b;
+    }
+    pool->first = b;
+    pool->size++;
+    hb_atomic_add(&buffers.held, pool->buffer_size);
+    if ((int64_t)pool->size * pool->buffer_size > buffers.held_peak[ii])
+    {
+        buffers.held_peak[ii] = (int64_t)pool->size * pool->buffer_size;
+    }
+}
+
+static hb_buffer_t * pool_pop_locked( int ii )
+{
+    hb_fifo_t   * pool = buffers.pool[ii];
+    hb_buffer_t * b    = pool->first;
+
+    if (b != NULL)
+    {
+        pool->first = b->next;
+        if (pool->first == NULL)
+        {
+            pool->last = NULL;
+        }
+        pool->size--;
+        hb_atomic_sub(&buffers.held, pool->buffer_size);
+        b->next = NULL;
+    }
+    return b;
+}
+
+// The shared pools keep at most a quarter of the process memory
+// budget in free buffers, the rest is returned to the system.
+static int pool_has_room( hb_fifo_t * pool )
+{
+    int64_t limit = hb_atomic_load(&process_budget.limit);
+
+    return pool->size < pool->capacity &&
+           (limit <= 0 ||
+            hb_atomic_load(&buffers.held) + pool->buffer_size <= limit / 4);
+}
+
+// Takes a free buffer of pool 'ii' from the calling thread's magazine,
+// refilling the magazine from the shared pool when it is empty.
+static hb_buffer_t * buffer_cache_get( int ii )
+{
+    buffer_magazine_t   * m = get_magazine();
+    buffer_pool_stats_t   shared_stats = {0}, * stats;
+    hb_buffer_t         * b;
+    int                   refill;
+
+    stats = m != NULL ? &m->stats[ii] : &shared_stats;
+    stats->allocs++;
+    if (m != NULL && m->count[ii] > 0)
+    {
+        stats->magazine_hits++;
+        return m->buf[ii][--m->count[ii]];
+    }
+
+    refill = m != NULL ? (magazine_size(ii) + 1) / 2 : 0;
+    pool_lock(buffers.pool[ii], stats);
+    b = pool_pop_locked(ii);
+    while (b != NULL && m != NULL && m->count[ii] < refill &&
+           buffers.pool[ii]->size > 0)
+    {
+        m->buf[ii][m->count[ii]++] = pool_pop_locked(ii);
+    }
+    hb_unlock(buffers.pool[ii]->lock);
+
+    if (b != NULL)
+    {
+        stats->pool_hits++;
+    }
+    return b;
+}
+
+// Returns a free buffer to the calling thread's magazine.  A full
+// magazine first moves half of its buffers to the shared pool.
+// Returns 0 if there is no room anywhere, the caller must free the
+// buffer in that case.
+static int buffer_cache_put( int ii, hb_buffer_t * b )
+{
+    buffer_magazine_t   * m = get_magazine();
+    buffer_pool_stats_t   shared_stats = {0}, * stats;
+    hb_fifo_t           * pool = buffers.pool[ii];
+    int                   size = magazine_size(ii);
+    int                   ret  = 1;
+
+    stats = m != NULL ? &m->stats[ii] : &shared_stats;
+    if (m != NULL && m->count[ii] < size)
+    {
+        m->buf[ii][m->count[ii]++] = b;
+        return 1;
+    }
+
+    pool_lock(pool, stats);
+    while (m != NULL && m->count[ii] > size / 2 &&
+           pool_has_room(pool))
+    {
+        pool_push_locked(ii, m->buf[ii][--m->count[ii]]);
+    }
+    if (m != NULL && m->count[ii] < size)
+    {
+        m->buf[ii][m->count[ii]++] = b;
+    }
+    else if (pool_has_room(pool))
+    {
+        pool_push_locked(ii, b);
+    }
+    else
+    {
+        ret = 0;
+    }
+    hb_unlock(pool->lock);
+
+    return ret;
+}
+
+// Returns all of a thread's cached buffers to the shared pools
+// and folds its statistics into the global statistics.
+static void buffer_magazine_flush( buffer_magazine_t * m )
+{
+    hb_buffer_t * spill = NULL, * b;
+    int           ii;
+
+    for (ii = BUFFER_POOL_FIRST; ii <= BUFFER_POOL_LAST; ii++)
+    {
+        if (m->count[ii] > 0)
+        {
+            hb_fifo_t * pool = buffers.pool[ii];
+
+            pool_lock(pool, &m->stats[ii]);
+            while (m->count[ii] > 0)
+            {
+                b = m->buf[ii][--m->count[ii]];
+                if (pool_has_room(pool))
+                {
+                    pool_push_locked(ii, b);
+                }
+                else
+                {
+                    b->next = spill;
+                    spill   = b;
+                }
+            }
+            hb_unlock(pool->lock);
+        }
+    }
+    while ((b = spill) != NULL)
+    {
+        spill = b->next;
+        buffer_free(b);
+    }
+
+    hb_lock(buffers.lock);
+    for (ii = BUFFER_POOL_FIRST; ii <= BUFFER_POOL_LAST; ii++)
+    {
+        buffers.stats[ii].allocs        += m->stats[ii].allocs;
+        buffers.stats[ii].magazine_hits += m->stats[ii].magazine_hits;
+        buffers.stats[ii].pool_hits     += m->stats[ii].pool_hits;
+        buffers.stats[ii].locks         += m->stats[ii].locks;
+        buffers.stats[ii].contended     += m->stats[ii].contended;
+    }
+    hb_unlock(buffers.lock);
+    memset(m->stats, 0, sizeof(m->stats));
+}
+
+// Called when a thread that used the buffer pools exits
+static void buffer_magazine_free( void * opaque )
+{
+    buffer_magazine_t * m = opaque;
+
+    buffer_magazine_flush(m);
+    free(m);
+}
+#endif
+
+static void buffer_free( hb_buffer_t * b )
+{
+    if( b->data )
+    {
+        av_free(b->data);
+        hb_lock(buffers.lock);
+        buffers.allocated -= b->alloc;
+        hb_unlock(buffers.lock);
+    }
+    free( b );
+}
+
 hb_buffer_t * hb_buffer_init_internal( int size )
 {
     hb_buffer_t * b;
@@ -353,26 +766,22 @@ hb_buffer_t * hb_buffer_init_internal( int size )
     int alloc = size + AV_INPUT_BUFFER_PADDING_SIZE;
     hb_fifo_t *buffer_pool = size_to_pool( alloc );
 
+#if !defined(HB_NO_BUFFER_POOL)
     if( buffer_pool )
     {
-        b = hb_fifo_get( buffer_pool );
+        b = buffer_cache_get( size_to_pool_index( alloc ) );
 
         if( b )
         {
             /*
-             * Zero the contents of the buffer, would be nice if we
-             * didn't have to do this.
+             * Reset the contents of the buffer
              */
             uint8_t *data = b->data;
 
-            memset( b, 0, sizeof(hb_buffer_t) );
-            b->alloc          = buffer_pool->buffer_size;
-            b->size           = size;
-            b->data           = data;
-            b->s.start        = AV_NOPTS_VALUE;
-            b->s.stop         = AV_NOPTS_VALUE;
-            b->s.renderOffset = AV_NOPTS_VALUE;
-            b->s.scr_sequence = -1;
+            *b       = buffer_template;
+            b->alloc = buffer_pool->buffer_size;
+            b->size  = size;
+            b->data  = data;
 
 #if defined(HB_BUFFER_DEBUG)
             hb_lock(buffers.lock);
@@ -382,6 +791,7 @@ hb_buffer_t * hb_buffer_init_internal( int size )
             return( b );
         }
     }
+#endif
 
     /*
      * No existing buffers, create a new one
@@ -435,6 +845,8 @@ hb_buffer_t * hb_buffer_eof_init(void)
     return buf;
 }
 
+static int buffer_is_wrapped( const hb_buffer_t * b );
+
 void hb_buffer_realloc( hb_buffer_t * b, int size )
 {
     if ( size > b->alloc || b->data == NULL )
@@ -452,7 +864,16 @@ void hb_buffer_realloc( hb_buffer_t * b, int size )
         {
             return;
         }
-        if (b->data != NULL)
+        if (buffer_is_wrapped(b))
+        {
+            // Packet data referenced from elsewhere, take a private copy
+            if (b->data != NULL)
+            {
+                memcpy(tmp, b->data, MIN(b->size, size));
+            }
+            av_buffer_unref(&b->storage[0]);
+        }
+        else if (b->data != NULL)
         {
             memcpy(tmp, b->data, b->alloc);
             av_free(b->data);
@@ -480,6 +901,32 @@ void hb_buffer_reduce( hb_buffer_t * b, int size )
     }
 }
 
+void hb_buffer_count_copied( int64_t size )
+{
+    hb_lock(buffers.lock);
+    buffers.frame_copied += size;
+    hb_unlock(buffers.lock);
+}
+
+static int buffer_is_wrapped( const hb_buffer_t * b )
+{
+    return b->storage[0] != NULL;
+}
+
+// Copies the picture planes of src into the planes of dst.
+// Both buffers must have the same format and dimensions.
+static void buffer_copy_planes( hb_buffer_t * dst, const hb_buffer_t * src )
+{
+    int pp, size = 0;
+
+    for (pp = 0; pp <= src->f.max_plane; pp++)
+    {
+        memcpy(dst->plane[pp].data, src->plane[pp].data, src->plane[pp].size);
+        size += src->plane[pp].size;
+    }
+    hb_buffer_count_copied(size);
+}
+
 hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src )
 {
 
@@ -488,14 +935,31 @@ hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src )
     if ( src == NULL )
         return NULL;
 
-    buf = hb_buffer_init( src->size );
-    if ( buf )
+    if (buffer_is_wrapped(src) && src->data == NULL)
     {
-        memcpy( buf->data, src->data, src->size );
-        buf->s = src->s;
-        buf->f = src->f;
-        if ( buf->s.type == FRAME_BUF )
-            hb_buffer_init_planes( buf );
+        buf = hb_frame_buffer_init(src->f.fmt, src->f.width, src->f.height);
+        if (buf != NULL)
+        {
+            buf->s = src->s;
+            buf->f = src->f;
+            hb_buffer_init_planes(buf);
+            buffer_copy_planes(buf, src);
+        }
+    }
+    else
+    {
+        buf = hb_buffer_init( src->size );
+        if ( buf )
+        {
+            memcpy( buf->data, src->data, src->size );
+            buf->s = src->s;
+            buf->f = src->f;
+            if ( buf->s.type == FRAME_BUF )
+            {
+                hb_buffer_init_planes( buf );
+                hb_buffer_count_copied( src->size );
+            }
+        }
     }
 
 #if HB_PROJECT_FEATURE_QSV
@@ -505,56 +969,222 @@ hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src )
     return buf;
 }
 
-int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
+static void buffer_storage_free( void * opaque, uint8_t * data )
 {
-    if (src == NULL || dst == NULL)
-        return -1;
+    hb_buffer_t * owner = opaque;
+    hb_buffer_close(&owner);
+}
 
-    if ( dst->size < src->size )
+// Moves the pool allocated storage of a frame buffer into a reference
+// counted AVBufferRef so that its planes can be shared.  The storage
+// goes back to the buffer pool when the last reference is dropped.
+static int buffer_make_shareable( hb_buffer_t * b )
+{
+    hb_buffer_t * owner;
+
+    if (buffer_is_wrapped(b))
+    {
+        return 0;
+    }
+    if (b->data == NULL || !(owner = calloc(sizeof(hb_buffer_t), 1)))
+    {
         return -1;
+    }
+    owner->data  = b->data;
+    owner->size  = b->size;
+    owner->alloc = b->alloc;
 
-    memcpy( dst->data, src->data, src->size );
-    dst->s = src->s;
-    dst->f = src->f;
-    if (dst->s.type == FRAME_BUF)
-        hb_buffer_init_planes(dst);
+    b->storage[0] = av_buffer_create(owner->data, owner->alloc,
+                                     buffer_storage_free, owner, 0);
+    if (b->storage[0] == NULL)
+    {
+        free(owner);
+        return -1;
+    }
+    b->data  = NULL;
+    b->alloc = 0;
 
     return 0;
 }
 
-void hb_buffer_init_planes(hb_buffer_t * b)
+// Duplicates a frame buffer by sharing its planes with the source rather
+// than copying them.  Both buffers become copy-on-write, so anyone that
+// modifies either picture must call hb_buffer_make_writable() first.
+// Buffers that cannot be shared are copied.
+hb_buffer_t * hb_buffer_shared_dup( hb_buffer_t * src )
 {
-    uint8_t * data = b->data;
-    int       pp;
+    hb_buffer_t * buf;
+    uint8_t     * data[4] = {NULL,};
+    int           pp;
 
-    for( pp = 0; pp <= b->f.max_plane; pp++ )
+    if (src == NULL)
+        return NULL;
+
+    if (src->s.type != FRAME_BUF ||
+#if HB_PROJECT_FEATURE_QSV
+        src->qsv_details.qsv_atom != NULL ||
+#endif
+        buffer_make_shareable(src) < 0)
     {
-        b->plane[pp].data = data;
-        b->plane[pp].stride        = hb_image_stride(b->f.fmt, b->f.width, pp);
-        b->plane[pp].height_stride = hb_image_height_stride(b->f.fmt,
-                                                            b->f.height, pp);
-        b->plane[pp].width         = hb_image_width(b->f.fmt, b->f.width, pp);
-        b->plane[pp].height        = hb_image_height(b->f.fmt, b->f.height, pp);
-        b->plane[pp].size          = b->plane[pp].stride *
-                                     b->plane[pp].height_stride;
-        data                      += b->plane[pp].size;
+        return hb_buffer_dup(src);
+    }
+
+    for (pp = 0; pp <= src->f.max_plane; pp++)
+    {
+        data[pp] = src->plane[pp].data;
     }
+    buf = hb_frame_buffer_wrap(src->f.fmt, src->f.width, src->f.height,
+                               data, src->storage);
+    if (buf != NULL)
+    {
+        buf->s = src->s;
+        buf->f = src->f;
+    }
+
+    return buf;
 }
 
-// this routine gets a buffer for an uncompressed picture
-// with pixel format pix_fmt and dimensions width x height.
-hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int width, int height )
+// Creates a packet buffer for 'size' bytes at 'data' inside the reference
+// counted storage 'ref', e.g. the data of an AVPacket, without copying.
+// The buffer holds a reference of its own.  Like any packet data, 'data'
+// must be followed by AV_INPUT_BUFFER_PADDING_SIZE readable bytes.
+hb_buffer_t * hb_buffer_wrap( uint8_t * data, int size, AVBufferRef * ref )
 {
-    const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(pix_fmt);
-    hb_buffer_t              * buf;
-    uint8_t                    has_plane[4] = {0,};
-    int                        ii, pp, max_plane = 0;
+    hb_buffer_t * buf;
 
-    if (desc == NULL)
+    if (ref == NULL)
     {
         return NULL;
     }
-
+    if (!(buf = calloc(sizeof(hb_buffer_t), 1)))
+    {
+        hb_error("out of memory");
+        return NULL;
+    }
+    buf->storage[0] = av_buffer_ref(ref);
+    if (buf->storage[0] == NULL)
+    {
+        hb_error("out of memory");
+        free(buf);
+        return NULL;
+    }
+    buf->data           = data;
+    buf->size           = size;
+    buf->s.start        = AV_NOPTS_VALUE;
+    buf->s.stop         = AV_NOPTS_VALUE;
+    buf->s.renderOffset = AV_NOPTS_VALUE;
+    buf->s.scr_sequence = -1;
+
+    hb_lock(buffers.lock);
+    buffers.packet_shared += size;
+#if defined(HB_BUFFER_DEBUG)
+    hb_list_add(buffers.alloc_list, buf);
+#endif
+    hb_unlock(buffers.lock);
+
+    return buf;
+}
+
+// Returns a packet buffer for 'size' bytes at 'offset' of packet buffer
+// 'src' that shares src's storage.  The data is copied if the storage
+// cannot be shared.  'src' keeps its data, but must not be modified
+// while the slice is in use.
+hb_buffer_t * hb_buffer_slice( hb_buffer_t * src, int offset, int size )
+{
+    hb_buffer_t * buf;
+    uint8_t     * data = src->data;
+
+    if (data == NULL || offset < 0 || offset + size > src->size)
+    {
+        return NULL;
+    }
+    if (!buffer_is_wrapped(src))
+    {
+        if (buffer_make_shareable(src) < 0)
+        {
+            buf = hb_buffer_init(size);
+            if (buf != NULL)
+            {
+                memcpy(buf->data, data + offset, size);
+                buf->s = src->s;
+            }
+            return buf;
+        }
+        src->data = data;
+    }
+    buf = hb_buffer_wrap(data + offset, size, src->storage[0]);
+    if (buf != NULL)
+    {
+        buf->s = src->s;
+    }
+
+    return buf;
+}
+
+int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
+{
+    if (src == NULL || dst == NULL)
+        return -1;
+
+    if ( dst->size < src->size )
+        return -1;
+
+    if (buffer_is_wrapped(src) || buffer_is_wrapped(dst))
+    {
+        if (hb_buffer_make_writable(dst) < 0)
+            return -1;
+        dst->s = src->s;
+        dst->f = src->f;
+        hb_buffer_init_planes(dst);
+        buffer_copy_planes(dst, src);
+        return 0;
+    }
+
+    memcpy( dst->data, src->data, src->size );
+    dst->s = src->s;
+    dst->f = src->f;
+    if (dst->s.type == FRAME_BUF)
+    {
+        hb_buffer_init_planes(dst);
+        hb_buffer_count_copied(src->size);
+    }
+
+    return 0;
+}
+
+void hb_buffer_init_planes(hb_buffer_t * b)
+{
+    uint8_t * data = b->data;
+    int       pp;
+
+    for( pp = 0; pp <= b->f.max_plane; pp++ )
+    {
+        b->plane[pp].data = data;
+        b->plane[pp].stride        = hb_image_stride(b->f.fmt, b->f.width, pp);
+        b->plane[pp].height_stride = hb_image_height_stride(b->f.fmt,
+                                                            b->f.height, pp);
+        b->plane[pp].width         = hb_image_width(b->f.fmt, b->f.width, pp);
+        b->plane[pp].height        = hb_image_height(b->f.fmt, b->f.height, pp);
+        b->plane[pp].size          = b->plane[pp].stride *
+                                     b->plane[pp].height_stride;
+        data                      += b->plane[pp].size;
+    }
+}
+
+// this routine gets a buffer for an uncompressed picture
+// with pixel format pix_fmt and dimensions width x height.
+hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int width, int height )
+{
+    const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(pix_fmt);
+    hb_buffer_t              * buf;
+    uint8_t                    has_plane[4] = {0,};
+    int                        ii, pp, max_plane = 0;
+
+    if (desc == NULL)
+    {
+        return NULL;
+    }
+
     int size = 0;
     for (ii = 0; ii < desc->nb_components; ii++)
     {
@@ -586,6 +1216,135 @@ hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int width, int height )
     return buf;
 }
 
+// this routine wraps the planes of an uncompressed picture that is
+// owned elsewhere in an hb_buffer_t without copying them.  Each plane
+// must use the hb_image_stride() / hb_image_height_stride() layout.
+// A new reference is taken on every non-NULL entry of 'ref', so the
+// caller keeps ownership of its own references.
+hb_buffer_t * hb_frame_buffer_wrap( int pix_fmt, int width, int height,
+                                    uint8_t * data[4], AVBufferRef * ref[4] )
+{
+    const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(pix_fmt);
+    hb_buffer_t              * buf;
+    int                        ii, pp, max_plane = 0;
+
+    if (desc == NULL || ref[0] == NULL)
+    {
+        return NULL;
+    }
+
+    for (ii = 0; ii < desc->nb_components; ii++)
+    {
+        if (desc->comp[ii].plane > max_plane)
+        {
+            max_plane = desc->comp[ii].plane;
+        }
+    }
+
+    if (!(buf = calloc(sizeof(hb_buffer_t), 1)))
+    {
+        hb_error("out of memory");
+        return NULL;
+    }
+    for (ii = 0; ii < 4; ii++)
+    {
+        if (ref[ii] != NULL)
+        {
+            buf->storage[ii] = av_buffer_ref(ref[ii]);
+            if (buf->storage[ii] == NULL)
+            {
+                hb_error("out of memory");
+                hb_buffer_close(&buf);
+                return NULL;
+            }
+        }
+    }
+
+    buf->s.type         = FRAME_BUF;
+    buf->s.start        = AV_NOPTS_VALUE;
+    buf->s.stop         = AV_NOPTS_VALUE;
+    buf->s.renderOffset = AV_NOPTS_VALUE;
+    buf->s.scr_sequence = -1;
+    buf->f.max_plane    = max_plane;
+    buf->f.width        = width;
+    buf->f.height       = height;
+    buf->f.fmt          = pix_fmt;
+
+    for (pp = 0; pp <= max_plane; pp++)
+    {
+        buf->plane[pp].data          = data[pp];
+        buf->plane[pp].stride        = hb_image_stride(pix_fmt, width, pp);
+        buf->plane[pp].height_stride = hb_image_height_stride(pix_fmt,
+                                                              height, pp);
+        buf->plane[pp].width         = hb_image_width(pix_fmt, width, pp);
+        buf->plane[pp].height        = hb_image_height(pix_fmt, height, pp);
+        buf->plane[pp].size          = buf->plane[pp].stride *
+                                       buf->plane[pp].height_stride;
+        buf->size                   += buf->plane[pp].size;
+    }
+
+    hb_lock(buffers.lock);
+    buffers.frame_shared += buf->size;
+#if defined(HB_BUFFER_DEBUG)
+    hb_list_add(buffers.alloc_list, buf);
+#endif
+    hb_unlock(buffers.lock);
+
+    return buf;
+}
+
+// Returns whether the planes of this buffer may be modified in place.
+// Wrapped buffers are only writable while no one else holds a
+// reference to their storage.
+int hb_buffer_is_writable( const hb_buffer_t * b )
+{
+    int ii;
+
+    for (ii = 0; ii < 4; ii++)
+    {
+        if (b->storage[ii] != NULL && !av_buffer_is_writable(b->storage[ii]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Gives a wrapped buffer private storage from the buffer pool if its
+// planes are shared, so that filters can modify the picture in place.
+// Returns 0 on success, -1 on failure.
+int hb_buffer_make_writable( hb_buffer_t * b )
+{
+    hb_buffer_t * tmp;
+    int           ii;
+
+    if (hb_buffer_is_writable(b))
+    {
+        return 0;
+    }
+
+    tmp = hb_frame_buffer_init(b->f.fmt, b->f.width, b->f.height);
+    if (tmp == NULL)
+    {
+        return -1;
+    }
+    buffer_copy_planes(tmp, b);
+
+    for (ii = 0; ii < 4; ii++)
+    {
+        av_buffer_unref(&b->storage[ii]);
+    }
+    b->data  = tmp->data;
+    b->size  = tmp->size;
+    b->alloc = tmp->alloc;
+    hb_buffer_init_planes(b);
+
+    tmp->data = NULL;
+    hb_buffer_close(&tmp);
+
+    return 0;
+}
+
 void hb_frame_buffer_blank_stride(hb_buffer_t * buf)
 {
     uint8_t * data;
@@ -659,6 +1418,63 @@ void hb_frame_buffer_mirror_stride(hb_buffer_t * buf)
     }
 }
 
+static int frame_stride_filled(const hb_buffer_t * buf)
+{
+    int pp, ii;
+
+    for (pp = 0; pp < 3; pp++)
+    {
+        const uint8_t * src, * dst;
+
+        src = buf->plane[pp].data + (buf->plane[pp].height - 1) *
+              buf->plane[pp].stride;
+        dst = src + buf->plane[pp].stride;
+        for (ii = 0; ii < 3; ii++)
+        {
+            if (memcmp(dst, src, buf->plane[pp].stride))
+            {
+                return 0;
+            }
+            dst += buf->plane[pp].stride;
+        }
+    }
+    return 1;
+}
+
+// Copies the last row of each plane into the 3 rows below it, which the
+// deinterlacers read past the bottom of the picture.  Rows that are
+// already filled are left alone, so a frame that was padded before it
+// was shared does not need a private copy.  Returns 0 on success, -1 if
+// the planes could not be made writable.
+int hb_frame_buffer_fill_stride(hb_buffer_t * buf)
+{
+    int pp, ii;
+
+    if (frame_stride_filled(buf))
+    {
+        return 0;
+    }
+    if (hb_buffer_make_writable(buf) < 0)
+    {
+        return -1;
+    }
+
+    for (pp = 0; pp < 3; pp++)
+    {
+        uint8_t * src, * dst;
+
+        src = buf->plane[pp].data + (buf->plane[pp].height - 1) *
+              buf->plane[pp].stride;
+        dst = src + buf->plane[pp].stride;
+        for (ii = 0; ii < 3; ii++)
+        {
+            memcpy(dst, src, buf->plane[pp].stride);
+            dst += buf->plane[pp].stride;
+        }
+    }
+    return 0;
+}
+
 // this routine reallocs a buffer for an uncompressed YUV420 video frame
 // with dimensions width x height.
 void hb_video_buffer_realloc( hb_buffer_t * buf, int width, int height )
@@ -703,15 +1519,19 @@ void hb_video_buffer_realloc( hb_buffer_t * buf, int width, int height )
 // from src to dst.
 void hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst )
 {
-    uint8_t *data  = dst->data;
-    int      size  = dst->size;
-    int      alloc = dst->alloc;
+    uint8_t     * data  = dst->data;
+    int           size  = dst->size;
+    int           alloc = dst->alloc;
+    AVBufferRef * storage[4];
+
+    memcpy(storage, dst->storage, sizeof(storage));
 
     *dst = *src;
 
     src->data  = data;
     src->size  = size;
     src->alloc = alloc;
+    memcpy(src->storage, storage, sizeof(storage));
 }
 
 // Frees the specified buffer list.
@@ -745,38 +1565,47 @@ void hb_buffer_close( hb_buffer_t ** _b )
 #endif
 
         hb_buffer_t * next = b->next;
-        hb_fifo_t *buffer_pool = size_to_pool( b->alloc );
+        int ii;
 
         b->next = NULL;
 
+        // Drop references to externally owned planes and packet data
+        if (buffer_is_wrapped(b))
+        {
+            for (ii = 0; ii < 4; ii++)
+            {
+                av_buffer_unref(&b->storage[ii]);
+            }
+            b->data  = NULL;
+            b->alloc = 0;
+        }
+
 #if defined(HB_BUFFER_DEBUG)
         hb_lock(buffers.lock);
         hb_list_rem(buffers.alloc_list, b);
         hb_unlock(buffers.lock);
 #endif
-        if( buffer_pool && b->data && !hb_fifo_is_full( buffer_pool ) )
+#if !defined(HB_NO_BUFFER_POOL)
+        int pool_index = size_to_pool_index( b->alloc );
+        if( pool_index >= 0 && b->data )
         {
 #if defined(HB_BUFFER_DEBUG)
-            if (hb_fifo_contains(buffer_pool, b))
+            if (hb_fifo_contains(buffers.pool[pool_index], b))
             {
                 hb_error("hb_buffer_close: buffer %p already freed", b);
                 assert(0);
             }
 #endif
-            hb_fifo_push_head( buffer_pool, b );
-            b = next;
-            continue;
+            if ( buffer_cache_put( pool_index, b ) )
+            {
+                b = next;
+                continue;
+            }
         }
+#endif
         // either the pool is full or this size doesn't use a pool
         // free the buf
-        if( b->data )
-        {
-            av_free(b->data);
-            hb_lock(buffers.lock);
-            buffers.allocated -= b->alloc;
-            hb_unlock(buffers.lock);
-        }
-        free( b );
+        buffer_free( b );
         b = next;
     }
 
@@ -859,12 +1688,13 @@ hb_image_t * hb_buffer_to_image(hb_buffer_t *buf)
     image->format = buf->f.fmt;
     image->width = buf->f.width;
     image->height = buf->f.height;
-    memcpy(image->data, buf->data, buf->size);
 
     int p;
     uint8_t *data = image->data;
     for (p = 0; p <= buf->f.max_plane; p++)
     {
+        // Planes of wrapped buffers need not be contiguous
+        memcpy(data, buf->plane[p].data, buf->plane[p].size);
         image->plane[p].data = data;
         image->plane[p].width = buf->plane[p].width;
         image->plane[p].height = buf->plane[p].height;
@@ -890,6 +1720,162 @@ void hb_image_close(hb_image_t **_image)
     }
 }
 
+hb_memory_budget_t * hb_memory_budget_init( int64_t limit )
+{
+    hb_memory_budget_t * budget = calloc(sizeof(hb_memory_budget_t), 1);
+
+    if (budget == NULL)
+    {
+        hb_error("hb_memory_budget_init: out of memory");
+        return NULL;
+    }
+    budget->limit  = limit;
+    budget->parent = &process_budget;
+    if (limit > 0)
+    {
+        hb_log("memory budget: %"PRId64" KiB", limit / 1024);
+    }
+    return budget;
+}
+
+void hb_memory_budget_close( hb_memory_budget_t ** _budget )
+{
+    hb_memory_budget_t * budget = *_budget;
+
+    if (budget == NULL)
+    {
+        return;
+    }
+    hb_log("memory budget: peak %"PRId64" KiB queued", budget->peak / 1024);
+    if (budget->bytes != 0)
+    {
+        // Give back whatever is still charged, e.g. buffers of fifos
+        // that weren't closed
+        hb_deep_log(2, "memory budget: %"PRId64" bytes still charged",
+                    budget->bytes);
+        hb_atomic_sub(&process_budget.bytes, budget->bytes);
+    }
+    free(budget);
+    *_budget = NULL;
+}
+
+void hb_memory_budget_set_process_limit( int64_t limit )
+{
+    hb_atomic_store(&process_budget.limit, limit > 0 ? limit : 0);
+}
+
+int64_t hb_memory_budget_bytes( hb_memory_budget_t * budget )
+{
+    if (budget == NULL)
+    {
+        return 0;
+    }
+    return hb_atomic_load(&budget->bytes);
+}
+
+// Returns the effective limit, the smaller of the budget's own and its
+// parents' limits
+int64_t hb_memory_budget_limit( hb_memory_budget_t * budget )
+{
+    int64_t limit = 0, l;
+
+    for (; budget != NULL; budget = budget->parent)
+    {
+        l = hb_atomic_load(&budget->limit);
+        if (l > 0 && (limit == 0 || l < limit))
+        {
+            limit = l;
+        }
+    }
+    return limit;
+}
+
+// Number of bytes a buffer keeps alive while it is queued
+static int64_t buffer_footprint( const hb_buffer_t * b )
+{
+    int64_t size = 0;
+    int     pp;
+
+    if (b->data != NULL)
+    {
+        return b->alloc;
+    }
+    // Frames referencing decoder or shared storage
+    for (pp = 0; pp < 4; pp++)
+    {
+        size += b->plane[pp].size;
+    }
+    return size;
+}
+
+static int64_t chain_footprint( const hb_buffer_t * b )
+{
+    int64_t size = 0;
+
+    for (; b != NULL; b = b->next)
+    {
+        size += buffer_footprint(b);
+    }
+    return size;
+}
+
+static void budget_charge( hb_memory_budget_t * budget, int64_t bytes )
+{
+    for (; budget != NULL; budget = budget->parent)
+    {
+        int64_t total = hb_atomic_add(&budget->bytes, bytes);
+        if (total > hb_atomic_load(&budget->peak))
+        {
+            // Only used for statistics, a lost update doesn't matter
+            hb_atomic_store(&budget->peak, total);
+        }
+    }
+}
+
+static void budget_discharge( hb_memory_budget_t * budget, int64_t bytes )
+{
+    for (; budget != NULL; budget = budget->parent)
+    {
+        hb_atomic_sub(&budget->bytes, bytes);
+    }
+}
+
+static int budget_exhausted( hb_memory_budget_t * budget )
+{
+    for (; budget != NULL; budget = budget->parent)
+    {
+        int64_t limit = hb_atomic_load(&budget->limit);
+        if (limit > 0 && hb_atomic_load(&budget->bytes) >= limit)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether a fifo holding 'size' buffers must refuse more
+static int fifo_is_full( hb_fifo_t * f, uint32_t size )
+{
+    return size >= f->capacity ||
+           (size > 0 && f->budget != NULL && budget_exhausted(f->budget));
+}
+
+// How long a producer waits for room before checking again
+static int fifo_full_timeout( hb_fifo_t * f, uint32_t size )
+{
+    return size >= f->capacity ? FIFO_TIMEOUT : BUDGET_TIMEOUT;
+}
+
+// Charges the bytes queued in this fifo to 'budget'.  Must be called
+// before any buffer is pushed.
+void hb_fifo_set_budget( hb_fifo_t * f, hb_memory_budget_t * budget )
+{
+    if (f != NULL)
+    {
+        f->budget = budget;
+    }
+}
+
 hb_fifo_t * hb_fifo_init( int capacity, int thresh )
 {
     hb_fifo_t * f;
@@ -908,6 +1894,288 @@ hb_fifo_t * hb_fifo_init( int capacity, int thresh )
     return f;
 }
 
+// Creates a fifo that may only ever be pushed to by one thread and
+// popped from by one other thread.  Such fifos avoid taking the lock
+// unless one side has to sleep.  hb_fifo_push_head() is not supported.
+hb_fifo_t * hb_fifo_init_spsc( int capacity, int thresh )
+{
+    hb_fifo_t * f = hb_fifo_init(capacity, thresh);
+    uint32_t    ring_size = 16;
+
+    // Leave room for filters that output several buffers at once
+    while (ring_size < 4 * capacity)
+    {
+        ring_size <<= 1;
+    }
+    f->ring = calloc(ring_size, sizeof(hb_buffer_t *));
+    if (f->ring != NULL)
+    {
+        f->ring_mask = ring_size - 1;
+        f->spsc      = 1;
+    }
+    return f;
+}
+
+// Lets the waits of a spsc fifo sleep until they are woken.  'done' and
+// 'die' are the flags that stop the threads using the fifo, whoever sets
+// them must call hb_fifo_wake_all() afterwards.  Must be called before
+// the fifo is used.  Other fifos keep checking back every FIFO_TIMEOUT.
+void hb_fifo_set_done( hb_fifo_t * f, volatile int * done,
+                       volatile int * die )
+{
+    if (f == NULL || !f->spsc || done == NULL || f->done != NULL)
+    {
+        return;
+    }
+    f->done = done;
+    f->die  = die;
+    hb_lock(spsc_fifos.lock);
+    hb_list_add(spsc_fifos.list, f);
+    hb_unlock(spsc_fifos.lock);
+}
+
+// Wakes every thread sleeping on a spsc fifo so that it sees the
+// stop flags that were just set
+void hb_fifo_wake_all( void )
+{
+    hb_fifo_t * f;
+    int         ii;
+
+    hb_lock(spsc_fifos.lock);
+    for (ii = 0; (f = hb_list_item(spsc_fifos.list, ii)) != NULL; ii++)
+    {
+        hb_lock(f->lock);
+        hb_cond_broadcast(f->cond_empty);
+        hb_cond_broadcast(f->cond_full);
+        hb_unlock(f->lock);
+    }
+    hb_unlock(spsc_fifos.lock);
+}
+
+static int fifo_stopped( hb_fifo_t * f )
+{
+    return (f->done != NULL && *f->done) || (f->die != NULL && *f->die);
+}
+
+// Producer side of a spsc fifo, queues a single buffer
+static void spsc_push_one( hb_fifo_t * f, hb_buffer_t * b )
+{
+    uint32_t tail = f->ring_tail;
+
+    if (hb_atomic_load(&f->overflow) == 0 &&
+        tail - hb_atomic_load(&f->ring_head) <= f->ring_mask)
+    {
+        f->ring[tail & f->ring_mask] = b;
+        hb_atomic_store(&f->ring_tail, tail + 1);
+        return;
+    }
+
+    // The ring is full.  Everything in the ring is older than anything
+    // on the overflow list, so keep using the list until it drains.
+    hb_lock(f->lock);
+    if (f->last != NULL)
+    {
+        f->last->next = b;
+    }
+    else
+    {
+        f->first = b;
+    }
+    f->last = b;
+    hb_atomic_add(&f->overflow, 1);
+    hb_unlock(f->lock);
+}
+
+static void spsc_push( hb_fifo_t * f, hb_buffer_t * b )
+{
+    hb_buffer_t * next;
+    uint32_t      count = 0;
+    int64_t       bytes = 0;
+
+    for (next = b; next != NULL; next = next->next)
+    {
+        count++;
+        if (f->budget != NULL)
+        {
+            bytes += buffer_footprint(next);
+        }
+    }
+
+    // Account for the buffers before publishing them so that 'size'
+    // can not underflow when the consumer takes them right away.
+    budget_charge(f->budget, bytes);
+    if (hb_atomic_add(&f->size, count) >= f->capacity &&
+        f->cond_alert_full != NULL)
+    {
+        hb_lock(f->lock);
+        hb_cond_broadcast(f->cond_alert_full);
+        hb_unlock(f->lock);
+    }
+    while (b != NULL)
+    {
+        next    = b->next;
+        b->next = NULL;
+        spsc_push_one(f, b);
+        b = next;
+    }
+
+    hb_atomic_fence();
+    if (hb_atomic_load(&f->wait_empty))
+    {
+        hb_lock(f->lock);
+        hb_atomic_store(&f->wait_empty, 0);
+        hb_cond_signal(f->cond_empty);
+        hb_unlock(f->lock);
+    }
+}
+
+// Consumer side of a spsc fifo, returns the n'th buffer without
+// removing it from the fifo
+static hb_buffer_t * spsc_peek( hb_fifo_t * f, uint32_t n )
+{
+    uint32_t      head = f->ring_head;
+    uint32_t      count;
+    hb_buffer_t * b = NULL;
+
+    count = hb_atomic_load(&f->ring_tail) - head;
+    if (n < count)
+    {
+        return f->ring[(head + n) & f->ring_mask];
+    }
+    if (hb_atomic_load(&f->overflow) == 0)
+    {
+        return NULL;
+    }
+
+    hb_lock(f->lock);
+    // The ring may have grown before the producer switched to the list
+    count = hb_atomic_load(&f->ring_tail) - head;
+    if (n < count)
+    {
+        b = f->ring[(head + n) & f->ring_mask];
+    }
+    else
+    {
+        for (b = f->first, n -= count; b != NULL && n > 0; n--)
+        {
+            b = b->next;
+        }
+    }
+    hb_unlock(f->lock);
+
+    return b;
+}
+
+static hb_buffer_t * spsc_get( hb_fifo_t * f )
+{
+    uint32_t      head = f->ring_head;
+    hb_buffer_t * b    = NULL;
+
+    if (head != hb_atomic_load(&f->ring_tail))
+    {
+        b = f->ring[head & f->ring_mask];
+        hb_atomic_store(&f->ring_head, head + 1);
+    }
+    else if (hb_atomic_load(&f->overflow) > 0)
+    {
+        hb_lock(f->lock);
+        if (head != hb_atomic_load(&f->ring_tail))
+        {
+            b = f->ring[head & f->ring_mask];
+            hb_atomic_store(&f->ring_head, head + 1);
+        }
+        else
+        {
+            b        = f->first;
+            f->first = b->next;
+            if (f->first == NULL)
+            {
+                f->last = NULL;
+            }
+            hb_atomic_sub(&f->overflow, 1);
+        }
+        hb_unlock(f->lock);
+    }
+    if (b == NULL)
+    {
+        return NULL;
+    }
+    b->next = NULL;
+
+    if (f->budget != NULL)
+    {
+        budget_discharge(f->budget, buffer_footprint(b));
+    }
+    if (hb_atomic_sub(&f->size, 1) <= f->capacity - f->thresh)
+    {
+        hb_atomic_fence();
+        if (hb_atomic_load(&f->wait_full))
+        {
+            hb_lock(f->lock);
+            hb_atomic_store(&f->wait_full, 0);
+            hb_cond_signal(f->cond_full);
+            hb_unlock(f->lock);
+        }
+    }
+
+    return b;
+}
+
+// Consumer side of a spsc fifo, sleeps until a buffer is queued or the
+// job is stopped.  Without stop flags, gives up after FIFO_TIMEOUT
+// milliseconds.
+static void spsc_wait_empty( hb_fifo_t * f )
+{
+    hb_lock(f->lock);
+    hb_atomic_store(&f->wait_empty, 1);
+    hb_atomic_fence();
+    if (hb_atomic_load(&f->ring_tail) == f->ring_head &&
+        hb_atomic_load(&f->overflow) == 0 && !fifo_stopped(f))
+    {
+        if (f->done != NULL)
+        {
+            hb_cond_wait(f->cond_empty, f->lock);
+        }
+        else
+        {
+            hb_cond_timedwait(f->cond_empty, f->lock, FIFO_TIMEOUT);
+        }
+    }
+    hb_atomic_store(&f->wait_empty, 0);
+    hb_unlock(f->lock);
+}
+
+// Producer side of a spsc fifo, sleeps until the consumer has made
+// room or the job is stopped.  Without stop flags, gives up after
+// FIFO_TIMEOUT milliseconds.  A fifo that is only full because of the
+// memory budget is not woken by its consumer, it checks back every
+// BUDGET_TIMEOUT milliseconds.
+static void spsc_wait_full( hb_fifo_t * f )
+{
+    uint32_t size;
+
+    hb_lock(f->lock);
+    hb_atomic_store(&f->wait_full, 1);
+    hb_atomic_fence();
+    size = hb_atomic_load(&f->size);
+    if (fifo_is_full(f, size) && !fifo_stopped(f))
+    {
+        if (f->cond_alert_full != NULL)
+            hb_cond_broadcast(f->cond_alert_full);
+        if (size >= f->capacity && f->done != NULL)
+        {
+            hb_cond_wait(f->cond_full, f->lock);
+        }
+        else
+        {
+            hb_cond_timedwait(f->cond_full, f->lock,
+                              fifo_full_timeout(f, size));
+        }
+    }
+    hb_atomic_store(&f->wait_full, 0);
+    hb_unlock(f->lock);
+}
+
 void hb_fifo_register_full_cond( hb_fifo_t * f, hb_cond_t * c )
 {
     f->cond_alert_full = c;
@@ -918,6 +2186,16 @@ int hb_fifo_size_bytes( hb_fifo_t * f )
     int ret = 0;
     hb_buffer_t * link;
 
+    if (f->spsc)
+    {
+        // Only safe to call from the consumer thread
+        uint32_t ii, count = hb_atomic_load(&f->ring_tail) - f->ring_head;
+        for (ii = 0; ii < count; ii++)
+        {
+            ret += f->ring[(f->ring_head + ii) & f->ring_mask]->size;
+        }
+    }
+
     hb_lock( f->lock );
     link = f->first;
     while ( link )
@@ -934,6 +2212,11 @@ int hb_fifo_size( hb_fifo_t * f )
 {
     int ret;
 
+    if (f->spsc)
+    {
+        return hb_atomic_load(&f->size);
+    }
+
     hb_lock( f->lock );
     ret = f->size;
     hb_unlock( f->lock );
@@ -945,8 +2228,13 @@ int hb_fifo_is_full( hb_fifo_t * f )
 {
     int ret;
 
+    if (f->spsc)
+    {
+        return fifo_is_full(f, hb_atomic_load(&f->size));
+    }
+
     hb_lock( f->lock );
-    ret = ( f->size >= f->capacity );
+    ret = fifo_is_full(f, f->size);
     hb_unlock( f->lock );
 
     return ret;
@@ -956,6 +2244,11 @@ float hb_fifo_percent_full( hb_fifo_t * f )
 {
     float ret;
 
+    if (f->spsc)
+    {
+        return hb_atomic_load(&f->size) / f->capacity;
+    }
+
     hb_lock( f->lock );
     ret = f->size / f->capacity;
     hb_unlock( f->lock );
@@ -969,6 +2262,16 @@ hb_buffer_t * hb_fifo_get_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if (f->spsc)
+    {
+        if ((b = spsc_get(f)) == NULL)
+        {
+            spsc_wait_empty(f);
+            b = spsc_get(f);
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -984,7 +2287,12 @@ hb_buffer_t * hb_fifo_get_wait( hb_fifo_t * f )
     f->first  = b->next;
     b->next   = NULL;
     f->size  -= 1;
-    if( f->wait_full && f->size == f->capacity - f->thresh )
+    if (f->budget != NULL)
+    {
+        budget_discharge(f->budget, buffer_footprint(b));
+    }
+    if( f->wait_full && ( f->size == f->capacity - f->thresh ||
+                          f->size == 0 ) )
     {
         f->wait_full = 0;
         hb_cond_signal( f->cond_full );
@@ -999,6 +2307,11 @@ hb_buffer_t * hb_fifo_get( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if (f->spsc)
+    {
+        return spsc_get(f);
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -1009,7 +2322,12 @@ hb_buffer_t * hb_fifo_get( hb_fifo_t * f )
     f->first  = b->next;
     b->next   = NULL;
     f->size  -= 1;
-    if( f->wait_full && f->size == f->capacity - f->thresh )
+    if (f->budget != NULL)
+    {
+        budget_discharge(f->budget, buffer_footprint(b));
+    }
+    if( f->wait_full && ( f->size == f->capacity - f->thresh ||
+                          f->size == 0 ) )
     {
         f->wait_full = 0;
         hb_cond_signal( f->cond_full );
@@ -1023,6 +2341,16 @@ hb_buffer_t * hb_fifo_see_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if (f->spsc)
+    {
+        if ((b = spsc_peek(f, 0)) == NULL)
+        {
+            spsc_wait_empty(f);
+            b = spsc_peek(f, 0);
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -1046,6 +2374,11 @@ hb_buffer_t * hb_fifo_see( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if (f->spsc)
+    {
+        return spsc_peek(f, 0);
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -1062,6 +2395,11 @@ hb_buffer_t * hb_fifo_see2( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if (f->spsc)
+    {
+        return spsc_peek(f, 1);
+    }
+
     hb_lock( f->lock );
     if( f->size < 2 )
     {
@@ -1080,13 +2418,23 @@ int hb_fifo_full_wait( hb_fifo_t * f )
 {
     int result;
 
+    if (f->spsc)
+    {
+        if (fifo_is_full(f, hb_atomic_load(&f->size)))
+        {
+            spsc_wait_full(f);
+        }
+        return !fifo_is_full(f, hb_atomic_load(&f->size));
+    }
+
     hb_lock( f->lock );
-    if( f->size >= f->capacity )
+    if( fifo_is_full( f, f->size ) )
     {
         f->wait_full = 1;
-        hb_cond_timedwait( f->cond_full, f->lock, FIFO_TIMEOUT );
+        hb_cond_timedwait( f->cond_full, f->lock,
+                           fifo_full_timeout( f, f->size ) );
     }
-    result = ( f->size < f->capacity );
+    result = !fifo_is_full( f, f->size );
     hb_unlock( f->lock );
     return result;
 }
@@ -1100,13 +2448,28 @@ void hb_fifo_push_wait( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if (f->spsc)
+    {
+        if (fifo_is_full(f, hb_atomic_load(&f->size)))
+        {
+            spsc_wait_full(f);
+        }
+        spsc_push(f, b);
+        return;
+    }
+
     hb_lock( f->lock );
-    if( f->size >= f->capacity )
+    if( fifo_is_full( f, f->size ) )
     {
         f->wait_full = 1;
         if (f->cond_alert_full != NULL)
             hb_cond_broadcast( f->cond_alert_full );
-        hb_cond_timedwait( f->cond_full, f->lock, FIFO_TIMEOUT );
+        hb_cond_timedwait( f->cond_full, f->lock,
+                           fifo_full_timeout( f, f->size ) );
+    }
+    if (f->budget != NULL)
+    {
+        budget_charge(f->budget, chain_footprint(b));
     }
     if( f->size > 0 )
     {
@@ -1139,6 +2502,16 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if (f->spsc)
+    {
+        spsc_push(f, b);
+        return;
+    }
+
+    if (f->budget != NULL)
+    {
+        budget_charge(f->budget, chain_footprint(b));
+    }
     hb_lock( f->lock );
     if (f->size >= f->capacity &&
         f->cond_alert_full != NULL)
@@ -1179,6 +2552,14 @@ void hb_fifo_push_head( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    // Prepending would race with the producer's lock-free pushes, and
+    // appending instead silently reorders the fifo
+    HB_DEBUG_ASSERT(f->spsc, "hb_fifo_push_head: not supported by spsc fifos");
+
+    if (f->budget != NULL)
+    {
+        budget_charge(f->budget, chain_footprint(b));
+    }
     hb_lock( f->lock );
     if (f->size >= f->capacity &&
         f->cond_alert_full != NULL)
@@ -1219,6 +2600,13 @@ void hb_fifo_close( hb_fifo_t ** _f )
     if ( f == NULL )
         return;
 
+    if (f->done != NULL)
+    {
+        hb_lock(spsc_fifos.lock);
+        hb_list_rem(spsc_fifos.list, f);
+        hb_unlock(spsc_fifos.lock);
+    }
+
     hb_deep_log( 2, "fifo_close: trashing %d buffer(s)", hb_fifo_size( f ) );
     while( ( b = hb_fifo_get( f ) ) )
     {
@@ -1228,6 +2616,7 @@ void hb_fifo_close( hb_fifo_t ** _f )
     hb_lock_close( &f->lock );
     hb_cond_close( &f->cond_empty );
     hb_cond_close( &f->cond_full );
+    free( f->ring );
 
 #if defined(HB_FIFO_DEBUG)
     // Remove the fifo from the global fifo list
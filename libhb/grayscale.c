@@ -9,23 +9,19 @@
 
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
-#include "handbrake/taskset.h"
+#include "handbrake/threadpool.h"
 
 // Settings:
 //  This filter has no settings.
 //  But at some point it might be interesting to add effects other than
 //  just gray.
 
-typedef struct grayscale_arguments_s {
-    hb_buffer_t *src;
-} grayscale_arguments_t;
-
 struct hb_filter_private_s
 {
     int                    cpu_count;
+    int                    depth;
 
-    taskset_t              grayscale_taskset;   // Threads - one per CPU
-    grayscale_arguments_t *grayscale_arguments; // Arguments to thread for work
+    hb_buffer_t          * src;         // Frame being grayed
 };
 
 static int hb_grayscale_init( hb_filter_object_t * filter,
@@ -48,114 +44,71 @@ hb_filter_object_t hb_filter_grayscale =
     .init          = hb_grayscale_init,
     .work          = hb_grayscale_work,
     .close         = hb_grayscale_close,
-    .info          = hb_grayscale_info
+    .info          = hb_grayscale_info,
+    .high_depth    = 1,
 };
 
 
-typedef struct grayscale_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
-} grayscale_thread_arg_t;
-
 /*
- * gray this segment of all three planes in a single thread.
+ * gray this segment of both chroma planes.
  */
-void grayscale_filter_thread( void *thread_args_v )
+static void grayscale_filter_segment( void * opaque, int segment )
 {
-    grayscale_arguments_t *grayscale_work = NULL;
-    hb_filter_private_t * pv;
-    int run = 1;
+    hb_filter_private_t * pv = opaque;
+    hb_buffer_t * src_buf = pv->src;
     int plane;
-    int segment, segment_start, segment_stop;
-    grayscale_thread_arg_t *thread_args = thread_args_v;
-    hb_buffer_t *src_buf;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    int segment_start, segment_stop;
 
-    hb_deep_log(3, "Grayscale thread started for segment %d", segment);
-
-    while( run )
+    for (plane = 1; plane < 3; plane++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->grayscale_taskset, segment );
-
-        if( taskset_thread_stop( &pv->grayscale_taskset, segment ) )
+        int src_stride = src_buf->plane[plane].stride;
+        int height     = src_buf->plane[plane].height;
+        segment_start = (height / pv->cpu_count) * segment;
+        if (segment == pv->cpu_count - 1)
         {
             /*
-             * No more work to do, exit this thread.
+             * Final segment
              */
-            run = 0;
-            goto report_completion;
+            segment_stop = height;
+        } else {
+            segment_stop = (height / pv->cpu_count) * (segment + 1);
         }
 
-        grayscale_work = &pv->grayscale_arguments[segment];
-        if (grayscale_work->src == NULL)
+        if (pv->depth > 8)
         {
-            hb_error( "Thread started when no work available" );
-            hb_snooze(500);
-            goto report_completion;
-        }
+            uint16_t   gray  = 1 << (pv->depth - 1);
+            int        count = (segment_stop - segment_start) * src_stride / 2;
+            uint16_t * dst   = (uint16_t*)&src_buf->plane[plane].data[
+                                                segment_start * src_stride];
+            int        ii;
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        src_buf = grayscale_work->src;
-        for (plane = 1; plane < 3; plane++)
-        {
-            int src_stride = src_buf->plane[plane].stride;
-            int height     = src_buf->plane[plane].height;
-            segment_start = (height / pv->cpu_count) * segment;
-            if (segment == pv->cpu_count - 1)
+            for (ii = 0; ii < count; ii++)
             {
-                /*
-                 * Final segment
-                 */
-                segment_stop = height;
-            } else {
-                segment_stop = (height / pv->cpu_count) * (segment + 1);
+                dst[ii] = gray;
             }
-
+        }
+        else
+        {
             memset(&src_buf->plane[plane].data[segment_start * src_stride],
                    0x80, (segment_stop - segment_start) * src_stride);
         }
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->grayscale_taskset, segment );
     }
 }
 
 
 /*
- * threaded gray - each thread grays a single segment of all
- * three planes. Where a segment is defined as the frame divided by
- * the number of CPUs.
+ * threaded gray - each slice of the thread pool grays a single segment
+ * of the chroma planes. Where a segment is defined as the frame divided
+ * by the number of CPUs.
  *
  * This function blocks until the frame is grayed.
  */
 static void grayscale_filter( hb_filter_private_t * pv,
                               hb_buffer_t         * in )
 {
-
-    int segment;
-
-    for( segment = 0; segment < pv->cpu_count; segment++ )
-    {
-        /*
-         * Setup the work for this plane.
-         */
-        pv->grayscale_arguments[segment].src = in;
-    }
-
-    /*
-     * Allow the taskset threads to make one pass over the data.
-     */
-    taskset_cycle( &pv->grayscale_taskset );
+    pv->src = in;
+    hb_parallel_for(pv->cpu_count, grayscale_filter_segment, pv);
+    pv->src = NULL;
 
     /*
      * Entire frame is now grayed.
@@ -170,38 +123,7 @@ static int hb_grayscale_init( hb_filter_object_t * filter,
     hb_filter_private_t * pv = filter->private_data;
 
     pv->cpu_count = hb_get_cpu_count();
-
-    /*
-     * Create gray taskset.
-     */
-    pv->grayscale_arguments = malloc(sizeof(grayscale_arguments_t) *
-                                     pv->cpu_count);
-    if (pv->grayscale_arguments == NULL ||
-        taskset_init( &pv->grayscale_taskset, pv->cpu_count,
-                      sizeof( grayscale_thread_arg_t ) ) == 0)
-    {
-        hb_error( "grayscale could not initialize taskset" );
-    }
-
-    int ii;
-    for (ii = 0; ii < pv->cpu_count; ii++)
-    {
-        grayscale_thread_arg_t *thread_args;
-
-        thread_args = taskset_thread_args(&pv->grayscale_taskset, ii);
-
-        thread_args->pv = pv;
-        thread_args->segment = ii;
-        pv->grayscale_arguments[ii].src = NULL;
-
-        if (taskset_thread_spawn(&pv->grayscale_taskset, ii,
-                                 "grayscale_filter_segment",
-                                 grayscale_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "grayscale could not spawn thread" );
-        }
-    }
+    pv->depth     = hb_get_bit_depth(init->pix_fmt);
 
     return 0;
 }
@@ -220,13 +142,6 @@ static void hb_grayscale_close( hb_filter_object_t * filter )
         return;
     }
 
-    taskset_fini( &pv->grayscale_taskset );
-
-    /*
-     * free memory for grayscale structs
-     */
-    free( pv->grayscale_arguments );
-
     free( pv );
     filter->private_data = NULL;
 }
@@ -246,6 +161,12 @@ static int hb_grayscale_work( hb_filter_object_t * filter,
     }
 
     // Grayscale!
+    if (hb_buffer_make_writable(in) < 0)
+    {
+        hb_error("grayscale: out of memory");
+        hb_buffer_close(&in);
+        return HB_FILTER_FAILED;
+    }
     grayscale_filter(pv, in);
 
     *buf_out = in;
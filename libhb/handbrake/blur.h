@@ -0,0 +1,67 @@
+/* blur.h
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HANDBRAKE_BLUR_H
+#define HANDBRAKE_BLUR_H
+
+/*
+ * Blur mask shared by unsharp and chroma_smooth.
+ *
+ * The blur runs 2 * steps passes of a 2 tap box filter over each row,
+ * then over each column, i.e. a binomial kernel 2 * steps + 1 pixels
+ * wide.  Edge pixels are repeated.  Each pixel then moves away from
+ * (HB_BLUR_SHARPEN) or towards (HB_BLUR_SMOOTH) its blurred value by
+ * amount / 65536 of the difference and is clamped to [min, max].
+ *
+ * Above 8 bit depth the samples are uint16_t and stride is in bytes.
+ * The sums are then 64 bit wide, which limits steps to
+ * HB_BLUR_STEPS_MAX_16.
+ *
+ * An hb_blur_t holds the scratch rows of one plane width, use one per
+ * thread.
+ */
+#define HB_BLUR_SHARPEN   0
+#define HB_BLUR_SMOOTH    1
+
+#define HB_BLUR_STEPS_MAX    31
+#define HB_BLUR_STEPS_MAX_16 12
+
+typedef struct hb_blur_s hb_blur_t;
+
+struct hb_blur_s
+{
+    int        width;
+    int        depth;
+    int        steps;
+    int        amount;
+    int        mode;
+    int        min;
+    int        max;
+    int        scalebits;
+    int32_t    halfscale;
+
+    uint32_t * SC[2 * HB_BLUR_STEPS_MAX];  // column state of each pass,
+                                           // uint64_t above 8 bit
+    uint32_t * coef;                       // binomial row kernel
+    uint8_t  * line;                       // source row, repeated edges
+    uint32_t * row;                        // row being blurred
+
+    void (*filter)(hb_blur_t *blur, const uint8_t *src, uint8_t *dst,
+                   int width, int height, int stride);
+};
+
+hb_blur_t * hb_blur_init(int width, int depth, int steps, int amount,
+                         int mode);
+void        hb_blur_close(hb_blur_t **blur);
+void        hb_blur_filter(hb_blur_t *blur, const uint8_t *src, uint8_t *dst,
+                           int width, int height, int stride);
+
+void        hb_blur_init_x86(hb_blur_t *blur);
+
+#endif // HANDBRAKE_BLUR_H
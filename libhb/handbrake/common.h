@@ -678,6 +678,11 @@ struct hb_job_s
                                         // added or initial frames dropped.
     int             mp4_optimize;
     int             ipod_atom;
+    int             mp4_fragment;       // fragmented mp4 (CMAF), a fragment
+                                        // starts at every video keyframe
+    int             mp4_segment_length; // seconds, > 0 writes fragments to
+                                        // separate segment files and an
+                                        // HLS playlist
 
     int                     indepth_scan;
     hb_subtitle_config_t    select_subtitle_config;
@@ -698,6 +703,18 @@ struct hb_job_s
     PRIVATE int use_decomb;
     PRIVATE int use_detelecine;
 
+    int64_t         memory_budget;      // limit in bytes of the buffers
+                                        //  queued between pipeline stages,
+                                        //  producers block when it is
+                                        //  exceeded. 0 means unlimited.
+    int             encode_chunks;      // number of consecutive ranges of
+                                        //  the video encoded concurrently
+                                        //  by separate x264/x265 instances.
+                                        //  0 or 1 uses a single instance.
+    PRIVATE int     encode_threads;     // CPUs each chunk encoder instance
+                                        //  may use, 0 lets the encoder
+                                        //  decide.
+
     // QSV-specific settings
     struct
     {
@@ -733,6 +750,8 @@ struct hb_job_s
     hb_fifo_t     * fifo_render;  /* Raw pictures, scaled */
     hb_fifo_t     * fifo_mpeg4;   /* MPEG-4 video ES */
 
+    hb_memory_budget_t * budget;  /* bytes queued in video fifos */
+
     hb_list_t     * list_work;
 
     hb_esconfig_t config;
@@ -883,7 +902,8 @@ struct hb_audio_s
     struct {
         hb_fifo_t * fifo_in;   /* AC3/MPEG/LPCM ES */
         hb_fifo_t * fifo_raw;  /* Raw audio */
-        hb_fifo_t * fifo_sync; /* Resampled, synced raw audio */
+        hb_fifo_t * fifo_sync; /* Synced raw audio */
+        hb_fifo_t * fifo_filter; /* Resampled, gain adjusted raw audio */
         hb_fifo_t * fifo_out;  /* MP3/AAC/Vorbis ES */
 
         hb_esconfig_t config;
@@ -1154,6 +1174,9 @@ struct hb_state_s
             int           seconds;
             uint64_t      paused;
             hb_error_code error;
+            int64_t       bytes_in_flight; // buffered between work objects
+            int64_t       bytes_budget;    // limit of bytes_in_flight, 0 if
+                                           // unlimited
         } working;
 
         struct
@@ -1263,6 +1286,8 @@ extern hb_work_object_t hb_encqsv;
 extern hb_work_object_t hb_encx264;
 extern hb_work_object_t hb_enctheora;
 extern hb_work_object_t hb_encx265;
+extern hb_work_object_t hb_encchunk;
+extern hb_work_object_t hb_audio_filter;
 extern hb_work_object_t hb_decavcodeca;
 extern hb_work_object_t hb_decavcodecv;
 extern hb_work_object_t hb_declpcm;
@@ -1323,6 +1348,9 @@ struct hb_filter_object_s
 
     const char          * settings_template;
 
+    // Filter accepts 10 to 16 bit planar YUV in addition to 8 bit
+    int                   high_depth;
+
     hb_fifo_t           * fifo_in;
     hb_fifo_t           * fifo_out;
 
@@ -1436,6 +1464,7 @@ const char * hb_x265_encopt_name( const char * name );
 int hb_output_color_prim(hb_job_t * job);
 int hb_output_color_transfer(hb_job_t * job);
 int hb_output_color_matrix(hb_job_t * job);
+int64_t hb_job_get_duration(hb_job_t * job);
 
 #define HB_NEG_FLOAT_REG "(([-])?(([0-9]+([.,][0-9]+)?)|([.,][0-9]+))"
 #define HB_FLOAT_REG     "(([0-9]+([.,][0-9]+)?)|([.,][0-9]+))"
@@ -22,4 +22,90 @@
 #define MODE_YADIF_BOB          4
 #define MODE_DEINTERLACE_QSV    8
 
+typedef struct
+{
+    // Yadif of pixels start .. stop - 1 of a line.  The spatial checks
+    // of these pixels must not read past the line, see yadif_filter_line().
+    // eedi2_guess replaces the spatial prediction when not NULL.
+    void (*yadif_filter_line)(uint8_t       *dst,
+                              const uint8_t *prev,
+                              const uint8_t *cur,
+                              const uint8_t *next,
+                              const uint8_t *eedi2_guess,
+                              int            cubic,
+                              int            vertical_edge,
+                              int            width,
+                              int            stride,
+                              int            parity,
+                              int            start,
+                              int            stop);
+    // Cubic interpolation from the lines a, b above and c, d below
+    void (*cubic_interpolate_line)(uint8_t       *dst,
+                                   const uint8_t *a,
+                                   const uint8_t *b,
+                                   const uint8_t *c,
+                                   const uint8_t *d,
+                                   int            width);
+    // 5 tap vertical low pass, rows[2] is the line being filtered
+    void (*blend_filter_line)(uint8_t        *dst,
+                              const uint8_t **rows,
+                              const int      *tap,
+                              int             normalize,
+                              int             width);
+} DecombFunctions;
+
+// Portable kernels, see decomb_c.c
+void decomb_yadif_filter_line_c(uint8_t       *dst,
+                                const uint8_t *prev,
+                                const uint8_t *cur,
+                                const uint8_t *next,
+                                const uint8_t *eedi2_guess,
+                                int            cubic,
+                                int            vertical_edge,
+                                int            width,
+                                int            stride,
+                                int            parity,
+                                int            start,
+                                int            stop);
+void decomb_cubic_interpolate_line_c(uint8_t       *dst,
+                                     const uint8_t *a,
+                                     const uint8_t *b,
+                                     const uint8_t *c,
+                                     const uint8_t *d,
+                                     int            width);
+void decomb_blend_filter_line_c(uint8_t        *dst,
+                                const uint8_t **rows,
+                                const int      *tap,
+                                int             normalize,
+                                int             width);
+
+// 16 bit sample versions for high bit depth frames, they clamp to max.
+// The yadif one does the whole line without EEDI2, its stride is in
+// samples.
+void decomb_yadif_filter_line_16(uint16_t       *dst,
+                                 const uint16_t *prev,
+                                 const uint16_t *cur,
+                                 const uint16_t *next,
+                                 int             cubic,
+                                 int             vertical_edge,
+                                 int             width,
+                                 int             stride,
+                                 int             parity,
+                                 int             pixel_max);
+void decomb_cubic_interpolate_line_16(uint16_t       *dst,
+                                      const uint16_t *a,
+                                      const uint16_t *b,
+                                      const uint16_t *c,
+                                      const uint16_t *d,
+                                      int             width,
+                                      int             max);
+void decomb_blend_filter_line_16(uint16_t        *dst,
+                                 const uint16_t **rows,
+                                 const int       *tap,
+                                 int              normalize,
+                                 int              width,
+                                 int              max);
+
+void decomb_init_x86(DecombFunctions *functions);
+
 #endif // HANDBRAKE_DECOMB_H
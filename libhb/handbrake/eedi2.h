@@ -10,6 +10,10 @@
 #ifndef HANDBRAKE_EEDI2_H
 #define HANDBRAKE_EEDI2_H
 
+// The per-plane stages below that take a band of rows [y_start, y_stop)
+// write only those rows of their destination, so a plane can be split
+// into bands that run concurrently.  Pass 0, height for the whole plane.
+
 // Used to order a sequence of metrics for median filtering
 void eedi2_sort_metrics( int *order, const int length );
 
@@ -30,58 +34,69 @@ void eedi2_upscale_by_2( uint8_t * srcp, uint8_t * dstp, int height, int pitch )
 
 // Finds places where vertically adjacent pixels abruptly change intensity
 void eedi2_build_edge_mask( uint8_t * dstp, int dst_pitch, uint8_t *srcp, int src_pitch,
-                            int mthresh, int lthresh, int vthresh, int height, int width );
+                            int mthresh, int lthresh, int vthresh, int height, int width,
+                            int y_start, int y_stop );
 
 // Expands and smooths out the edge mask by considering a pixel
 // to be masked if >= dilation threshold adjacent pixels are masked.
 void eedi2_dilate_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
-                             int dstr, int height, int width );
+                             int dstr, int height, int width, int y_start, int y_stop );
 
 // Contracts the edge mask by considering a pixel to be masked
 // only if > erosion threshold adjacent pixels are masked
 void eedi2_erode_edge_mask( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
-                            int estr, int height, int width );
+                            int estr, int height, int width, int y_start, int y_stop );
 
 // Smooths out horizontally aligned holes in the mask
 // If none of the 6 horizontally adjacent pixels are masked,
 // don't consider the current pixel masked. If there are any
 // masked on both sides, consider the current pixel masked.
 void eedi2_remove_small_gaps( uint8_t * mskp, int msk_pitch, uint8_t * dstp, int dst_pitch,
-                              int height, int width );
+                              int height, int width, int y_start, int y_stop );
 
 // Spatial vectors. Looks at maximum_search_distance surrounding pixels
 // to guess which angle edges follow. This is EEDI2's timesink, and can be
 // thought of as YADIF_CHECK on steroids. Both find edge directions.
 void eedi2_calc_directions( const int plane, uint8_t * mskp, int msk_pitch, uint8_t * srcp, int src_pitch,
-                            uint8_t * dstp, int dst_pitch, int maxd, int nt, int height, int width  );
+                            uint8_t * dstp, int dst_pitch, int maxd, int nt, int height, int width,
+                            int y_start, int y_stop );
+
+// The direction of one edge pixel found by eedi2_calc_directions,
+// and the vote between the metrics that picks it
+int eedi2_calc_direction( const int plane, uint8_t * mskp, int msk_pitch, uint8_t * srcp, int src_pitch,
+                          int x, int y, int maxd, int nt, int height, int width );
+int eedi2_direction_median( int dira, int dirb, int dirc, int dird, int dire );
 
 void eedi2_filter_map( uint8_t *mskp, int msk_pitch, uint8_t *dmskp, int dmsk_pitch,
-                       uint8_t * dstp, int dst_pitch, int height, int width );
+                       uint8_t * dstp, int dst_pitch, int height, int width, int y_start, int y_stop );
 
 void eedi2_filter_dir_map( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
-                           int dst_pitch, int height, int width );
+                           int dst_pitch, int height, int width, int y_start, int y_stop );
 
 void eedi2_expand_dir_map( uint8_t * mskp, int msk_pitch, uint8_t  *dmskp, int dmsk_pitch, uint8_t * dstp,
-                           int dst_pitch, int height, int width );
+                           int dst_pitch, int height, int width, int y_start, int y_stop );
 
 void eedi2_mark_directions_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
-                               int dst_pitch, int tff, int height, int width );
+                               int dst_pitch, int tff, int height, int width,
+                               int y_start, int y_stop );
 
 void eedi2_filter_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
-                              int dst_pitch, int field, int height, int width );
+                              int dst_pitch, int field, int height, int width,
+                              int y_start, int y_stop );
 
 void eedi2_expand_dir_map_2x( uint8_t * mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
-                              int dst_pitch, int field, int height, int width );
+                              int dst_pitch, int field, int height, int width,
+                              int y_start, int y_stop );
 
 void eedi2_fill_gaps_2x( uint8_t *mskp, int msk_pitch, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
-                         int dst_pitch, int field, int height, int width );
+                         int dst_pitch, int field, int height, int width, int y_start, int y_stop );
 
 void eedi2_interpolate_lattice( const int plane, uint8_t * dmskp, int dmsk_pitch, uint8_t * dstp,
                                 int dst_pitch, uint8_t * omskp, int omsk_pitch, int field, int nt,
                                 int height, int width );
 
 void eedi2_post_process( uint8_t * nmskp, int nmsk_pitch, uint8_t * omskp, int omsk_pitch, uint8_t * dstp,
-                         int src_pitch, int field, int height, int width );
+                         int src_pitch, int field, int height, int width, int y_start, int y_stop );
 
 void eedi2_gaussian_blur1( uint8_t * src, int src_pitch, uint8_t * tmp, int tmp_pitch, uint8_t * dst,
                            int dst_pitch, int height, int width );
@@ -95,4 +110,22 @@ void eedi2_calc_derivatives( uint8_t *srcp, int src_pitch, int height, int width
 void eedi2_post_process_corner( int *x2, int *y2, int *xy, const int pitch, uint8_t * mskp, int msk_pitch,
                                 uint8_t * dstp, int dst_pitch, int height, int width, int field );
 
+// The stages with SIMD versions, the C functions above by default
+typedef struct
+{
+    void (*build_edge_mask)( uint8_t * dstp, int dst_pitch, uint8_t *srcp, int src_pitch,
+                             int mthresh, int lthresh, int vthresh, int height, int width,
+                             int y_start, int y_stop );
+    void (*dilate_edge_mask)( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
+                              int dstr, int height, int width, int y_start, int y_stop );
+    void (*erode_edge_mask)( uint8_t *mskp, int msk_pitch, uint8_t *dstp, int dst_pitch,
+                             int estr, int height, int width, int y_start, int y_stop );
+    void (*calc_directions)( const int plane, uint8_t * mskp, int msk_pitch,
+                             uint8_t * srcp, int src_pitch, uint8_t * dstp, int dst_pitch,
+                             int maxd, int nt, int height, int width,
+                             int y_start, int y_stop );
+} EEDI2Functions;
+
+void eedi2_init_x86( EEDI2Functions * functions );
+
 #endif // HANDBRAKE_EEDI2_H
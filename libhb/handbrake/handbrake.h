@@ -75,6 +75,12 @@ hb_buffer_t * hb_read_preview( hb_handle_t * h, hb_title_t *title,
 
 hb_image_t  * hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
                               hb_geometry_settings_t *geo, int deinterlace);
+/* hb_set_preview_memory()
+   Keeps scan previews and the scaled images returned by hb_get_preview2()
+   in up to 'bytes' of memory, deflated if 'compress' is set.  Previews
+   beyond the budget go to temporary files.  Applies from the next scan. */
+void          hb_set_preview_memory( hb_handle_t * h, int64_t bytes,
+                                     int compress );
 void          hb_set_anamorphic_size2(hb_geometry_t *src_geo,
                                       hb_geometry_settings_t *geo,
                                       hb_geometry_t *result);
@@ -135,6 +141,18 @@ int           hb_global_init_no_hardware(void);
    Performs final cleanup for the process. */
 void          hb_global_close(void);
 
+/* hb_global_set_memory_budget()
+   Limits the bytes of buffers queued between the pipeline stages of all
+   jobs of the process.  Producers wait while the limit is exceeded.
+   0 removes the limit. */
+void          hb_global_set_memory_budget(int64_t bytes);
+
+/* hb_global_set_scan_cache()
+   Keeps the results of decoding previews, identifying audio and
+   detecting crop in directory 'dir' and reuses them when the same
+   unchanged source is scanned again.  NULL disables the cache (default). */
+void          hb_global_set_scan_cache(const char * dir);
+
 /* hb_get_instance_id()
    Return the unique instance id of an libhb instance created by hb_init. */
 int hb_get_instance_id( hb_handle_t * h );
@@ -33,6 +33,7 @@ const char* const* hb_av_preset_get_names(int encoder);
 uint64_t hb_ff_mixdown_xlat(int hb_mixdown, int *downmix_mode);
 void     hb_ff_set_sample_fmt(AVCodecContext *, AVCodec *, enum AVSampleFormat);
 
+int hb_get_bit_depth(int format);
 int hb_sws_get_colorspace(int color_matrix);
 int hb_colr_pri_hb_to_ff(int colr_prim);
 int hb_colr_tra_hb_to_ff(int colr_tra);
@@ -42,6 +42,7 @@ typedef struct hb_filter_object_s  hb_filter_object_t;
 typedef struct hb_buffer_settings_s hb_buffer_settings_t;
 typedef struct hb_image_format_s hb_image_format_t;
 typedef struct hb_fifo_s hb_fifo_t;
+typedef struct hb_memory_budget_s hb_memory_budget_t;
 typedef struct hb_lock_s hb_lock_t;
 
 #endif // HANDBRAKE_TYPES_H
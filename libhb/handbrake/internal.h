@@ -10,6 +10,7 @@
 #ifndef HANDBRAKE_INTERNAL_H
 #define HANDBRAKE_INTERNAL_H
 
+#include "libavutil/buffer.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/pixdesc.h"
 
@@ -151,6 +152,15 @@ struct hb_buffer_s
         int           size;
     } plane[4]; // 3 Color components + alpha
 
+    // Reference counted plane storage that may be shared with other
+    // buffers or owned outside of the buffer pool (e.g. by libavcodec
+    // or libavfilter).  When any of these are set, 'data' is NULL and
+    // the planes point into memory held by these references.
+    // See hb_frame_buffer_wrap() and hb_buffer_shared_dup().
+    // Packet buffers may hold their data in storage[0] as well, 'data'
+    // then points into it.  See hb_buffer_wrap() and hb_buffer_slice().
+    AVBufferRef * storage[4];
+
 #if HB_PROJECT_FEATURE_QSV
     struct qsv
     {
@@ -176,14 +186,23 @@ void hb_buffer_pool_free( void );
 hb_buffer_t * hb_buffer_init( int size );
 hb_buffer_t * hb_buffer_eof_init( void );
 hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int w, int h);
+hb_buffer_t * hb_frame_buffer_wrap( int pix_fmt, int w, int h,
+                                    uint8_t * data[4], AVBufferRef * ref[4] );
+int           hb_buffer_is_writable( const hb_buffer_t * b );
+int           hb_buffer_make_writable( hb_buffer_t * b );
+void          hb_buffer_count_copied( int64_t size );
 void          hb_frame_buffer_blank_stride(hb_buffer_t * buf);
 void          hb_frame_buffer_mirror_stride(hb_buffer_t * buf);
+int           hb_frame_buffer_fill_stride(hb_buffer_t * buf);
 void          hb_buffer_init_planes( hb_buffer_t * b );
 void          hb_buffer_realloc( hb_buffer_t *, int size );
 void          hb_video_buffer_realloc( hb_buffer_t * b, int w, int h );
 void          hb_buffer_reduce( hb_buffer_t * b, int size );
 void          hb_buffer_close( hb_buffer_t ** );
 hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src );
+hb_buffer_t * hb_buffer_shared_dup( hb_buffer_t * src );
+hb_buffer_t * hb_buffer_wrap( uint8_t * data, int size, AVBufferRef * ref );
+hb_buffer_t * hb_buffer_slice( hb_buffer_t * src, int offset, int size );
 int           hb_buffer_copy( hb_buffer_t * dst, const hb_buffer_t * src );
 void          hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst );
 hb_image_t  * hb_image_init(int pix_fmt, int width, int height);
@@ -193,6 +212,7 @@ int           hb_picture_crop(uint8_t *data[], int stride[], hb_buffer_t *b,
                               int top, int left);
 
 hb_fifo_t   * hb_fifo_init( int capacity, int thresh );
+hb_fifo_t   * hb_fifo_init_spsc( int capacity, int thresh );
 void          hb_fifo_register_full_cond( hb_fifo_t * f, hb_cond_t * c );
 int           hb_fifo_size( hb_fifo_t * );
 int           hb_fifo_size_bytes( hb_fifo_t * );
@@ -209,6 +229,16 @@ int           hb_fifo_full_wait( hb_fifo_t * f );
 void          hb_fifo_push_head( hb_fifo_t *, hb_buffer_t * );
 void          hb_fifo_close( hb_fifo_t ** );
 void          hb_fifo_flush( hb_fifo_t * f );
+void          hb_fifo_set_budget( hb_fifo_t * f, hb_memory_budget_t * budget );
+void          hb_fifo_set_done( hb_fifo_t * f, volatile int * done,
+                                volatile int * die );
+void          hb_fifo_wake_all( void );
+
+hb_memory_budget_t * hb_memory_budget_init( int64_t limit );
+void          hb_memory_budget_close( hb_memory_budget_t ** );
+void          hb_memory_budget_set_process_limit( int64_t limit );
+int64_t       hb_memory_budget_bytes( hb_memory_budget_t * budget );
+int64_t       hb_memory_budget_limit( hb_memory_budget_t * budget );
 
 static inline int hb_image_stride( int pix_fmt, int width, int plane )
 {
@@ -268,6 +298,49 @@ static inline hb_buffer_t * hb_video_buffer_init( int width, int height )
     return hb_frame_buffer_init( AV_PIX_FMT_YUV420P, width, height );
 }
 
+/***********************************************************************
+ * scancache.c
+ **********************************************************************/
+typedef struct hb_scan_cache_s hb_scan_cache_t;
+
+void              hb_scan_cache_set_directory( const char * dir );
+hb_scan_cache_t * hb_scan_cache_open( const char * path, int preview_count );
+void              hb_scan_cache_close( hb_scan_cache_t ** cache );
+int               hb_scan_cache_get( hb_scan_cache_t * cache,
+                                     hb_title_t * title );
+void              hb_scan_cache_put( hb_scan_cache_t * cache,
+                                     hb_title_t * title, int npreviews );
+
+/***********************************************************************
+ * previewstore.c
+ **********************************************************************/
+#define HB_PREVIEW_MEMORY_DEFAULT (256 * 1024 * 1024)
+
+typedef struct hb_preview_store_s hb_preview_store_t;
+
+hb_preview_store_t * hb_preview_store_init( int64_t budget, int compress );
+void                 hb_preview_store_close( hb_preview_store_t ** store );
+void                 hb_preview_store_configure( hb_preview_store_t * store,
+                                                 int64_t budget, int compress );
+void                 hb_preview_store_clear( hb_preview_store_t * store );
+int                  hb_preview_store_put( hb_preview_store_t * store,
+                                           int title, int preview,
+                                           hb_buffer_t * buf );
+hb_buffer_t        * hb_preview_store_get( hb_preview_store_t * store,
+                                           int title, int preview,
+                                           int width, int height );
+hb_image_t         * hb_preview_store_get_image( hb_preview_store_t * store,
+                                                 int title, int preview,
+                                                 int width, int height,
+                                                 const int crop[4],
+                                                 int deinterlace );
+void                 hb_preview_store_put_image( hb_preview_store_t * store,
+                                                 int title, int preview,
+                                                 int width, int height,
+                                                 const int crop[4],
+                                                 int deinterlace,
+                                                 const hb_image_t * image );
+
 /***********************************************************************
  * Threads: scan.c, work.c, reader.c, muxcommon.c
  **********************************************************************/
@@ -286,6 +359,11 @@ hb_work_object_t * hb_audio_encoder( hb_handle_t *, int );
 hb_work_object_t * hb_video_decoder( hb_handle_t *, int, int );
 hb_work_object_t * hb_video_encoder( hb_handle_t *, int );
 
+/***********************************************************************
+ * audio_filter.c
+ **********************************************************************/
+int hb_audio_filter_needed( hb_audio_t * audio );
+
 /***********************************************************************
  * sync.c
  **********************************************************************/
@@ -342,6 +420,7 @@ void         hb_dvd_set_angle( hb_dvd_t * d, int angle );
 int          hb_dvd_main_feature( hb_dvd_t * d, hb_list_t * list_title );
 
 hb_bd_t     * hb_bd_init( hb_handle_t *h, const char * path );
+hb_bd_t     * hb_bd_dup( hb_bd_t * src );
 int           hb_bd_title_count( hb_bd_t * d );
 hb_title_t  * hb_bd_title_scan( hb_bd_t * d, int t, uint64_t min_duration );
 int           hb_bd_start( hb_bd_t * d, hb_title_t *title );
@@ -457,7 +536,9 @@ enum
     WORK_ENCAVCODEC_AUDIO,
     WORK_MUX,
     WORK_READER,
-    WORK_DECPGSSUB
+    WORK_DECPGSSUB,
+    WORK_ENCCHUNK,
+    WORK_AUDIO_FILTER
 };
 
 extern hb_filter_object_t hb_filter_detelecine;
@@ -513,7 +594,7 @@ DECLARE_MUX( mkv );
 DECLARE_MUX( webm );
 DECLARE_MUX( avformat );
 
-void hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src);
+int hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src);
 
 struct hb_chapter_queue_item_s
 {
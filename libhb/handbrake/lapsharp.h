@@ -0,0 +1,35 @@
+/* lapsharp.h
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HANDBRAKE_LAPSHARP_H
+#define HANDBRAKE_LAPSHARP_H
+
+#define LAPSHARP_KERNELS 4
+
+typedef struct {
+    const int   *mem;
+    const int    size;
+    const double coef;
+} lapsharp_kernel_t;
+
+typedef struct
+{
+    // Sharpens src[0] .. src[n - 1] of a row that has all neighbors the
+    // kernel reads, one function per kernel
+    void (*filter_row[LAPSHARP_KERNELS])(const uint8_t           *src,
+                                               uint8_t           *dst,
+                                               int                stride,
+                                               int                n,
+                                         const lapsharp_kernel_t *kernel,
+                                               double             strength);
+} LapsharpFunctions;
+
+void lapsharp_init_x86(LapsharpFunctions *functions);
+
+#endif // HANDBRAKE_LAPSHARP_H
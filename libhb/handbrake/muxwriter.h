@@ -0,0 +1,35 @@
+/* muxwriter.h
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HANDBRAKE_MUXWRITER_H
+#define HANDBRAKE_MUXWRITER_H
+
+#include "handbrake/hbffmpeg.h"
+
+/*
+ * Write-behind output for the muxer.
+ *
+ * hb_mux_writer_init() opens 'path' and returns an AVIOContext for
+ * libavformat.  Data written to it is collected in large blocks that a
+ * writer thread of its own puts on disk, so the muxer, and every encoder
+ * waiting on the muxer's lock, only waits for slow storage once the
+ * bounded queue of blocks is full.  Write errors are reported through
+ * the AVIOContext like those of avio_open2().
+ *
+ * hb_mux_writer_sync() waits for all queued data to be on disk and makes
+ * every later write complete before it returns.  Call it before anything
+ * reopens the file, e.g. before the mp4 muxer's faststart pass.
+ */
+typedef struct hb_mux_writer_s hb_mux_writer_t;
+
+hb_mux_writer_t * hb_mux_writer_init( const char * path, AVIOContext ** pb );
+void              hb_mux_writer_sync( hb_mux_writer_t * writer );
+int               hb_mux_writer_close( hb_mux_writer_t ** writer );
+
+#endif /* HANDBRAKE_MUXWRITER_H */
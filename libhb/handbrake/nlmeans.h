@@ -11,6 +11,12 @@
 #ifndef HANDBRAKE_NLMEANS_H
 #define HANDBRAKE_NLMEANS_H
 
+struct PixelSum
+{
+    float weight_sum;
+    float pixel_sum;
+};
+
 typedef struct
 {
     void (*build_integral)(uint32_t *integral,
@@ -25,8 +31,39 @@ typedef struct
                            int       dst_h,
                            int       dx,
                            int       dy);
+    void (*accumulate_weights)(struct PixelSum *tmp_data,
+                         const uint8_t         *compare,
+                         const uint32_t        *integral_ptr1,
+                         const uint32_t        *integral_ptr2,
+                               int              n,
+                               int              count,
+                         const float           *exptable,
+                         const float            weight_fact_table,
+                         const int              diff_max);
 } NLMeansFunctions;
 
+void nlmeans_build_integral_scalar(uint32_t *integral,
+                                   int       integral_stride,
+                             const uint8_t  *src,
+                             const uint8_t  *src_pre,
+                             const uint8_t  *compare,
+                             const uint8_t  *compare_pre,
+                                   int       w,
+                                   int       border,
+                                   int       dst_w,
+                                   int       dst_h,
+                                   int       dx,
+                                   int       dy);
+void nlmeans_accumulate_weights_scalar(struct PixelSum *tmp_data,
+                                 const uint8_t         *compare,
+                                 const uint32_t        *integral_ptr1,
+                                 const uint32_t        *integral_ptr2,
+                                       int              n,
+                                       int              count,
+                                 const float           *exptable,
+                                 const float            weight_fact_table,
+                                 const int              diff_max);
+
 void nlmeans_init_x86(NLMeansFunctions *functions);
 
 #endif // HANDBRAKE_NLMEANS_H
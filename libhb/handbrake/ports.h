@@ -114,6 +114,7 @@ struct dirent * hb_readdir(HB_DIR *dir);
 int hb_mkdir(char * name);
 int hb_stat(const char *path, hb_stat_t *sb);
 FILE * hb_fopen(const char *path, const char *mode);
+int hb_ftruncate(FILE *file, int64_t size);
 char * hb_strr_dir_sep(const char *path);
 
 /************************************************************************
@@ -187,8 +188,28 @@ void          hb_yield(void);
 hb_lock_t * hb_lock_init();
 void        hb_lock_close( hb_lock_t ** );
 void        hb_lock( hb_lock_t * );
+int         hb_trylock( hb_lock_t * );
 void        hb_unlock( hb_lock_t * );
 
+/************************************************************************
+ * Thread local storage
+ ***********************************************************************/
+typedef struct hb_tls_s hb_tls_t;
+
+hb_tls_t  * hb_tls_init( void (*destructor)(void *) );
+void        hb_tls_close( hb_tls_t ** );
+void      * hb_tls_get( hb_tls_t * );
+void        hb_tls_set( hb_tls_t *, void * );
+
+/************************************************************************
+ * Atomics
+ ***********************************************************************/
+#define hb_atomic_load(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define hb_atomic_store(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define hb_atomic_add(p, v)     __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define hb_atomic_sub(p, v)     __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define hb_atomic_fence()       __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 /************************************************************************
  * Condition variables
  ***********************************************************************/
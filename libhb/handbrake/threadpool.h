@@ -0,0 +1,48 @@
+/* threadpool.h
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HANDBRAKE_THREADPOOL_H
+#define HANDBRAKE_THREADPOOL_H
+
+/*
+ * Process wide pool of worker threads shared by all filters.
+ *
+ * hb_parallel_for() splits a unit of work into 'count' independent
+ * slices (row bands, planes, ...) and returns once every slice has been
+ * processed.  The calling thread works on its own slices too, and idle
+ * workers take slices from whichever caller has some left, so several
+ * filter threads can share the pool without any of them owning threads.
+ * Calls may be nested.
+ */
+typedef void hb_parallel_func_t( void * opaque, int index );
+
+int  hb_thread_pool_init( int thread_count );
+void hb_thread_pool_close( void );
+
+void hb_parallel_for( int count, hb_parallel_func_t * func, void * opaque );
+
+/*
+ * Runs func once on each pool thread, with the thread's number as index,
+ * and returns when all of them have run it.  Threads that are busy run it
+ * after their current slices.  Used to release per-thread state, since
+ * pool threads outlive the jobs that use them.
+ */
+void hb_thread_pool_broadcast( hb_parallel_func_t * func, void * opaque );
+
+/*
+ * Runs a chain of row band filters without a barrier between them.
+ * Band k of stages[s] starts as soon as stages[s - 1] has finished bands
+ * k - 1, k and k + 1, so each stage may read one band above and below the
+ * one it writes.  Bands must therefore be at least as tall as the rows a
+ * stage reads beyond its own band.
+ */
+void hb_parallel_pipeline( int stage_count, hb_parallel_func_t ** stages,
+                           int band_count, void * opaque );
+
+#endif /* HANDBRAKE_THREADPOOL_H */
@@ -10,6 +10,7 @@
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
 #include "handbrake/encx264.h"
+#include "handbrake/threadpool.h"
 #include "libavfilter/avfilter.h"
 #include <stdio.h>
 #include <unistd.h>
@@ -40,6 +41,9 @@ struct hb_handle_s
     hb_title_set_t title_set;
     hb_thread_t  * scan_thread;
 
+    /* Scan previews, kept in memory up to the configured budget */
+    hb_preview_store_t * preview_store;
+
     /* The thread which processes the jobs. Others threads are launched
        from this one (see work.c) */
     int            sequence_id;
@@ -219,6 +223,8 @@ hb_handle_t * hb_init( int verbose )
 
     h->interjob = calloc( sizeof( hb_interjob_t ), 1 );
 
+    h->preview_store = hb_preview_store_init( HB_PREVIEW_MEMORY_DEFAULT, 0 );
+
     /* Start library thread */
     hb_log( "hb_init: starting libhb thread" );
     h->die         = 0;
@@ -315,6 +321,8 @@ void hb_remove_previews( hb_handle_t * h )
     DIR           * dir;
     struct dirent * entry;
 
+    hb_preview_store_clear( h->preview_store );
+
     dirname = hb_get_temporary_directory();
     dir = opendir( dirname );
     if (dir == NULL)
@@ -464,6 +472,12 @@ int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
     char * filename;
     char   reason[80];
 
+    if (hb_preview_store_put(h->preview_store, title, preview, buf) == 0)
+    {
+        return 0;
+    }
+
+    // Over the memory budget, spill to a temporary file
     filename = hb_get_temporary_filename("%d_%d_%d", hb_get_instance_id(h),
                                          title, preview );
 
@@ -519,6 +533,14 @@ hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
     char * filename;
     char   reason[80];
 
+    hb_buffer_t * buf;
+    buf = hb_preview_store_get(h->preview_store, title->index, preview,
+                               title->geometry.width, title->geometry.height);
+    if (buf != NULL)
+    {
+        return buf;
+    }
+
     filename = hb_get_temporary_filename("%d_%d_%d", hb_get_instance_id(h),
                                          title->index, preview);
 
@@ -534,7 +556,6 @@ hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
         return NULL;
     }
 
-    hb_buffer_t * buf;
     buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
                                title->geometry.width, title->geometry.height);
 
@@ -585,6 +606,7 @@ hb_image_t* hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
     uint8_t            * preview_data[4], * crop_data[4];
     int                  preview_stride[4], crop_stride[4];
     struct SwsContext  * context;
+    hb_image_t         * image;
 
     int width = geo->geometry.width *
                 geo->geometry.par.num / geo->geometry.par.den;
@@ -599,6 +621,14 @@ hb_image_t* hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
     height = MIN(MAX(height * width  / ww, HB_MIN_HEIGHT), HB_MAX_HEIGHT);
     width  = MIN(MAX(width  * height / hh, HB_MIN_WIDTH),  HB_MAX_WIDTH);
 
+    // Scrubbing through previews asks for the same images again and again
+    image = hb_preview_store_get_image(h->preview_store, title_idx, picture,
+                                       width, height, geo->crop, deinterlace);
+    if (image != NULL)
+    {
+        return image;
+    }
+
     swsflags = SWS_LANCZOS | SWS_ACCURATE_RND;
 
     preview_buf = hb_frame_buffer_init(AV_PIX_FMT_RGB32, width, height);
@@ -627,7 +657,10 @@ hb_image_t* hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
         // Deinterlace and crop
         deint_buf = hb_frame_buffer_init( AV_PIX_FMT_YUV420P,
                               title->geometry.width, title->geometry.height );
-        hb_deinterlace(deint_buf, in_buf);
+        if (hb_deinterlace(deint_buf, in_buf) < 0)
+        {
+            goto fail;
+        }
         hb_picture_crop(crop_data, crop_stride, deint_buf,
                         geo->crop[0], geo->crop[2] );
     }
@@ -661,7 +694,13 @@ hb_image_t* hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
     // Free context
     sws_freeContext( context );
 
-    hb_image_t *image = hb_buffer_to_image(preview_buf);
+    image = hb_buffer_to_image(preview_buf);
+    if (image != NULL)
+    {
+        hb_preview_store_put_image(h->preview_store, title_idx, picture,
+                                   width, height, geo->crop, deinterlace,
+                                   image);
+    }
 
     // Clean up
     hb_buffer_close( &in_buf );
@@ -680,6 +719,18 @@ fail:
     return image;
 }
 
+/**
+ * Sets how much memory the previews of a scan may use.  Previews that
+ * do not fit are written to temporary files.
+ * @param h Handle to hb_handle_t
+ * @param bytes Memory budget, 0 keeps all previews in files.
+ * @param compress Deflate previews kept in memory.
+ */
+void hb_set_preview_memory( hb_handle_t * h, int64_t bytes, int compress )
+{
+    hb_preview_store_configure( h->preview_store, bytes, compress );
+}
+
  /**
  * Analyzes a frame to detect interlacing artifacts
  * and returns true if interlacing (combing) is found.
@@ -1590,6 +1641,7 @@ void hb_stop( hb_handle_t * h )
 {
     h->work_error = HB_ERROR_CANCELED;
     h->work_die   = 1;
+    hb_fifo_wake_all();
     hb_resume( h );
 }
 
@@ -1658,6 +1710,8 @@ void hb_close( hb_handle_t ** _h )
 
     free( h->interjob );
 
+    hb_preview_store_close( &h->preview_store );
+
     free( h );
     *_h = NULL;
 }
@@ -1729,6 +1783,8 @@ int hb_global_init()
 #if HB_PROJECT_FEATURE_X265
     hb_register(&hb_encx265);
 #endif
+    hb_register(&hb_encchunk);
+    hb_register(&hb_audio_filter);
 #if HB_PROJECT_FEATURE_QSV
     if (!disable_hardware)
     {
@@ -1744,12 +1800,35 @@ int hb_global_init()
      */
     hb_buffer_pool_init();
 
+    /*
+     * Initialise the worker threads shared by the filters
+     */
+    hb_thread_pool_init(hb_get_cpu_count());
+
     // Initialize the builtin presets hb_dict_t
     hb_presets_builtin_init();
 
     return result;
 }
 
+/**
+ * Limits the memory queued between pipeline stages of all jobs.
+ * @param bytes Limit in bytes, 0 for unlimited.
+ */
+void hb_global_set_memory_budget(int64_t bytes)
+{
+    hb_memory_budget_set_process_limit(bytes);
+}
+
+/**
+ * Sets the directory of the persistent scan cache.
+ * @param dir Cache directory, NULL to disable the cache.
+ */
+void hb_global_set_scan_cache(const char * dir)
+{
+    hb_scan_cache_set_directory(dir);
+}
+
 /**
  * Cleans up libhb at a process level. Call before the app closes. Removes preview directory.
  */
@@ -1760,6 +1839,8 @@ void hb_global_close()
     struct dirent * entry;
 
     hb_presets_free();
+    hb_thread_pool_close();
+    hb_scan_cache_set_directory(NULL);
 
     /* Find and remove temp folder */
     dirname = hb_get_temporary_directory();
@@ -78,7 +78,7 @@ hb_dict_t* hb_state_to_dict( hb_state_t * state)
     case HB_STATE_SEARCHING:
         dict = json_pack_ex(&error, 0,
             "{s:o, s{s:o, s:o, s:o, s:o, s:o, s:o,"
-                   " s:o, s:o, s:o, s:o, s:o, s:o}}",
+                   " s:o, s:o, s:o, s:o, s:o, s:o, s:o, s:o}}",
             "State", hb_value_string(state_s),
             "Working",
                 "Progress",     hb_value_double(state->param.working.progress),
@@ -92,6 +92,8 @@ hb_dict_t* hb_state_to_dict( hb_state_t * state)
                 "Minutes",      hb_value_int(state->param.working.minutes),
                 "Paused",       hb_value_int(state->param.working.paused),
                 "Seconds",      hb_value_int(state->param.working.seconds),
+                "BytesInFlight", hb_value_int(state->param.working.bytes_in_flight),
+                "BytesBudget",  hb_value_int(state->param.working.bytes_budget),
                 "SequenceID",   hb_value_int(state->sequence_id));
         break;
     case HB_STATE_WORKDONE:
@@ -598,6 +600,10 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
         hb_error("json pack failure: %s", error.text);
         return NULL;
     }
+    if (job->memory_budget > 0)
+    {
+        hb_dict_set(dict, "MemoryBudget", hb_value_int(job->memory_budget));
+    }
     hb_dict_t *dest_dict = hb_dict_get(dict, "Destination");
     if (job->file != NULL)
     {
@@ -606,9 +612,11 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
     if (job->mux & HB_MUX_MASK_MP4)
     {
         hb_dict_t *mp4_dict;
-        mp4_dict = json_pack_ex(&error, 0, "{s:o, s:o}",
+        mp4_dict = json_pack_ex(&error, 0, "{s:o, s:o, s:o, s:o}",
             "Mp4Optimize",      hb_value_bool(job->mp4_optimize),
-            "IpodAtom",         hb_value_bool(job->ipod_atom));
+            "IpodAtom",         hb_value_bool(job->ipod_atom),
+            "Fragmented",       hb_value_bool(job->mp4_fragment),
+            "SegmentLength",    hb_value_int(job->mp4_segment_length));
         hb_dict_set(dest_dict, "Mp4Options", mp4_dict);
     }
     hb_dict_t *source_dict = hb_dict_get(dict, "Source");
@@ -720,6 +728,11 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
         hb_dict_set(video_dict, "Options",
                     hb_value_string(job->encoder_options));
     }
+    if (job->encode_chunks > 1)
+    {
+        hb_dict_set(video_dict, "EncodeChunks",
+                    hb_value_int(job->encode_chunks));
+    }
     hb_dict_t *meta_dict = hb_dict_get(dict, "Metadata");
     if (job->metadata->name != NULL)
     {
@@ -1046,8 +1059,9 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
     "s:i,"
     // Destination {File, Mux, InlineParameterSets, AlignAVStart,
     //              ChapterMarkers, ChapterList,
-    //              Mp4Options {Mp4Optimize, IpodAtom}}
-    "s:{s?s, s:o, s?b, s?b, s:b, s?o s?{s?b, s?b}},"
+    //              Mp4Options {Mp4Optimize, IpodAtom, Fragmented,
+    //                          SegmentLength}}
+    "s:{s?s, s:o, s?b, s?b, s:b, s?o s?{s?b, s?b, s?b, s?i}},"
     // Source {Angle, Range {Type, Start, End, SeekPoints}}
     "s:{s?i, s?{s:s, s?I, s?I, s?I}},"
     // PAR {Num, Den}
@@ -1085,6 +1099,8 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
             "Mp4Options",
                 "Mp4Optimize",      unpack_b(&job->mp4_optimize),
                 "IpodAtom",         unpack_b(&job->ipod_atom),
+                "Fragmented",       unpack_b(&job->mp4_fragment),
+                "SegmentLength",    unpack_i(&job->mp4_segment_length),
         "Source",
             "Angle",                unpack_i(&job->angle),
             "Range",
@@ -1150,6 +1166,19 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
     // Make sure QSV Decode is only True if the hardware is available.
     job->qsv.decode = job->qsv.decode && hb_qsv_available();
 
+    hb_value_t *memory_budget = hb_dict_get(dict, "MemoryBudget");
+    if (memory_budget != NULL)
+    {
+        job->memory_budget = hb_value_get_int(memory_budget);
+    }
+
+    hb_value_t *encode_chunks = hb_dict_get(hb_dict_get(dict, "Video"),
+                                            "EncodeChunks");
+    if (encode_chunks != NULL)
+    {
+        job->encode_chunks = hb_value_get_int(encode_chunks);
+    }
+
     // Lookup mux id
     if (hb_value_type(mux) == HB_VALUE_TYPE_STRING)
     {
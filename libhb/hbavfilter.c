@@ -224,8 +224,31 @@ int hb_avfilter_add_buf(hb_avfilter_graph_t * graph, hb_buffer_t * in)
 {
     if (in != NULL)
     {
+        int ii, ret;
+
         hb_video_buffer_to_avframe(graph->frame, in);
-        return av_buffersrc_add_frame(graph->input, graph->frame);
+
+        // Pass wrapped planes by reference, libavfilter copies anything
+        // that is not reference counted.
+        for (ii = 0; ii < 4 && in->storage[ii] != NULL; ii++)
+        {
+            graph->frame->buf[ii] = av_buffer_ref(in->storage[ii]);
+            if (graph->frame->buf[ii] == NULL)
+            {
+                while (ii-- > 0)
+                {
+                    av_buffer_unref(&graph->frame->buf[ii]);
+                }
+                break;
+            }
+        }
+        if (graph->frame->buf[0] == NULL)
+        {
+            hb_buffer_count_copied(in->size);
+        }
+        ret = av_buffersrc_add_frame(graph->input, graph->frame);
+        av_frame_unref(graph->frame);
+        return ret;
     }
     else
     {
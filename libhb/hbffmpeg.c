@@ -84,10 +84,97 @@ void hb_avframe_set_video_buffer_flags(hb_buffer_t * buf, AVFrame *frame,
     buf->f.color_range    = frame->color_range;
 }
 
+// Returns the reference that holds the memory at 'data', or NULL
+// if the frame does not own it.
+static AVBufferRef * frame_plane_ref(AVFrame *frame, uint8_t *data)
+{
+    int ii;
+
+    for (ii = 0; ii < AV_NUM_DATA_POINTERS && frame->buf[ii] != NULL; ii++)
+    {
+        AVBufferRef * ref = frame->buf[ii];
+        if (data >= ref->data && data < ref->data + ref->size)
+        {
+            return ref;
+        }
+    }
+    return NULL;
+}
+
+// Wraps the planes of a reference counted AVFrame in an hb_buffer_t.
+// This is only possible when every plane already has the stride and
+// padding that our filters expect.  Returns NULL when the frame has
+// to be copied instead.
+static hb_buffer_t * wrap_frame(AVFrame *frame)
+{
+    const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(frame->format);
+    AVBufferRef              * ref[4] = {NULL,};
+    uint8_t                  * data[4] = {NULL,};
+    int                        ii, pp, max_plane = 0;
+
+    if (desc == NULL || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) ||
+        frame->buf[0] == NULL || frame->nb_extended_buf > 0)
+    {
+        return NULL;
+    }
+
+    for (ii = 0; ii < desc->nb_components; ii++)
+    {
+        if (desc->comp[ii].plane > max_plane)
+        {
+            max_plane = desc->comp[ii].plane;
+        }
+    }
+
+    for (pp = 0; pp <= max_plane; pp++)
+    {
+        int stride = hb_image_stride(frame->format, frame->width, pp);
+        int size   = stride * hb_image_height_stride(frame->format,
+                                                     frame->height, pp);
+        AVBufferRef * plane_ref = frame_plane_ref(frame, frame->data[pp]);
+
+        if (plane_ref == NULL || frame->linesize[pp] != stride ||
+            frame->data[pp] + size > plane_ref->data + plane_ref->size)
+        {
+            return NULL;
+        }
+        // Filters write into the padding below each plane,
+        // so it must not overlap the planes that follow
+        for (ii = 0; ii < pp; ii++)
+        {
+            if (frame->data[pp] < data[ii] + frame->linesize[ii] *
+                    hb_image_height_stride(frame->format, frame->height, ii) &&
+                data[ii] < frame->data[pp] + size)
+            {
+                return NULL;
+            }
+        }
+        data[pp] = frame->data[pp];
+
+        // Planes frequently share a single allocation,
+        // only hold one reference to each.
+        for (ii = 0; ii < 4 && ref[ii] != NULL && ref[ii] != plane_ref; ii++);
+        if (ii < 4)
+        {
+            ref[ii] = plane_ref;
+        }
+    }
+
+    return hb_frame_buffer_wrap(frame->format, frame->width, frame->height,
+                                data, ref);
+}
+
 hb_buffer_t * hb_avframe_to_video_buffer(AVFrame *frame, AVRational time_base)
 {
     hb_buffer_t * buf;
 
+    buf = wrap_frame(frame);
+    if (buf != NULL)
+    {
+        hb_avframe_set_video_buffer_flags(buf, frame, time_base);
+        return buf;
+    }
+
     buf = hb_frame_buffer_init(frame->format, frame->width, frame->height);
     if (buf == NULL)
     {
@@ -114,6 +201,7 @@ hb_buffer_t * hb_avframe_to_video_buffer(AVFrame *frame, AVRational time_base)
             src += linesize;
         }
     }
+    hb_buffer_count_copied(buf->size);
 
     return buf;
 }
@@ -174,6 +262,17 @@ hb_sws_get_context(int srcW, int srcH, enum AVPixelFormat srcFormat,
     return ctx;
 }
 
+int hb_get_bit_depth(int format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+
+    if (desc == NULL)
+    {
+        return 8;
+    }
+    return desc->comp[0].depth;
+}
+
 int hb_sws_get_colorspace(int color_matrix)
 {
     int color_space = SWS_CS_DEFAULT;
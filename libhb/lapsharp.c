@@ -8,11 +8,12 @@
  */
 
 #include "handbrake/handbrake.h"
+#include "handbrake/threadpool.h"
+#include "handbrake/lapsharp.h"
 
 #define LAPSHARP_STRENGTH_LUMA_DEFAULT   0.2
 #define LAPSHARP_STRENGTH_CHROMA_DEFAULT 0.2
 
-#define LAPSHARP_KERNELS 4
 #define LAPSHARP_KERNEL_LUMA_DEFAULT   2
 #define LAPSHARP_KERNEL_CHROMA_DEFAULT 2
 
@@ -22,12 +23,6 @@ typedef struct
     int    kernel;    // which kernel to use; kernels[kernel]
 } lapsharp_plane_context_t;
 
-typedef struct {
-    const int   *mem;
-    const int    size;
-    const double coef;
-} kernel_t;
-
 // 4-neighbor Laplacian kernel (lap)
 // Sharpens vertical and horizontal edges, less effective on diagonals
 // size = 3, coef = 1.0
@@ -74,7 +69,7 @@ static const int    kernel_isolog[] =
  0, -1, -1, -1,  0
 };
 
-static kernel_t kernels[] =
+static const lapsharp_kernel_t kernels[] =
 {
     { kernel_lap,    3, 1.0      },
     { kernel_isolap, 3, 1.0 /  5 },
@@ -85,6 +80,8 @@ static kernel_t kernels[] =
 struct hb_filter_private_s
 {
     lapsharp_plane_context_t plane_ctx[3];
+    LapsharpFunctions        functions;
+    int                      band_count;
 
     hb_filter_init_t         input;
     hb_filter_init_t         output;
@@ -116,44 +113,127 @@ hb_filter_object_t hb_filter_lapsharp =
     .settings_template = hb_lapsharp_template,
 };
 
-static void hb_lapsharp(const uint8_t *src,
-                              uint8_t *dst,
-                        const int width,
-                        const int height,
-                        const int stride,
-                        lapsharp_plane_context_t * ctx)
+// Frame being sharpened.  Frames are sharpened concurrently when the
+// filter runs under mt_frame, so this lives on the stack of the caller.
+typedef struct
+{
+    hb_filter_private_t * pv;
+    hb_buffer_t         * in;
+    hb_buffer_t         * out;
+} lapsharp_frame_t;
+
+static inline uint8_t lapsharp_apply(int pixel, int src, double coef,
+                                     double strength)
+{
+    pixel = (int16_t)(((pixel * coef) - src) * strength) + src;
+    pixel = pixel < 0 ? 0 : pixel;
+    pixel = pixel > 255 ? 255 : pixel;
+    return pixel;
+}
+
+static inline void lapsharp_row(const uint8_t *src,
+                                      uint8_t *dst,
+                                const int      stride,
+                                const int      n,
+                                const lapsharp_kernel_t *kernel,
+                                const int      size,
+                                const double   strength)
 {
-    const kernel_t *kernel = &kernels[ctx->kernel];
-
-    // Sharpen using selected kernel
-    const int offset_min    = -((kernel->size - 1) / 2);
-    const int offset_max    =   (kernel->size + 1) / 2;
-    const int stride_border =   (stride - width) / 2;
-    int16_t   pixel;
-    for (int y = 0; y < height; y++)
+    const int offset = (size - 1) / 2;
+
+    for (int x = 0; x < n; x++)
     {
-        for (int x = 0; x < width; x++)
+        int16_t pixel = 0;
+        for (int j = -offset; j <= offset; j++)
         {
-            if ((y < offset_max) ||
-                (y > height - offset_max) ||
-                (x < stride_border + offset_max) ||
-                (x > width + stride_border - offset_max))
+            for (int k = -offset; k <= offset; k++)
             {
-                *(dst + stride*y + x) = *(src + stride*y + x);
-                continue;
+                pixel += kernel->mem[(j + offset) * size + k + offset] *
+                         *(src + stride*j + x + k);
             }
-            pixel = 0;
-            for (int k = offset_min; k < offset_max; k++)
+        }
+        dst[x] = lapsharp_apply(pixel, src[x], kernel->coef, strength);
+    }
+}
+
+// The kernel size is a constant, so the compiler can unroll the kernel
+static void lapsharp_row3_c(const uint8_t *src, uint8_t *dst, int stride,
+                            int n, const lapsharp_kernel_t *kernel,
+                            double strength)
+{
+    lapsharp_row(src, dst, stride, n, kernel, 3, strength);
+}
+
+static void lapsharp_row5_c(const uint8_t *src, uint8_t *dst, int stride,
+                            int n, const lapsharp_kernel_t *kernel,
+                            double strength)
+{
+    lapsharp_row(src, dst, stride, n, kernel, 5, strength);
+}
+
+// isolap is 41 times the center pixel minus the separable (1 4 1) x (1 4 1)
+// kernel, the column sums are shared by three neighboring pixels
+static void lapsharp_row_isolap_c(const uint8_t *src, uint8_t *dst,
+                                  int stride, int n,
+                                  const lapsharp_kernel_t *kernel,
+                                  double strength)
+{
+    const uint8_t *above = src - stride, *below = src + stride;
+    int left  = above[-1] + 4 * src[-1] + below[-1];
+    int mid   = above[0]  + 4 * src[0]  + below[0];
+    int right;
+
+    for (int x = 0; x < n; x++)
+    {
+        right  = above[x + 1] + 4 * src[x + 1] + below[x + 1];
+        dst[x] = lapsharp_apply(41 * src[x] - (left + 4 * mid + right),
+                                src[x], kernel->coef, strength);
+        left   = mid;
+        mid    = right;
+    }
+}
+
+/*
+ * Sharpens a band of rows of each plane.  Pixels closer to the edges than
+ * the kernel reaches are copied.
+ */
+static void lapsharp_filter_band(void *opaque, int band)
+{
+    lapsharp_frame_t    *frame = opaque;
+    hb_filter_private_t *pv    = frame->pv;
+
+    for (int c = 0; c < 3; c++)
+    {
+        lapsharp_plane_context_t *ctx    = &pv->plane_ctx[c];
+        const lapsharp_kernel_t  *kernel = &kernels[ctx->kernel];
+        const uint8_t *src    = frame->in->plane[c].data;
+        uint8_t       *dst    = frame->out->plane[c].data;
+        const int      width  = frame->in->plane[c].width;
+        const int      height = frame->in->plane[c].height;
+        const int      stride = frame->in->plane[c].stride;
+
+        const int offset_max    = (kernel->size + 1) / 2;
+        const int stride_border = (stride - width) / 2;
+        const int x0 = stride_border + offset_max;
+        const int x1 = MIN(width - 1, width + stride_border - offset_max) + 1;
+        const int y0 = height * band / pv->band_count;
+        const int y1 = height * (band + 1) / pv->band_count;
+
+        for (int y = y0; y < y1; y++)
+        {
+            const uint8_t *s = src + stride*y;
+            uint8_t       *d = dst + stride*y;
+
+            if ((y < offset_max) || (y > height - offset_max) || (x0 >= x1))
             {
-                for (int j = offset_min; j < offset_max; j++)
-                {
-                    pixel += kernel->mem[((j - offset_min) * kernel->size) + k - offset_min] * *(src + stride*(y + j) + (x + k));
-                }
+                memcpy(d, s, width);
+                continue;
             }
-            pixel = (int16_t)(((pixel * kernel->coef) - *(src + stride*y + x)) * ctx->strength) + *(src + stride*y + x);
-            pixel = pixel < 0 ? 0 : pixel;
-            pixel = pixel > 255 ? 255 : pixel;
-            *(dst + stride*y + x) = (uint8_t)(pixel);
+            memcpy(d, s, x0);
+            pv->functions.filter_row[ctx->kernel](s + x0, d + x0, stride,
+                                                  x1 - x0, kernel,
+                                                  ctx->strength);
+            memcpy(d + x1, s + x1, width - x1);
         }
     }
 }
@@ -257,6 +337,15 @@ static int hb_lapsharp_init(hb_filter_object_t *filter,
             ctx->kernel = c ? LAPSHARP_KERNEL_CHROMA_DEFAULT : LAPSHARP_KERNEL_LUMA_DEFAULT;
         }
     }
+    pv->functions.filter_row[0] = lapsharp_row3_c;
+    pv->functions.filter_row[1] = lapsharp_row_isolap_c;
+    pv->functions.filter_row[2] = lapsharp_row5_c;
+    pv->functions.filter_row[3] = lapsharp_row5_c;
+#if defined(ARCH_X86)
+    lapsharp_init_x86(&pv->functions);
+#endif
+    pv->band_count = hb_get_cpu_count();
+
     pv->output = *init;
 
     return 0;
@@ -289,6 +378,11 @@ static int hb_lapsharp_work(hb_filter_object_t *filter,
         return HB_FILTER_DONE;
     }
 
+    if (hb_buffer_make_writable(in) < 0)
+    {
+        hb_error("lapsharp: out of memory");
+        return HB_FILTER_FAILED;
+    }
     hb_frame_buffer_mirror_stride(in);
     out = hb_frame_buffer_init(pv->output.pix_fmt, in->f.width, in->f.height);
     out->f.color_prim     = pv->output.color_prim;
@@ -296,17 +390,8 @@ static int hb_lapsharp_work(hb_filter_object_t *filter,
     out->f.color_matrix   = pv->output.color_matrix;
     out->f.color_range    = pv->output.color_range ;
 
-    int c;
-    for (c = 0; c < 3; c++)
-    {
-        lapsharp_plane_context_t * ctx = &pv->plane_ctx[c];
-        hb_lapsharp(in->plane[c].data,
-                    out->plane[c].data,
-                    in->plane[c].width,
-                    in->plane[c].height,
-                    in->plane[c].stride,
-                    ctx);
-    }
+    lapsharp_frame_t frame = { pv, in, out };
+    hb_parallel_for(pv->band_count, lapsharp_filter_band, &frame);
 
     out->s = in->s;
     *buf_out = out;
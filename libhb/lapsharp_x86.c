@@ -0,0 +1,152 @@
+/* lapsharp_x86.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include "libavutil/cpu.h"
+#include "handbrake/lapsharp.h"
+
+// The kernels are compiled for AVX2 only and are selected at runtime,
+// the rest of libhb keeps its baseline flags
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_LAPSHARP_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(HAVE_LAPSHARP_AVX2)
+
+#define LAPSHARP_MAX_TAPS 25
+
+/*
+ * (int16_t)(((pixel * coef) - src) * strength) + src for 4 pixels, in
+ * double precision like the C code so the results are the same
+ */
+TARGET_AVX2
+static inline __m128i apply4_avx2(__m128i pixel, __m128i src,
+                                  __m256d coef, __m256d strength)
+{
+    __m256d d = _mm256_mul_pd(_mm256_cvtepi32_pd(pixel), coef);
+
+    d = _mm256_sub_pd(d, _mm256_cvtepi32_pd(src));
+    d = _mm256_mul_pd(d, strength);
+
+    return _mm_add_epi32(_mm256_cvttpd_epi32(d), src);
+}
+
+TARGET_AVX2
+static void lapsharp_row_avx2(const uint8_t           *src,
+                                    uint8_t           *dst,
+                                    int                stride,
+                                    int                n,
+                              const lapsharp_kernel_t *kernel,
+                                    double             strength)
+{
+    const int     offset = (kernel->size - 1) / 2;
+    const __m256d coef   = _mm256_set1_pd(kernel->coef);
+    const __m256d str    = _mm256_set1_pd(strength);
+    int           tap_offset[LAPSHARP_MAX_TAPS];
+    __m256i       tap_coef[LAPSHARP_MAX_TAPS];
+    int           taps = 0, x, ii;
+
+    // Skip the zeros of the kernel
+    for (int j = -offset; j <= offset; j++)
+    {
+        for (int k = -offset; k <= offset; k++)
+        {
+            int c = kernel->mem[(j + offset) * kernel->size + k + offset];
+            if (c != 0)
+            {
+                tap_offset[taps] = stride * j + k;
+                tap_coef[taps]   = _mm256_set1_epi16(c);
+                taps++;
+            }
+        }
+    }
+
+    for (x = 0; x < n; x += 16)
+    {
+        // The last pixels are done by a block ending at the last pixel
+        if (x + 16 > n)
+        {
+            if (n < 16)
+            {
+                break;
+            }
+            x = n - 16;
+        }
+
+        // Sums fit 16 bits for all kernels
+        __m256i sum = _mm256_setzero_si256();
+        for (ii = 0; ii < taps; ii++)
+        {
+            __m256i p = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *)(src + x + tap_offset[ii])));
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(p, tap_coef[ii]));
+        }
+
+        __m128i s8   = _mm_loadu_si128((const __m128i *)(src + x));
+        __m256i s_lo = _mm256_cvtepu8_epi32(s8);
+        __m256i s_hi = _mm256_cvtepu8_epi32(_mm_srli_si128(s8, 8));
+        __m256i p_lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(sum));
+        __m256i p_hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(sum, 1));
+
+        __m128i r0 = apply4_avx2(_mm256_castsi256_si128(p_lo),
+                                 _mm256_castsi256_si128(s_lo), coef, str);
+        __m128i r1 = apply4_avx2(_mm256_extracti128_si256(p_lo, 1),
+                                 _mm256_extracti128_si256(s_lo, 1), coef, str);
+        __m128i r2 = apply4_avx2(_mm256_castsi256_si128(p_hi),
+                                 _mm256_castsi256_si128(s_hi), coef, str);
+        __m128i r3 = apply4_avx2(_mm256_extracti128_si256(p_hi, 1),
+                                 _mm256_extracti128_si256(s_hi, 1), coef, str);
+
+        // Clamp to 0 .. 255
+        _mm_storeu_si128((__m128i *)(dst + x),
+                         _mm_packus_epi16(_mm_packs_epi32(r0, r1),
+                                          _mm_packs_epi32(r2, r3)));
+    }
+
+    // Rows too short for a block
+    for (; x < n; x++)
+    {
+        int16_t pixel = 0;
+        for (ii = 0; ii < taps; ii++)
+        {
+            pixel += (int16_t)_mm256_extract_epi16(tap_coef[ii], 0) *
+                     src[x + tap_offset[ii]];
+        }
+        pixel = (int16_t)(((pixel * kernel->coef) - src[x]) * strength) +
+                src[x];
+        pixel = pixel < 0 ? 0 : pixel;
+        pixel = pixel > 255 ? 255 : pixel;
+        dst[x] = pixel;
+    }
+}
+
+#endif // HAVE_LAPSHARP_AVX2
+
+void lapsharp_init_x86(LapsharpFunctions *functions)
+{
+#if defined(HAVE_LAPSHARP_AVX2)
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        for (int ii = 0; ii < LAPSHARP_KERNELS; ii++)
+        {
+            functions->filter_row[ii] = lapsharp_row_avx2;
+        }
+        hb_log("Lapsharp using AVX2 optimizations");
+    }
+#endif
+}
+
+#endif // ARCH_X86
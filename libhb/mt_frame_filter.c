@@ -13,23 +13,15 @@
  * from one frame to the next. */
 
 #include "handbrake/handbrake.h"
-#include "handbrake/taskset.h"
-
-typedef struct
-{
-    hb_filter_private_t *pv;
-    int segment;
-    hb_buffer_t *out;
-} mt_frame_thread_arg_t;
+#include "handbrake/threadpool.h"
 
 struct hb_filter_private_s
 {
     hb_filter_object_t     * sub_filter;
     hb_buffer_t           ** buf;
+    hb_buffer_t           ** out;
     int                      frame_count;
-    taskset_t                taskset;
     int                      thread_count;
-    mt_frame_thread_arg_t ** thread_data;
 };
 
 static int mt_frame_init(hb_filter_object_t *filter, hb_filter_init_t *init);
@@ -38,7 +30,7 @@ static int mt_frame_work(hb_filter_object_t *filter,
                          hb_buffer_t **buf_out);
 static void mt_frame_close(hb_filter_object_t *filter);
 
-static void mt_frame_filter_thread(void *thread_args_v);
+static void mt_frame_filter_segment(void *opaque, int segment);
 
 static const char mt_frame_template[] = "";
 
@@ -65,33 +57,13 @@ static int mt_frame_init(hb_filter_object_t * filter,
 
     pv->thread_count = hb_get_cpu_count();
     pv->buf = calloc(pv->thread_count, sizeof(hb_buffer_t*));
-
-    pv->thread_data = malloc(pv->thread_count * sizeof(mt_frame_thread_arg_t*));
-    if (taskset_init(&pv->taskset, pv->thread_count,
-                     sizeof(mt_frame_thread_arg_t)) == 0)
+    pv->out = calloc(pv->thread_count, sizeof(hb_buffer_t*));
+    if (pv->buf == NULL || pv->out == NULL)
     {
-        hb_error("MTFrame could not initialize taskset");
+        hb_error("MTFrame could not allocate frame lists");
         goto fail;
     }
 
-    for (int ii = 0; ii < pv->thread_count; ii++)
-    {
-        pv->thread_data[ii] = taskset_thread_args(&pv->taskset, ii);
-        if (pv->thread_data[ii] == NULL)
-        {
-            hb_error("MTFrame could not create thread args");
-            goto fail;
-        }
-        pv->thread_data[ii]->pv = pv;
-        pv->thread_data[ii]->segment = ii;
-        if (taskset_thread_spawn(&pv->taskset, ii, "mt_frame_filter",
-                             mt_frame_filter_thread, HB_NORMAL_PRIORITY) == 0)
-        {
-            hb_error("MTFrame could not spawn thread");
-            goto fail;
-        }
-    }
-
     if (pv->sub_filter->init_thread != NULL)
     {
         if (pv->sub_filter->init_thread(pv->sub_filter, pv->thread_count) < 0)
@@ -103,8 +75,8 @@ static int mt_frame_init(hb_filter_object_t * filter,
     return 0;
 
 fail:
-    taskset_fini(&pv->taskset);
-    free(pv->thread_data);
+    free(pv->buf);
+    free(pv->out);
     free(pv);
     return -1;
 }
@@ -119,50 +91,31 @@ static void mt_frame_close(hb_filter_object_t *filter)
     }
 
     pv->sub_filter->close(pv->sub_filter);
-    taskset_fini(&pv->taskset);
-    free(pv->thread_data);
     free(pv->buf);
+    free(pv->out);
     free(pv);
     filter->private_data = NULL;
 }
 
-static void mt_frame_filter_thread(void *thread_args_v)
+static void mt_frame_filter_segment(void *opaque, int segment)
 {
-    mt_frame_thread_arg_t *thread_data = thread_args_v;
-    hb_filter_private_t *pv = thread_data->pv;
-    int segment = thread_data->segment;
-
-    hb_log("MTFrame thread started for segment %d", segment);
+    hb_filter_private_t *pv = opaque;
 
-    while (1)
+    if (pv->sub_filter->work_thread != NULL)
     {
-        // Wait until there is work to do.
-        taskset_thread_wait4start(&pv->taskset, segment);
-
-        if (taskset_thread_stop(&pv->taskset, segment))
-        {
-            break;
-        }
-
-        if (pv->sub_filter->work_thread != NULL)
-        {
-            pv->sub_filter->work_thread(pv->sub_filter,
-                                 &pv->buf[segment], &thread_data->out, segment);
-        }
-        else
-        {
-            pv->sub_filter->work(pv->sub_filter,
-                                 &pv->buf[segment], &thread_data->out);
-        }
-        if (pv->buf[segment] != NULL)
-        {
-            hb_buffer_close(&pv->buf[segment]);
-        }
-
-        // Finished this segment, notify.
-        taskset_thread_complete(&pv->taskset, segment);
+        pv->sub_filter->work_thread(pv->sub_filter,
+                                    &pv->buf[segment], &pv->out[segment],
+                                    segment);
+    }
+    else
+    {
+        pv->sub_filter->work(pv->sub_filter,
+                             &pv->buf[segment], &pv->out[segment]);
+    }
+    if (pv->buf[segment] != NULL)
+    {
+        hb_buffer_close(&pv->buf[segment]);
     }
-    taskset_thread_complete(&pv->taskset, segment);
 }
 
 static hb_buffer_t * mt_frame_filter(hb_filter_private_t *pv)
@@ -172,15 +125,16 @@ static hb_buffer_t * mt_frame_filter(hb_filter_private_t *pv)
         return NULL;
     }
 
-    taskset_cycle(&pv->taskset);
+    hb_parallel_for(pv->thread_count, mt_frame_filter_segment, pv);
     pv->frame_count = 0;
 
-    // Collect results from taskset
+    // Collect results from the thread pool
     hb_buffer_list_t list;
     hb_buffer_list_clear(&list);
     for (int t = 0; t < pv->thread_count; t++)
     {
-        hb_buffer_list_append(&list, pv->thread_data[t]->out);
+        hb_buffer_list_append(&list, pv->out[t]);
+        pv->out[t] = NULL;
     }
     return hb_buffer_list_clear(&list);
 }
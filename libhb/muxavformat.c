@@ -16,6 +16,7 @@
 #include "handbrake/ssautil.h"
 #include "handbrake/lang.h"
 #include "handbrake/hbffmpeg.h"
+#include "handbrake/muxwriter.h"
 
 struct hb_mux_data_s
 {
@@ -47,6 +48,19 @@ struct hb_mux_object_s
 
     AVFormatContext   * oc;
     AVRational          time_base;
+    hb_mux_writer_t   * writer;
+    int                 moov_reserved;  // mp4 moov space after the ftyp
+
+    // Fragmented mp4
+    int                 fragment;
+    int                 fragment_frames;  // video frames in current fragment
+    hb_list_t         * fragment_queue;   // packets not yet given to
+                                          // libavformat, in muxing order
+    int64_t             segment_length;   // 90KHz ticks, 0 for a single file
+    int64_t             segment_start;    // start of the current segment
+    char              * segment_stem;     // output path without extension
+    double            * segment_durations;
+    int                 segment_count;    // segments completed
 
     int                 ntracks;
     hb_mux_data_t    ** tracks;
@@ -117,6 +131,565 @@ static char* lookup_lang_code(int mux, char *iso639_2)
  **********************************************************************
  * Allocates hb_mux_data_t structures, create file and write headers
  *********************************************************************/
+/*
+ * In place mp4 optimization
+ *
+ * Instead of libavformat's faststart, which rewrites the whole file to
+ * insert the moov in front of the media data, space for the moov is
+ * reserved right after the ftyp.  Once the file is complete the moov is
+ * copied there.  Chunk offsets stay valid since the media data does not
+ * move.  Only when the reservation turns out to be too small is the media
+ * data shifted and the chunk offsets adjusted.
+ */
+#define MOOV_TRACK_SIZE 4096    // fixed per track atoms, sample description
+#define MOOV_SHIFT_SIZE (4 * 1024 * 1024)
+
+static int estimate_moov_size( hb_job_t * job )
+{
+    hb_audio_t    * audio;
+    hb_subtitle_t * subtitle;
+    int64_t         duration, samples, size;
+    int             ii, frame_size, samplerate;
+
+    duration = hb_job_get_duration(job);
+    if (duration <= 0 || job->vrate.num <= 0 || job->vrate.den <= 0)
+    {
+        return 0;
+    }
+
+    // Video: sample size, composition offset, duration (vfr) and sync
+    // sample entries, one chunk per frame since tracks are interleaved
+    // frame by frame
+    samples = duration * job->vrate.num / job->vrate.den / 90000;
+    size    = MOOV_TRACK_SIZE + samples * 32;
+
+    // Audio: sample size entries and a chunk for every video frame
+    for (ii = 0; ii < hb_list_count(job->list_audio); ii++)
+    {
+        audio      = hb_list_item(job->list_audio, ii);
+        frame_size = audio->config.out.samples_per_frame;
+        samplerate = audio->config.out.samplerate > 0 ?
+                     audio->config.out.samplerate :
+                     audio->config.in.samplerate;
+        if (frame_size <= 0)
+        {
+            frame_size = 1024;
+        }
+        size += MOOV_TRACK_SIZE + audio->priv.config.extradata.length;
+        size += duration * samplerate / frame_size / 90000 * 4;
+        size += samples * 12;
+    }
+
+    // Subtitles are sparse, assume a sample per second
+    for (ii = 0; ii < hb_list_count(job->list_subtitle); ii++)
+    {
+        subtitle = hb_list_item(job->list_subtitle, ii);
+        if (subtitle->config.dest == PASSTHRUSUB)
+        {
+            size += MOOV_TRACK_SIZE + duration / 90000 * 16;
+        }
+    }
+
+    // Chapter track and metadata
+    size += MOOV_TRACK_SIZE + MOOV_TRACK_SIZE;
+    if (job->chapter_markers)
+    {
+        size += (job->chapter_end - job->chapter_start + 1) * 32;
+    }
+
+    size += size / 4;
+    if (size > INT_MAX / 2)
+    {
+        return 0;
+    }
+    return size;
+}
+
+static int read_at( FILE * file, int64_t pos, uint8_t * buf, int64_t size )
+{
+    if (fseeko(file, pos, SEEK_SET) != 0 ||
+        (int64_t)fread(buf, 1, size, file) != size)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int write_at( FILE * file, int64_t pos, const uint8_t * buf,
+                     int64_t size )
+{
+    if (fseeko(file, pos, SEEK_SET) != 0 ||
+        (int64_t)fwrite(buf, 1, size, file) != size)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int write_free_atom( FILE * file, int64_t pos, int64_t size )
+{
+    uint8_t header[8];
+
+    AV_WB32(header, size);
+    AV_WB32(header + 4, MKBETAG('f','r','e','e'));
+    return write_at(file, pos, header, 8);
+}
+
+/*
+ * Adds 'delta' to the chunk offsets of all tracks in the moov atom
+ * contents 'data'.  Fails if an offset no longer fits its field.
+ */
+static int patch_chunk_offsets( uint8_t * data, int64_t size, int64_t delta )
+{
+    int64_t pos = 0, atom_size, offset;
+    int     header, ii, count;
+
+    while (pos + 8 <= size)
+    {
+        atom_size = AV_RB32(data + pos);
+        header    = 8;
+        if (atom_size == 1 && pos + 16 <= size)
+        {
+            atom_size = AV_RB64(data + pos + 8);
+            header    = 16;
+        }
+        if (atom_size < header || pos + atom_size > size)
+        {
+            return -1;
+        }
+        switch (AV_RB32(data + pos + 4))
+        {
+            case MKBETAG('t','r','a','k'):
+            case MKBETAG('m','d','i','a'):
+            case MKBETAG('m','i','n','f'):
+            case MKBETAG('s','t','b','l'):
+                if (patch_chunk_offsets(data + pos + header,
+                                        atom_size - header, delta))
+                {
+                    return -1;
+                }
+                break;
+
+            case MKBETAG('s','t','c','o'):
+                count = AV_RB32(data + pos + header + 4);
+                if (header + 8 + (int64_t)count * 4 > atom_size)
+                {
+                    return -1;
+                }
+                for (ii = 0; ii < count; ii++)
+                {
+                    uint8_t * entry = data + pos + header + 8 + ii * 4;
+                    offset = AV_RB32(entry) + delta;
+                    if (offset < 0 || offset > UINT32_MAX)
+                    {
+                        return -1;
+                    }
+                    AV_WB32(entry, offset);
+                }
+                break;
+
+            case MKBETAG('c','o','6','4'):
+                count = AV_RB32(data + pos + header + 4);
+                if (header + 8 + (int64_t)count * 8 > atom_size)
+                {
+                    return -1;
+                }
+                for (ii = 0; ii < count; ii++)
+                {
+                    uint8_t * entry = data + pos + header + 8 + ii * 8;
+                    AV_WB64(entry, AV_RB64(entry) + delta);
+                }
+                break;
+
+            default:
+                break;
+        }
+        pos += atom_size;
+    }
+    return 0;
+}
+
+/*
+ * Moves the file range [start, end) by 'delta' bytes
+ */
+static int shift_data( FILE * file, int64_t start, int64_t end,
+                       int64_t delta )
+{
+    uint8_t * buf = malloc(MOOV_SHIFT_SIZE);
+    int64_t   pos, len;
+    int       ret = 0;
+
+    if (buf == NULL)
+    {
+        return -1;
+    }
+    // Copy in the direction of the move so nothing is overwritten
+    // before it was read
+    pos = delta > 0 ? end : start;
+    while (ret == 0 && (delta > 0 ? pos > start : pos < end))
+    {
+        if (delta > 0)
+        {
+            len  = MIN(MOOV_SHIFT_SIZE, pos - start);
+            pos -= len;
+        }
+        else
+        {
+            len  = MIN(MOOV_SHIFT_SIZE, end - pos);
+        }
+        if (read_at(file, pos, buf, len) ||
+            write_at(file, pos + delta, buf, len))
+        {
+            ret = -1;
+        }
+        if (delta < 0)
+        {
+            pos += len;
+        }
+    }
+    free(buf);
+    return ret;
+}
+
+/*
+ * Moves the moov that libavformat appended to the complete file into
+ * the 'reserved' bytes libavformat skipped after the ftyp.
+ */
+static int place_moov( const char * path, int reserved )
+{
+    FILE    * file;
+    uint8_t   header[16], * moov = NULL;
+    int64_t   file_size, gap, pos, size, moov_pos = -1, moov_size = 0;
+    int64_t   spare, delta;
+    int       ret = -1, moov_header;
+
+    file = hb_fopen(path, "r+b");
+    if (file == NULL)
+    {
+        hb_error("muxavformat: could not reopen %s", path);
+        return -1;
+    }
+    if (fseeko(file, 0, SEEK_END) != 0 || (file_size = ftello(file)) < 0 ||
+        read_at(file, 0, header, 8) ||
+        AV_RB32(header + 4) != MKBETAG('f','t','y','p'))
+    {
+        hb_error("muxavformat: unexpected mp4 layout");
+        goto done;
+    }
+    gap = AV_RB32(header);
+    if (gap + reserved > file_size)
+    {
+        hb_error("muxavformat: unexpected mp4 layout");
+        goto done;
+    }
+
+    // The reserved space must be a valid atom whatever happens below
+    if (write_free_atom(file, gap, reserved))
+    {
+        goto fail;
+    }
+
+    // Find the moov behind the media data
+    for (pos = gap + reserved; pos + 8 <= file_size; pos += size)
+    {
+        if (read_at(file, pos, header, 16 <= file_size - pos ? 16 : 8))
+        {
+            goto fail;
+        }
+        size = AV_RB32(header);
+        if (size == 1)
+        {
+            size = AV_RB64(header + 8);
+        }
+        else if (size == 0)
+        {
+            size = file_size - pos;
+        }
+        if (size < 8)
+        {
+            break;
+        }
+        if (AV_RB32(header + 4) == MKBETAG('m','o','o','v'))
+        {
+            moov_pos  = pos;
+            moov_size = size;
+        }
+    }
+    if (moov_pos < 0 || moov_pos + moov_size != file_size ||
+        moov_size > INT_MAX)
+    {
+        hb_log("muxavformat: moov is not the last atom, left in place");
+        ret = 0;
+        goto done;
+    }
+    moov = malloc(moov_size);
+    if (moov == NULL || read_at(file, moov_pos, moov, moov_size))
+    {
+        goto fail;
+    }
+
+    spare = reserved - moov_size;
+    if (spare == 0 || spare >= 8)
+    {
+        if (write_at(file, gap, moov, moov_size) ||
+            (spare > 0 && write_free_atom(file, gap + moov_size, spare)) ||
+            fflush(file) || hb_ftruncate(file, moov_pos))
+        {
+            goto fail;
+        }
+        hb_log("muxavformat: moov written in place, %"PRId64" of %d "
+               "reserved bytes used", moov_size, reserved);
+        ret = 0;
+        goto done;
+    }
+
+    // The reservation is too small, move the media data instead
+    delta = moov_size - reserved;
+    hb_log("muxavformat: moov needs %"PRId64" bytes, %d reserved, "
+           "rewriting file", moov_size, reserved);
+    moov_header = AV_RB32(moov) == 1 ? 16 : 8;
+    if (patch_chunk_offsets(moov + moov_header, moov_size - moov_header,
+                            delta))
+    {
+        hb_log("muxavformat: could not adjust chunk offsets, "
+               "moov left in place");
+        ret = 0;
+        goto done;
+    }
+    if (shift_data(file, gap + reserved, moov_pos, delta) ||
+        write_at(file, gap, moov, moov_size) ||
+        fflush(file) || hb_ftruncate(file, moov_pos + delta))
+    {
+        goto fail;
+    }
+    ret = 0;
+    goto done;
+
+fail:
+    hb_error("muxavformat: moving the moov failed: %s", strerror(errno));
+
+done:
+    free(moov);
+    fclose(file);
+    return ret;
+}
+
+/*
+ * Fragmented mp4
+ *
+ * libavformat writes an empty moov and HandBrake ends a fragment before
+ * every video keyframe, so each fragment decodes on its own and is on
+ * disk as soon as the next GOP starts.  With a segment length, the moov
+ * stays alone in job->file as init segment, fragments go to numbered
+ * segment files and an HLS playlist lists the completed segments.
+ */
+static char * segment_path( hb_mux_object_t * m, int index )
+{
+    return hb_strdup_printf("%s_%05d.m4s", m->segment_stem, index);
+}
+
+static const char * path_basename( const char * path )
+{
+    char * sep = hb_strr_dir_sep(path);
+
+    return sep != NULL ? sep + 1 : path;
+}
+
+/*
+ * Rewrites the playlist.  It is written to a temporary file first so
+ * readers never see a partial playlist.
+ */
+static int write_playlist( hb_mux_object_t * m, int complete )
+{
+    FILE   * file;
+    char   * path, * tmp, * name;
+    double   target = m->segment_length / 90000.;
+    int      ii, ret = 0;
+
+    path = hb_strdup_printf("%s.m3u8", m->segment_stem);
+    tmp  = hb_strdup_printf("%s.m3u8.tmp", m->segment_stem);
+    file = hb_fopen(tmp, "w");
+    if (file == NULL)
+    {
+        hb_error("muxavformat: could not write playlist %s", tmp);
+        free(path);
+        free(tmp);
+        return -1;
+    }
+    for (ii = 0; ii < m->segment_count; ii++)
+    {
+        target = MAX(target, m->segment_durations[ii]);
+    }
+    fprintf(file, "#EXTM3U\n");
+    fprintf(file, "#EXT-X-VERSION:7\n");
+    fprintf(file, "#EXT-X-TARGETDURATION:%d\n", (int)ceil(target));
+    fprintf(file, "#EXT-X-PLAYLIST-TYPE:%s\n", complete ? "VOD" : "EVENT");
+    fprintf(file, "#EXT-X-INDEPENDENT-SEGMENTS\n");
+    fprintf(file, "#EXT-X-MAP:URI=\"%s\"\n", path_basename(m->job->file));
+    for (ii = 0; ii < m->segment_count; ii++)
+    {
+        name = segment_path(m, ii + 1);
+        fprintf(file, "#EXTINF:%.3f,\n%s\n", m->segment_durations[ii],
+                path_basename(name));
+        free(name);
+    }
+    if (complete)
+    {
+        fprintf(file, "#EXT-X-ENDLIST\n");
+    }
+    if (fclose(file) != 0)
+    {
+        hb_error("muxavformat: could not write playlist %s", tmp);
+        ret = -1;
+    }
+    else if (rename(tmp, path) != 0)
+    {
+        // rename() does not replace existing files everywhere
+        remove(path);
+        if (rename(tmp, path) != 0)
+        {
+            hb_error("muxavformat: could not write playlist %s", path);
+            ret = -1;
+        }
+    }
+    free(path);
+    free(tmp);
+    return ret;
+}
+
+/*
+ * Completes the current segment, which ends at 'pts', and adds it to the
+ * playlist.  Opens the next segment unless 'complete' is set.
+ */
+static int segment_next( hb_mux_object_t * m, int64_t pts, int complete )
+{
+    double * durations;
+    char   * path;
+
+    if (m->writer != NULL)
+    {
+        if (hb_mux_writer_close(&m->writer))
+        {
+            return -1;
+        }
+        m->oc->pb = NULL;
+    }
+    if (m->segment_start != AV_NOPTS_VALUE)
+    {
+        durations = realloc(m->segment_durations,
+                            (m->segment_count + 1) * sizeof(double));
+        if (durations == NULL)
+        {
+            return -1;
+        }
+        m->segment_durations = durations;
+        m->segment_durations[m->segment_count++] =
+                                (pts - m->segment_start) / 90000.;
+        if (write_playlist(m, complete))
+        {
+            return -1;
+        }
+    }
+    m->segment_start = pts;
+    if (complete)
+    {
+        return 0;
+    }
+
+    path = segment_path(m, m->segment_count + 1);
+    m->writer = hb_mux_writer_init(path, &m->oc->pb);
+    free(path);
+    return m->writer != NULL ? 0 : -1;
+}
+
+/*
+ * Hands the queued packets that belong before 'pts' (90KHz ticks) to
+ * libavformat and flushes its interleaving queue.  Video packets were all
+ * queued before the keyframe at 'pts', other packets go by their own pts.
+ * The later ones stay queued for the next fragment.  AV_NOPTS_VALUE writes
+ * all of them.
+ */
+static int fragment_write( hb_mux_object_t * m, int64_t pts )
+{
+    AVPacket * pkt;
+    AVStream * st;
+    int        ii, ret = 0;
+
+    for (ii = 0; ii < hb_list_count(m->fragment_queue); )
+    {
+        pkt = hb_list_item(m->fragment_queue, ii);
+        st  = m->oc->streams[pkt->stream_index];
+        if (pts != AV_NOPTS_VALUE &&
+            st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+            av_compare_ts(pkt->pts, st->time_base,
+                          pts, (AVRational){1,90000}) >= 0)
+        {
+            ii++;
+            continue;
+        }
+        hb_list_rem(m->fragment_queue, pkt);
+        if (ret >= 0)
+        {
+            ret = av_interleaved_write_frame(m->oc, pkt);
+        }
+        av_packet_free(&pkt);
+    }
+    if (ret >= 0)
+    {
+        ret = av_interleaved_write_frame(m->oc, NULL);
+    }
+    return ret;
+}
+
+/*
+ * In fragmented mode packets are held back until the fragment they belong
+ * to is cut, libavformat would flush its whole interleaving queue into the
+ * current fragment.
+ */
+static int write_packet( hb_mux_object_t * m, AVPacket * pkt )
+{
+    AVPacket * copy;
+
+    if (!m->fragment)
+    {
+        return av_interleaved_write_frame(m->oc, pkt);
+    }
+    copy = av_packet_clone(pkt);
+    if (copy == NULL)
+    {
+        return AVERROR(ENOMEM);
+    }
+    hb_list_add(m->fragment_queue, copy);
+    return 0;
+}
+
+/*
+ * Ends the current fragment before the video keyframe at 'pts'
+ */
+static int fragment_next( hb_mux_object_t * m, int64_t pts )
+{
+    // Everything before the keyframe must be in the fragment, nothing
+    // after it
+    if (fragment_write(m, pts) < 0 || av_write_frame(m->oc, NULL) < 0)
+    {
+        hb_error("muxavformat: writing fragment failed");
+        return -1;
+    }
+    m->fragment_frames = 0;
+
+    if (m->segment_length > 0 &&
+        pts - m->segment_start >= m->segment_length)
+    {
+        if (segment_next(m, pts, 0))
+        {
+            hb_error("muxavformat: starting segment %d failed",
+                     m->segment_count + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 static int avformatInit( hb_mux_object_t * m )
 {
     hb_job_t   * job   = m->job;
@@ -152,7 +725,45 @@ static int avformatInit( hb_mux_object_t * m )
             meta_mux = META_MUX_MP4;
 
             av_dict_set(&av_opts, "brand", "mp42", 0);
+            if (job->mp4_fragment)
+            {
+                // Fragments are cut by fragment_next()
+                m->fragment       = 1;
+                m->fragment_queue = hb_list_init();
+                av_dict_set(&av_opts, "movflags",
+                            "frag_custom+empty_moov+default_base_moof+"
+                            "disable_chpl", 0);
+                if (job->mp4_segment_length > 0)
+                {
+                    // The mfra index at the end of the last segment would
+                    // hold offsets into that segment only
+                    av_dict_set(&av_opts, "movflags", "+skip_trailer",
+                                AV_DICT_APPEND);
+
+                    char * sep = hb_strr_dir_sep(job->file);
+                    char * ext = strrchr(sep != NULL ? sep : job->file, '.');
+                    int    len = ext != NULL ? ext - job->file :
+                                               strlen(job->file);
+
+                    m->segment_stem   = hb_strdup_printf("%.*s", len,
+                                                         job->file);
+                    m->segment_length =
+                                (int64_t)job->mp4_segment_length * 90000;
+                }
+                break;
+            }
             if (job->mp4_optimize)
+            {
+                m->moov_reserved = estimate_moov_size(job);
+            }
+            if (m->moov_reserved > 0)
+            {
+                // The moov is moved into the reserved space once the file
+                // is complete, see place_moov()
+                av_dict_set_int(&av_opts, "moov_size", m->moov_reserved, 0);
+                av_dict_set(&av_opts, "movflags", "+disable_chpl", 0);
+            }
+            else if (job->mp4_optimize)
                 av_dict_set(&av_opts, "movflags", "faststart+disable_chpl", 0);
             else
                 av_dict_set(&av_opts, "movflags", "+disable_chpl", 0);
@@ -190,11 +801,10 @@ static int avformatInit( hb_mux_object_t * m )
         goto error;
     }
 
-    ret = avio_open2(&m->oc->pb, job->file, AVIO_FLAG_WRITE,
-                     &m->oc->interrupt_callback, NULL);
-    if( ret < 0 )
+    // Disk writes happen in a writer thread, the muxer only queues data
+    m->writer = hb_mux_writer_init(job->file, &m->oc->pb);
+    if (m->writer == NULL)
     {
-        hb_error( "avio_open2 failed, errno %d", ret);
         goto error;
     }
 
@@ -1119,12 +1729,26 @@ static int avformatInit( hb_mux_object_t * m )
     }
     av_dict_free( &av_opts );
 
+    if (m->segment_length > 0)
+    {
+        // job->file holds only the init segment
+        if (segment_next(m, AV_NOPTS_VALUE, 0))
+        {
+            hb_error("muxavformat: could not start the first segment");
+            goto error;
+        }
+    }
+
     return 0;
 
 error:
     free(job->mux_data);
     job->mux_data = NULL;
+    hb_mux_writer_close(&m->writer);
     avformat_free_context(m->oc);
+    hb_list_close(&m->fragment_queue);
+    free(m->segment_stem);
+    m->segment_stem = NULL;
     *job->done_error = HB_ERROR_INIT;
     *job->die = 1;
     return -1;
@@ -1203,7 +1827,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
                 empty_pkt.pts = track->duration;
                 empty_pkt.duration = 90;
                 empty_pkt.stream_index = track->st->index;
-                av_interleaved_write_frame(m->oc, &empty_pkt);
+                write_packet(m, &empty_pkt);
             }
         }
         return 0;
@@ -1302,6 +1926,23 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
         pkt.flags |= AV_PKT_FLAG_KEY;
     }
 
+    if (m->fragment && track->type == MUX_TYPE_VIDEO)
+    {
+        if (m->segment_start == AV_NOPTS_VALUE)
+        {
+            m->segment_start = buf->s.start;
+        }
+        // Start a new fragment at each of the encoder's keyframes
+        if ((pkt.flags & AV_PKT_FLAG_KEY) && m->fragment_frames > 0 &&
+            fragment_next(m, buf->s.start))
+        {
+            *job->done_error = HB_ERROR_UNKNOWN;
+            *job->die = 1;
+            return -1;
+        }
+        m->fragment_frames++;
+    }
+
     switch (track->type)
     {
         case MUX_TYPE_VIDEO:
@@ -1360,7 +2001,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
                     empty_pkt.pts = track->duration;
                     empty_pkt.duration = pts - track->duration;
                     empty_pkt.stream_index = track->st->index;
-                    int ret = av_interleaved_write_frame(m->oc, &empty_pkt);
+                    int ret = write_packet(m, &empty_pkt);
                     if (ret < 0)
                     {
                         char errstr[64];
@@ -1447,7 +2088,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
     }
 
     pkt.stream_index = track->st->index;
-    int ret = av_interleaved_write_frame(m->oc, &pkt);
+    int ret = write_packet(m, &pkt);
     if (sub_out != NULL)
     {
         free(sub_out);
@@ -1474,6 +2115,7 @@ static int avformatEnd(hb_mux_object_t *m)
 {
     hb_job_t *job           = m->job;
     hb_mux_data_t *track = job->mux_data;
+    int ret;
 
     if( !job->mux_data )
     {
@@ -1560,10 +2202,45 @@ static int avformatEnd(hb_mux_object_t *m)
         }
     }
 
+    if (m->moov_reserved > 0)
+    {
+        // Have libavformat append the moov, it can not tell in advance
+        // whether the moov fits the reserved space
+        av_opt_set_int(m->oc->priv_data, "moov_size", 0, 0);
+    }
+    else if (job->mux == HB_MUX_AV_MP4 && job->mp4_optimize && !m->fragment)
+    {
+        // faststart reads the file back through a handle of its own
+        hb_mux_writer_sync(m->writer);
+    }
+    if (m->fragment && fragment_write(m, AV_NOPTS_VALUE) < 0)
+    {
+        hb_error("muxavformat: writing fragment failed");
+        *job->done_error = HB_ERROR_UNKNOWN;
+        *job->die = 1;
+    }
+    hb_list_close(&m->fragment_queue);
     av_write_trailer(m->oc);
-    avio_close(m->oc->pb);
+    if (m->segment_length > 0)
+    {
+        // Complete the last segment and the playlist
+        ret = segment_next(m, m->tracks[0]->duration, 1);
+    }
+    else
+    {
+        ret = hb_mux_writer_close(&m->writer);
+    }
+    if (ret || (m->moov_reserved > 0 &&
+                place_moov(job->file, m->moov_reserved)))
+    {
+        *job->done_error = HB_ERROR_UNKNOWN;
+        *job->die = 1;
+    }
+    m->oc->pb = NULL;
     avformat_free_context(m->oc);
     free(m->tracks);
+    free(m->segment_stem);
+    free(m->segment_durations);
     m->oc = NULL;
 
     return 0;
@@ -1576,5 +2253,6 @@ hb_mux_object_t * hb_mux_avformat_init( hb_job_t * job )
     m->mux       = avformatMux;
     m->end       = avformatEnd;
     m->job       = job;
+    m->segment_start = AV_NOPTS_VALUE;
     return m;
 }
@@ -0,0 +1,362 @@
+/* muxwriter.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include <errno.h>
+#include "handbrake/handbrake.h"
+#include "handbrake/muxwriter.h"
+
+#define WRITER_AVIO_SIZE   (64 * 1024)     // libavformat side buffer
+#define WRITER_BLOCK_SIZE  (1024 * 1024)   // size of each write to disk
+#define WRITER_BLOCKS      16              // write-behind depth
+
+typedef struct
+{
+    uint8_t * data;
+    int       size;
+    int64_t   pos;     // file offset of data[0]
+} writer_block_t;
+
+struct hb_mux_writer_s
+{
+    FILE           * file;
+    AVIOContext    * pb;
+    hb_thread_t    * thread;
+    hb_lock_t      * lock;
+    hb_cond_t      * cond;
+
+    // blocks[head] .. blocks[head + count - 1] are queued for the writer
+    // thread, blocks[head + count] is being filled by the muxer
+    writer_block_t   blocks[WRITER_BLOCKS];
+    int              head;
+    int              count;
+    int              stop;
+    int              error;       // errno of the first failed write
+
+    // Only used by the muxer thread
+    int64_t          pos;         // current AVIOContext position
+    int64_t          size;        // end of the furthest write
+    int              sync;
+
+    // Statistics
+    uint64_t         bytes;
+    int              writes;
+    uint64_t         write_us;    // time the writer thread spent writing
+    uint64_t         stall_us;    // time the muxer waited for the writer
+    int              stalls;
+};
+
+static void writer_thread( void * _w )
+{
+    hb_mux_writer_t * w = _w;
+    writer_block_t  * block;
+    int64_t           file_pos = 0;
+    uint64_t          start;
+    int               error = 0;
+
+    hb_lock(w->lock);
+    while (1)
+    {
+        while (w->count == 0 && !w->stop)
+        {
+            hb_cond_wait(w->cond, w->lock);
+        }
+        if (w->count == 0)
+        {
+            break;
+        }
+        block = &w->blocks[w->head];
+        hb_unlock(w->lock);
+
+        // The block belongs to this thread until it is dequeued below
+        start = hb_get_time_us();
+        if (!error)
+        {
+            if (block->pos != file_pos &&
+                fseeko(w->file, block->pos, SEEK_SET) != 0)
+            {
+                error = errno ? errno : EIO;
+            }
+            else if (fwrite(block->data, 1, block->size, w->file) !=
+                     block->size)
+            {
+                error = errno ? errno : EIO;
+            }
+            file_pos = block->pos + block->size;
+            if (error)
+            {
+                // Reported to libavformat by the next write
+                hb_atomic_store(&w->error, error);
+            }
+        }
+
+        hb_lock(w->lock);
+        w->write_us += hb_get_time_us() - start;
+        w->bytes    += block->size;
+        w->writes++;
+        block->size  = 0;
+        w->head      = (w->head + 1) % WRITER_BLOCKS;
+        w->count--;
+        hb_cond_broadcast(w->cond);
+    }
+    hb_unlock(w->lock);
+}
+
+/*
+ * Returns the block the muxer fills next, waiting for the writer thread
+ * if all blocks are queued.
+ */
+static writer_block_t * writer_fill_block( hb_mux_writer_t * w )
+{
+    writer_block_t * block;
+    uint64_t         start;
+
+    hb_lock(w->lock);
+    if (w->count == WRITER_BLOCKS)
+    {
+        start = hb_get_time_us();
+        while (w->count == WRITER_BLOCKS)
+        {
+            hb_cond_wait(w->cond, w->lock);
+        }
+        w->stall_us += hb_get_time_us() - start;
+        w->stalls++;
+    }
+    block = &w->blocks[(w->head + w->count) % WRITER_BLOCKS];
+    hb_unlock(w->lock);
+
+    return block;
+}
+
+static void writer_submit( hb_mux_writer_t * w, writer_block_t * block )
+{
+    hb_lock(w->lock);
+    if (block->size > 0)
+    {
+        w->count++;
+        hb_cond_broadcast(w->cond);
+    }
+    if (w->sync)
+    {
+        while (w->count > 0)
+        {
+            hb_cond_wait(w->cond, w->lock);
+        }
+    }
+    hb_unlock(w->lock);
+}
+
+static int writer_write_packet( void * opaque, uint8_t * buf, int buf_size )
+{
+    hb_mux_writer_t * w = opaque;
+    writer_block_t  * block;
+    int               size = buf_size, len;
+    int               error = hb_atomic_load(&w->error);
+
+    if (error)
+    {
+        return AVERROR(error);
+    }
+    while (size > 0)
+    {
+        block = writer_fill_block(w);
+        if (block->size > 0 && block->pos + block->size != w->pos)
+        {
+            // libavformat seeked, start a new block
+            writer_submit(w, block);
+            continue;
+        }
+        if (block->size == 0)
+        {
+            block->pos = w->pos;
+        }
+        len = MIN(size, WRITER_BLOCK_SIZE - block->size);
+        memcpy(block->data + block->size, buf, len);
+        block->size += len;
+        w->pos      += len;
+        buf         += len;
+        size        -= len;
+        if (block->size == WRITER_BLOCK_SIZE)
+        {
+            writer_submit(w, block);
+        }
+    }
+    if (w->pos > w->size)
+    {
+        w->size = w->pos;
+    }
+    if (w->sync)
+    {
+        writer_submit(w, writer_fill_block(w));
+    }
+
+    return buf_size;
+}
+
+static int64_t writer_seek( void * opaque, int64_t offset, int whence )
+{
+    hb_mux_writer_t * w = opaque;
+
+    // Writes are queued with their offset, seeking needs no I/O
+    switch (whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE:
+            return MAX(w->size, w->pos);
+        case SEEK_SET:
+            w->pos = offset;
+            break;
+        case SEEK_CUR:
+            w->pos += offset;
+            break;
+        case SEEK_END:
+            w->pos = MAX(w->size, w->pos) + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    return w->pos;
+}
+
+static void writer_free( hb_mux_writer_t * w )
+{
+    int ii;
+
+    if (w->pb != NULL)
+    {
+        av_freep(&w->pb->buffer);
+        avio_context_free(&w->pb);
+    }
+    for (ii = 0; ii < WRITER_BLOCKS; ii++)
+    {
+        av_free(w->blocks[ii].data);
+    }
+    if (w->file != NULL)
+    {
+        fclose(w->file);
+    }
+    hb_cond_close(&w->cond);
+    hb_lock_close(&w->lock);
+    free(w);
+}
+
+hb_mux_writer_t * hb_mux_writer_init( const char * path, AVIOContext ** pb )
+{
+    hb_mux_writer_t * w;
+    uint8_t         * buffer;
+    int               ii;
+
+    w = calloc(1, sizeof(hb_mux_writer_t));
+    if (w == NULL)
+    {
+        hb_error("mux writer: allocation failed");
+        return NULL;
+    }
+    w->file = hb_fopen(path, "wb");
+    if (w->file == NULL)
+    {
+        hb_error("mux writer: could not open %s: %s", path, strerror(errno));
+        writer_free(w);
+        return NULL;
+    }
+    // Blocks go to the file descriptor directly, stdio buffering would
+    // only split them up again
+    setvbuf(w->file, NULL, _IONBF, 0);
+
+    w->lock = hb_lock_init();
+    w->cond = hb_cond_init();
+    for (ii = 0; ii < WRITER_BLOCKS; ii++)
+    {
+        // av_malloc() returns buffers aligned for direct I/O as well
+        w->blocks[ii].data = av_malloc(WRITER_BLOCK_SIZE);
+        if (w->blocks[ii].data == NULL)
+        {
+            break;
+        }
+    }
+    buffer = av_malloc(WRITER_AVIO_SIZE);
+    if (buffer != NULL)
+    {
+        w->pb = avio_alloc_context(buffer, WRITER_AVIO_SIZE, 1, w, NULL,
+                                   writer_write_packet, writer_seek);
+        if (w->pb == NULL)
+        {
+            av_free(buffer);
+        }
+    }
+    if (w->lock == NULL || w->cond == NULL || ii < WRITER_BLOCKS ||
+        w->pb == NULL)
+    {
+        hb_error("mux writer: allocation failed");
+        writer_free(w);
+        return NULL;
+    }
+
+    w->thread = hb_thread_init("mux writer", writer_thread, w,
+                               HB_NORMAL_PRIORITY);
+    if (w->thread == NULL)
+    {
+        hb_error("mux writer: could not spawn thread");
+        writer_free(w);
+        return NULL;
+    }
+    *pb = w->pb;
+
+    return w;
+}
+
+void hb_mux_writer_sync( hb_mux_writer_t * w )
+{
+    if (w == NULL || w->sync)
+    {
+        return;
+    }
+    w->sync = 1;
+    avio_flush(w->pb);
+    writer_submit(w, writer_fill_block(w));
+}
+
+int hb_mux_writer_close( hb_mux_writer_t ** _w )
+{
+    hb_mux_writer_t * w = *_w;
+    int               error;
+
+    if (w == NULL)
+    {
+        return 0;
+    }
+
+    avio_flush(w->pb);
+    writer_submit(w, writer_fill_block(w));
+
+    hb_lock(w->lock);
+    w->stop = 1;
+    hb_cond_broadcast(w->cond);
+    hb_unlock(w->lock);
+    hb_thread_close(&w->thread);
+
+    if (fclose(w->file) != 0 && !w->error)
+    {
+        w->error = errno ? errno : EIO;
+    }
+    w->file = NULL;
+    error   = w->error;
+
+    hb_log("mux: wrote %"PRIu64" bytes in %d writes, %.2f s writing, "
+           "muxer stalled %d times for %.2f s",
+           w->bytes, w->writes, w->write_us / 1000000.,
+           w->stalls, w->stall_us / 1000000.);
+    if (error)
+    {
+        hb_error("mux writer: write failed: %s", strerror(error));
+    }
+
+    writer_free(w);
+    *_w = NULL;
+
+    return error ? -1 : 0;
+}
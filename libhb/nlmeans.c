@@ -52,7 +52,7 @@
 
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
-#include "handbrake/taskset.h"
+#include "handbrake/threadpool.h"
 #include "handbrake/nlmeans.h"
 
 #define NLMEANS_STRENGTH_LUMA_DEFAULT      6
@@ -109,19 +109,6 @@ typedef struct
     hb_buffer_settings_t s;
 } Frame;
 
-struct PixelSum
-{
-    float weight_sum;
-    float pixel_sum;
-};
-
-typedef struct
-{
-    hb_filter_private_t *pv;
-    int segment;
-    hb_buffer_t *out;
-} nlmeans_thread_arg_t;
-
 struct hb_filter_private_s
 {
     double strength[3];    // averaging weight decay, larger produces smoother output
@@ -142,8 +129,7 @@ struct hb_filter_private_s
     int         next_frame;
     int         max_frames;
 
-    taskset_t   taskset;
-    nlmeans_thread_arg_t ** thread_data;
+    hb_buffer_t ** out;    // filtered frame of each segment
 
     hb_filter_init_t        input;
     hb_filter_init_t        output;
@@ -155,7 +141,7 @@ static int nlmeans_work(hb_filter_object_t *filter,
                            hb_buffer_t **buf_out);
 static void nlmeans_close(hb_filter_object_t *filter);
 
-static void nlmeans_filter_thread(void *thread_args_v);
+static void nlmeans_filter_segment(void *opaque, int segment);
 
 static const char nlmeans_template[] =
     "y-strength=^"HB_FLOAT_REG"$:y-origin-tune=^"HB_FLOAT_REG"$:"
@@ -706,48 +692,6 @@ static void nlmeans_prefilter(BorderedPlane *src,
     hb_unlock(src->mutex);
 }
 
-static void build_integral_scalar(uint32_t *integral,
-                                  int       integral_stride,
-                            const uint8_t  *src,
-                            const uint8_t  *src_pre,
-                            const uint8_t  *compare,
-                            const uint8_t  *compare_pre,
-                                  int       w,
-                                  int       border,
-                                  int       dst_w,
-                                  int       dst_h,
-                                  int       dx,
-                                  int       dy)
-{
-    const int bw = w + 2 * border;
-    for (int y = 0; y < dst_h; y++)
-    {
-        const uint8_t *p1 = src_pre + y*bw;
-        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
-        uint32_t *out = integral + (y*integral_stride);
-
-        for (int x = 0; x < dst_w; x++)
-        {
-            int diff = *p1 - *p2;
-            *out = *(out-1) + diff * diff;
-            out++;
-            p1++;
-            p2++;
-        }
-
-        if (y > 0)
-        {
-            out = integral + y*integral_stride;
-
-            for (int x = 0; x < dst_w; x++)
-            {
-                *out += *(out - integral_stride);
-                out++;
-            }
-        }
-    }
-}
-
 static void nlmeans_plane(NLMeansFunctions *functions,
                           Frame *frame,
                           int prefilter,
@@ -831,30 +775,17 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                 {
                     const uint32_t *integral_ptr1 = integral + (y  -1)*integral_stride - 1;
                     const uint32_t *integral_ptr2 = integral + (y+n-1)*integral_stride - 1;
-
-                    for (int x = 0; x <= dst_w-n; x++)
-                    {
-                        const int xc = x + n_half;
-                        const int yc = y + n_half;
-
-                        // Difference between patches
-                        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
-
-                        // Sum pixel with weight
-                        if (diff < diff_max)
-                        {
-                            const int diffidx = diff * weight_fact_table;
-
-                            //float weight = exp(-diff*weightFact);
-                            const float weight = exptable[diffidx];
-
-                            tmp_data[yc*dst_w + xc].weight_sum += weight;
-                            tmp_data[yc*dst_w + xc].pixel_sum  += weight * compare[(yc+dy)*bw + xc + dx];
-                        }
-
-                        integral_ptr1++;
-                        integral_ptr2++;
-                    }
+                    const int yc = y + n_half;
+
+                    functions->accumulate_weights(tmp_data + yc*dst_w + n_half,
+                                                  compare + (yc+dy)*bw + n_half + dx,
+                                                  integral_ptr1,
+                                                  integral_ptr2,
+                                                  n,
+                                                  dst_w - n + 1,
+                                                  exptable,
+                                                  weight_fact_table,
+                                                  diff_max);
                 }
             }
         }
@@ -900,7 +831,8 @@ static int nlmeans_init(hb_filter_object_t *filter,
 
     pv->input = *init;
 
-    functions->build_integral = build_integral_scalar;
+    functions->build_integral = nlmeans_build_integral_scalar;
+    functions->accumulate_weights = nlmeans_accumulate_weights_scalar;
 #if defined(ARCH_X86)
     nlmeans_init_x86(functions);
 #endif
@@ -1021,38 +953,18 @@ static int nlmeans_init(hb_filter_object_t *filter,
         }
     }
 
-    pv->thread_data = malloc(pv->threads * sizeof(nlmeans_thread_arg_t*));
-    if (taskset_init(&pv->taskset, pv->threads,
-                     sizeof(nlmeans_thread_arg_t)) == 0)
+    pv->out = calloc(pv->threads, sizeof(hb_buffer_t*));
+    if (pv->out == NULL)
     {
-        hb_error("NLMeans could not initialize taskset");
+        hb_error("NLMeans could not allocate output list");
         goto fail;
     }
-
-    for (int ii = 0; ii < pv->threads; ii++)
-    {
-        pv->thread_data[ii] = taskset_thread_args(&pv->taskset, ii);
-        if (pv->thread_data[ii] == NULL)
-        {
-            hb_error("NLMeans could not create thread args");
-            goto fail;
-        }
-        pv->thread_data[ii]->pv = pv;
-        pv->thread_data[ii]->segment = ii;
-        if (taskset_thread_spawn(&pv->taskset, ii, "nlmeans_filter",
-                                 nlmeans_filter_thread, HB_NORMAL_PRIORITY) == 0)
-        {
-            hb_error("NLMeans could not spawn thread");
-            goto fail;
-        }
-    }
     pv->output = *init;
 
     return 0;
 
 fail:
-    taskset_fini(&pv->taskset);
-    free(pv->thread_data);
+    free(pv->out);
     free(pv);
     return -1;
 }
@@ -1066,7 +978,6 @@ static void nlmeans_close(hb_filter_object_t *filter)
         return;
     }
 
-    taskset_fini(&pv->taskset);
     for (int c = 0; c < 3; c++)
     {
         for (int f = 0; f < pv->nframes[c]; f++)
@@ -1094,84 +1005,65 @@ static void nlmeans_close(hb_filter_object_t *filter)
     }
 
     free(pv->frame);
-    free(pv->thread_data);
+    free(pv->out);
     free(pv);
     filter->private_data = NULL;
 }
 
-static void nlmeans_filter_thread(void *thread_args_v)
+static void nlmeans_filter_segment(void *opaque, int segment)
 {
-    nlmeans_thread_arg_t *thread_data = thread_args_v;
-    hb_filter_private_t *pv = thread_data->pv;
-    int segment = thread_data->segment;
+    hb_filter_private_t *pv = opaque;
 
-    hb_deep_log(3, "NLMeans thread started for segment %d", segment);
+    Frame *frame = &pv->frame[segment];
+    hb_buffer_t *buf;
+    buf = hb_frame_buffer_init(pv->output.pix_fmt,
+                               frame->width, frame->height);
+    buf->f.color_prim     = pv->output.color_prim;
+    buf->f.color_transfer = pv->output.color_transfer;
+    buf->f.color_matrix   = pv->output.color_matrix;
+    buf->f.color_range    = pv->output.color_range ;
 
-    while (1)
-    {
-        // Wait until there is work to do.
-        taskset_thread_wait4start(&pv->taskset, segment);
 
-        if (taskset_thread_stop(&pv->taskset, segment))
+    NLMeansFunctions *functions = &pv->functions;
+
+    for (int c = 0; c < 3; c++)
+    {
+        if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
         {
-            break;
+            nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
         }
-
-        Frame *frame = &pv->frame[segment];
-        hb_buffer_t *buf;
-        buf = hb_frame_buffer_init(pv->output.pix_fmt,
-                                   frame->width, frame->height);
-        buf->f.color_prim     = pv->output.color_prim;
-        buf->f.color_transfer = pv->output.color_transfer;
-        buf->f.color_matrix   = pv->output.color_matrix;
-        buf->f.color_range    = pv->output.color_range ;
-
-
-        NLMeansFunctions *functions = &pv->functions;
-
-        for (int c = 0; c < 3; c++)
+        if (pv->strength[c] == 0)
         {
-            if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
-            {
-                nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-            if (pv->strength[c] == 0)
-            {
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-
-            // Process current plane
-            nlmeans_plane(functions,
-                          frame,
-                          pv->prefilter[c],
-                          c,
-                          pv->nframes[c],
-                          buf->plane[c].data,
-                          buf->plane[c].width,
-                          buf->plane[c].stride,
-                          buf->plane[c].height,
-                          pv->strength[c],
-                          pv->origin_tune[c],
-                          pv->patch_size[c],
-                          pv->range[c],
-                          pv->exptable[c],
-                          pv->weight_fact_table[c],
-                          pv->diff_max[c]);
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
         }
-        buf->s = pv->frame[segment].s;
-        thread_data->out = buf;
 
-        // Finished this segment, notify.
-        taskset_thread_complete(&pv->taskset, segment);
+        // Process current plane
+        nlmeans_plane(functions,
+                      frame,
+                      pv->prefilter[c],
+                      c,
+                      pv->nframes[c],
+                      buf->plane[c].data,
+                      buf->plane[c].width,
+                      buf->plane[c].stride,
+                      buf->plane[c].height,
+                      pv->strength[c],
+                      pv->origin_tune[c],
+                      pv->patch_size[c],
+                      pv->range[c],
+                      pv->exptable[c],
+                      pv->weight_fact_table[c],
+                      pv->diff_max[c]);
     }
-    taskset_thread_complete(&pv->taskset, segment);
+    buf->s = pv->frame[segment].s;
+    pv->out[segment] = buf;
 }
 
 static void nlmeans_add_frame(hb_filter_private_t *pv, hb_buffer_t *buf)
@@ -1201,9 +1093,9 @@ static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
         return NULL;
     }
 
-    taskset_cycle(&pv->taskset);
+    hb_parallel_for(pv->threads, nlmeans_filter_segment, pv);
 
-    // Free buffers that are not needed for next taskset cycle
+    // Free buffers that are not needed for the next batch
     for (int c = 0; c < 3; c++)
     {
         for (int t = 0; t < pv->threads; t++)
@@ -1237,12 +1129,13 @@ static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
     }
     pv->next_frame -= pv->threads;
 
-    // Collect results from taskset
+    // Collect results from the thread pool
     hb_buffer_list_t list;
     hb_buffer_list_clear(&list);
     for (int t = 0; t < pv->threads; t++)
     {
-        hb_buffer_list_append(&list, pv->thread_data[t]->out);
+        hb_buffer_list_append(&list, pv->out[t]);
+        pv->out[t] = NULL;
     }
     return hb_buffer_list_clear(&list);
 }
@@ -0,0 +1,91 @@
+/* nlmeans_c.c
+
+   Copyright (c) 2013 Dirk Farin
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Portable NLMeans kernels.  They are the reference the x86 kernels must
+ * match bit for bit, test/kernels/nlmeans_test.c checks that they do.
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/nlmeans.h"
+
+void nlmeans_build_integral_scalar(uint32_t *integral,
+                                   int       integral_stride,
+                             const uint8_t  *src,
+                             const uint8_t  *src_pre,
+                             const uint8_t  *compare,
+                             const uint8_t  *compare_pre,
+                                   int       w,
+                                   int       border,
+                                   int       dst_w,
+                                   int       dst_h,
+                                   int       dx,
+                                   int       dy)
+{
+    const int bw = w + 2 * border;
+    for (int y = 0; y < dst_h; y++)
+    {
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        for (int x = 0; x < dst_w; x++)
+        {
+            int diff = *p1 - *p2;
+            *out = *(out-1) + diff * diff;
+            out++;
+            p1++;
+            p2++;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x++)
+            {
+                *out += *(out - integral_stride);
+                out++;
+            }
+        }
+    }
+}
+
+void nlmeans_accumulate_weights_scalar(struct PixelSum *tmp_data,
+                                 const uint8_t         *compare,
+                                 const uint32_t        *integral_ptr1,
+                                 const uint32_t        *integral_ptr2,
+                                       int              n,
+                                       int              count,
+                                 const float           *exptable,
+                                 const float            weight_fact_table,
+                                 const int              diff_max)
+{
+    for (int x = 0; x < count; x++)
+    {
+        // Difference between patches
+        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
+
+        // Sum pixel with weight
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+
+            //float weight = exp(-diff*weightFact);
+            const float weight = exptable[diffidx];
+
+            tmp_data[x].weight_sum += weight;
+            tmp_data[x].pixel_sum  += weight * compare[x];
+        }
+
+        integral_ptr1++;
+        integral_ptr2++;
+    }
+}
@@ -17,6 +17,18 @@
 #include "libavutil/cpu.h"
 #include "handbrake/nlmeans.h"
 
+// AVX2 and AVX-512 kernels are compiled for their target only and are
+// selected at runtime, the rest of libhb keeps its baseline flags
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_NLMEANS_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#if defined(AV_CPU_FLAG_AVX512)
+#define HAVE_NLMEANS_AVX512
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
 static void build_integral_sse2(uint32_t *integral,
                                 int       integral_stride,
                           const uint8_t  *src,
@@ -143,9 +155,302 @@ static void build_integral_sse2(uint32_t *integral,
     }
 }
 
+#if defined(HAVE_NLMEANS_AVX2)
+TARGET_AVX2
+static void build_integral_avx2(uint32_t *integral,
+                                int       integral_stride,
+                          const uint8_t  *src,
+                          const uint8_t  *src_pre,
+                          const uint8_t  *compare,
+                          const uint8_t  *compare_pre,
+                                int       w,
+                                int       border,
+                                int       dst_w,
+                                int       dst_h,
+                                int       dx,
+                                int       dy)
+{
+    const __m256i zero    = _mm256_setzero_si256();
+    const __m256i lane_lo = _mm256_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3);
+    const __m256i last    = _mm256_set1_epi32(7);
+    const int bw = w + 2 * border;
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        __m256i prevadd = zero;
+
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        for (int x = 0; x < dst_w; x += 8)
+        {
+            __m256i pa, pb, diff, tmp;
+
+            pa = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)p1));
+            pb = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)p2));
+
+            diff = _mm256_sub_epi32(pa, pb);
+            diff = _mm256_mullo_epi32(diff, diff);
+
+            // Prefix sum within each 128 bit lane
+            diff = _mm256_add_epi32(diff, _mm256_slli_si256(diff, 4));
+            diff = _mm256_add_epi32(diff, _mm256_slli_si256(diff, 8));
+
+            // Carry the low lane total into the high lane
+            tmp  = _mm256_permutevar8x32_epi32(diff, lane_lo);
+            tmp  = _mm256_blend_epi32(zero, tmp, 0xf0);
+            diff = _mm256_add_epi32(diff, tmp);
+            diff = _mm256_add_epi32(diff, prevadd);
+
+            prevadd = _mm256_permutevar8x32_epi32(diff, last);
+
+            _mm256_storeu_si256((__m256i*)out, diff);
+
+            out += 8;
+            p1  += 8;
+            p2  += 8;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x += 8)
+            {
+                __m256i above = _mm256_loadu_si256((__m256i*)(out - integral_stride));
+                __m256i cur   = _mm256_loadu_si256((__m256i*)out);
+                _mm256_storeu_si256((__m256i*)out, _mm256_add_epi32(above, cur));
+                out += 8;
+            }
+        }
+    }
+}
+
+/*
+ * Separate multiply and add, no FMA, so that the sums round exactly
+ * like accumulate_weights_scalar().  Rejected patches get a weight of
+ * zero, adding it leaves the non-negative sums unchanged.
+ */
+TARGET_AVX2
+static void accumulate_weights_avx2(struct PixelSum *tmp_data,
+                              const uint8_t         *compare,
+                              const uint32_t        *integral_ptr1,
+                              const uint32_t        *integral_ptr2,
+                                    int              n,
+                                    int              count,
+                              const float           *exptable,
+                              const float            weight_fact_table,
+                              const int              diff_max)
+{
+    const __m256  wfact = _mm256_set1_ps(weight_fact_table);
+    const __m256i dmax  = _mm256_set1_epi32(diff_max);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i a0, an, b0, bn, diff, idx, mask;
+        __m256  weight, pixel, lo, hi, sum_lo, sum_hi;
+
+        a0 = _mm256_loadu_si256((__m256i*)(integral_ptr1 + x));
+        an = _mm256_loadu_si256((__m256i*)(integral_ptr1 + x + n));
+        b0 = _mm256_loadu_si256((__m256i*)(integral_ptr2 + x));
+        bn = _mm256_loadu_si256((__m256i*)(integral_ptr2 + x + n));
+
+        diff = _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(bn, b0), an), a0);
+        mask = _mm256_cmpgt_epi32(dmax, diff);
+        idx  = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(diff), wfact));
+
+        weight = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), exptable, idx,
+                                          _mm256_castsi256_ps(mask), 4);
+        pixel  = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                                    _mm_loadl_epi64((__m128i*)(compare + x))));
+        pixel  = _mm256_mul_ps(weight, pixel);
+
+        // Interleave into weight_sum, pixel_sum pairs
+        lo = _mm256_unpacklo_ps(weight, pixel);
+        hi = _mm256_unpackhi_ps(weight, pixel);
+
+        float *sums = (float*)(tmp_data + x);
+        sum_lo = _mm256_loadu_ps(sums);
+        sum_hi = _mm256_loadu_ps(sums + 8);
+        sum_lo = _mm256_add_ps(sum_lo, _mm256_permute2f128_ps(lo, hi, 0x20));
+        sum_hi = _mm256_add_ps(sum_hi, _mm256_permute2f128_ps(lo, hi, 0x31));
+        _mm256_storeu_ps(sums,     sum_lo);
+        _mm256_storeu_ps(sums + 8, sum_hi);
+    }
+
+    for (; x < count; x++)
+    {
+        const int diff = (uint32_t)(integral_ptr2[x + n] - integral_ptr2[x] - integral_ptr1[x + n] + integral_ptr1[x]);
+
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+            const float weight = exptable[diffidx];
+
+            tmp_data[x].weight_sum += weight;
+            tmp_data[x].pixel_sum  += weight * compare[x];
+        }
+    }
+}
+#endif // HAVE_NLMEANS_AVX2
+
+#if defined(HAVE_NLMEANS_AVX512)
+TARGET_AVX512
+static void build_integral_avx512(uint32_t *integral,
+                                  int       integral_stride,
+                            const uint8_t  *src,
+                            const uint8_t  *src_pre,
+                            const uint8_t  *compare,
+                            const uint8_t  *compare_pre,
+                                  int       w,
+                                  int       border,
+                                  int       dst_w,
+                                  int       dst_h,
+                                  int       dx,
+                                  int       dy)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi32(15);
+    const int bw = w + 2 * border;
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        __m512i prevadd = zero;
+
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        for (int x = 0; x < dst_w; x += 16)
+        {
+            __m512i pa, pb, diff;
+
+            pa = _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*)p1));
+            pb = _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*)p2));
+
+            diff = _mm512_sub_epi32(pa, pb);
+            diff = _mm512_mullo_epi32(diff, diff);
+
+            // Prefix sum, shifting in zeros from the bottom
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 15));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 14));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 12));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 8));
+            diff = _mm512_add_epi32(diff, prevadd);
+
+            prevadd = _mm512_permutexvar_epi32(last, diff);
+
+            _mm512_storeu_si512(out, diff);
+
+            out += 16;
+            p1  += 16;
+            p2  += 16;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x += 16)
+            {
+                __m512i above = _mm512_loadu_si512(out - integral_stride);
+                __m512i cur   = _mm512_loadu_si512(out);
+                _mm512_storeu_si512(out, _mm512_add_epi32(above, cur));
+                out += 16;
+            }
+        }
+    }
+}
+
+TARGET_AVX512
+static void accumulate_weights_avx512(struct PixelSum *tmp_data,
+                                const uint8_t         *compare,
+                                const uint32_t        *integral_ptr1,
+                                const uint32_t        *integral_ptr2,
+                                      int              n,
+                                      int              count,
+                                const float           *exptable,
+                                const float            weight_fact_table,
+                                const int              diff_max)
+{
+    const __m512  wfact = _mm512_set1_ps(weight_fact_table);
+    const __m512i dmax  = _mm512_set1_epi32(diff_max);
+    const __m512i perm_lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+                                              4, 20, 5, 21, 6, 22, 7, 23);
+    const __m512i perm_hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27,
+                                              12, 28, 13, 29, 14, 30, 15, 31);
+    int x = 0;
+
+    for (; x + 16 <= count; x += 16)
+    {
+        __m512i a0, an, b0, bn, diff, idx;
+        __m512  weight, pixel;
+        __mmask16 mask;
+
+        a0 = _mm512_loadu_si512(integral_ptr1 + x);
+        an = _mm512_loadu_si512(integral_ptr1 + x + n);
+        b0 = _mm512_loadu_si512(integral_ptr2 + x);
+        bn = _mm512_loadu_si512(integral_ptr2 + x + n);
+
+        diff = _mm512_add_epi32(_mm512_sub_epi32(_mm512_sub_epi32(bn, b0), an), a0);
+        mask = _mm512_cmpgt_epi32_mask(dmax, diff);
+        idx  = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(diff), wfact));
+
+        weight = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx,
+                                          exptable, 4);
+        pixel  = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+                                    _mm_loadu_si128((__m128i*)(compare + x))));
+        pixel  = _mm512_mul_ps(weight, pixel);
+
+        // Interleave into weight_sum, pixel_sum pairs
+        float *sums = (float*)(tmp_data + x);
+        _mm512_storeu_ps(sums, _mm512_add_ps(_mm512_loadu_ps(sums),
+                         _mm512_permutex2var_ps(weight, perm_lo, pixel)));
+        _mm512_storeu_ps(sums + 16, _mm512_add_ps(_mm512_loadu_ps(sums + 16),
+                         _mm512_permutex2var_ps(weight, perm_hi, pixel)));
+    }
+
+    for (; x < count; x++)
+    {
+        const int diff = (uint32_t)(integral_ptr2[x + n] - integral_ptr2[x] - integral_ptr1[x + n] + integral_ptr1[x]);
+
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+            const float weight = exptable[diffidx];
+
+            tmp_data[x].weight_sum += weight;
+            tmp_data[x].pixel_sum  += weight * compare[x];
+        }
+    }
+}
+#endif // HAVE_NLMEANS_AVX512
+
 void nlmeans_init_x86(NLMeansFunctions *functions)
 {
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HAVE_NLMEANS_AVX512)
+    if (cpu_flags & AV_CPU_FLAG_AVX512)
+    {
+        functions->build_integral     = build_integral_avx512;
+        functions->accumulate_weights = accumulate_weights_avx512;
+        hb_log("NLMeans using AVX-512 optimizations");
+        return;
+    }
+#endif
+#if defined(HAVE_NLMEANS_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->build_integral     = build_integral_avx2;
+        functions->accumulate_weights = accumulate_weights_avx2;
+        hb_log("NLMeans using AVX2 optimizations");
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
     {
         functions->build_integral = build_integral_sse2;
         hb_log("NLMeans using SSE2 optimizations");
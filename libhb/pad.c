@@ -28,6 +28,7 @@ hb_filter_object_t hb_filter_pad =
     .work              = hb_avfilter_null_work,
     .close             = hb_avfilter_alias_close,
     .settings_template = pad_template,
+    .high_depth        = 1,
 };
 
 /* Pad presets and tunes
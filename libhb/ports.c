@@ -58,6 +58,7 @@
 #include <mbctype.h>
 #include <locale.h>
 #include <shlobj.h>
+#include <io.h>
 #endif
 
 #ifdef SYS_SunOS
@@ -702,6 +703,27 @@ FILE * hb_fopen(const char *path, const char *mode)
 #endif
 }
 
+/*
+ * Truncates 'file' to 'size' bytes.  off_t is 32 bit on MinGW, so use
+ * _chsize_s there, which takes a 64 bit size.  Buffered writes must be
+ * flushed first.
+ * Returns 0 on success, errno is set on failure.
+ */
+int hb_ftruncate(FILE *file, int64_t size)
+{
+#ifdef SYS_MINGW
+    errno_t ret = _chsize_s(_fileno(file), size);
+    if (ret)
+    {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+#else
+    return ftruncate(fileno(file), size);
+#endif
+}
+
 HB_DIR* hb_opendir(const char *path)
 {
 #ifdef SYS_MINGW
@@ -1048,6 +1070,19 @@ void hb_lock( hb_lock_t * l )
 #endif
 }
 
+// Returns 1 if the lock was acquired, 0 if it is held by another thread
+int hb_trylock( hb_lock_t * l )
+{
+#if defined( SYS_BEOS )
+    acquire_sem( l->sem );
+    return 1;
+#elif USE_PTHREAD
+    return pthread_mutex_trylock( &l->mutex ) == 0;
+#else
+    return 1;
+#endif
+}
+
 void hb_unlock( hb_lock_t * l )
 {
 #if defined( SYS_BEOS )
@@ -1059,6 +1094,68 @@ void hb_unlock( hb_lock_t * l )
 #endif
 }
 
+/************************************************************************
+ * Thread local storage
+ ************************************************************************
+ * 'destructor' is called with the thread's value when a thread that
+ * set a non-NULL value exits.  Returns NULL if the platform has no
+ * thread local storage.
+ ***********************************************************************/
+struct hb_tls_s
+{
+#if USE_PTHREAD
+    pthread_key_t key;
+#endif
+};
+
+hb_tls_t * hb_tls_init( void (*destructor)(void *) )
+{
+#if USE_PTHREAD
+    hb_tls_t * tls = calloc( sizeof( hb_tls_t ), 1 );
+
+    if (tls != NULL && pthread_key_create(&tls->key, destructor) != 0)
+    {
+        free(tls);
+        tls = NULL;
+    }
+    return tls;
+#else
+    return NULL;
+#endif
+}
+
+void hb_tls_close( hb_tls_t ** _tls )
+{
+    hb_tls_t * tls = *_tls;
+
+    if (tls == NULL)
+    {
+        return;
+    }
+#if USE_PTHREAD
+    pthread_key_delete(tls->key);
+#endif
+    free(tls);
+
+    *_tls = NULL;
+}
+
+void * hb_tls_get( hb_tls_t * tls )
+{
+#if USE_PTHREAD
+    return pthread_getspecific(tls->key);
+#else
+    return NULL;
+#endif
+}
+
+void hb_tls_set( hb_tls_t * tls, void * value )
+{
+#if USE_PTHREAD
+    pthread_setspecific(tls->key, value);
+#endif
+}
+
 /************************************************************************
  * Portable condition variable implementation
  ***********************************************************************/
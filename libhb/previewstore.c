@@ -0,0 +1,488 @@
+/* previewstore.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include <zlib.h>
+#include "handbrake/handbrake.h"
+
+/*
+ * In memory store of scan previews.
+ *
+ * Decoded previews are kept as packed plane rows, optionally deflated.
+ * Scaled previews handed out by hb_get_preview2() are kept as well, keyed
+ * by output size, crop and deinterlace, so scrubbing through previews
+ * neither rereads nor rescales them.
+ *
+ * Everything is bounded by one budget.  Scaled previews are dropped least
+ * recently used first when space is needed.  Decoded previews can not be
+ * recreated without a rescan, they are never dropped; a decoded preview
+ * that does not fit is refused and its caller writes it to a temporary
+ * file instead.
+ *
+ * Scan threads store previews while the UI reads them, the store has a
+ * lock of its own.
+ */
+
+typedef struct
+{
+    int       title;
+    int       preview;
+    uint8_t * data;
+    int       size;         // bytes in data
+    int       raw_size;     // bytes of the packed rows
+} preview_source_t;
+
+typedef struct
+{
+    int          title;
+    int          preview;
+    int          width;
+    int          height;
+    int          crop[4];
+    int          deinterlace;
+    hb_image_t * image;
+    int          size;
+} preview_scaled_t;
+
+struct hb_preview_store_s
+{
+    hb_lock_t * lock;
+    int64_t     budget;
+    int         compress;
+    int64_t     source_size;
+    int64_t     scaled_size;
+    hb_list_t * sources;
+    hb_list_t * scaled;     // least recently used first
+};
+
+hb_preview_store_t * hb_preview_store_init( int64_t budget, int compress )
+{
+    hb_preview_store_t * store = calloc(1, sizeof(hb_preview_store_t));
+
+    if (store == NULL)
+    {
+        return NULL;
+    }
+    store->lock     = hb_lock_init();
+    store->budget   = budget;
+    store->compress = compress;
+    store->sources  = hb_list_init();
+    store->scaled   = hb_list_init();
+
+    return store;
+}
+
+static void scaled_close( preview_scaled_t ** _scaled )
+{
+    preview_scaled_t * scaled = *_scaled;
+
+    hb_image_close(&scaled->image);
+    free(scaled);
+    *_scaled = NULL;
+}
+
+// Call with the lock held
+static void drop_scaled( hb_preview_store_t * store, int64_t limit )
+{
+    preview_scaled_t * scaled;
+
+    while (store->source_size + store->scaled_size > limit &&
+           (scaled = hb_list_item(store->scaled, 0)) != NULL)
+    {
+        hb_list_rem(store->scaled, scaled);
+        store->scaled_size -= scaled->size;
+        scaled_close(&scaled);
+    }
+}
+
+// Removes a stored preview and its scaled images.  Call with the lock held
+static void drop_preview( hb_preview_store_t * store, int title, int preview )
+{
+    preview_source_t * source;
+    preview_scaled_t * scaled;
+    int                ii;
+
+    for (ii = 0; ii < hb_list_count(store->scaled); )
+    {
+        scaled = hb_list_item(store->scaled, ii);
+        if (scaled->title == title && scaled->preview == preview)
+        {
+            hb_list_rem(store->scaled, scaled);
+            store->scaled_size -= scaled->size;
+            scaled_close(&scaled);
+            continue;
+        }
+        ii++;
+    }
+    for (ii = 0; ii < hb_list_count(store->sources); ii++)
+    {
+        source = hb_list_item(store->sources, ii);
+        if (source->title == title && source->preview == preview)
+        {
+            hb_list_rem(store->sources, source);
+            store->source_size -= source->size;
+            free(source->data);
+            free(source);
+            break;
+        }
+    }
+}
+
+void hb_preview_store_clear( hb_preview_store_t * store )
+{
+    preview_source_t * source;
+
+    if (store == NULL)
+    {
+        return;
+    }
+    hb_lock(store->lock);
+    drop_scaled(store, 0);
+    while ((source = hb_list_item(store->sources, 0)) != NULL)
+    {
+        hb_list_rem(store->sources, source);
+        free(source->data);
+        free(source);
+    }
+    store->source_size = 0;
+    hb_unlock(store->lock);
+}
+
+void hb_preview_store_close( hb_preview_store_t ** _store )
+{
+    hb_preview_store_t * store = *_store;
+
+    if (store == NULL)
+    {
+        return;
+    }
+    hb_preview_store_clear(store);
+    hb_list_close(&store->sources);
+    hb_list_close(&store->scaled);
+    hb_lock_close(&store->lock);
+    free(store);
+    *_store = NULL;
+}
+
+void hb_preview_store_configure( hb_preview_store_t * store,
+                                 int64_t budget, int compress )
+{
+    if (store == NULL)
+    {
+        return;
+    }
+    hb_lock(store->lock);
+    store->budget   = budget;
+    store->compress = compress;
+    // Decoded previews already stored stay until the next scan
+    drop_scaled(store, budget);
+    hb_unlock(store->lock);
+}
+
+int hb_preview_store_put( hb_preview_store_t * store, int title, int preview,
+                          hb_buffer_t * buf )
+{
+    preview_source_t * source;
+    uint8_t          * rows, * data;
+    int                pp, hh, raw_size = 0, size;
+    uLongf             len;
+
+    if (store == NULL)
+    {
+        return -1;
+    }
+    // A rescan saves the preview again.  The new one replaces the old one
+    // even when it is not stored, the caller then keeps it in a file.
+    hb_lock(store->lock);
+    drop_preview(store, title, preview);
+    hb_unlock(store->lock);
+    if (store->budget <= 0)
+    {
+        return -1;
+    }
+    for (pp = 0; pp <= buf->f.max_plane; pp++)
+    {
+        raw_size += buf->plane[pp].width * buf->plane[pp].height;
+    }
+    rows = malloc(raw_size);
+    if (rows == NULL)
+    {
+        return -1;
+    }
+    data = rows;
+    for (pp = 0; pp <= buf->f.max_plane; pp++)
+    {
+        for (hh = 0; hh < buf->plane[pp].height; hh++)
+        {
+            memcpy(data, buf->plane[pp].data + hh * buf->plane[pp].stride,
+                   buf->plane[pp].width);
+            data += buf->plane[pp].width;
+        }
+    }
+    size = raw_size;
+
+    if (store->compress)
+    {
+        len  = compressBound(raw_size);
+        data = malloc(len);
+        if (data != NULL &&
+            compress2(data, &len, rows, raw_size, Z_BEST_SPEED) == Z_OK &&
+            len < raw_size)
+        {
+            free(rows);
+            rows = realloc(data, len);
+            if (rows == NULL)
+            {
+                rows = data;
+            }
+            size = len;
+        }
+        else
+        {
+            free(data);
+        }
+    }
+
+    source = calloc(1, sizeof(preview_source_t));
+    if (source == NULL)
+    {
+        free(rows);
+        return -1;
+    }
+    source->title    = title;
+    source->preview  = preview;
+    source->data     = rows;
+    source->size     = size;
+    source->raw_size = raw_size;
+
+    hb_lock(store->lock);
+    if (store->source_size + size > store->budget)
+    {
+        hb_unlock(store->lock);
+        free(source->data);
+        free(source);
+        return -1;
+    }
+    drop_scaled(store, store->budget - size);
+    store->source_size += size;
+    hb_list_add(store->sources, source);
+    hb_unlock(store->lock);
+
+    return 0;
+}
+
+hb_buffer_t * hb_preview_store_get( hb_preview_store_t * store, int title,
+                                    int preview, int width, int height )
+{
+    preview_source_t * source = NULL;
+    hb_buffer_t      * buf    = NULL;
+    uint8_t          * rows   = NULL, * data;
+    int                ii, pp, hh, raw_size = 0;
+    uLongf             len;
+
+    if (store == NULL)
+    {
+        return NULL;
+    }
+    hb_lock(store->lock);
+    for (ii = 0; ii < hb_list_count(store->sources); ii++)
+    {
+        source = hb_list_item(store->sources, ii);
+        if (source->title == title && source->preview == preview)
+        {
+            break;
+        }
+        source = NULL;
+    }
+    if (source == NULL)
+    {
+        hb_unlock(store->lock);
+        return NULL;
+    }
+
+    buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P, width, height);
+    if (buf == NULL)
+    {
+        goto done;
+    }
+    for (pp = 0; pp <= buf->f.max_plane; pp++)
+    {
+        raw_size += buf->plane[pp].width * buf->plane[pp].height;
+    }
+    if (raw_size != source->raw_size)
+    {
+        hb_error("hb_preview_store_get: preview %d of title %d has "
+                 "unexpected size", preview, title);
+        hb_buffer_close(&buf);
+        goto done;
+    }
+    data = source->data;
+    if (source->size != source->raw_size)
+    {
+        len  = raw_size;
+        rows = malloc(raw_size);
+        if (rows == NULL ||
+            uncompress(rows, &len, source->data, source->size) != Z_OK ||
+            len != raw_size)
+        {
+            hb_error("hb_preview_store_get: failed to inflate preview %d "
+                     "of title %d", preview, title);
+            hb_buffer_close(&buf);
+            goto done;
+        }
+        data = rows;
+    }
+    for (pp = 0; pp <= buf->f.max_plane; pp++)
+    {
+        for (hh = 0; hh < buf->plane[pp].height; hh++)
+        {
+            memcpy(buf->plane[pp].data + hh * buf->plane[pp].stride, data,
+                   buf->plane[pp].width);
+            data += buf->plane[pp].width;
+        }
+    }
+
+done:
+    hb_unlock(store->lock);
+    free(rows);
+
+    return buf;
+}
+
+static hb_image_t * image_dup( const hb_image_t * image, int * size )
+{
+    hb_image_t * dup;
+    uint8_t    * data;
+    int          pp;
+
+    dup = malloc(sizeof(hb_image_t));
+    if (dup == NULL)
+    {
+        return NULL;
+    }
+    *dup  = *image;
+    *size = 0;
+    for (pp = 0; pp <= image->max_plane; pp++)
+    {
+        *size += image->plane[pp].size;
+    }
+    dup->data = av_malloc(*size);
+    if (dup->data == NULL)
+    {
+        free(dup);
+        return NULL;
+    }
+    data = dup->data;
+    for (pp = 0; pp <= image->max_plane; pp++)
+    {
+        memcpy(data, image->plane[pp].data, image->plane[pp].size);
+        dup->plane[pp].data = data;
+        data += image->plane[pp].size;
+    }
+    return dup;
+}
+
+static int scaled_match( const preview_scaled_t * scaled, int title,
+                         int preview, int width, int height,
+                         const int crop[4], int deinterlace )
+{
+    return scaled->title       == title       &&
+           scaled->preview     == preview     &&
+           scaled->width       == width       &&
+           scaled->height      == height      &&
+           scaled->deinterlace == deinterlace &&
+           !memcmp(scaled->crop, crop, sizeof(scaled->crop));
+}
+
+hb_image_t * hb_preview_store_get_image( hb_preview_store_t * store,
+                                         int title, int preview,
+                                         int width, int height,
+                                         const int crop[4], int deinterlace )
+{
+    preview_scaled_t * scaled;
+    hb_image_t       * image = NULL;
+    int                ii, size;
+
+    if (store == NULL)
+    {
+        return NULL;
+    }
+    hb_lock(store->lock);
+    for (ii = hb_list_count(store->scaled) - 1; ii >= 0; ii--)
+    {
+        scaled = hb_list_item(store->scaled, ii);
+        if (scaled_match(scaled, title, preview, width, height,
+                         crop, deinterlace))
+        {
+            // Most recently used
+            hb_list_rem(store->scaled, scaled);
+            hb_list_add(store->scaled, scaled);
+            image = image_dup(scaled->image, &size);
+            break;
+        }
+    }
+    hb_unlock(store->lock);
+
+    return image;
+}
+
+void hb_preview_store_put_image( hb_preview_store_t * store,
+                                 int title, int preview,
+                                 int width, int height,
+                                 const int crop[4], int deinterlace,
+                                 const hb_image_t * image )
+{
+    preview_scaled_t * scaled;
+    int                ii;
+
+    if (store == NULL || store->budget <= 0)
+    {
+        return;
+    }
+    scaled = calloc(1, sizeof(preview_scaled_t));
+    if (scaled == NULL)
+    {
+        return;
+    }
+    scaled->title       = title;
+    scaled->preview     = preview;
+    scaled->width       = width;
+    scaled->height      = height;
+    scaled->deinterlace = deinterlace;
+    memcpy(scaled->crop, crop, sizeof(scaled->crop));
+    scaled->image = image_dup(image, &scaled->size);
+    if (scaled->image == NULL)
+    {
+        free(scaled);
+        return;
+    }
+
+    hb_lock(store->lock);
+    for (ii = 0; ii < hb_list_count(store->scaled); ii++)
+    {
+        preview_scaled_t * old = hb_list_item(store->scaled, ii);
+        if (scaled_match(old, title, preview, width, height,
+                         crop, deinterlace))
+        {
+            // Another caller scaled the same preview meanwhile
+            hb_unlock(store->lock);
+            scaled_close(&scaled);
+            return;
+        }
+    }
+    if (store->source_size + scaled->size > store->budget)
+    {
+        hb_unlock(store->lock);
+        scaled_close(&scaled);
+        return;
+    }
+    drop_scaled(store, store->budget - scaled->size);
+    store->scaled_size += scaled->size;
+    hb_list_add(store->scaled, scaled);
+    hb_unlock(store->lock);
+}
@@ -18,6 +18,7 @@ struct hb_filter_private_s
     // Common
     int                 crop[4];
     int                 type;
+    int                 depth;
     struct SwsContext * sws;
     int                 sws_width;
     int                 sws_height;
@@ -96,6 +97,7 @@ hb_filter_object_t hb_filter_render_sub =
 {
     .id            = HB_FILTER_RENDER_SUB,
     .enforce_order = 1,
+    .high_depth    = 1,
     .name          = "Subtitle renderer",
     .settings      = NULL,
     .init          = hb_rendersub_init,
@@ -188,13 +190,109 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
     }
 }
 
+// blends src YUVA420P buffer into a dst of more than 8 bit depth
+// the subtitle samples are scaled up to the depth of dst
+static void blend_16( hb_buffer_t *dst, hb_buffer_t *src, int left, int top,
+                      int depth )
+{
+    int xx, yy;
+    int ww, hh;
+    int x0, y0;
+    int shift = depth - 8;
+    uint8_t  *y_in, *u_in, *v_in, *a_in, alpha;
+    uint16_t *y_out, *u_out, *v_out;
+
+    x0 = y0 = 0;
+    if( left < 0 )
+    {
+        x0 = -left;
+    }
+    if( top < 0 )
+    {
+        y0 = -top;
+    }
+
+    ww = src->f.width;
+    if( src->f.width - x0 > dst->f.width - left )
+    {
+        ww = dst->f.width - left + x0;
+    }
+    hh = src->f.height;
+    if( src->f.height - y0 > dst->f.height - top )
+    {
+        hh = dst->f.height - top + y0;
+    }
+    // Blend luma
+    for( yy = y0; yy < hh; yy++ )
+    {
+        y_in  = src->plane[0].data + yy * src->plane[0].stride;
+        y_out = (uint16_t *)(dst->plane[0].data +
+                             ( yy + top ) * dst->plane[0].stride);
+        a_in  = src->plane[3].data + yy * src->plane[3].stride;
+        for( xx = x0; xx < ww; xx++ )
+        {
+            alpha = a_in[xx];
+            y_out[left + xx] =
+                ( (uint32_t)y_out[left + xx] * ( 255 - alpha ) +
+                  ((uint32_t)y_in[xx] << shift) * alpha ) / 255;
+        }
+    }
+
+    // Blend U & V
+    // Assumes source and dest have the same chroma subsampling
+    int hshift = 0;
+    int wshift = 0;
+    if( dst->plane[1].height < dst->plane[0].height )
+        hshift = 1;
+    if( dst->plane[1].width < dst->plane[0].width )
+        wshift = 1;
+
+    for( yy = y0 >> hshift; yy < hh >> hshift; yy++ )
+    {
+        u_in  = src->plane[1].data + yy * src->plane[1].stride;
+        u_out = (uint16_t *)(dst->plane[1].data +
+                             ( yy + ( top >> hshift ) ) * dst->plane[1].stride);
+        v_in  = src->plane[2].data + yy * src->plane[2].stride;
+        v_out = (uint16_t *)(dst->plane[2].data +
+                             ( yy + ( top >> hshift ) ) * dst->plane[2].stride);
+        a_in  = src->plane[3].data + ( yy << hshift ) * src->plane[3].stride;
+
+        for( xx = x0 >> wshift; xx < ww >> wshift; xx++ )
+        {
+            alpha = a_in[xx << wshift];
+
+            u_out[(left >> wshift) + xx] =
+                ( (uint32_t)u_out[(left >> wshift) + xx] * ( 255 - alpha ) +
+                  ((uint32_t)u_in[xx] << shift) * alpha ) / 255;
+            v_out[(left >> wshift) + xx] =
+                ( (uint32_t)v_out[(left >> wshift) + xx] * ( 255 - alpha ) +
+                  ((uint32_t)v_in[xx] << shift) * alpha ) / 255;
+        }
+    }
+}
+
 // applies subtitle 'sub' YUVA420P buffer into destination 'buf'
-// 'buf' is currently YUV420P, but in future will be other formats as well
+// 'buf' is YUV420P at 8 bit or higher depth
 // Assumes that the input destination buffer has the same dimensions
 // as the original title dimensions
-static void ApplySub( hb_filter_private_t * pv, hb_buffer_t * buf, hb_buffer_t * sub )
+// Returns -1 if the subtitle could not be applied
+static int ApplySub( hb_filter_private_t * pv, hb_buffer_t * buf, hb_buffer_t * sub )
 {
-    blend( buf, sub, sub->f.x, sub->f.y );
+    // The decoder may still reference the frame, blend into a private copy
+    if (hb_buffer_make_writable(buf) < 0)
+    {
+        hb_error("rendersub: out of memory, subtitle not rendered");
+        return -1;
+    }
+    if (pv->depth > 8)
+    {
+        blend_16( buf, sub, sub->f.x, sub->f.y, pv->depth );
+    }
+    else
+    {
+        blend( buf, sub, sub->f.x, sub->f.y );
+    }
+    return 0;
 }
 
 static hb_buffer_t * ScaleSubtitle(hb_filter_private_t *pv,
@@ -340,7 +438,7 @@ static hb_buffer_t * ScaleSubtitle(hb_filter_private_t *pv,
 
 // Assumes that the input buffer has the same dimensions
 // as the original title dimensions
-static void ApplyVOBSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
+static int ApplyVOBSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
 {
     int ii;
     hb_buffer_t *sub, *next;
@@ -367,8 +465,12 @@ static void ApplyVOBSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
             while ( sub )
             {
                 hb_buffer_t *scaled = ScaleSubtitle(pv, sub, buf);
-                ApplySub( pv, buf, scaled );
+                int          ret    = ApplySub( pv, buf, scaled );
                 hb_buffer_close(&scaled);
+                if (ret < 0)
+                {
+                    return -1;
+                }
                 sub = sub->next;
             }
             ii++;
@@ -379,6 +481,7 @@ static void ApplyVOBSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
             break;
         }
     }
+    return 0;
 }
 
 static int vobsub_post_init( hb_filter_object_t * filter, hb_job_t * job )
@@ -433,7 +536,11 @@ static int vobsub_work( hb_filter_object_t * filter,
         hb_list_add( pv->sub_list, sub );
     }
 
-    ApplyVOBSubs( pv, in );
+    if (ApplyVOBSubs( pv, in ) < 0)
+    {
+        hb_buffer_close(buf_in);
+        return HB_FILTER_FAILED;
+    }
     *buf_in = NULL;
     *buf_out = in;
 
@@ -507,7 +614,7 @@ static hb_buffer_t * RenderSSAFrame( hb_filter_private_t * pv, ASS_Image * frame
     return sub;
 }
 
-static void ApplySSASubs( hb_filter_private_t * pv, hb_buffer_t * buf )
+static int ApplySSASubs( hb_filter_private_t * pv, hb_buffer_t * buf )
 {
     ASS_Image *frameList;
     hb_buffer_t *sub;
@@ -515,17 +622,22 @@ static void ApplySSASubs( hb_filter_private_t * pv, hb_buffer_t * buf )
     frameList = ass_render_frame( pv->renderer, pv->ssaTrack,
                                   buf->s.start / 90, NULL );
     if ( !frameList )
-        return;
+        return 0;
 
     ASS_Image *frame;
     for (frame = frameList; frame; frame = frame->next) {
         sub = RenderSSAFrame( pv, frame );
         if( sub )
         {
-            ApplySub( pv, buf, sub );
+            int ret = ApplySub( pv, buf, sub );
             hb_buffer_close( &sub );
+            if (ret < 0)
+            {
+                return -1;
+            }
         }
     }
+    return 0;
 }
 
 static void ssa_log(int level, const char *fmt, va_list args, void *data)
@@ -673,7 +785,11 @@ static int ssa_work( hb_filter_object_t * filter,
         hb_buffer_close(&sub);
     }
 
-    ApplySSASubs( pv, in );
+    if (ApplySSASubs( pv, in ) < 0)
+    {
+        hb_buffer_close(buf_in);
+        return HB_FILTER_FAILED;
+    }
     *buf_in = NULL;
     *buf_out = in;
 
@@ -829,14 +945,18 @@ static int textsub_work(hb_filter_object_t * filter,
         process_sub(pv, pv->current_sub);
     }
 
-    ApplySSASubs(pv, in);
+    if (ApplySSASubs(pv, in) < 0)
+    {
+        hb_buffer_close(buf_in);
+        return HB_FILTER_FAILED;
+    }
     *buf_in = NULL;
     *buf_out = in;
 
     return HB_FILTER_OK;
 }
 
-static void ApplyPGSSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
+static int ApplyPGSSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
 {
     int index;
     hb_buffer_t * old_sub;
@@ -880,10 +1000,12 @@ static void ApplyPGSSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
         if ( sub->s.start <= buf->s.start )
         {
             hb_buffer_t *scaled = ScaleSubtitle(pv, sub, buf);
-            ApplySub( pv, buf, scaled );
+            int          ret    = ApplySub( pv, buf, scaled );
             hb_buffer_close(&scaled);
+            return ret;
         }
     }
+    return 0;
 }
 
 static int pgssub_post_init( hb_filter_object_t * filter, hb_job_t * job )
@@ -938,7 +1060,11 @@ static int pgssub_work( hb_filter_object_t * filter,
         hb_list_add( pv->sub_list, sub );
     }
 
-    ApplyPGSSubs( pv, in );
+    if (ApplyPGSSubs( pv, in ) < 0)
+    {
+        hb_buffer_close(buf_in);
+        return HB_FILTER_FAILED;
+    }
     *buf_in = NULL;
     *buf_out = in;
 
@@ -954,6 +1080,7 @@ static int hb_rendersub_init( hb_filter_object_t * filter,
     int ii;
 
     pv->input = *init;
+    pv->depth = hb_get_bit_depth(init->pix_fmt);
 
     // Find the subtitle we need
     for( ii = 0; ii < hb_list_count(init->job->list_subtitle); ii++ )
@@ -26,6 +26,7 @@ hb_filter_object_t hb_filter_rotate =
     .work              = hb_avfilter_null_work,
     .close             = hb_avfilter_alias_close,
     .settings_template = rotate_template,
+    .high_depth        = 1,
 };
 
 /* Rotate Settings:
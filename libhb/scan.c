@@ -28,19 +28,48 @@ typedef struct
     int            store_previews;
 
     uint64_t       min_title_duration;
+
+    hb_scan_cache_t * cache;    // results of earlier scans, may be NULL
+
+    int            parallel;    // one of several threads scanning titles
 } hb_scan_t;
 
 #define PREVIEW_READ_THRESH (200)
 
+// Titles of batch folders and BDs, and the previews of a title, are scanned
+// by up to this many threads.  Scanning is mostly waiting for reads and
+// decoding a few frames, more threads would only make the source seek back
+// and forth.
+#define SCAN_MAX_THREADS    4
+
+typedef struct
+{
+    hb_lock_t    * lock;
+    int            next;        // index of the next title to scan
+    int            done;        // number of titles scanned
+    int            count;
+    hb_title_t  ** titles;      // scanned titles by index, NULL if none
+} scan_queue_t;
+
+typedef struct
+{
+    hb_scan_t      data;        // copy of the scan with handles of its own
+    scan_queue_t * queue;
+    hb_thread_t  * thread;
+} scan_worker_t;
+
 static void ScanFunc( void * );
+static void ScanTitles( hb_scan_t * data );
+static int  ScanPreviews( hb_scan_t * data, hb_title_t * title );
 static int  DecodePreviews( hb_scan_t *, hb_title_t * title, int flush );
 static void LookForAudio(hb_scan_t *scan, hb_title_t *title, hb_buffer_t *b);
 static int  AllAudioOK( hb_title_t * title );
 static void UpdateState1(hb_scan_t *scan, int title);
 static void UpdateState2(hb_scan_t *scan, int title);
 static void UpdateState3(hb_scan_t *scan, int preview);
+static void UpdateState4(hb_scan_t *scan, int done, int count);
 
-static const char *aspect_to_string(hb_rational_t *dar)
+static const char *aspect_to_string(hb_rational_t *dar, char arstr[32])
 {
     double aspect = (double)dar->num / dar->den;
     switch ( (int)(aspect * 9.) )
@@ -48,11 +77,10 @@ static const char *aspect_to_string(hb_rational_t *dar)
         case 9 * 4 / 3:    return "4:3";
         case 9 * 16 / 9:   return "16:9";
     }
-    static char arstr[32];
     if (aspect >= 1)
-        sprintf(arstr, "%.2f:1", aspect);
+        snprintf(arstr, 32, "%.2f:1", aspect);
     else
-        sprintf(arstr, "1:%.2f", 1. / aspect );
+        snprintf(arstr, 32, "1:%.2f", 1. / aspect );
     return arstr;
 }
 
@@ -95,10 +123,12 @@ static void ScanFunc( void * _data )
     hb_title_t * title;
     int          i;
     int          feature = 0;
+    int          previews_done = 0;
 
     data->bd = NULL;
     data->dvd = NULL;
     data->stream = NULL;
+    data->cache = hb_scan_cache_open( data->path, data->preview_count );
 
     /* Try to open the path as a DVD. If it fails, try as a file */
     if( ( data->bd = hb_bd_init( data->h, data->path ) ) )
@@ -115,13 +145,8 @@ static void ScanFunc( void * _data )
         else
         {
             /* Scan all titles */
-            for( i = 0; i < hb_bd_title_count( data->bd ); i++ )
-            {
-                UpdateState1(data, i + 1);
-                hb_list_add( data->title_set->list_title,
-                             hb_bd_title_scan( data->bd,
-                             i + 1, data->min_title_duration ) );
-            }
+            ScanTitles( data );
+            previews_done = 1;
             feature = hb_bd_main_feature( data->bd,
                                           data->title_set->list_title );
         }
@@ -165,17 +190,8 @@ static void ScanFunc( void * _data )
         else
         {
             /* Scan all titles */
-            for( i = 0; i < hb_batch_title_count( data->batch ); i++ )
-            {
-                hb_title_t * title;
-
-                UpdateState1(data, i + 1);
-                title = hb_batch_title_scan(data->batch, i + 1);
-                if ( title != NULL )
-                {
-                    hb_list_add( data->title_set->list_title, title );
-                }
-            }
+            ScanTitles( data );
+            previews_done = 1;
         }
     }
     else
@@ -204,11 +220,9 @@ static void ScanFunc( void * _data )
         }
     }
 
-    for( i = 0; i < hb_list_count( data->title_set->list_title ); )
+    for( i = 0; i < hb_list_count( data->title_set->list_title ) &&
+                !previews_done; )
     {
-        int j, npreviews;
-        hb_audio_t * audio;
-
         if ( *data->die )
         {
             goto finish;
@@ -217,73 +231,18 @@ static void ScanFunc( void * _data )
 
         UpdateState2(data, i + 1);
 
-        /* Decode previews */
-        /* this will also detect more AC3 / DTS information */
-        npreviews = DecodePreviews( data, title, 1 );
-        if (npreviews < 2)
-        {
-            // Try harder to get some valid frames
-            // Allow libav to return "corrupt" frames
-            hb_log("scan: Too few previews (%d), trying harder", npreviews);
-            title->flags |= HBTF_NO_IDR;
-            npreviews = DecodePreviews( data, title, 0 );
-        }
-        if (npreviews == 0)
+        if ( !ScanPreviews( data, title ) )
         {
-            /* TODO: free things */
             hb_list_rem( data->title_set->list_title, title );
-            for( j = 0; j < hb_list_count( title->list_audio ); j++)
-            {
-                audio = hb_list_item( title->list_audio, j );
-                if ( audio->priv.scan_cache )
-                {
-                    hb_fifo_flush( audio->priv.scan_cache );
-                    hb_fifo_close( &audio->priv.scan_cache );
-                }
-            }
             hb_title_close( &title );
             continue;
         }
-        title->preview_count = npreviews;
-
-        /* Make sure we found audio rates and bitrates */
-        for( j = 0; j < hb_list_count( title->list_audio ); )
-        {
-            audio = hb_list_item( title->list_audio, j );
-            if ( audio->priv.scan_cache )
-            {
-                hb_fifo_flush( audio->priv.scan_cache );
-                hb_fifo_close( &audio->priv.scan_cache );
-            }
-            if( !audio->config.in.bitrate )
-            {
-                hb_log( "scan: removing audio 0x%x because no bitrate found",
-                        audio->id );
-                hb_list_rem( title->list_audio, audio );
-                free( audio );
-                continue;
-            }
-            j++;
-        }
-
-        // VOBSUB and PGS width and height needs to be set to the
-        // title width and height for any stream type that does
-        // not provide this information (DVDs, BDs, VOBs, and M2TSs).
-        // Title width and height don't get set until we decode
-        // previews, so we can't set subtitle width/height till
-        // we get here.
-        for (j = 0; j < hb_list_count(title->list_subtitle); j++)
-        {
-            hb_subtitle_t *subtitle = hb_list_item(title->list_subtitle, j);
-            if ((subtitle->source == VOBSUB || subtitle->source == PGSSUB) &&
-                (subtitle->width <= 0 || subtitle->height <= 0))
-            {
-                subtitle->width  = title->geometry.width;
-                subtitle->height = title->geometry.height;
-            }
-        }
         i++;
     }
+    if ( previews_done && *data->die )
+    {
+        goto finish;
+    }
 
     data->title_set->feature = feature;
 
@@ -321,12 +280,225 @@ finish:
     {
         hb_batch_close( &data->batch );
     }
+    hb_scan_cache_close( &data->cache );
     free( data->path );
     free( data );
     _data = NULL;
     hb_buffer_pool_free();
 }
 
+/*
+ * Decodes the previews of 'title' and finishes its audio and subtitle
+ * information.  Returns the number of previews, 0 if the title is
+ * unusable and should be dropped.
+ */
+static int ScanPreviews( hb_scan_t * data, hb_title_t * title )
+{
+    int j, npreviews = -1, cached;
+    hb_audio_t * audio;
+
+    // Previews have to be decoded when they are stored
+    if ( !data->store_previews )
+    {
+        npreviews = hb_scan_cache_get( data->cache, title );
+    }
+    cached = npreviews >= 0;
+    if ( !cached )
+    {
+        /* Decode previews */
+        /* this will also detect more AC3 / DTS information */
+        npreviews = DecodePreviews( data, title, 1 );
+        if (npreviews < 2 && !*data->die)
+        {
+            // Try harder to get some valid frames
+            // Allow libav to return "corrupt" frames
+            hb_log("scan: Too few previews (%d), trying harder", npreviews);
+            title->flags |= HBTF_NO_IDR;
+            npreviews = DecodePreviews( data, title, 0 );
+        }
+    }
+    if ( !cached && !*data->die )
+    {
+        hb_scan_cache_put( data->cache, title, npreviews );
+    }
+    if (npreviews == 0)
+    {
+        for( j = 0; j < hb_list_count( title->list_audio ); j++)
+        {
+            audio = hb_list_item( title->list_audio, j );
+            if ( audio->priv.scan_cache )
+            {
+                hb_fifo_flush( audio->priv.scan_cache );
+                hb_fifo_close( &audio->priv.scan_cache );
+            }
+        }
+        return 0;
+    }
+    title->preview_count = npreviews;
+
+    /* Make sure we found audio rates and bitrates */
+    for( j = 0; j < hb_list_count( title->list_audio ); )
+    {
+        audio = hb_list_item( title->list_audio, j );
+        if ( audio->priv.scan_cache )
+        {
+            hb_fifo_flush( audio->priv.scan_cache );
+            hb_fifo_close( &audio->priv.scan_cache );
+        }
+        if( !audio->config.in.bitrate )
+        {
+            hb_log( "scan: removing audio 0x%x because no bitrate found",
+                    audio->id );
+            hb_list_rem( title->list_audio, audio );
+            free( audio );
+            continue;
+        }
+        j++;
+    }
+
+    // VOBSUB and PGS width and height needs to be set to the
+    // title width and height for any stream type that does
+    // not provide this information (DVDs, BDs, VOBs, and M2TSs).
+    // Title width and height don't get set until we decode
+    // previews, so we can't set subtitle width/height till
+    // we get here.
+    for (j = 0; j < hb_list_count(title->list_subtitle); j++)
+    {
+        hb_subtitle_t *subtitle = hb_list_item(title->list_subtitle, j);
+        if ((subtitle->source == VOBSUB || subtitle->source == PGSSUB) &&
+            (subtitle->width <= 0 || subtitle->height <= 0))
+        {
+            subtitle->width  = title->geometry.width;
+            subtitle->height = title->geometry.height;
+        }
+    }
+    return npreviews;
+}
+
+static void ScanTitleWorker( void * _worker )
+{
+    scan_worker_t * worker = _worker;
+    scan_queue_t  * queue  = worker->queue;
+    hb_scan_t     * data   = &worker->data;
+    hb_title_t    * title;
+    int             index;
+
+    while ( 1 )
+    {
+        hb_lock( queue->lock );
+        index = queue->next++;
+        hb_unlock( queue->lock );
+        if ( index >= queue->count || *data->die )
+        {
+            break;
+        }
+
+        if ( data->bd )
+        {
+            title = hb_bd_title_scan( data->bd, index + 1,
+                                      data->min_title_duration );
+        }
+        else
+        {
+            title = hb_batch_title_scan( data->batch, index + 1 );
+        }
+        if ( title != NULL && !*data->die && !ScanPreviews( data, title ) )
+        {
+            hb_title_close( &title );
+        }
+
+        hb_lock( queue->lock );
+        queue->titles[index] = title;
+        queue->done++;
+        UpdateState4( data, queue->done, queue->count );
+        hb_unlock( queue->lock );
+    }
+}
+
+/*
+ * Scans all titles of a BD or batch folder and decodes their previews.
+ * Titles are handed out to a few threads, each with its own BD handle.
+ * The titles are added to the title set in title order.
+ */
+static void ScanTitles( hb_scan_t * data )
+{
+    scan_queue_t    queue;
+    scan_worker_t * workers;
+    int             ii, thread_count;
+
+    memset( &queue, 0, sizeof( queue ) );
+    queue.count  = data->bd ? hb_bd_title_count( data->bd ) :
+                              hb_batch_title_count( data->batch );
+    if ( queue.count <= 0 )
+    {
+        return;
+    }
+    queue.lock   = hb_lock_init();
+    queue.titles = calloc( queue.count, sizeof( hb_title_t * ) );
+
+    thread_count = MIN( hb_get_cpu_count(), SCAN_MAX_THREADS );
+    thread_count = MAX( MIN( thread_count, queue.count ), 1 );
+    workers      = calloc( thread_count, sizeof( scan_worker_t ) );
+    if ( queue.lock == NULL || queue.titles == NULL || workers == NULL )
+    {
+        hb_error( "scan: out of memory" );
+        goto done;
+    }
+
+    for ( ii = 0; ii < thread_count; ii++ )
+    {
+        workers[ii].data          = *data;
+        workers[ii].data.parallel = 1;
+        workers[ii].queue         = &queue;
+        if ( ii > 0 && data->bd )
+        {
+            // libbluray handles can only read one title at a time,
+            // the batch file list is only read
+            workers[ii].data.bd = hb_bd_dup( data->bd );
+            if ( workers[ii].data.bd == NULL )
+            {
+                thread_count = ii;
+                break;
+            }
+        }
+    }
+    hb_log( "scan: scanning %d titles with %d threads",
+            queue.count, thread_count );
+
+    UpdateState4( data, 0, queue.count );
+    for ( ii = 1; ii < thread_count; ii++ )
+    {
+        workers[ii].thread = hb_thread_init( "scan title", ScanTitleWorker,
+                                             &workers[ii],
+                                             HB_NORMAL_PRIORITY );
+    }
+    ScanTitleWorker( &workers[0] );
+    for ( ii = 1; ii < thread_count; ii++ )
+    {
+        if ( workers[ii].thread != NULL )
+        {
+            hb_thread_close( &workers[ii].thread );
+        }
+        if ( workers[ii].data.bd != NULL )
+        {
+            hb_bd_close( &workers[ii].data.bd );
+        }
+    }
+
+    for ( ii = 0; ii < queue.count; ii++ )
+    {
+        if ( queue.titles[ii] != NULL )
+        {
+            hb_list_add( data->title_set->list_title, queue.titles[ii] );
+        }
+    }
+
+done:
+    free( workers );
+    free( queue.titles );
+    hb_lock_close( &queue.lock );
+}
+
 // -----------------------------------------------
 // stuff related to cropping
 
@@ -537,389 +709,526 @@ static hb_buffer_t * read_buf(hb_scan_t * data, hb_stream_t * stream)
  * Decode 10 pictures for the given title.
  * It assumes that data->reader and data->vts have successfully been
  * DVDOpen()ed and ifoOpen()ed.
+ *
+ * Previews of stream and BD titles are decoded by several workers, each
+ * with a source handle and a decoder of its own.  The results are
+ * merged in preview order afterwards, so the title ends up as if the
+ * previews were decoded one after the other.
  **********************************************************************/
-static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
+typedef struct
 {
-    int                i, npreviews = 0, abort = 0;
-    hb_buffer_t      * buf, * buf_es;
-    hb_buffer_list_t   list_es;
-    int                progressive_count = 0;
-    int                pulldown_count = 0;
-    int                doubled_frame_count = 0;
-    int                interlaced_preview_count = 0;
-    int                vid_samples = 0;
-    int                frame_wait = 0;
-    int                cc_wait = 10;
-    int                frames;
-    hb_stream_t      * stream = NULL;
-    info_list_t      * info_list;
-    int                abort_audio = 0;
+    int              valid;         // a picture was decoded and measured
+    int              abort;         // no data left, later previews dropped
+    hb_work_info_t   info;
+    int              interlaced;
+    int              crop_valid;
+    int              crop[4];       // top, bottom, left, right
+    int              pulldown_count;
+    int              doubled_frame_count;
+    int              progressive_count;
+    int              vid_samples;
+} preview_result_t;
 
-    info_list = calloc(data->preview_count+1, sizeof(*info_list));
-    crop_record_t *crops = crop_record_init( data->preview_count );
+typedef struct
+{
+    hb_lock_t        * lock;        // protects the title's audio and below
+    int                next;        // index of the next preview to decode
+    int                stop;
+    int                abort_audio;
+    int                audio_done;  // abort_audio or all audio identified,
+                                    // read without the lock
+    void             * audio_owner; // worker filling the audio scan caches
+    int                flush;
+    hb_title_t       * title;
+    preview_result_t * results;
+} preview_queue_t;
 
-    hb_buffer_list_clear(&list_es);
+typedef struct
+{
+    hb_scan_t          data;        // copy of the scan with handles of its own
+    hb_stream_t      * stream;
+    hb_title_t         title;       // copy of the title for the decoder
+    int                subtitle_count;
+    hb_work_object_t * decoder;
+    int                cc_wait;
+    preview_queue_t  * queue;
+    hb_thread_t      * thread;
+} preview_worker_t;
 
-    if( data->batch )
-    {
-        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
-    }
-    else
+/*
+ * Returns whether the worker can stop reading for audio: all audio is
+ * identified, the source ran out of data or another worker is busy
+ * identifying it.
+ */
+static int preview_audio_done( preview_worker_t * worker )
+{
+    preview_queue_t * queue = worker->queue;
+    int               done;
+
+    if (hb_atomic_load(&queue->audio_done))
     {
-        hb_log( "scan: decoding previews for title %d", title->index );
+        return 1;
     }
+    hb_lock( queue->lock );
+    done = queue->abort_audio || AllAudioOK( queue->title ) ||
+           ( queue->audio_owner != NULL && queue->audio_owner != worker );
+    hb_unlock( queue->lock );
 
-    if (data->bd)
+    return done;
+}
+
+static int preview_worker_init( preview_worker_t * worker, hb_scan_t * data,
+                                hb_title_t * title, preview_queue_t * queue,
+                                int primary )
+{
+    void * opaque_priv = title->opaque_priv;
+    int    ii;
+
+    worker->data    = *data;
+    worker->queue   = queue;
+    worker->cc_wait = 10;
+    if ( data->bd )
     {
-        hb_bd_start( data->bd, title );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
+        if ( !primary )
+        {
+            worker->data.bd = hb_bd_dup( data->bd );
+            if ( worker->data.bd == NULL )
+            {
+                return 1;
+            }
+            if ( !hb_bd_start( worker->data.bd, title ) )
+            {
+                hb_bd_close( &worker->data.bd );
+                return 1;
+            }
+        }
     }
-    else if (data->dvd)
+    else if ( data->batch )
     {
-        hb_dvd_start( data->dvd, title, 1 );
-        title->angle_count = hb_dvd_angle_count( data->dvd );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
+        worker->stream = hb_stream_open( data->h, title->path, title, 0 );
     }
-    else if (data->batch)
+    else if ( data->stream )
     {
-        stream = hb_stream_open(data->h, title->path, title, 0);
+        worker->stream = hb_stream_open( data->h, data->path, title, 0 );
     }
-    else if (data->stream)
+    if ( !primary )
     {
-        stream = hb_stream_open(data->h, data->path, title, 0);
+        // ffmpeg streams point the title at their demuxer, all decoders
+        // use the one of the primary stream which is closed last
+        title->opaque_priv = opaque_priv;
+        if ( ( data->batch || data->stream ) && worker->stream == NULL )
+        {
+            return 1;
+        }
     }
 
-    if (title->video_codec == WORK_NONE)
+    // The decoder adds closed caption subtitles it detects to its title,
+    // it gets a copy so that the title's lists are only changed here
+    worker->title               = *title;
+    worker->title.list_audio    = hb_list_init();
+    worker->title.list_subtitle = hb_list_init();
+    for ( ii = 0; ii < hb_list_count( title->list_audio ); ii++ )
     {
-        hb_error("No video decoder set!");
-        free(info_list);
-        crop_record_free(crops);
-        hb_stream_close(&stream);
-        return 0;
+        hb_list_add( worker->title.list_audio,
+                     hb_list_item( title->list_audio, ii ) );
     }
-    hb_work_object_t *vid_decoder = hb_get_work(data->h, title->video_codec);
-    vid_decoder->codec_param = title->video_codec_param;
-    vid_decoder->title = title;
-
-    if (vid_decoder->init(vid_decoder, NULL))
+    for ( ii = 0; ii < hb_list_count( title->list_subtitle ); ii++ )
     {
-        hb_error("Decoder init failed!");
-        free(info_list);
-        crop_record_free(crops);
-        free( vid_decoder );
-        hb_stream_close(&stream);
-        return 0;
+        hb_list_add( worker->title.list_subtitle,
+                     hb_list_item( title->list_subtitle, ii ) );
     }
+    worker->subtitle_count = hb_list_count( worker->title.list_subtitle );
 
-    for( i = 0; i < data->preview_count; i++ )
+    worker->decoder = hb_get_work( data->h, title->video_codec );
+    worker->decoder->codec_param = title->video_codec_param;
+    worker->decoder->title = &worker->title;
+    if ( worker->decoder->init( worker->decoder, NULL ) )
     {
-        int j;
+        free( worker->decoder );
+        worker->decoder = NULL;
+        return 1;
+    }
+    return 0;
+}
 
-        UpdateState3(data, i + 1);
+static void preview_worker_close( preview_worker_t * worker,
+                                  hb_title_t * title, int primary )
+{
+    hb_subtitle_t * subtitle, * other;
+    int             ii;
 
-        if ( *data->die )
+    if ( worker->decoder != NULL )
+    {
+        worker->decoder->close( worker->decoder );
+        free( worker->decoder );
+        worker->decoder = NULL;
+    }
+
+    // Subtitles behind the copied ones are closed captions the decoder
+    // found, keep the first of them
+    while ( ( subtitle = hb_list_item( worker->title.list_subtitle,
+                                       worker->subtitle_count ) ) != NULL )
+    {
+        hb_list_rem( worker->title.list_subtitle, subtitle );
+        for ( ii = 0; ii < hb_list_count( title->list_subtitle ); ii++ )
         {
-            free( info_list );
-            crop_record_free( crops );
-            vid_decoder->close( vid_decoder );
-            free( vid_decoder );
-            hb_stream_close(&stream);
-            return 0;
+            other = hb_list_item( title->list_subtitle, ii );
+            if ( other->source == subtitle->source )
+            {
+                break;
+            }
         }
-        if (data->bd)
+        if ( ii < hb_list_count( title->list_subtitle ) )
         {
-            if( !hb_bd_seek( data->bd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
-          {
-              continue;
-          }
+            hb_subtitle_close( &subtitle );
+            continue;
         }
-        if (data->dvd)
+        subtitle->track = hb_list_count( title->list_subtitle );
+        hb_list_add( title->list_subtitle, subtitle );
+    }
+    hb_list_close( &worker->title.list_subtitle );
+    hb_list_close( &worker->title.list_audio );
+
+    hb_stream_close( &worker->stream );
+    if ( !primary && worker->data.bd != NULL )
+    {
+        hb_bd_stop( worker->data.bd );
+        hb_bd_close( &worker->data.bd );
+    }
+}
+
+/*
+ * Decodes preview 'i' with the source handle and decoder of 'worker'
+ */
+static void DecodePreview( preview_worker_t * worker, int i,
+                           preview_result_t * result )
+{
+    preview_queue_t  * queue       = worker->queue;
+    hb_scan_t        * data        = &worker->data;
+    hb_title_t       * title       = queue->title;
+    hb_work_object_t * vid_decoder = worker->decoder;
+    hb_stream_t      * stream      = worker->stream;
+    hb_buffer_t      * buf, * buf_es;
+    hb_buffer_list_t   list_es;
+    hb_buffer_t      * vid_buf = NULL, * last_vid_buf = NULL;
+    hb_work_info_t     vid_info;
+    int                j, frames, frame_wait, packets;
+
+    hb_buffer_list_clear(&list_es);
+
+    if (data->bd)
+    {
+        if( !hb_bd_seek( data->bd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
         {
-            if( !hb_dvd_seek( data->dvd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
-          {
-              continue;
-          }
+            return;
         }
-        else if (stream)
+    }
+    if (data->dvd)
+    {
+        if( !hb_dvd_seek( data->dvd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
         {
-            /* we start reading streams at zero rather than 1/11 because
-             * short streams may have only one sequence header in the entire
-             * file and we need it to decode any previews.
-             *
-             * Also, seeking to position 0 loses the palette of avi files
-             * so skip initial seek */
-            if (i != 0)
-            {
-                if (!hb_stream_seek(stream,
-                                    (float)i / (data->preview_count + 1.0)))
-                {
-                    continue;
-                }
-            }
-            else
+            return;
+        }
+    }
+    else if (stream)
+    {
+        /* we start reading streams at zero rather than 1/11 because
+         * short streams may have only one sequence header in the entire
+         * file and we need it to decode any previews.
+         *
+         * Also, seeking to position 0 loses the palette of avi files
+         * so skip initial seek */
+        if (i != 0)
+        {
+            if (!hb_stream_seek(stream,
+                                (float)i / (data->preview_count + 1.0)))
             {
-                hb_stream_set_need_keyframe(stream, 1);
+                return;
             }
         }
+        else
+        {
+            hb_stream_set_need_keyframe(stream, 1);
+        }
+    }
 
-        hb_deep_log( 2, "scan: preview %d", i + 1 );
+    hb_deep_log( 2, "scan: preview %d", i + 1 );
 
-        if (flush && vid_decoder->flush)
-            vid_decoder->flush( vid_decoder );
-        if (title->flags & HBTF_NO_IDR)
+    if (queue->flush && vid_decoder->flush)
+        vid_decoder->flush( vid_decoder );
+    if (title->flags & HBTF_NO_IDR)
+    {
+        if (!queue->flush)
         {
-            if (!flush)
-            {
-                // If we are doing the first previews decode attempt,
-                // set this threshold high so that we get the best
-                // quality frames possible.
-                frame_wait = 100;
-            }
-            else
-            {
-                // If we failed to get enough valid frames in the first
-                // previews decode attempt, lower the threshold to improve
-                // our chances of getting something to work with.
-                frame_wait = 10;
-            }
+            // If we are doing the first previews decode attempt,
+            // set this threshold high so that we get the best
+            // quality frames possible.
+            frame_wait = 100;
         }
         else
         {
-            // For certain mpeg-2 streams, libav is delivering a
-            // dummy first frame that is all black.  So always skip
-            // one frame
-            frame_wait = 1;
+            // If we failed to get enough valid frames in the first
+            // previews decode attempt, lower the threshold to improve
+            // our chances of getting something to work with.
+            frame_wait = 10;
         }
-        frames = 0;
-
-        hb_buffer_t * vid_buf = NULL, * last_vid_buf = NULL;
+    }
+    else
+    {
+        // For certain mpeg-2 streams, libav is delivering a
+        // dummy first frame that is all black.  So always skip
+        // one frame
+        frame_wait = 1;
+    }
+    frames = 0;
 
-        int packets = 0;
-        vid_decoder->frame_count = 0;
-        while (vid_decoder->frame_count < PREVIEW_READ_THRESH ||
-              (!AllAudioOK(title) && packets < 10000))
+    packets = 0;
+    vid_decoder->frame_count = 0;
+    while (vid_decoder->frame_count < PREVIEW_READ_THRESH ||
+          (!preview_audio_done(worker) && packets < 10000))
+    {
+        if ((buf = read_buf(data, stream)) == NULL)
         {
-            if ((buf = read_buf(data, stream)) == NULL)
+            // If we reach EOF and no audio, don't continue looking for
+            // audio
+            hb_lock(queue->lock);
+            queue->abort_audio = 1;
+            hb_atomic_store(&queue->audio_done, 1);
+            hb_unlock(queue->lock);
+            if (vid_buf != NULL || last_vid_buf != NULL)
             {
-                // If we reach EOF and no audio, don't continue looking for
-                // audio
-                abort_audio = 1;
-                if (vid_buf != NULL || last_vid_buf != NULL)
-                {
-                    break;
-                }
-                hb_log("Warning: Could not read data for preview %d, skipped",
-                       i + 1 );
-
-                // If we reach EOF and no video, don't continue looking for
-                // video
-                abort = 1;
-                goto skip_preview;
+                break;
             }
+            hb_log("Warning: Could not read data for preview %d, skipped",
+                   i + 1 );
 
-            packets++;
-            if (buf->size <= 0)
-            {
-                // Ignore "null" frames
-                hb_buffer_close(&buf);
-                continue;
-            }
+            // If we reach EOF and no video, don't continue looking for
+            // video
+            result->abort = 1;
+            goto skip_preview;
+        }
+
+        packets++;
+        if (buf->size <= 0)
+        {
+            // Ignore "null" frames
+            hb_buffer_close(&buf);
+            continue;
+        }
 
-            (hb_demux[title->demuxer])(buf, &list_es, 0 );
+        (hb_demux[title->demuxer])(buf, &list_es, 0 );
 
-            while ((buf_es = hb_buffer_list_rem_head(&list_es)) != NULL)
+        while ((buf_es = hb_buffer_list_rem_head(&list_es)) != NULL)
+        {
+            if( buf_es->s.id == title->video_id && vid_buf == NULL )
             {
-                if( buf_es->s.id == title->video_id && vid_buf == NULL )
+                vid_decoder->work( vid_decoder, &buf_es, &vid_buf );
+                // There are 2 conditions we decode additional
+                // video frames for during scan.
+                // 1. We did not detect IDR frames, so the initial video
+                //    frames may be corrupt.  We decode extra frames to
+                //    increase the probability of a complete preview frame
+                // 2. Some frames do not contain CC data, even though
+                //    CCs are present in the stream.  So we need to decode
+                //    additional frames to find the CCs.
+                if (vid_buf != NULL && (frame_wait || worker->cc_wait))
                 {
-                    vid_decoder->work( vid_decoder, &buf_es, &vid_buf );
-                    // There are 2 conditions we decode additional
-                    // video frames for during scan.
-                    // 1. We did not detect IDR frames, so the initial video
-                    //    frames may be corrupt.  We decode extra frames to
-                    //    increase the probability of a complete preview frame
-                    // 2. Some frames do not contain CC data, even though
-                    //    CCs are present in the stream.  So we need to decode
-                    //    additional frames to find the CCs.
-                    if (vid_buf != NULL && (frame_wait || cc_wait))
+                    if (vid_decoder->info(vid_decoder, &vid_info))
                     {
-                        hb_work_info_t vid_info;
-                        if (vid_decoder->info(vid_decoder, &vid_info))
+                        if (is_close_to(vid_info.rate.den, 900900, 100) &&
+                            (vid_buf->s.flags & PIC_FLAG_REPEAT_FIRST_FIELD))
+                        {
+                            /* Potentially soft telecine material */
+                            result->pulldown_count++;
+                        }
+
+                        if (vid_buf->s.flags & PIC_FLAG_REPEAT_FRAME)
                         {
-                            if (is_close_to(vid_info.rate.den, 900900, 100) &&
-                                (vid_buf->s.flags & PIC_FLAG_REPEAT_FIRST_FIELD))
-                            {
-                                /* Potentially soft telecine material */
-                                pulldown_count++;
-                            }
-
-                            if (vid_buf->s.flags & PIC_FLAG_REPEAT_FRAME)
-                            {
-                                // AVCHD-Lite specifies that all streams are
-                                // 50 or 60 fps.  To produce 25 or 30 fps, camera
-                                // makers are repeating all frames.
-                                doubled_frame_count++;
-                            }
-
-                            if (is_close_to(vid_info.rate.den, 1126125, 100 ))
-                            {
-                                // Frame FPS is 23.976 (meaning it's
-                                // progressive), so start keeping track of
-                                // how many are reporting at that speed. When
-                                // enough show up that way, we want to make
-                                // that the overall title FPS.
-                                progressive_count++;
-                            }
-                            vid_samples++;
+                            // AVCHD-Lite specifies that all streams are
+                            // 50 or 60 fps.  To produce 25 or 30 fps, camera
+                            // makers are repeating all frames.
+                            result->doubled_frame_count++;
                         }
 
-                        if (frames > 0 && vid_buf->s.frametype == HB_FRAME_I)
-                            frame_wait = 0;
-                        if (frame_wait || cc_wait)
+                        if (is_close_to(vid_info.rate.den, 1126125, 100 ))
                         {
-                            hb_buffer_close(&last_vid_buf);
-                            last_vid_buf = vid_buf;
-                            vid_buf = NULL;
-                            if (frame_wait) frame_wait--;
-                            if (cc_wait) cc_wait--;
+                            // Frame FPS is 23.976 (meaning it's
+                            // progressive), so start keeping track of
+                            // how many are reporting at that speed. When
+                            // enough show up that way, we want to make
+                            // that the overall title FPS.
+                            result->progressive_count++;
                         }
-                        frames++;
+                        result->vid_samples++;
+                    }
+
+                    if (frames > 0 && vid_buf->s.frametype == HB_FRAME_I)
+                        frame_wait = 0;
+                    if (frame_wait || worker->cc_wait)
+                    {
+                        hb_buffer_close(&last_vid_buf);
+                        last_vid_buf = vid_buf;
+                        vid_buf = NULL;
+                        if (frame_wait) frame_wait--;
+                        if (worker->cc_wait) worker->cc_wait--;
                     }
+                    frames++;
                 }
-                else if (!AllAudioOK(title) && !abort_audio)
+            }
+            else if (!hb_atomic_load(&queue->audio_done))
+            {
+                // Audio scan caches must hold consecutive packets,
+                // so one worker at a time identifies audio
+                hb_lock(queue->lock);
+                if (!queue->abort_audio && !AllAudioOK(title) &&
+                    (queue->audio_owner == NULL ||
+                     queue->audio_owner == worker))
                 {
+                    queue->audio_owner = worker;
                     LookForAudio( data, title, buf_es );
                     buf_es = NULL;
+                    if (AllAudioOK(title))
+                    {
+                        hb_atomic_store(&queue->audio_done, 1);
+                    }
                 }
-                if ( buf_es )
-                    hb_buffer_close( &buf_es );
+                hb_unlock(queue->lock);
             }
-
-            if (vid_buf && (abort_audio || AllAudioOK(title)))
-                break;
+            if ( buf_es )
+                hb_buffer_close( &buf_es );
         }
-        hb_buffer_list_close(&list_es);
 
-        if (vid_buf == NULL)
-        {
-            vid_buf = last_vid_buf;
-            last_vid_buf = NULL;
-        }
-        hb_buffer_close(&last_vid_buf);
+        if (vid_buf && preview_audio_done(worker))
+            break;
+    }
 
-        if (vid_buf == NULL)
-        {
-            hb_log( "scan: could not get a decoded picture" );
-            continue;
-        }
+    if (vid_buf == NULL)
+    {
+        vid_buf = last_vid_buf;
+        last_vid_buf = NULL;
+    }
+    hb_buffer_close(&last_vid_buf);
 
-        /* Get size and rate infos */
+    if (vid_buf == NULL)
+    {
+        hb_log( "scan: could not get a decoded picture" );
+        goto skip_preview;
+    }
 
-        hb_work_info_t vid_info;
-        if( !vid_decoder->info( vid_decoder, &vid_info ) )
-        {
-            /*
-             * Could not fill vid_info, don't continue and try to use vid_info
-             * in this case.
-             */
-            hb_log( "scan: could not get a video information" );
-            hb_buffer_close( &vid_buf );
-            continue;
-        }
+    /* Get size and rate infos */
 
-        if (vid_info.geometry.width  != vid_buf->f.width ||
-            vid_info.geometry.height != vid_buf->f.height)
-        {
-            hb_log( "scan: video geometry information does not match buffer" );
-            hb_buffer_close( &vid_buf );
-            continue;
-        }
-        remember_info( info_list, &vid_info );
+    if( !vid_decoder->info( vid_decoder, &vid_info ) )
+    {
+        /*
+         * Could not fill vid_info, don't continue and try to use vid_info
+         * in this case.
+         */
+        hb_log( "scan: could not get a video information" );
+        goto skip_preview;
+    }
 
-        /* Check preview for interlacing artifacts */
-        if( hb_detect_comb( vid_buf, 10, 30, 9, 10, 30, 9 ) )
-        {
-            hb_deep_log( 2, "Interlacing detected in preview frame %i", i+1);
-            interlaced_preview_count++;
-        }
+    if (vid_info.geometry.width  != vid_buf->f.width ||
+        vid_info.geometry.height != vid_buf->f.height)
+    {
+        hb_log( "scan: video geometry information does not match buffer" );
+        goto skip_preview;
+    }
+    result->info = vid_info;
 
-        if( data->store_previews )
-        {
-            hb_save_preview( data->h, title->index, i, vid_buf );
-        }
+    /* Check preview for interlacing artifacts */
+    if( hb_detect_comb( vid_buf, 10, 30, 9, 10, 30, 9 ) )
+    {
+        hb_deep_log( 2, "Interlacing detected in preview frame %i", i+1);
+        result->interlaced = 1;
+    }
+
+    if( data->store_previews )
+    {
+        hb_save_preview( data->h, title->index, i, vid_buf );
+    }
 
-        /* Detect black borders */
+    /* Detect black borders */
 
-        int top, bottom, left, right;
-        int h4 = vid_info.geometry.height / 4, w4 = vid_info.geometry.width / 4;
+    int top, bottom, left, right;
+    int h4 = vid_info.geometry.height / 4, w4 = vid_info.geometry.width / 4;
 
-        // When widescreen content is matted to 16:9 or 4:3 there's sometimes
-        // a thin border on the outer edge of the matte. On TV content it can be
-        // "line 21" VBI data that's normally hidden in the overscan. For HD
-        // content it can just be a diagnostic added in post production so that
-        // the frame borders are visible. We try to ignore these borders so
-        // we can crop the matte. The border width depends on the resolution
-        // (12 pixels on 1080i looks visually the same as 4 pixels on 480i)
-        // so we allow the border to be up to 1% of the frame height.
-        const int border = vid_info.geometry.height / 100;
+    // When widescreen content is matted to 16:9 or 4:3 there's sometimes
+    // a thin border on the outer edge of the matte. On TV content it can be
+    // "line 21" VBI data that's normally hidden in the overscan. For HD
+    // content it can just be a diagnostic added in post production so that
+    // the frame borders are visible. We try to ignore these borders so
+    // we can crop the matte. The border width depends on the resolution
+    // (12 pixels on 1080i looks visually the same as 4 pixels on 480i)
+    // so we allow the border to be up to 1% of the frame height.
+    const int border = vid_info.geometry.height / 100;
 
-        for ( top = border; top < h4; ++top )
+    for ( top = border; top < h4; ++top )
+    {
+        if ( ! row_all_dark( vid_buf, top ) )
+            break;
+    }
+    if ( top <= border )
+    {
+        // we never made it past the border region - see if the rows we
+        // didn't check are dark or if we shouldn't crop at all.
+        for ( top = 0; top < border; ++top )
         {
             if ( ! row_all_dark( vid_buf, top ) )
                 break;
         }
-        if ( top <= border )
+        if ( top >= border )
         {
-            // we never made it past the border region - see if the rows we
-            // didn't check are dark or if we shouldn't crop at all.
-            for ( top = 0; top < border; ++top )
-            {
-                if ( ! row_all_dark( vid_buf, top ) )
-                    break;
-            }
-            if ( top >= border )
-            {
-                top = 0;
-            }
+            top = 0;
         }
-        for ( bottom = border; bottom < h4; ++bottom )
+    }
+    for ( bottom = border; bottom < h4; ++bottom )
+    {
+        if ( ! row_all_dark( vid_buf, vid_info.geometry.height - 1 - bottom ) )
+            break;
+    }
+    if ( bottom <= border )
+    {
+        for ( bottom = 0; bottom < border; ++bottom )
         {
             if ( ! row_all_dark( vid_buf, vid_info.geometry.height - 1 - bottom ) )
                 break;
         }
-        if ( bottom <= border )
+        if ( bottom >= border )
         {
-            for ( bottom = 0; bottom < border; ++bottom )
-            {
-                if ( ! row_all_dark( vid_buf, vid_info.geometry.height - 1 - bottom ) )
-                    break;
-            }
-            if ( bottom >= border )
-            {
-                bottom = 0;
-            }
-        }
-        for ( left = 0; left < w4; ++left )
-        {
-            if ( ! column_all_dark( vid_buf, top, bottom, left ) )
-                break;
-        }
-        for ( right = 0; right < w4; ++right )
-        {
-            if ( ! column_all_dark( vid_buf, top, bottom, vid_info.geometry.width - 1 - right ) )
-                break;
+            bottom = 0;
         }
+    }
+    for ( left = 0; left < w4; ++left )
+    {
+        if ( ! column_all_dark( vid_buf, top, bottom, left ) )
+            break;
+    }
+    for ( right = 0; right < w4; ++right )
+    {
+        if ( ! column_all_dark( vid_buf, top, bottom, vid_info.geometry.width - 1 - right ) )
+            break;
+    }
 
-        // only record the result if all the crops are less than a quarter of
-        // the frame otherwise we can get fooled by frames with a lot of black
-        // like titles, credits & fade-thru-black transitions.
-        if ( top < h4 && bottom < h4 && left < w4 && right < w4 )
-        {
-            record_crop( crops, top, bottom, left, right );
-        }
-        ++npreviews;
+    // only record the result if all the crops are less than a quarter of
+    // the frame otherwise we can get fooled by frames with a lot of black
+    // like titles, credits & fade-thru-black transitions.
+    if ( top < h4 && bottom < h4 && left < w4 && right < w4 )
+    {
+        result->crop_valid = 1;
+        result->crop[0] = top;
+        result->crop[1] = bottom;
+        result->crop[2] = left;
+        result->crop[3] = right;
+    }
+    result->valid = 1;
 
 skip_preview:
-        /* Make sure we found audio rates and bitrates */
+    hb_buffer_list_close(&list_es);
+
+    /* Make sure we found audio rates and bitrates */
+    hb_lock(queue->lock);
+    if (queue->audio_owner == worker)
+    {
         for( j = 0; j < hb_list_count( title->list_audio ); j++ )
         {
             hb_audio_t * audio = hb_list_item( title->list_audio, j );
@@ -928,24 +1237,185 @@ skip_preview:
                 hb_fifo_flush( audio->priv.scan_cache );
             }
         }
-        if (vid_buf)
+        queue->audio_owner = NULL;
+    }
+    hb_unlock(queue->lock);
+
+    if (vid_buf)
+    {
+        hb_buffer_close( &vid_buf );
+    }
+}
+
+static void DecodePreviewWorker( void * _worker )
+{
+    preview_worker_t * worker = _worker;
+    preview_queue_t  * queue  = worker->queue;
+    int                index;
+
+    while ( 1 )
+    {
+        hb_lock( queue->lock );
+        index = queue->next;
+        if ( index >= worker->data.preview_count || queue->stop ||
+             *worker->data.die )
+        {
+            hb_unlock( queue->lock );
+            break;
+        }
+        queue->next++;
+        UpdateState3( &worker->data, index + 1 );
+        hb_unlock( queue->lock );
+
+        DecodePreview( worker, index, &queue->results[index] );
+        if ( queue->results[index].abort )
         {
-            hb_buffer_close( &vid_buf );
+            // Later previews would run into the end of the source as well
+            hb_lock( queue->lock );
+            queue->stop = 1;
+            hb_unlock( queue->lock );
         }
-        if (abort)
+    }
+}
+
+static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
+{
+    int                i, ii, npreviews = 0;
+    int                progressive_count = 0;
+    int                pulldown_count = 0;
+    int                doubled_frame_count = 0;
+    int                interlaced_preview_count = 0;
+    int                vid_samples = 0;
+    int                thread_count;
+    info_list_t      * info_list;
+    crop_record_t    * crops;
+    preview_queue_t    queue;
+    preview_worker_t * workers;
+    preview_result_t * result;
+    char               arstr[32];
+
+    if( data->batch )
+    {
+        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
+    }
+    else
+    {
+        hb_log( "scan: decoding previews for title %d", title->index );
+    }
+
+    if (data->bd)
+    {
+        hb_bd_start( data->bd, title );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+    else if (data->dvd)
+    {
+        hb_dvd_start( data->dvd, title, 1 );
+        title->angle_count = hb_dvd_angle_count( data->dvd );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+
+    if (title->video_codec == WORK_NONE)
+    {
+        hb_error("No video decoder set!");
+        return 0;
+    }
+
+    // Titles that are scanned in parallel already keep the CPUs busy,
+    // DVDs are read through a single libdvdnav handle
+    thread_count = 1;
+    if (!data->parallel && !data->dvd)
+    {
+        thread_count = MIN(hb_get_cpu_count(), SCAN_MAX_THREADS);
+        thread_count = MAX(MIN(thread_count, data->preview_count), 1);
+    }
+
+    memset(&queue, 0, sizeof(queue));
+    queue.lock       = hb_lock_init();
+    queue.flush      = flush;
+    queue.title      = title;
+    queue.audio_done = AllAudioOK(title);
+    queue.results    = calloc(data->preview_count + 1,
+                              sizeof(preview_result_t));
+    workers          = calloc(thread_count, sizeof(preview_worker_t));
+    info_list        = calloc(data->preview_count + 1, sizeof(*info_list));
+    crops            = crop_record_init( data->preview_count );
+    if (queue.lock == NULL || queue.results == NULL || workers == NULL)
+    {
+        hb_error("scan: out of memory");
+        goto fail;
+    }
+
+    if (preview_worker_init(&workers[0], data, title, &queue, 1))
+    {
+        hb_error("Decoder init failed!");
+        preview_worker_close(&workers[0], title, 1);
+        goto fail;
+    }
+    for (ii = 1; ii < thread_count; ii++)
+    {
+        if (preview_worker_init(&workers[ii], data, title, &queue, 0))
         {
+            preview_worker_close(&workers[ii], title, 0);
+            thread_count = ii;
             break;
         }
     }
-    UpdateState3(data, i);
+    if (thread_count > 1)
+    {
+        hb_log("scan: decoding previews with %d threads", thread_count);
+    }
+
+    for (ii = 1; ii < thread_count; ii++)
+    {
+        workers[ii].thread = hb_thread_init("scan preview",
+                                            DecodePreviewWorker, &workers[ii],
+                                            HB_NORMAL_PRIORITY);
+    }
+    DecodePreviewWorker(&workers[0]);
+    for (ii = thread_count - 1; ii >= 0; ii--)
+    {
+        if (workers[ii].thread != NULL)
+        {
+            hb_thread_close(&workers[ii].thread);
+        }
+        // The primary stream goes last, decoders may still refer to it
+        preview_worker_close(&workers[ii], title, ii == 0);
+    }
 
-    vid_decoder->close( vid_decoder );
-    free( vid_decoder );
+    if ( *data->die )
+    {
+        goto fail;
+    }
 
-    if (stream != NULL)
+    // Merge the results as if the previews were decoded in order
+    for( i = 0; i < data->preview_count; i++ )
     {
-        hb_stream_close(&stream);
+        result = &queue.results[i];
+        pulldown_count      += result->pulldown_count;
+        doubled_frame_count += result->doubled_frame_count;
+        progressive_count   += result->progressive_count;
+        vid_samples         += result->vid_samples;
+        if (result->valid)
+        {
+            remember_info( info_list, &result->info );
+            if (result->interlaced)
+            {
+                interlaced_preview_count++;
+            }
+            if (result->crop_valid)
+            {
+                record_crop( crops, result->crop[0], result->crop[1],
+                             result->crop[2], result->crop[3] );
+            }
+            ++npreviews;
+        }
+        if (result->abort)
+        {
+            break;
+        }
     }
+    UpdateState3(data, i);
 
     if ( npreviews )
     {
@@ -1062,7 +1532,7 @@ skip_preview:
                 npreviews, title->geometry.width, title->geometry.height,
                 (float)title->vrate.num / title->vrate.den,
                 title->crop[0], title->crop[1], title->crop[2], title->crop[3],
-                aspect_to_string(&title->dar),
+                aspect_to_string(&title->dar, arstr),
                 title->geometry.par.num, title->geometry.par.den);
 
         if (title->video_decode_support != HB_DECODE_SUPPORT_SW)
@@ -1083,10 +1553,13 @@ skip_preview:
             title->detected_interlacing = 0;
         }
     }
+
+fail:
     crop_record_free( crops );
     free( info_list );
-
-    hb_buffer_list_close(&list_es);
+    free( workers );
+    free( queue.results );
+    hb_lock_close( &queue.lock );
 
     if (data->bd)
       hb_bd_stop( data->bd );
@@ -1477,6 +1950,11 @@ static void UpdateState3(hb_scan_t *scan, int preview)
 {
     hb_state_t state;
 
+    if (scan->parallel)
+    {
+        // Progress is reported per title, see UpdateState4()
+        return;
+    }
     hb_get_state2(scan->h, &state);
 #define p state.param.scanning
     p.preview_cur = preview;
@@ -1489,3 +1967,21 @@ static void UpdateState3(hb_scan_t *scan, int preview)
 
     hb_set_state(scan->h, &state);
 }
+
+static void UpdateState4(hb_scan_t *scan, int done, int count)
+{
+    hb_state_t state;
+
+    hb_get_state2(scan->h, &state);
+#define p state.param.scanning
+    /* Update the UI */
+    state.state   = HB_STATE_SCANNING;
+    p.title_cur   = MIN(done + 1, count);
+    p.title_count = count;
+    p.preview_cur = 0;
+    p.preview_count = 1;
+    p.progress = (float)done / count;
+#undef p
+
+    hb_set_state(scan->h, &state);
+}
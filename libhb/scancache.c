@@ -0,0 +1,519 @@
+/* scancache.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/hbffmpeg.h"
+#include "handbrake/hb_dict.h"
+#include "handbrake/audio_remap.h"
+#include "libavutil/md5.h"
+
+/*
+ * Persistent scan results.
+ *
+ * Decoding previews, identifying audio and detecting crop make up most
+ * of a scan.  Their results are kept per title in a JSON file of the
+ * cache directory, one file per source.  A source is recognized by its
+ * path, size, modification time and a hash of its first and last bytes.
+ * Container parsing still runs on every scan; the title it produces
+ * must match the cached one before the results are used.
+ *
+ * Only regular files are cached (stream files, DVD and BD images).
+ */
+
+#define SCAN_CACHE_VERSION   1
+#define SCAN_CACHE_HASH_SIZE (64 * 1024)   // bytes hashed at each end
+
+struct hb_scan_cache_s
+{
+    hb_lock_t * lock;
+    char      * file;           // cache file of the source
+    hb_dict_t * titles;         // results by title index
+    int         modified;
+};
+
+static char * cache_directory = NULL;
+static int    cache_write_count = 0;  // makes temporary file names unique
+
+void hb_scan_cache_set_directory( const char * dir )
+{
+    free(cache_directory);
+    cache_directory = dir != NULL && dir[0] != 0 ? strdup(dir) : NULL;
+}
+
+static void md5_to_string( uint8_t digest[16], char str[33] )
+{
+    int ii;
+
+    for (ii = 0; ii < 16; ii++)
+    {
+        snprintf(str + ii * 2, 3, "%02x", digest[ii]);
+    }
+}
+
+/*
+ * Returns a string that changes whenever the source does, NULL if the
+ * source is not a regular file.
+ */
+static char * source_fingerprint( const char * path )
+{
+    hb_stat_t       st;
+    FILE          * file;
+    struct AVMD5  * md5;
+    uint8_t       * buf, digest[16];
+    int64_t         size;
+    size_t          len;
+    char            hash[33];
+
+    if (hb_stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return NULL;
+    }
+    file = hb_fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    buf = malloc(SCAN_CACHE_HASH_SIZE);
+    md5 = av_md5_alloc();
+    if (buf == NULL || md5 == NULL)
+    {
+        free(buf);
+        av_free(md5);
+        fclose(file);
+        return NULL;
+    }
+
+    size = st.st_size;
+    av_md5_init(md5);
+    len = fread(buf, 1, SCAN_CACHE_HASH_SIZE, file);
+    av_md5_update(md5, buf, len);
+    if (size > SCAN_CACHE_HASH_SIZE &&
+        fseeko(file, MAX(size - SCAN_CACHE_HASH_SIZE,
+                         SCAN_CACHE_HASH_SIZE), SEEK_SET) == 0)
+    {
+        len = fread(buf, 1, SCAN_CACHE_HASH_SIZE, file);
+        av_md5_update(md5, buf, len);
+    }
+    av_md5_final(md5, digest);
+    md5_to_string(digest, hash);
+
+    av_free(md5);
+    free(buf);
+    fclose(file);
+
+    return hb_strdup_printf("%s:%"PRId64":%"PRId64":%s", path, size,
+                            (int64_t)st.st_mtime, hash);
+}
+
+/*
+ * Returns the cache file of 'path', named after the hash of the path
+ */
+static char * cache_file( const char * path )
+{
+    uint8_t digest[16];
+    char    hash[33];
+
+    av_md5_sum(digest, (const uint8_t*)path, strlen(path));
+    md5_to_string(digest, hash);
+
+    return hb_strdup_printf("%s/%s.json", cache_directory, hash);
+}
+
+hb_scan_cache_t * hb_scan_cache_open( const char * path, int preview_count )
+{
+    hb_scan_cache_t * cache;
+    hb_dict_t       * dict, * titles = NULL;
+    char            * fingerprint;
+    const char      * str;
+    int               version = 0, count = 0;
+
+    if (cache_directory == NULL)
+    {
+        return NULL;
+    }
+    fingerprint = source_fingerprint(path);
+    if (fingerprint == NULL)
+    {
+        return NULL;
+    }
+    hb_mkdir(cache_directory);
+
+    cache = calloc(1, sizeof(hb_scan_cache_t));
+    if (cache == NULL)
+    {
+        free(fingerprint);
+        return NULL;
+    }
+    cache->lock = hb_lock_init();
+    cache->file = cache_file(path);
+
+    // Results depend on the preview count and on the decoders
+    dict = hb_value_read_json(cache->file);
+    str  = hb_value_get_string(hb_dict_get(dict, "Fingerprint"));
+    hb_dict_extract_int(&version, dict, "Version");
+    hb_dict_extract_int(&count, dict, "PreviewCount");
+    if (version == SCAN_CACHE_VERSION && count == preview_count &&
+        str != NULL && !strcmp(str, fingerprint) &&
+        (str = hb_value_get_string(hb_dict_get(dict, "HandBrake"))) != NULL &&
+        !strcmp(str, HB_PROJECT_VERSION))
+    {
+        titles = hb_value_dup(hb_dict_get(dict, "Titles"));
+    }
+    hb_value_free(&dict);
+
+    if (titles == NULL || hb_value_type(titles) != HB_VALUE_TYPE_DICT)
+    {
+        hb_value_free(&titles);
+        titles = hb_dict_init();
+    }
+    cache->titles = hb_dict_init();
+    hb_dict_set(cache->titles, "Version", hb_value_int(SCAN_CACHE_VERSION));
+    hb_dict_set(cache->titles, "HandBrake", hb_value_string(HB_PROJECT_VERSION));
+    hb_dict_set(cache->titles, "Fingerprint", hb_value_string(fingerprint));
+    hb_dict_set(cache->titles, "PreviewCount", hb_value_int(preview_count));
+    hb_dict_set(cache->titles, "Titles", titles);
+    free(fingerprint);
+
+    if (cache->lock == NULL || cache->file == NULL)
+    {
+        hb_scan_cache_close(&cache);
+    }
+    return cache;
+}
+
+void hb_scan_cache_close( hb_scan_cache_t ** _cache )
+{
+    hb_scan_cache_t * cache = *_cache;
+    char            * tmp;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+    if (cache->modified)
+    {
+        // Scans of the same source may run concurrently, in this process
+        // or others, replace the file in one step
+        tmp = hb_strdup_printf("%s.%d.%d.tmp", cache->file, (int)getpid(),
+                               hb_atomic_add(&cache_write_count, 1));
+        if (hb_value_write_json(cache->titles, tmp) == 0 &&
+            rename(tmp, cache->file) != 0)
+        {
+            // rename() does not replace existing files everywhere
+            remove(cache->file);
+            rename(tmp, cache->file);
+        }
+        if (remove(tmp) == 0)
+        {
+            hb_log("scan cache: could not write %s", cache->file);
+        }
+        free(tmp);
+    }
+    hb_value_free(&cache->titles);
+    hb_lock_close(&cache->lock);
+    free(cache->file);
+    free(cache);
+    *_cache = NULL;
+}
+
+static hb_dict_t * rational_to_dict( hb_rational_t r )
+{
+    hb_dict_t * dict = hb_dict_init();
+
+    hb_dict_set(dict, "Num", hb_value_int(r.num));
+    hb_dict_set(dict, "Den", hb_value_int(r.den));
+    return dict;
+}
+
+static hb_dict_t * audio_to_dict( hb_audio_t * audio )
+{
+    hb_dict_t * dict = hb_dict_init();
+
+    hb_dict_set(dict, "ID", hb_value_int(audio->id));
+    hb_dict_set(dict, "SampleRate",
+                hb_value_int(audio->config.in.samplerate));
+    hb_dict_set(dict, "SampleBitDepth",
+                hb_value_int(audio->config.in.sample_bit_depth));
+    hb_dict_set(dict, "SamplesPerFrame",
+                hb_value_int(audio->config.in.samples_per_frame));
+    hb_dict_set(dict, "BitRate", hb_value_int(audio->config.in.bitrate));
+    hb_dict_set(dict, "MatrixEncoding",
+                hb_value_int(audio->config.in.matrix_encoding));
+    hb_dict_set(dict, "ChannelLayout",
+                hb_value_int(audio->config.in.channel_layout));
+    hb_dict_set(dict, "LibavChannelMap",
+                hb_value_bool(audio->config.in.channel_map ==
+                              &hb_libav_chan_map));
+    hb_dict_set(dict, "Version", hb_value_int(audio->config.in.version));
+    hb_dict_set(dict, "Flags", hb_value_int(audio->config.in.flags));
+    hb_dict_set(dict, "Mode", hb_value_int(audio->config.in.mode));
+    hb_dict_set(dict, "Description",
+                hb_value_string(audio->config.lang.description));
+    return dict;
+}
+
+static void dict_to_audio( hb_dict_t * dict, hb_audio_t * audio )
+{
+    const char * description;
+    json_int_t   channel_layout;
+    int          val;
+
+    hb_dict_extract_int(&audio->config.in.samplerate, dict, "SampleRate");
+    hb_dict_extract_int(&audio->config.in.sample_bit_depth, dict,
+                        "SampleBitDepth");
+    hb_dict_extract_int(&audio->config.in.samples_per_frame, dict,
+                        "SamplesPerFrame");
+    hb_dict_extract_int(&audio->config.in.bitrate, dict, "BitRate");
+    hb_dict_extract_int(&audio->config.in.matrix_encoding, dict,
+                        "MatrixEncoding");
+    channel_layout = hb_value_get_int(hb_dict_get(dict, "ChannelLayout"));
+    audio->config.in.channel_layout = channel_layout;
+    audio->config.in.channel_map =
+        hb_value_get_bool(hb_dict_get(dict, "LibavChannelMap")) ?
+        &hb_libav_chan_map : NULL;
+    if (hb_dict_extract_int(&val, dict, "Version"))
+    {
+        audio->config.in.version = val;
+    }
+    if (hb_dict_extract_int(&val, dict, "Flags"))
+    {
+        audio->config.in.flags = val;
+    }
+    if (hb_dict_extract_int(&val, dict, "Mode"))
+    {
+        audio->config.in.mode = val;
+    }
+    description = hb_value_get_string(hb_dict_get(dict, "Description"));
+    if (description != NULL)
+    {
+        snprintf(audio->config.lang.description,
+                 sizeof(audio->config.lang.description), "%s", description);
+    }
+}
+
+static hb_subtitle_t * find_closed_caption( hb_title_t * title )
+{
+    hb_subtitle_t * subtitle;
+    int             ii;
+
+    for (ii = 0; ii < hb_list_count(title->list_subtitle); ii++)
+    {
+        subtitle = hb_list_item(title->list_subtitle, ii);
+        if (subtitle->source == CC608SUB)
+        {
+            return subtitle;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the number of previews the cached scan of 'title' found,
+ * 0 if it found the title unusable and -1 if there is no cached scan.
+ * A usable title gets the cached video, crop and audio information.
+ */
+int hb_scan_cache_get( hb_scan_cache_t * cache, hb_title_t * title )
+{
+    hb_dict_t     * dict, * item;
+    hb_audio_t    * audio;
+    hb_subtitle_t * subtitle;
+    const char    * str;
+    char            key[16];
+    int             ii, jj, npreviews = -1, val;
+    json_int_t      duration;
+
+    if (cache == NULL)
+    {
+        return -1;
+    }
+
+    hb_lock(cache->lock);
+    snprintf(key, sizeof(key), "%d", title->index);
+    dict = hb_dict_get(hb_dict_get(cache->titles, "Titles"), key);
+    if (dict == NULL)
+    {
+        goto done;
+    }
+    duration = hb_value_get_int(hb_dict_get(dict, "Duration"));
+    if (duration != (json_int_t)title->duration ||
+        !hb_dict_extract_int(&val, dict, "VideoID") ||
+        val != title->video_id ||
+        !hb_dict_extract_int(&val, dict, "VideoCodec") ||
+        val != title->video_codec ||
+        !hb_dict_extract_int(&npreviews, dict, "Previews"))
+    {
+        npreviews = -1;
+        goto done;
+    }
+    if (npreviews <= 0)
+    {
+        npreviews = 0;
+        goto done;
+    }
+
+    if (hb_value_get_bool(hb_dict_get(dict, "NoIDR")))
+    {
+        title->flags |= HBTF_NO_IDR;
+    }
+    str = hb_value_get_string(hb_dict_get(dict, "VideoCodecName"));
+    if (title->video_codec_name == NULL && str != NULL)
+    {
+        title->video_codec_name = strdup(str);
+    }
+    hb_dict_extract_int(&title->angle_count, dict, "AngleCount");
+    hb_dict_extract_int(&title->geometry.width, dict, "Width");
+    hb_dict_extract_int(&title->geometry.height, dict, "Height");
+    hb_dict_extract_rational(&title->geometry.par, dict, "PAR");
+    hb_dict_extract_rational(&title->dar, dict, "DAR");
+    hb_dict_extract_rational(&title->vrate, dict, "FrameRate");
+    hb_dict_extract_int(&title->has_resolution_change, dict,
+                        "HasResolutionChange");
+    hb_dict_extract_int(&title->video_bitrate, dict, "VideoBitrate");
+    hb_dict_extract_int(&title->video_decode_support, dict, "DecodeSupport");
+    hb_dict_extract_int_array(title->crop, 4, dict, "Crop");
+    hb_dict_extract_int(&title->detected_interlacing, dict,
+                        "InterlaceDetected");
+    item = hb_dict_get(dict, "Color");
+    hb_dict_extract_int(&title->pix_fmt, item, "Format");
+    hb_dict_extract_int(&title->color_range, item, "Range");
+    hb_dict_extract_int(&title->color_prim, item, "Primary");
+    hb_dict_extract_int(&title->color_transfer, item, "Transfer");
+    hb_dict_extract_int(&title->color_matrix, item, "Matrix");
+
+    // Audio the cached scan could not identify keeps a bitrate of 0 and
+    // is removed by the caller as after decoding
+    item = hb_dict_get(dict, "AudioList");
+    for (ii = 0; ii < hb_list_count(title->list_audio); ii++)
+    {
+        audio = hb_list_item(title->list_audio, ii);
+        for (jj = 0; jj < hb_value_array_len(item); jj++)
+        {
+            hb_dict_t * audio_dict = hb_value_array_get(item, jj);
+            if (hb_dict_extract_int(&val, audio_dict, "ID") &&
+                val == audio->id)
+            {
+                dict_to_audio(audio_dict, audio);
+                break;
+            }
+        }
+    }
+
+    item = hb_dict_get(dict, "ClosedCaption");
+    if (item != NULL && find_closed_caption(title) == NULL)
+    {
+        subtitle = calloc(1, sizeof(hb_subtitle_t));
+        if (subtitle != NULL)
+        {
+            subtitle->track       = hb_list_count(title->list_subtitle);
+            subtitle->id          = HB_SUBTITLE_EMBEDDED_CC_TAG;
+            subtitle->format      = TEXTSUB;
+            subtitle->source      = CC608SUB;
+            subtitle->config.dest = PASSTHRUSUB;
+            subtitle->codec       = WORK_DECCC608;
+            subtitle->attributes  = HB_SUBTITLE_ATTR_CC;
+            str = hb_value_get_string(hb_dict_get(item, "Language"));
+            snprintf(subtitle->lang, sizeof(subtitle->lang), "%s",
+                     str != NULL ? str : "");
+            str = hb_value_get_string(hb_dict_get(item, "ISO639-2"));
+            snprintf(subtitle->iso639_2, sizeof(subtitle->iso639_2), "%s",
+                     str != NULL ? str : "und");
+            hb_list_add(title->list_subtitle, subtitle);
+        }
+    }
+    hb_log("scan: using cached scan of title %d", title->index);
+
+done:
+    hb_unlock(cache->lock);
+    return npreviews;
+}
+
+/*
+ * Stores the results of scanning 'title', which found 'npreviews'
+ * previews.  Scans that were stopped must not be stored.
+ */
+void hb_scan_cache_put( hb_scan_cache_t * cache, hb_title_t * title,
+                        int npreviews )
+{
+    hb_dict_t     * dict, * item;
+    hb_subtitle_t * subtitle;
+    char            key[16];
+    int             ii;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    dict = hb_dict_init();
+    hb_dict_set(dict, "Duration", hb_value_int(title->duration));
+    hb_dict_set(dict, "VideoID", hb_value_int(title->video_id));
+    hb_dict_set(dict, "VideoCodec", hb_value_int(title->video_codec));
+    hb_dict_set(dict, "Previews", hb_value_int(npreviews));
+    if (npreviews > 0)
+    {
+        hb_dict_set(dict, "NoIDR",
+                    hb_value_bool(title->flags & HBTF_NO_IDR));
+        if (title->video_codec_name != NULL)
+        {
+            hb_dict_set(dict, "VideoCodecName",
+                        hb_value_string(title->video_codec_name));
+        }
+        hb_dict_set(dict, "AngleCount", hb_value_int(title->angle_count));
+        hb_dict_set(dict, "Width", hb_value_int(title->geometry.width));
+        hb_dict_set(dict, "Height", hb_value_int(title->geometry.height));
+        hb_dict_set(dict, "PAR", rational_to_dict(title->geometry.par));
+        hb_dict_set(dict, "DAR", rational_to_dict(title->dar));
+        hb_dict_set(dict, "FrameRate", rational_to_dict(title->vrate));
+        hb_dict_set(dict, "HasResolutionChange",
+                    hb_value_int(title->has_resolution_change));
+        hb_dict_set(dict, "VideoBitrate",
+                    hb_value_int(title->video_bitrate));
+        hb_dict_set(dict, "DecodeSupport",
+                    hb_value_int(title->video_decode_support));
+        item = hb_value_array_init();
+        for (ii = 0; ii < 4; ii++)
+        {
+            hb_value_array_append(item, hb_value_int(title->crop[ii]));
+        }
+        hb_dict_set(dict, "Crop", item);
+        hb_dict_set(dict, "InterlaceDetected",
+                    hb_value_int(title->detected_interlacing));
+        item = hb_dict_init();
+        hb_dict_set(item, "Format", hb_value_int(title->pix_fmt));
+        hb_dict_set(item, "Range", hb_value_int(title->color_range));
+        hb_dict_set(item, "Primary", hb_value_int(title->color_prim));
+        hb_dict_set(item, "Transfer", hb_value_int(title->color_transfer));
+        hb_dict_set(item, "Matrix", hb_value_int(title->color_matrix));
+        hb_dict_set(dict, "Color", item);
+
+        item = hb_value_array_init();
+        for (ii = 0; ii < hb_list_count(title->list_audio); ii++)
+        {
+            hb_value_array_append(item,
+                        audio_to_dict(hb_list_item(title->list_audio, ii)));
+        }
+        hb_dict_set(dict, "AudioList", item);
+
+        subtitle = find_closed_caption(title);
+        if (subtitle != NULL)
+        {
+            item = hb_dict_init();
+            hb_dict_set(item, "Language", hb_value_string(subtitle->lang));
+            hb_dict_set(item, "ISO639-2",
+                        hb_value_string(subtitle->iso639_2));
+            hb_dict_set(dict, "ClosedCaption", item);
+        }
+    }
+
+    hb_lock(cache->lock);
+    snprintf(key, sizeof(key), "%d", title->index);
+    hb_dict_set(hb_dict_get(cache->titles, "Titles"), key, dict);
+    cache->modified = 1;
+    hb_unlock(cache->lock);
+}
@@ -20,6 +20,14 @@
 #define HB_MAX_PROBE_SIZE (1*1024*1024)
 #define HB_MAX_PROBES     3
 
+// Transport streams are read in blocks that start small after a seek,
+// where often only a few packets are needed, and grow while reading
+// sequentially.  Sizes are in packets.
+#define TS_BLOCK_MIN      512
+#define TS_BLOCK_MAX      16384
+// stdio buffer for the byte wise program stream parser
+#define STREAM_FILE_BUFFER_SIZE (256*1024)
+
 /*
  * This table defines how ISO MPEG stream type codes map to HandBrake
  * codecs. It is indexed by the 8 bit stream type and contains the codec
@@ -183,7 +191,13 @@ struct hb_stream_s
         int64_t last_timestamp; // used for discontinuity detection when
                                 // there are no PCRs
 
-        uint8_t *packet;        // buffer for one TS packet
+        // read-ahead for next_packet(), which returns packets in place.
+        // The file position is at the end of the valid data, use
+        // stream_tell() and stream_seek() instead of ftello and fseeko.
+        uint8_t *block;
+        int     block_len;      // valid bytes in block
+        int     block_pos;      // offset of the next packet
+        int     block_read;     // packets to read next
         hb_ts_stream_t *list;
         int count;
         int alloc;
@@ -212,6 +226,7 @@ struct hb_stream_s
 
     char    *path;
     FILE    *file_handle;
+    char    *file_buffer;
     hb_stream_type_t hb_stream_type;
     hb_title_t *title;
 
@@ -253,6 +268,8 @@ typedef struct {
  **********************************************************************/
 static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle);
 static off_t align_to_next_packet(hb_stream_t *stream);
+static off_t stream_tell(hb_stream_t *stream);
+static int stream_seek(hb_stream_t *stream, off_t offset, int whence);
 static int64_t pes_timestamp( const uint8_t *pes );
 
 static int hb_ts_stream_init(hb_stream_t *stream);
@@ -637,20 +654,27 @@ static int hb_stream_get_type(hb_stream_t *stream)
     return 0;
 }
 
-static void hb_stream_delete_dynamic( hb_stream_t *d )
+static void stream_file_close( hb_stream_t *d )
 {
     if( d->file_handle )
     {
         fclose( d->file_handle );
         d->file_handle = NULL;
     }
+    free( d->file_buffer );
+    d->file_buffer = NULL;
+}
+
+static void hb_stream_delete_dynamic( hb_stream_t *d )
+{
+    stream_file_close( d );
 
     int i=0;
 
-    if ( d->ts.packet )
+    if ( d->ts.block )
     {
-        free( d->ts.packet );
-        d->ts.packet = NULL;
+        free( d->ts.block );
+        d->ts.block = NULL;
     }
     if ( d->ts.list )
     {
@@ -845,6 +869,11 @@ hb_stream_open(hb_handle_t *h, const char *path, hb_title_t *title, int scan)
      */
     d->h = h;
     d->file_handle = f;
+    d->file_buffer = malloc( STREAM_FILE_BUFFER_SIZE );
+    if ( d->file_buffer != NULL )
+    {
+        setvbuf( f, d->file_buffer, _IOFBF, STREAM_FILE_BUFFER_SIZE );
+    }
     d->title = title;
     d->scan = scan;
     d->path = strdup( path );
@@ -861,17 +890,14 @@ hb_stream_open(hb_handle_t *h, const char *path, hb_title_t *title, int scan)
             hb_stream_seek( d, 0. );
             return d;
         }
-        fclose( d->file_handle );
-        d->file_handle = NULL;
+        stream_file_close( d );
         if ( ffmpeg_open( d, title, scan ) )
         {
             return d;
         }
     }
-    if ( d->file_handle )
-    {
-        fclose( d->file_handle );
-    }
+    stream_file_close( d );
+    free( d->ts.block );
     if (d->path)
     {
         free( d->path );
@@ -945,7 +971,7 @@ hb_stream_t * hb_bd_stream_open( hb_handle_t *h, hb_title_t *title )
     d->file_handle = NULL;
     d->title = title;
     d->path = NULL;
-    d->ts.packet = NULL;
+    d->ts.block = NULL;
 
     int pid = title->video_id;
     int stream_type = title->video_stream_type;
@@ -1127,33 +1153,87 @@ hb_title_t * hb_stream_title_scan(hb_stream_t *stream, hb_title_t * title)
     return title;
 }
 
+/*
+ * position of the next byte next_packet() returns
+ */
+static off_t stream_tell( hb_stream_t *stream )
+{
+    return ftello( stream->file_handle ) -
+           ( stream->ts.block_len - stream->ts.block_pos );
+}
+
+/*
+ * fseeko() that discards the read-ahead of next_packet()
+ */
+static int stream_seek( hb_stream_t *stream, off_t offset, int whence )
+{
+    if ( whence == SEEK_CUR )
+    {
+        offset -= stream->ts.block_len - stream->ts.block_pos;
+    }
+    stream->ts.block_len = 0;
+    stream->ts.block_pos = 0;
+    stream->ts.block_read = TS_BLOCK_MIN;
+    return fseeko( stream->file_handle, offset, whence );
+}
+
+/*
+ * refill the read-ahead, keeping a partial packet at its end.
+ * Returns 0 on eof or error.
+ */
+static int fill_block( hb_stream_t *stream )
+{
+    int left = stream->ts.block_len - stream->ts.block_pos;
+    size_t len;
+
+    memmove( stream->ts.block, stream->ts.block + stream->ts.block_pos, left );
+    len = fread( stream->ts.block + left, 1,
+                 stream->ts.block_read * stream->packetsize,
+                 stream->file_handle );
+    stream->ts.block_len = left + len;
+    stream->ts.block_pos = 0;
+    if ( stream->ts.block_read < TS_BLOCK_MAX )
+    {
+        stream->ts.block_read *= 2;
+    }
+    if ( stream->ts.block_len < stream->packetsize )
+    {
+        int err;
+        if ((err = ferror(stream->file_handle)) != 0)
+        {
+            hb_error("next_packet: error (%d)", err);
+            hb_set_work_error(stream->h, HB_ERROR_READ);
+        }
+        return 0;
+    }
+    return 1;
+}
+
 /*
  * read the next transport stream packet from 'stream'. Return NULL if
- * we hit eof & a pointer to the sync byte otherwise.
+ * we hit eof & a pointer to the sync byte otherwise. The packet is
+ * valid until the next call.
  */
 static const uint8_t *next_packet( hb_stream_t *stream )
 {
-    uint8_t *buf = stream->ts.packet + stream->packetsize - 188;
+    uint8_t *buf;
 
     while ( 1 )
     {
-        if ( fread(stream->ts.packet, 1, stream->packetsize, stream->file_handle) !=
-             stream->packetsize )
+        if ( stream->ts.block_len - stream->ts.block_pos < stream->packetsize &&
+             !fill_block( stream ) )
         {
-            int err;
-            if ((err = ferror(stream->file_handle)) != 0)
-            {
-                hb_error("next_packet: error (%d)", err);
-                hb_set_work_error(stream->h, HB_ERROR_READ);
-            }
             return NULL;
         }
+        buf = stream->ts.block + stream->ts.block_pos +
+              stream->packetsize - 188;
+        stream->ts.block_pos += stream->packetsize;
         if (buf[0] == 0x47)
         {
             return buf;
         }
         // lost sync - back up to where we started then try to re-establish.
-        off_t pos = ftello(stream->file_handle) - stream->packetsize;
+        off_t pos = stream_tell(stream) - stream->packetsize;
         off_t pos2 = align_to_next_packet(stream);
         if ( pos2 == 0 )
         {
@@ -1547,7 +1627,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
     {
         const uint8_t *buf;
         int adapt_len;
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         align_to_next_packet( stream );
         int pid = stream->ts.list[ts_index_of_video(stream)].pid;
         buf = hb_ts_stream_getPEStype( stream, pid, &adapt_len );
@@ -1575,7 +1655,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
                 ++stream->has_IDRs;
             }
         }
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
         if ( !stream->has_IDRs )
         {
             // Scan a little more to see if we will stumble upon one
@@ -1600,7 +1680,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
 
         // round address down to nearest dvd sector start
         fpos &=~ ( HB_DVD_READ_BUFFER_SIZE - 1 );
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         if ( stream->hb_stream_type == program )
         {
             skip_to_next_pack( stream );
@@ -1645,7 +1725,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
         }
 
         pp.pts = pes_info.pts;
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
     }
     return pp;
 }
@@ -1705,8 +1785,8 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     struct pts_pos *pp = ptspos;
     int i;
 
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
+    stream_seek(stream, 0, SEEK_END);
+    uint64_t fsize = stream_tell(stream);
     uint64_t fincr = fsize / NDURSAMPLES;
     uint64_t fpos = fincr / 2;
     for ( i = NDURSAMPLES; --i >= 0; fpos += fincr )
@@ -1720,7 +1800,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     inTitle->minutes  = ( dur % 3600 ) / 60;
     inTitle->seconds  = dur % 60;
 
-    rewind(stream->file_handle);
+    stream_seek(stream, 0, SEEK_SET);
 }
 
 /***********************************************************************
@@ -1825,16 +1905,16 @@ int hb_stream_seek( hb_stream_t * stream, float f )
     }
     off_t stream_size, cur_pos, new_pos;
     double pos_ratio = f;
-    cur_pos = ftello( stream->file_handle );
-    fseeko( stream->file_handle, 0, SEEK_END );
-    stream_size = ftello( stream->file_handle );
+    cur_pos = stream_tell( stream );
+    stream_seek( stream, 0, SEEK_END );
+    stream_size = stream_tell( stream );
     new_pos = (off_t) ((double) (stream_size) * pos_ratio);
     new_pos &=~ (HB_DVD_READ_BUFFER_SIZE - 1);
 
-    int r = fseeko( stream->file_handle, new_pos, SEEK_SET );
+    int r = stream_seek( stream, new_pos, SEEK_SET );
     if (r == -1)
     {
-        fseeko( stream->file_handle, cur_pos, SEEK_SET );
+        stream_seek( stream, cur_pos, SEEK_SET );
         return 0;
     }
 
@@ -1885,10 +1965,9 @@ static char* strncpyupper( char *dst, const char *src, int len )
     return dst;
 }
 
-static const char *stream_type_name2(hb_stream_t *stream, hb_pes_stream_t *pes)
+static const char *stream_type_name2(hb_stream_t *stream, hb_pes_stream_t *pes,
+                                     char codec_name_caps[80])
 {
-    static char codec_name_caps[80];
-
     if ( stream->reg_desc == STR4_TO_UINT32("HDMV") )
     {
         // Names for streams we know about.
@@ -2231,7 +2310,12 @@ static int hb_ts_stream_init(hb_stream_t *stream)
     }
     stream->pes.count = 0;
 
-    stream->ts.packet = malloc( stream->packetsize );
+    stream->ts.block = malloc( ( TS_BLOCK_MAX + 1 ) * stream->packetsize );
+    if (stream->ts.block == NULL)
+    {
+        return -1;
+    }
+    stream->ts.block_read = TS_BLOCK_MIN;
 
     // Find the audio and video pids in the stream
     if (hb_ts_stream_find_pids(stream) < 0)
@@ -2251,6 +2335,8 @@ static int hb_ts_stream_init(hb_stream_t *stream)
 
     if( stream->scan )
     {
+        char codec_name[80];
+
         hb_log("Found the following PIDS");
         hb_log("    Video PIDS : ");
         for (i=0; i < stream->ts.count; i++)
@@ -2260,7 +2346,8 @@ static int hb_ts_stream_init(hb_stream_t *stream)
                 hb_log( "      0x%x type %s (0x%x)%s",
                         stream->ts.list[i].pid,
                         stream_type_name2(stream,
-                                &stream->pes.list[stream->ts.list[i].pes_list]),
+                                &stream->pes.list[stream->ts.list[i].pes_list],
+                                codec_name),
                         ts_stream_type( stream, i ),
                         stream->ts.list[i].is_pcr ? " (PCR)" : "");
             }
@@ -2273,7 +2360,8 @@ static int hb_ts_stream_init(hb_stream_t *stream)
                 hb_log( "      0x%x type %s (0x%x)%s",
                         stream->ts.list[i].pid,
                         stream_type_name2(stream,
-                                &stream->pes.list[stream->ts.list[i].pes_list]),
+                                &stream->pes.list[stream->ts.list[i].pes_list],
+                                codec_name),
                         ts_stream_type( stream, i ),
                         stream->ts.list[i].is_pcr ? " (PCR)" : "");
             }
@@ -2286,7 +2374,8 @@ static int hb_ts_stream_init(hb_stream_t *stream)
                 hb_log( "      0x%x type %s (0x%x)%s",
                         stream->ts.list[i].pid,
                         stream_type_name2(stream,
-                                &stream->pes.list[stream->ts.list[i].pes_list]),
+                                &stream->pes.list[stream->ts.list[i].pes_list],
+                                codec_name),
                         ts_stream_type( stream, i ),
                         stream->ts.list[i].is_pcr ? " (PCR)" : "");
             }
@@ -2300,7 +2389,8 @@ static int hb_ts_stream_init(hb_stream_t *stream)
                 hb_log( "      0x%x type %s (0x%x)%s",
                         stream->ts.list[i].pid,
                         stream_type_name2(stream,
-                                &stream->pes.list[stream->ts.list[i].pes_list]),
+                                &stream->pes.list[stream->ts.list[i].pes_list],
+                                codec_name),
                         ts_stream_type( stream, i ),
                         stream->ts.list[i].is_pcr ? " (PCR)" : "");
             }
@@ -2339,6 +2429,8 @@ static void hb_ps_stream_init(hb_stream_t *stream)
 
     if( stream->scan )
     {
+        char codec_name[80];
+
         hb_log("Found the following streams");
         hb_log("    Video Streams : ");
         for (i=0; i < stream->pes.count; i++)
@@ -2349,7 +2441,7 @@ static void hb_ps_stream_init(hb_stream_t *stream)
                         stream->pes.list[i].stream_id,
                         stream->pes.list[i].stream_id_ext,
                         stream_type_name2(stream,
-                                         &stream->pes.list[i]),
+                                         &stream->pes.list[i], codec_name),
                         stream->pes.list[i].stream_type);
             }
         }
@@ -2362,7 +2454,7 @@ static void hb_ps_stream_init(hb_stream_t *stream)
                         stream->pes.list[i].stream_id,
                         stream->pes.list[i].stream_id_ext,
                         stream_type_name2(stream,
-                                         &stream->pes.list[i]),
+                                         &stream->pes.list[i], codec_name),
                         stream->pes.list[i].stream_type );
             }
         }
@@ -2375,7 +2467,7 @@ static void hb_ps_stream_init(hb_stream_t *stream)
                         stream->pes.list[i].stream_id,
                         stream->pes.list[i].stream_id_ext,
                         stream_type_name2(stream,
-                                         &stream->pes.list[i]),
+                                         &stream->pes.list[i], codec_name),
                         stream->pes.list[i].stream_type );
             }
         }
@@ -2388,7 +2480,7 @@ static void hb_ps_stream_init(hb_stream_t *stream)
                         stream->pes.list[i].stream_id,
                         stream->pes.list[i].stream_id_ext,
                         stream_type_name2(stream,
-                                         &stream->pes.list[i]),
+                                         &stream->pes.list[i], codec_name),
                         stream->pes.list[i].stream_type );
                 hb_stream_delete_ps_entry(stream, i);
             }
@@ -2410,13 +2502,14 @@ static off_t align_to_next_packet(hb_stream_t *stream)
 {
     uint8_t buf[MAX_HOLE];
     off_t pos = 0;
-    off_t start = ftello(stream->file_handle);
+    off_t start = stream_tell(stream);
     off_t orig;
 
+    // reads below bypass the read-ahead of next_packet()
     if ( start >= stream->packetsize ) {
         start -= stream->packetsize;
-        fseeko(stream->file_handle, start, SEEK_SET);
     }
+    stream_seek(stream, start, SEEK_SET);
     orig = start;
 
     while (1)
@@ -2438,8 +2531,8 @@ static off_t align_to_next_packet(hb_stream_t *stream)
                 pos = ( bp - buf ) - stream->packetsize + 188;
                 break;
             }
-            fseeko(stream->file_handle, -8 * stream->packetsize, SEEK_CUR);
-            start = ftello(stream->file_handle);
+            stream_seek(stream, -8 * stream->packetsize, SEEK_CUR);
+            start = stream_tell(stream);
         }
         else
         {
@@ -2452,7 +2545,7 @@ static off_t align_to_next_packet(hb_stream_t *stream)
             return 0;
         }
     }
-    fseeko(stream->file_handle, start+pos, SEEK_SET);
+    stream_seek(stream, start+pos, SEEK_SET);
     return start - orig + pos;
 }
 
@@ -3770,7 +3863,7 @@ static void hb_ps_stream_find_streams(hb_stream_t *stream)
     int ii, jj;
     hb_buffer_t *buf  = hb_buffer_init(HB_DVD_READ_BUFFER_SIZE);
 
-    fseeko( stream->file_handle, 0, SEEK_SET );
+    stream_seek( stream, 0, SEEK_SET );
     // Scan beginning of file, then if no program stream map is found
     // seek to 20% and scan again since there's occasionally no
     // audio at the beginning (particularly for vobs).
@@ -4479,9 +4572,9 @@ static int hb_ts_stream_find_pids(hb_stream_t *stream)
     // changes PMTs (and thus video & audio PIDs) when 'programs' change. Since
     // we may have the tail of the previous program at the beginning of this
     // file, take our PMT from the middle of the file.
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
-    fseeko(stream->file_handle, fsize >> 1, SEEK_SET);
+    stream_seek(stream, 0, SEEK_END);
+    uint64_t fsize = stream_tell(stream);
+    stream_seek(stream, fsize >> 1, SEEK_SET);
     align_to_next_packet(stream);
 
     // Read the Transport Stream Packets (188 bytes each) looking at first for PID 0 (the PAT PID), then decode that
@@ -4577,6 +4670,7 @@ static hb_buffer_t * generate_output_data(hb_stream_t *stream, int curstream)
 {
     hb_buffer_list_t list;
     hb_buffer_t *buf = NULL;
+    int shared = 0;
 
     hb_buffer_list_clear(&list);
     hb_ts_stream_t * ts_stream = &stream->ts.list[curstream];
@@ -4643,7 +4737,20 @@ static hb_buffer_t * generate_output_data(hb_stream_t *stream, int curstream)
         // we want the whole TS stream including all substreams.
         // DTS-HD is an example of this.
 
-        buf = hb_buffer_init(es_size);
+        // The PES packet was gathered from its TS packets into 'b' already,
+        // pass the elementary stream data on without copying it again.
+        // Further substreams get a copy so every buffer can be modified.
+        if (!shared)
+        {
+            memset(b->data + b->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+            buf = hb_buffer_slice(b, ts_stream->packet_offset, es_size);
+            shared = 1;
+        }
+        else
+        {
+            buf = hb_buffer_init(es_size);
+            memcpy(buf->data, tdat, es_size);
+        }
         if (ts_stream->packet_len < ts_stream->pes_info.packet_len + 6)
         {
             buf->s.split = 1;
@@ -4672,8 +4779,6 @@ static hb_buffer_t * generate_output_data(hb_stream_t *stream, int curstream)
             buf->s.start = AV_NOPTS_VALUE;
             buf->s.renderOffset = AV_NOPTS_VALUE;
         }
-        // copy the elementary stream data into the buffer
-        memcpy(buf->data, tdat, es_size);
     }
 
     if (ts_stream->pes_info.packet_len > 0 &&
@@ -4682,7 +4787,14 @@ static hb_buffer_t * generate_output_data(hb_stream_t *stream, int curstream)
         ts_stream->pes_info_valid = 0;
         ts_stream->packet_len = 0;
     }
-    b->size = 0;
+    if (shared)
+    {
+        // 'b' is referenced by the output now, gather the next PES
+        // packet into a new buffer of about the same size
+        ts_stream->buf = hb_buffer_init(b->size);
+        hb_buffer_close(&b);
+    }
+    ts_stream->buf->size = 0;
     ts_stream->packet_offset = 0;
     return hb_buffer_list_clear(&list);
 }
@@ -4693,12 +4805,15 @@ static void hb_ts_stream_append_pkt(hb_stream_t *stream, int idx,
     if (stream->ts.list[idx].skipbad || len <= 0)
         return;
 
-    if (stream->ts.list[idx].buf->size + len > stream->ts.list[idx].buf->alloc)
+    // keep room for the padding generate_output_data() adds
+    if (stream->ts.list[idx].buf->size + len + AV_INPUT_BUFFER_PADDING_SIZE >
+        stream->ts.list[idx].buf->alloc)
     {
         int size;
 
         size = MAX(stream->ts.list[idx].buf->alloc * 2,
-                   stream->ts.list[idx].buf->size + len);
+                   stream->ts.list[idx].buf->size + len +
+                   AV_INPUT_BUFFER_PADDING_SIZE);
         hb_buffer_realloc(stream->ts.list[idx].buf, size);
     }
     memcpy(stream->ts.list[idx].buf->data + stream->ts.list[idx].buf->size,
@@ -5980,8 +6095,21 @@ hb_buffer_t * hb_ffmpeg_read( hb_stream_t *stream )
             av_packet_unref(&stream->ffmpeg_pkt);
             return hb_ffmpeg_read( stream );
         }
-        buf = hb_buffer_init( stream->ffmpeg_pkt.size );
-        memcpy( buf->data, stream->ffmpeg_pkt.data, stream->ffmpeg_pkt.size );
+        // Reference the packet data where libavformat allocated it
+        // instead of copying it
+        buf = NULL;
+        if ( stream->ffmpeg_pkt.buf != NULL )
+        {
+            buf = hb_buffer_wrap( stream->ffmpeg_pkt.data,
+                                  stream->ffmpeg_pkt.size,
+                                  stream->ffmpeg_pkt.buf );
+        }
+        if ( buf == NULL )
+        {
+            buf = hb_buffer_init( stream->ffmpeg_pkt.size );
+            memcpy( buf->data, stream->ffmpeg_pkt.data,
+                    stream->ffmpeg_pkt.size );
+        }
 
         const uint8_t *palette;
         int size;
@@ -10,7 +10,6 @@
 #include "handbrake/handbrake.h"
 #include "handbrake/hbffmpeg.h"
 #include <stdio.h>
-#include "handbrake/audio_resample.h"
 
 #define SYNC_MAX_VIDEO_QUEUE_LEN    40
 #define SYNC_MIN_VIDEO_QUEUE_LEN    20
@@ -122,11 +121,6 @@ typedef struct
         struct
         {
             hb_audio_t          * audio;
-
-            // Audio filter settings
-            // Samplerate conversion
-            hb_audio_resample_t * resample;
-            double                gain_factor;
         } audio;
 
         // Subtitle stream context
@@ -299,8 +293,8 @@ static hb_buffer_t * CreateSilenceBuf( sync_stream_t * stream,
                           stream->audio.audio->config.in.samplerate;
     // Audio mixdown occurs in decoders before sync.
     // So number of channels here is output channel count.
-    // But audio samplerate conversion happens in later here in sync.c
-    // FilterAudioFrame, so samples_per_frame is still the input sample count.
+    // But audio samplerate conversion happens after sync in the audio
+    // filter stage, so samples_per_frame is still the input sample count.
     size = sizeof(float) * stream->audio.audio->config.in.samples_per_frame *
                            hb_mixdown_get_discrete_channel_count(
                                     stream->audio.audio->config.out.mixdown);
@@ -365,12 +359,33 @@ static hb_buffer_t * CreateBlackBuf( sync_stream_t * stream,
     {
         if (buf == NULL)
         {
-            buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
-                                   stream->common->job->title->geometry.width,
-                                   stream->common->job->title->geometry.height);
+            hb_job_t * job = stream->common->job;
+            int        depth;
+
+            buf = hb_frame_buffer_init(job->pix_fmt,
+                                       job->title->geometry.width,
+                                       job->title->geometry.height);
+            depth = hb_get_bit_depth(job->pix_fmt);
             memset(buf->plane[0].data, 0x00, buf->plane[0].size);
-            memset(buf->plane[1].data, 0x80, buf->plane[1].size);
-            memset(buf->plane[2].data, 0x80, buf->plane[2].size);
+            if (depth > 8)
+            {
+                uint16_t * chroma;
+                int        pp, ii;
+
+                for (pp = 1; pp < 3; pp++)
+                {
+                    chroma = (uint16_t*)buf->plane[pp].data;
+                    for (ii = 0; ii < buf->plane[pp].size / 2; ii++)
+                    {
+                        chroma[ii] = 1 << (depth - 1);
+                    }
+                }
+            }
+            else
+            {
+                memset(buf->plane[1].data, 0x80, buf->plane[1].size);
+                memset(buf->plane[2].data, 0x80, buf->plane[2].size);
+            }
         }
         else
         {
@@ -2238,31 +2253,6 @@ static int InitAudio( sync_common_t * common, int index )
     pv->stream->audio.audio     = audio;
     pv->stream->fifo_out        = w->fifo_out;
 
-    if (!(audio->config.out.codec & HB_ACODEC_PASS_FLAG) &&
-        audio->config.in.samplerate != audio->config.out.samplerate)
-    {
-        /* Initialize samplerate conversion */
-        pv->stream->audio.resample =
-            hb_audio_resample_init(AV_SAMPLE_FMT_FLT,
-                                   audio->config.out.samplerate,
-                                   audio->config.out.mixdown,
-                                   audio->config.out.normalize_mix_level);
-        if (pv->stream->audio.resample == NULL)
-        {
-            hb_error("sync: audio 0x%x resample init failed", audio->id);
-            goto fail;
-        }
-        hb_audio_resample_set_sample_rate(pv->stream->audio.resample,
-                                          audio->config.in.samplerate);
-        if (hb_audio_resample_update(pv->stream->audio.resample))
-        {
-            hb_error("sync: audio 0x%x resample update failed", audio->id);
-            goto fail;
-        }
-    }
-
-    pv->stream->audio.gain_factor = pow(10, audio->config.out.gain / 20);
-
     hb_list_add(common->list_work, w);
 
     return 0;
@@ -2272,10 +2262,6 @@ fail:
     {
         if (pv->stream != NULL)
         {
-            if (pv->stream->audio.resample)
-            {
-                hb_audio_resample_free(pv->stream->audio.resample);
-            }
             hb_list_close(&pv->stream->delta_list);
             hb_list_close(&pv->stream->in_queue);
         }
@@ -2438,43 +2424,10 @@ static int syncVideoInit( hb_work_object_t * w, hb_job_t * job)
         }
         else
         {
-            int64_t duration, total_duration, extra_duration = 0;
+            int64_t duration = hb_job_get_duration(job);
             if (job->pts_to_stop)
             {
-                duration = job->pts_to_stop + 90000;
-            }
-            else
-            {
-                total_duration = 0;
-                for (ii = 0; ii <= hb_list_count(job->list_chapter); ii++)
-                {
-                    hb_chapter_t * chapter;
-                    chapter = hb_list_item(job->list_chapter, ii - 1);
-                    if (chapter != NULL)
-                    {
-                        total_duration += chapter->duration;
-                    }
-                }
-                // Some titles are longer than the sum duration of their
-                // chapters.  Account for this extra duration.
-                if (job->title->duration > total_duration)
-                {
-                    extra_duration = job->title->duration - total_duration;
-                }
-                duration = 0;
-                for (ii = job->chapter_start; ii <= job->chapter_end; ii++)
-                {
-                    hb_chapter_t * chapter;
-                    chapter = hb_list_item(job->list_chapter, ii - 1);
-                    if (chapter != NULL)
-                    {
-                        duration += chapter->duration;
-                    }
-                }
-                if (job->chapter_end == hb_list_count(job->list_chapter))
-                {
-                    duration += extra_duration;
-                }
+                duration += 90000;
             }
             pv->common->est_frame_count = duration * job->title->vrate.num /
                                           job->title->vrate.den / 90000;
@@ -3053,12 +3006,6 @@ static void syncAudioClose( hb_work_object_t * w )
         return;
     }
 
-    // Free samplerate conversion context
-    if (pv->stream->audio.resample)
-    {
-        hb_audio_resample_free(pv->stream->audio.resample);
-    }
-
     sync_delta_t * delta;
     while ((delta = hb_list_item(pv->stream->delta_list, 0)) != NULL)
     {
@@ -3127,8 +3074,6 @@ hb_work_object_t hb_sync_audio =
 static hb_buffer_t * FilterAudioFrame( sync_stream_t * stream,
                                        hb_buffer_t *buf )
 {
-    hb_audio_t * audio = stream->audio.audio;
-
     // Can't count of buf->s.stop - buf->s.start for accurate duration
     // due to integer rounding, so use buf->s.duration when it is set
     // (which should be always if I didn't miss anything)
@@ -3137,68 +3082,8 @@ static hb_buffer_t * FilterAudioFrame( sync_stream_t * stream,
         buf->s.duration = buf->s.stop - buf->s.start;
     }
 
-    if (!(audio->config.out.codec & HB_ACODEC_PASS_FLAG))
-    {
-        // TODO: this should all be replaced by an audio filter chain.
-
-        // Audio is not passthru.  Check if we need to modify the audio
-        // in any way.
-        if (stream->audio.resample != NULL)
-        {
-            /* do sample rate conversion */
-            hb_buffer_t * out;
-            int           nsamples, sample_size;
-
-            sample_size = hb_mixdown_get_discrete_channel_count(
-                            audio->config.out.mixdown ) * sizeof( float );
-
-            nsamples  = buf->size / sample_size;
-            out = hb_audio_resample(stream->audio.resample,
-                                    (const uint8_t **)&buf->data,
-                                    nsamples);
-            hb_buffer_close(&buf);
-            if (out == NULL)
-            {
-                return NULL;
-            }
-            out->s.start = stream->next_pts;
-            out->s.stop  = stream->next_pts + out->s.duration;
-            buf = out;
-        }
-        if (audio->config.out.gain > 0.0)
-        {
-            int count, ii;
-
-            count  = buf->size / sizeof(float);
-            for ( ii = 0; ii < count; ii++ )
-            {
-                double sample;
-
-                sample = (double)*(((float*)buf->data)+ii);
-                sample *= stream->audio.gain_factor;
-                if (sample > 0)
-                    sample = MIN(sample, 1.0);
-                else
-                    sample = MAX(sample, -1.0);
-                *(((float*)buf->data)+ii) = sample;
-            }
-        }
-        else if( audio->config.out.gain < 0.0 )
-        {
-            int count, ii;
-
-            count  = buf->size / sizeof(float);
-            for ( ii = 0; ii < count; ii++ )
-            {
-                double sample;
-
-                sample = (double)*(((float*)buf->data)+ii);
-                sample *= stream->audio.gain_factor;
-                *(((float*)buf->data)+ii) = sample;
-            }
-        }
-    }
-
+    // Samplerate conversion and gain are applied per track after sync,
+    // see audio_filter.c
     buf->s.type = AUDIO_BUF;
     buf->s.frametype = HB_FRAME_AUDIO;
 
@@ -3262,6 +3147,8 @@ static void UpdateState( sync_common_t * common, int frame_count )
         p.minutes  = -1;
         p.seconds  = -1;
     }
+    p.bytes_in_flight = hb_memory_budget_bytes(job->budget);
+    p.bytes_budget    = hb_memory_budget_limit(job->budget);
 #undef p
 
     hb_set_state(job->h, &state);
@@ -3329,6 +3216,8 @@ static void UpdateSearchState( sync_common_t * common, int64_t start,
         p.minutes  = -1;
         p.seconds  = -1;
     }
+    p.bytes_in_flight = hb_memory_budget_bytes(job->budget);
+    p.bytes_budget    = hb_memory_budget_limit(job->budget);
 #undef p
 
     hb_set_state(job->h, &state);
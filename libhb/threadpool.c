@@ -0,0 +1,362 @@
+/* threadpool.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "handbrake/handbrake.h"
+#include "handbrake/ports.h"
+#include "handbrake/threadpool.h"
+
+typedef struct hb_parallel_job_s hb_parallel_job_t;
+
+struct hb_parallel_job_s
+{
+    hb_parallel_func_t * func;
+    void               * opaque;
+    int                  count;
+    int                  next;     // next slice to hand out
+    int                  done;     // number of slices completed
+    int                  workers;  // pool threads running slices of the job
+    hb_parallel_job_t  * link;
+};
+
+static struct
+{
+    hb_lock_t         * lock;
+    hb_cond_t         * work;      // a job was queued or the pool stops
+    hb_cond_t         * complete;  // a job may have completed
+    hb_parallel_job_t * jobs;      // jobs that are in progress
+    hb_thread_t      ** threads;
+    int                 thread_count;
+    int                 stop;
+    // hb_thread_pool_broadcast() request, every thread runs it once
+    hb_parallel_func_t * each_func;
+    void               * each_opaque;
+    int                  each_serial;
+    int                  each_pending;
+} pool;
+
+/*
+ * Runs slices of a job until all of them have been handed out.
+ * Slices are claimed one at a time, so threads that arrive late or
+ * run faster simply take more of them.
+ */
+static void job_run( hb_parallel_job_t * job )
+{
+    int ii;
+
+    while ((ii = hb_atomic_add(&job->next, 1) - 1) < job->count)
+    {
+        job->func(job->opaque, ii);
+        hb_atomic_add(&job->done, 1);
+    }
+}
+
+static void pool_thread( void * arg )
+{
+    hb_parallel_job_t * job;
+    int                 index  = (intptr_t)arg;
+    int                 serial = 0;
+
+    hb_lock(pool.lock);
+    while (!pool.stop)
+    {
+        if (serial != pool.each_serial)
+        {
+            hb_parallel_func_t * func   = pool.each_func;
+            void               * opaque = pool.each_opaque;
+
+            serial = pool.each_serial;
+            hb_unlock(pool.lock);
+            func(opaque, index);
+            hb_lock(pool.lock);
+            if (--pool.each_pending == 0)
+            {
+                hb_cond_broadcast(pool.complete);
+            }
+            continue;
+        }
+
+        // Help the oldest job that still has slices left
+        for (job = pool.jobs; job != NULL; job = job->link)
+        {
+            if (hb_atomic_load(&job->next) < job->count)
+            {
+                break;
+            }
+        }
+        if (job == NULL)
+        {
+            hb_cond_wait(pool.work, pool.lock);
+            continue;
+        }
+
+        job->workers++;
+        hb_unlock(pool.lock);
+        job_run(job);
+        hb_lock(pool.lock);
+        job->workers--;
+
+        if (job->workers == 0 && hb_atomic_load(&job->done) == job->count)
+        {
+            hb_cond_broadcast(pool.complete);
+        }
+    }
+    hb_unlock(pool.lock);
+}
+
+int hb_thread_pool_init( int thread_count )
+{
+    int ii;
+
+    if (pool.lock != NULL)
+    {
+        return 0;
+    }
+
+    pool.lock     = hb_lock_init();
+    pool.work     = hb_cond_init();
+    pool.complete = hb_cond_init();
+    pool.threads  = calloc(thread_count, sizeof(hb_thread_t *));
+    if (pool.lock == NULL || pool.work == NULL || pool.complete == NULL ||
+        pool.threads == NULL)
+    {
+        hb_error("hb_thread_pool_init: initialization failed");
+        hb_thread_pool_close();
+        return -1;
+    }
+
+    for (ii = 0; ii < thread_count; ii++)
+    {
+        pool.threads[ii] = hb_thread_init("thread_pool", pool_thread,
+                                          (void *)(intptr_t)ii,
+                                          HB_NORMAL_PRIORITY);
+        if (pool.threads[ii] == NULL)
+        {
+            hb_error("hb_thread_pool_init: could not spawn thread");
+            break;
+        }
+        pool.thread_count++;
+    }
+    hb_deep_log(2, "thread pool: %d threads", pool.thread_count);
+
+    return 0;
+}
+
+void hb_thread_pool_close( void )
+{
+    int ii;
+
+    if (pool.lock != NULL)
+    {
+        hb_lock(pool.lock);
+        pool.stop = 1;
+        hb_cond_broadcast(pool.work);
+        hb_unlock(pool.lock);
+    }
+
+    for (ii = 0; ii < pool.thread_count; ii++)
+    {
+        hb_thread_close(&pool.threads[ii]);
+    }
+    free(pool.threads);
+    hb_cond_close(&pool.complete);
+    hb_cond_close(&pool.work);
+    hb_lock_close(&pool.lock);
+    memset(&pool, 0, sizeof(pool));
+}
+
+void hb_parallel_for( int count, hb_parallel_func_t * func, void * opaque )
+{
+    hb_parallel_job_t   job, ** link;
+    int                 ii;
+
+    if (count <= 1 || pool.thread_count == 0)
+    {
+        for (ii = 0; ii < count; ii++)
+        {
+            func(opaque, ii);
+        }
+        return;
+    }
+
+    job.func    = func;
+    job.opaque  = opaque;
+    job.count   = count;
+    job.next    = 0;
+    job.done    = 0;
+    job.workers = 0;
+    job.link    = NULL;
+
+    hb_lock(pool.lock);
+    for (link = &pool.jobs; *link != NULL; link = &(*link)->link);
+    *link = &job;
+    // The calling thread takes slices as well
+    if (count - 1 >= pool.thread_count)
+    {
+        hb_cond_broadcast(pool.work);
+    }
+    else
+    {
+        for (ii = 0; ii < count - 1; ii++)
+        {
+            hb_cond_signal(pool.work);
+        }
+    }
+    hb_unlock(pool.lock);
+
+    job_run(&job);
+
+    // All slices are handed out, wait for the workers still running some
+    hb_lock(pool.lock);
+    for (link = &pool.jobs; *link != &job; link = &(*link)->link);
+    *link = job.link;
+    while (job.workers > 0 || hb_atomic_load(&job.done) < job.count)
+    {
+        hb_cond_wait(pool.complete, pool.lock);
+    }
+    hb_unlock(pool.lock);
+}
+
+void hb_thread_pool_broadcast( hb_parallel_func_t * func, void * opaque )
+{
+    if (pool.thread_count == 0)
+    {
+        return;
+    }
+
+    hb_lock(pool.lock);
+    // Let a broadcast from another thread finish first
+    while (pool.each_pending > 0)
+    {
+        hb_cond_wait(pool.complete, pool.lock);
+    }
+    pool.each_func    = func;
+    pool.each_opaque  = opaque;
+    pool.each_pending = pool.thread_count;
+    pool.each_serial++;
+    hb_cond_broadcast(pool.work);
+    while (pool.each_pending > 0)
+    {
+        hb_cond_wait(pool.complete, pool.lock);
+    }
+    hb_unlock(pool.lock);
+}
+
+typedef struct
+{
+    hb_parallel_func_t ** stages;
+    int                   stage_count;
+    int                   band_count;
+    void                * opaque;
+    int                 * order;   // slice index -> stage * band_count + band
+    int                 * done;    // per stage and band completion flags
+    hb_lock_t           * lock;
+    hb_cond_t           * cond;
+} hb_pipeline_t;
+
+static int pipeline_ready( hb_pipeline_t * pl, int stage, int band )
+{
+    int * done = &pl->done[(stage - 1) * pl->band_count];
+    int   ii;
+
+    for (ii = band - 1; ii <= band + 1; ii++)
+    {
+        if (ii >= 0 && ii < pl->band_count && !hb_atomic_load(&done[ii]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void pipeline_slice( void * opaque, int index )
+{
+    hb_pipeline_t * pl    = opaque;
+    int             stage = pl->order[index] / pl->band_count;
+    int             band  = pl->order[index] % pl->band_count;
+
+    if (stage > 0 && !pipeline_ready(pl, stage, band))
+    {
+        hb_lock(pl->lock);
+        while (!pipeline_ready(pl, stage, band))
+        {
+            hb_cond_wait(pl->cond, pl->lock);
+        }
+        hb_unlock(pl->lock);
+    }
+
+    pl->stages[stage](pl->opaque, band);
+
+    hb_lock(pl->lock);
+    hb_atomic_store(&pl->done[pl->order[index]], 1);
+    hb_cond_broadcast(pl->cond);
+    hb_unlock(pl->lock);
+}
+
+void hb_parallel_pipeline( int stage_count, hb_parallel_func_t ** stages,
+                           int band_count, void * opaque )
+{
+    hb_pipeline_t pl;
+    int           ii, ss, tt, count;
+
+    count = stage_count * band_count;
+    if (pool.thread_count == 0 || band_count <= 1)
+    {
+        for (ss = 0; ss < stage_count; ss++)
+        {
+            hb_parallel_for(band_count, stages[ss], opaque);
+        }
+        return;
+    }
+
+    pl.stages      = stages;
+    pl.stage_count = stage_count;
+    pl.band_count  = band_count;
+    pl.opaque      = opaque;
+    pl.order       = malloc(count * sizeof(int));
+    pl.done        = calloc(count, sizeof(int));
+    pl.lock        = hb_lock_init();
+    pl.cond        = hb_cond_init();
+    if (pl.order == NULL || pl.done == NULL || pl.lock == NULL ||
+        pl.cond == NULL)
+    {
+        hb_error("hb_parallel_pipeline: allocation failed");
+        for (ss = 0; ss < stage_count; ss++)
+        {
+            hb_parallel_for(band_count, stages[ss], opaque);
+        }
+        goto done;
+    }
+
+    /*
+     * Hand slices out along diagonals, band k of stage s after band k + 1
+     * of stage s - 1.  Slices are claimed in index order, so everything a
+     * slice waits for has already been claimed by a running thread and
+     * the pipeline can not deadlock.
+     */
+    ii = 0;
+    for (tt = 0; ii < count; tt++)
+    {
+        for (ss = 0; ss < stage_count; ss++)
+        {
+            int band = tt - 2 * ss;
+            if (band >= 0 && band < band_count)
+            {
+                pl.order[ii++] = ss * band_count + band;
+            }
+        }
+    }
+
+    hb_parallel_for(count, pipeline_slice, &pl);
+
+done:
+    hb_cond_close(&pl.cond);
+    hb_lock_close(&pl.lock);
+    free(pl.done);
+    free(pl.order);
+}
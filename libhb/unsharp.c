@@ -9,6 +9,8 @@
  */
 
 #include "handbrake/handbrake.h"
+#include "handbrake/hbffmpeg.h"
+#include "handbrake/blur.h"
 
 #define UNSHARP_STRENGTH_LUMA_DEFAULT 0.25
 #define UNSHARP_SIZE_LUMA_DEFAULT 7
@@ -26,13 +28,11 @@ typedef struct
 
     int        steps;
     int        amount;
-    int        scalebits;
-    int32_t    halfscale;
 } unsharp_plane_context_t;
 
 typedef struct
 {
-    uint32_t * SC[UNSHARP_SIZE_MAX - 1];
+    hb_blur_t * blur;
 } unsharp_thread_context_t;
 
 typedef unsharp_thread_context_t unsharp_thread_context3_t[3];
@@ -70,6 +70,7 @@ hb_filter_object_t hb_filter_unsharp =
 {
     .id                = HB_FILTER_UNSHARP,
     .enforce_order     = 1,
+    .high_depth        = 1,
     .name              = "Sharpen (unsharp)",
     .settings          = NULL,
     .init              = unsharp_init,
@@ -80,85 +81,6 @@ hb_filter_object_t hb_filter_unsharp =
     .settings_template = unsharp_template,
 };
 
-static void unsharp(const uint8_t *src,
-                          uint8_t *dst,
-                    const int width,
-                    const int height,
-                    const int stride,
-                    unsharp_plane_context_t * ctx,
-                    unsharp_thread_context_t * tctx)
-{
-    uint32_t **SC = tctx->SC;
-    uint32_t SR[UNSHARP_SIZE_MAX - 1],
-             Tmp1,
-             Tmp2;
-    const uint8_t *src2 = src; // avoid gcc warning
-    int32_t res;
-    int x, y, z;
-    int amount        = ctx->amount;
-    int steps         = ctx->steps;
-    int scalebits     = ctx->scalebits;
-    int32_t halfscale = ctx->halfscale;
-
-    if (!amount)
-    {
-        if (src != dst)
-        {
-            memcpy(dst, src, stride*height);
-        }
-
-        return;
-    }
-
-    for (y = 0; y < 2 * steps; y++)
-    {
-        memset(SC[y], 0, sizeof(SC[y][0]) * (width + 2 * steps));
-    }
-
-    for (y = -steps; y < height + steps; y++)
-    {
-        if (y < height)
-        {
-            src2 = src;
-        }
-
-        memset(SR, 0, sizeof(SR[0]) * (2 * steps - 1));
-
-        for (x = -steps; x < width + steps; x++)
-        {
-            Tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width - 1] : src2[x];
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
-                Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
-            }
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SC[z + 0][x + steps] + Tmp1; SC[z + 0][x + steps] = Tmp1;
-                Tmp1 = SC[z + 1][x + steps] + Tmp2; SC[z + 1][x + steps] = Tmp2;
-            }
-
-            if (x >= steps && y >= steps)
-            {
-                const uint8_t * srx = src - steps * stride + x - steps;
-                uint8_t       * dsx = dst - steps * stride + x - steps;
-
-                res = (int32_t)*srx + ((((int32_t)*srx -
-                     (int32_t)((Tmp1 + halfscale) >> scalebits)) * amount) >> 16);
-                *dsx = res > 255 ? 255 : res < 0 ? 0 : (uint8_t)res;
-            }
-        }
-
-        if (y >= 0)
-        {
-            dst += stride;
-            src += stride;
-        }
-    }
-}
-
 static int unsharp_init(hb_filter_object_t *filter,
                         hb_filter_init_t   *init)
 {
@@ -208,7 +130,8 @@ static int unsharp_init(hb_filter_object_t *filter,
     {
         unsharp_plane_context_t * ctx = &pv->plane_ctx[c];
 
-        ctx->width = init->geometry.width;
+        ctx->pix_fmt = init->pix_fmt;
+        ctx->width   = init->geometry.width;
 
         // Replace unset values with defaults
         if (ctx->strength == -1)
@@ -231,8 +154,6 @@ static int unsharp_init(hb_filter_object_t *filter,
 
         ctx->amount    = ctx->strength * 65536.0;
         ctx->steps     = ctx->size / 2;
-        ctx->scalebits = ctx->steps * 4;
-        ctx->halfscale = 1 << (ctx->scalebits - 1);
     }
 
     if (unsharp_init_thread(filter, 1) < 0)
@@ -248,18 +169,13 @@ static int unsharp_init(hb_filter_object_t *filter,
 
 static void unsharp_thread_close(hb_filter_private_t *pv)
 {
-    int c, z;
+    int c;
     for (c = 0; c < 3; c++)
     {
-        unsharp_plane_context_t * ctx = &pv->plane_ctx[c];
         for (int t = 0; t < pv->threads; t++)
         {
             unsharp_thread_context_t * tctx = &pv->thread_ctx[t][c];
-            for (z = 0; z < 2 * ctx->steps; z++)
-            {
-                free(tctx->SC[z]);
-                tctx->SC[z] = NULL;
-            }
+            hb_blur_close(&tctx->blur);
         }
     }
     free(pv->thread_ctx);
@@ -275,22 +191,19 @@ static int unsharp_init_thread(hb_filter_object_t *filter, int threads)
     for (int c = 0; c < 3; c++)
     {
         unsharp_plane_context_t * ctx = &pv->plane_ctx[c];
-        int w = hb_image_width(ctx->pix_fmt, ctx->width, c);
+        int w     = hb_image_width(ctx->pix_fmt, ctx->width, c);
+        int depth = hb_get_bit_depth(ctx->pix_fmt);
 
         for (int t = 0; t < threads; t++)
         {
             unsharp_thread_context_t * tctx = &pv->thread_ctx[t][c];
-            int z;
-            for (z = 0; z < 2 * ctx->steps; z++)
+            tctx->blur = hb_blur_init(w, depth, ctx->steps, ctx->amount,
+                                      HB_BLUR_SHARPEN);
+            if (tctx->blur == NULL)
             {
-                tctx->SC[z] = malloc(sizeof(*(tctx->SC[z])) *
-                                     (w + 2 * ctx->steps));
-                if (tctx->SC[z] == NULL)
-                {
-                    hb_error("Unsharp calloc failed");
-                    unsharp_close(filter);
-                    return -1;
-                }
+                hb_error("Unsharp calloc failed");
+                unsharp_close(filter);
+                return -1;
             }
         }
     }
@@ -334,14 +247,13 @@ static int unsharp_work_thread(hb_filter_object_t *filter,
     int c;
     for (c = 0; c < 3; c++)
     {
-        unsharp_plane_context_t  * ctx  = &pv->plane_ctx[c];
         unsharp_thread_context_t * tctx = &pv->thread_ctx[thread][c];
-        unsharp(in->plane[c].data,
-                out->plane[c].data,
-                in->plane[c].width,
-                in->plane[c].height,
-                in->plane[c].stride,
-                ctx, tctx);
+        hb_blur_filter(tctx->blur,
+                       in->plane[c].data,
+                       out->plane[c].data,
+                       in->plane[c].width,
+                       in->plane[c].height,
+                       in->plane[c].stride);
     }
 
     out->s = in->s;
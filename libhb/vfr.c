@@ -8,6 +8,7 @@
  */
 
 #include "handbrake/handbrake.h"
+#include "handbrake/hbffmpeg.h"
 
 //#define HB_DEBUG_CFR_DROPS 1
 #define MAX_FRAME_ANALYSIS_DEPTH 10
@@ -39,6 +40,7 @@ struct hb_filter_private_s
     double        * frame_metric;
 
     unsigned        gamma_lut[256];
+    int             depth;
 #if defined(HB_DEBUG_CFR_DROPS)
     int64_t         sequence;
 #endif
@@ -68,6 +70,7 @@ hb_filter_object_t hb_filter_vfr =
     .close             = hb_vfr_close,
     .info              = hb_vfr_info,
     .settings_template = hb_vfr_template,
+    .high_depth        = 1,
 };
 
 // Create gamma lookup table.
@@ -107,10 +110,33 @@ static inline unsigned sse_block16( unsigned *gamma_lut, uint8_t *a, uint8_t *b,
     return sum;
 }
 
+// High bit depth variant of sse_block16(), only the 8 most significant
+// bits of each sample are compared.
+static inline unsigned sse_block16_hbd( unsigned *gamma_lut, int shift,
+                                        uint16_t *a, uint16_t *b, int stride )
+{
+    int x, y;
+    unsigned sum = 0;
+    int diff;
+
+    for( y = 0; y < 16; y++ )
+    {
+        for( x = 0; x < 16; x++ )
+        {
+            diff =  gamma_lut[a[x] >> shift] - gamma_lut[b[x] >> shift];
+            sum += diff * diff;
+        }
+        a += stride;
+        b += stride;
+    }
+    return sum;
+}
+
 // Sum of squared errors.  Computes and sums the SSEs for all
 // 16x16 blocks in the images.  Only checks the Y component.
-static float motion_metric( unsigned * gamma_lut, hb_buffer_t * a, hb_buffer_t * b )
+static float motion_metric( hb_filter_private_t * pv, hb_buffer_t * a, hb_buffer_t * b )
 {
+    unsigned * gamma_lut = pv->gamma_lut;
     int bw = a->f.width / 16;
     int bh = a->f.height / 16;
     int stride = a->plane[0].stride;
@@ -119,6 +145,24 @@ static float motion_metric( unsigned * gamma_lut, hb_buffer_t * a, hb_buffer_t *
     int x, y;
     uint64_t sum = 0;
 
+    if (pv->depth > 8)
+    {
+        int shift = pv->depth - 8;
+
+        stride /= 2;
+        for( y = 0; y < bh; y++ )
+        {
+            for( x = 0; x < bw; x++ )
+            {
+                sum += sse_block16_hbd( gamma_lut, shift,
+                                        (uint16_t*)pa + y * 16 * stride + x * 16,
+                                        (uint16_t*)pb + y * 16 * stride + x * 16,
+                                        stride );
+            }
+        }
+        return (float)sum / ( a->f.width * a->f.height );
+    }
+
     for( y = 0; y < bh; y++ )
     {
         for( x = 0; x < bw; x++ )
@@ -243,7 +287,7 @@ static hb_buffer_t * adjust_frame_rate( hb_filter_private_t * pv,
         penultimate = hb_list_item(pv->frame_rate_list, count - 2);
         ultimate    = hb_list_item(pv->frame_rate_list, count - 1);
 
-        pv->frame_metric[count - 1] = motion_metric(pv->gamma_lut,
+        pv->frame_metric[count - 1] = motion_metric(pv,
                                                     penultimate, ultimate);
 
         if (count < pv->frame_analysis_depth)
@@ -345,7 +389,7 @@ static hb_buffer_t * adjust_frame_rate( hb_filter_private_t * pv,
         for (; excess >= pv->frame_duration; excess -= pv->frame_duration)
         {
             /* next frame too far ahead - dup current frame */
-            hb_buffer_t *dup = hb_buffer_dup( out );
+            hb_buffer_t *dup = hb_buffer_shared_dup( out );
             dup->s.new_chap = 0;
             dup->s.start = cfr_stop;
             cfr_stop += pv->frame_duration;
@@ -377,6 +421,7 @@ static int hb_vfr_init(hb_filter_object_t *filter, hb_filter_init_t *init)
     filter->private_data    = calloc(1, sizeof(struct hb_filter_private_s));
     hb_filter_private_t *pv = filter->private_data;
     build_gamma_lut(pv);
+    pv->depth = hb_get_bit_depth(init->pix_fmt);
 
     pv->cfr              = init->cfr;
     pv->input_vrate = pv->vrate = init->vrate;
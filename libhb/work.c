@@ -9,6 +9,7 @@
 
 #include "handbrake/handbrake.h"
 #include "libavformat/avformat.h"
+#include "handbrake/hbffmpeg.h"
 #include "handbrake/decomb.h"
 #include "handbrake/hbavfilter.h"
 
@@ -399,7 +400,12 @@ void hb_display_job_info(hb_job_t *job)
     switch (job->mux)
     {
         case HB_MUX_AV_MP4:
-            if (job->mp4_optimize)
+            if (job->mp4_fragment && job->mp4_segment_length > 0)
+                hb_log("     + fragmented, %d second segments",
+                       job->mp4_segment_length);
+            else if (job->mp4_fragment)
+                hb_log("     + fragmented");
+            else if (job->mp4_optimize)
                 hb_log("     + optimized for HTTP streaming (fast start)");
             if (job->ipod_atom)
                 hb_log("     + compatibility atom for iPod 5G");
@@ -1461,6 +1467,98 @@ static void sanitize_filter_list(hb_list_t *list, hb_geometry_t src_geo)
     }
 }
 
+/*
+ * Keep high bit depth sources at their native depth through the filter
+ * chain when the encoder takes high bit depth input and every filter in
+ * the chain can process it.  Otherwise frames are converted to 8 bit
+ * 4:2:0 by the decoder as before.
+ *
+ * nlmeans, hqdn3d, lapsharp and decomb's EEDI2 mode only have 8 bit
+ * kernels, using any of them keeps the whole chain at 8 bit.
+ */
+static void sanitize_pix_fmt(hb_job_t *job)
+{
+    hb_title_t * title = job->title;
+    int          depth, ii;
+
+    if (job->pix_fmt != AV_PIX_FMT_YUV420P)
+    {
+        // Explicitly requested format
+        return;
+    }
+    switch (job->vcodec)
+    {
+        case HB_VCODEC_X264_10BIT:
+        case HB_VCODEC_X265_10BIT:
+        case HB_VCODEC_X265_12BIT:
+        case HB_VCODEC_X265_16BIT:
+            break;
+        default:
+            return;
+    }
+    if (hb_get_bit_depth(title->pix_fmt) <= 8)
+    {
+        return;
+    }
+    for (ii = 0; ii < hb_list_count(job->list_filter); ii++)
+    {
+        hb_filter_object_t * filter = hb_list_item(job->list_filter, ii);
+        int                  high_depth = filter->high_depth;
+
+        if (filter->id == HB_FILTER_DECOMB &&
+            (hb_dict_get_int(filter->settings, "mode") & MODE_DECOMB_EEDI2))
+        {
+            // decomb's EEDI2 interpolation is 8 bit only
+            high_depth = 0;
+        }
+        if (!high_depth)
+        {
+            hb_log("work: filter '%s' is 8 bit only, "
+                   "filtering at 8 bit depth", filter->name);
+            return;
+        }
+    }
+
+    depth = hb_video_encoder_get_depth(job->vcodec);
+    switch (depth)
+    {
+        case 10:
+            job->pix_fmt = AV_PIX_FMT_YUV420P10;
+            break;
+        case 12:
+            job->pix_fmt = AV_PIX_FMT_YUV420P12;
+            break;
+        default:
+            job->pix_fmt = AV_PIX_FMT_YUV420P16;
+            break;
+    }
+    hb_log("work: filtering at %d bit depth", depth);
+}
+
+/*
+ * Chunked encoding runs several instances of the encoder on consecutive
+ * ranges of the video.  It is limited to single pass software encodes,
+ * multi-pass stats files can not be split between instances.
+ */
+static int use_chunked_encoder(hb_job_t *job)
+{
+    if (job->encode_chunks <= 1 || job->indepth_scan)
+    {
+        return 0;
+    }
+    if (!(job->vcodec & (HB_VCODEC_X264_MASK | HB_VCODEC_X265_MASK)))
+    {
+        hb_log("work: chunked encoding requires x264 or x265, disabled");
+        return 0;
+    }
+    if (job->pass_id != HB_PASS_ENCODE)
+    {
+        hb_log("work: chunked encoding is single pass only, disabled");
+        return 0;
+    }
+    return 1;
+}
+
 /**
  * Job initialization routine.
  *
@@ -1528,6 +1626,8 @@ static void do_job(hb_job_t *job)
         *job->die = 1;
         goto cleanup;
     }
+    sanitize_pix_fmt(job);
+
     // Filters have an effect on settings.
     // So initialize the filters and update the job.
     if (job->list_filter && hb_list_count(job->list_filter))
@@ -1540,11 +1640,8 @@ static void do_job(hb_job_t *job)
         init.time_base.num = 1;
         init.time_base.den = 90000;
         init.job = job;
-        // TODO: When more complete pix format support is complete this
-        // needs to be updated to reflect the pix_fmt output by
-        // decavcodec.c.  This may be different than title->pix_fmt
-        // since we will likely only support planar YUV color formats.
-        init.pix_fmt = AV_PIX_FMT_YUV420P;
+        // decavcodec.c converts decoded frames to job->pix_fmt
+        init.pix_fmt = job->pix_fmt;
         init.color_prim = title->color_prim;
         init.color_transfer = title->color_transfer;
         init.color_matrix = title->color_matrix;
@@ -1644,17 +1741,29 @@ static void do_job(hb_job_t *job)
 #endif // QSV zerocopy path
 #endif
     {
-        job->fifo_mpeg2  = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
+        // Fifos that have exactly one producer and one consumer thread
+        // (reader -> decoder, encoder -> muxer) can skip locking.
+        job->fifo_mpeg2  = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
         job->fifo_raw    = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
         if (!job->indepth_scan)
         {
             // When doing subtitle indepth scan, the pipeline ends at sync
             job->fifo_sync   = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
             job->fifo_render = NULL; // Attached to filter chain
-            job->fifo_mpeg4  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
+            job->fifo_mpeg4  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
         }
     }
 
+    // Video fifos hold the bulk of the memory of a job, limit the bytes
+    // they queue in addition to the number of buffers.
+    job->budget = hb_memory_budget_init(job->memory_budget);
+    hb_fifo_set_budget(job->fifo_mpeg2, job->budget);
+    hb_fifo_set_budget(job->fifo_raw,   job->budget);
+    hb_fifo_set_budget(job->fifo_sync,  job->budget);
+    hb_fifo_set_budget(job->fifo_mpeg4, job->budget);
+    hb_fifo_set_done(job->fifo_mpeg2, &job->done, job->die);
+    hb_fifo_set_done(job->fifo_mpeg4, &job->done, job->die);
+
     result = sanitize_audio(job);
     if (result)
     {
@@ -1672,10 +1781,16 @@ static void do_job(hb_job_t *job)
             audio = hb_list_item(job->list_audio, i);
 
             /* set up the audio work fifos */
-            audio->priv.fifo_in   = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
+            audio->priv.fifo_in   = hb_fifo_init_spsc(FIFO_LARGE, FIFO_LARGE_WAKE);
+            hb_fifo_set_done(audio->priv.fifo_in, &job->done, job->die);
             audio->priv.fifo_raw  = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
             audio->priv.fifo_sync = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
             audio->priv.fifo_out  = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
+            if (hb_audio_filter_needed(audio))
+            {
+                audio->priv.fifo_filter = hb_fifo_init(FIFO_SMALL,
+                                                       FIFO_SMALL_WAKE);
+            }
 
             // Add audio decoder work object
             w = hb_audio_decoder(job->h, audio->config.in.codec);
@@ -1778,6 +1893,23 @@ static void do_job(hb_job_t *job)
                 w->config   = &audio->priv.config;
                 w->audio    = audio;
 
+                if (audio->priv.fifo_filter != NULL)
+                {
+                    /*
+                    * Resample and apply gain in a thread of its own
+                    * rather than under sync's shared lock
+                    */
+                    hb_work_object_t * filter;
+
+                    filter = hb_get_work(job->h, WORK_AUDIO_FILTER);
+                    filter->fifo_in  = audio->priv.fifo_sync;
+                    filter->fifo_out = audio->priv.fifo_filter;
+                    filter->audio    = audio;
+                    hb_list_add(job->list_work, filter);
+
+                    w->fifo_in = audio->priv.fifo_filter;
+                }
+
                 hb_list_add( job->list_work, w );
             }
         }
@@ -1792,7 +1924,10 @@ static void do_job(hb_job_t *job)
                 if (!filter->skip)
                 {
                     filter->fifo_in = fifo_in;
-                    filter->fifo_out = hb_fifo_init(FIFO_MINI, FIFO_MINI_WAKE);
+                    filter->fifo_out = hb_fifo_init_spsc(FIFO_MINI,
+                                                         FIFO_MINI_WAKE);
+                    hb_fifo_set_budget(filter->fifo_out, job->budget);
+                    hb_fifo_set_done(filter->fifo_out, &job->done, job->die);
                     fifo_in = filter->fifo_out;
                 }
             }
@@ -1805,7 +1940,14 @@ static void do_job(hb_job_t *job)
         }
 
         // Video encoder
-        w = hb_video_encoder(job->h, job->vcodec);
+        if (use_chunked_encoder(job))
+        {
+            w = hb_get_work(job->h, WORK_ENCCHUNK);
+        }
+        else
+        {
+            w = hb_video_encoder(job->h, job->vcodec);
+        }
         if (w == NULL)
         {
             *job->done_error = HB_ERROR_INIT;
@@ -1899,6 +2041,7 @@ static void do_job(hb_job_t *job)
 
 cleanup:
     job->done = 1;
+    hb_fifo_wake_all();
 
     // Close render filter pipeline
     if (job->list_filter)
@@ -1959,6 +2102,8 @@ cleanup:
             hb_fifo_close( &audio->priv.fifo_raw );
         if( audio->priv.fifo_sync != NULL )
             hb_fifo_close( &audio->priv.fifo_sync );
+        if( audio->priv.fifo_filter != NULL )
+            hb_fifo_close( &audio->priv.fifo_filter );
         if( audio->priv.fifo_out != NULL )
             hb_fifo_close( &audio->priv.fifo_out );
     }
@@ -1975,6 +2120,8 @@ cleanup:
         }
     }
 
+    hb_memory_budget_close(&job->budget);
+
     if (job->indepth_scan)
     {
         analyze_subtitle_scan(job);
@@ -2066,6 +2213,11 @@ void hb_work_loop( void * _w )
     {
         hb_buffer_close( &buf_out );
     }
+    if (*w->done || (w->die != NULL && *w->die))
+    {
+        // Threads sleeping on a fifo don't check the flags by themselves
+        hb_fifo_wake_all();
+    }
 
     // Consume data in incoming fifo till job completes so that
     // residual data does not stall the pipeline. There can be
@@ -2170,6 +2322,10 @@ static void filter_loop( void * _f )
     {
         hb_buffer_close( &buf_out );
     }
+    if ( *f->done )
+    {
+        hb_fifo_wake_all();
+    }
 
     // Consume data in incoming fifo till job complete so that
     // residual data does not stall the pipeline
@@ -0,0 +1,104 @@
+/* blur_bench.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+    Times the unsharp / chroma smooth blur for every steps value on each
+    instruction set tier, so that a kernel change can be checked against
+    the matrix sizes the filters actually use (steps = (size - 1) / 2).
+    Tiers that use the same kernel as the tier below them print "-".
+
+    Needs libhb/blur.c and libhb/blur_x86.c, see kernel_test.h.
+
+    Usage: blur_bench [width height [frames]]
+ */
+
+#include "kernel_test.h"
+#include "handbrake/blur.h"
+
+int main(int argc, char **argv)
+{
+    kernel_tier_t tiers[KERNEL_TIERS_MAX];
+    int width  = argc > 2 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int frames = argc > 3 ? atoi(argv[3]) : 20;
+    int stride = (width + 31) / 32 * 32;
+    int count, steps, t, f;
+
+    if (width < 1 || height < 1 || frames < 1)
+    {
+        fprintf(stderr, "usage: %s [width height [frames]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *src = malloc(stride * height);
+    uint8_t *dst = malloc(stride * height);
+    if (src == NULL || dst == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    kernel_fill(src, width, height, stride);
+
+    count = kernel_tiers(tiers);
+    printf("%dx%d, %d frames, ms per frame\n", width, height, frames);
+    printf("steps");
+    for (t = 0; t < count; t++)
+    {
+        printf(" %8s", tiers[t].name);
+    }
+    printf("\n");
+
+    for (steps = 1; steps <= HB_BLUR_STEPS_MAX; steps++)
+    {
+        hb_blur_t *blur[KERNEL_TIERS_MAX];
+
+        for (t = 0; t < count; t++)
+        {
+            kernel_cpu_flags = tiers[t].cpu_flags;
+            blur[t] = hb_blur_init(width, 8, steps, 32768,
+                                   HB_BLUR_SHARPEN);
+            if (blur[t] == NULL)
+            {
+                fprintf(stderr, "blur_bench: hb_blur_init failed\n");
+                return EXIT_FAILURE;
+            }
+        }
+
+        printf("%5d", steps);
+        for (t = 0; t < count; t++)
+        {
+            double start;
+
+            if (t + 1 < count && blur[t]->filter == blur[t + 1]->filter)
+            {
+                printf(" %8s", "-");
+                continue;
+            }
+            // Warm up the caches and the scratch rows
+            hb_blur_filter(blur[t], src, dst, width, height, stride);
+            start = kernel_time();
+            for (f = 0; f < frames; f++)
+            {
+                hb_blur_filter(blur[t], src, dst, width, height, stride);
+            }
+            printf(" %8.3f", (kernel_time() - start) * 1000 / frames);
+        }
+        printf("\n");
+        fflush(stdout);
+
+        for (t = 0; t < count; t++)
+        {
+            hb_blur_close(&blur[t]);
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/* decomb_test.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+    Checks that the decomb x86 kernels match the C kernels on random lines,
+    widths, taps and yadif modes.
+
+    Needs libhb/decomb_c.c and libhb/decomb_x86.c, see kernel_test.h.
+
+    Usage: decomb_test [iterations [seed]]
+ */
+
+#include "kernel_test.h"
+#include "handbrake/decomb.h"
+
+#define MAX_WIDTH 256
+#define ROWS      7     // yadif reads 3 lines above and below
+#define PAD       32
+
+typedef struct
+{
+    int       stride;
+    uint8_t * mem;
+    uint8_t * line;     // middle row
+} lines_t;
+
+static void lines_init(lines_t *l, int width)
+{
+    l->stride = width + 2 * PAD;
+    l->mem    = malloc(l->stride * ROWS);
+    l->line   = l->mem + (ROWS / 2) * l->stride + PAD;
+    kernel_fill(l->mem, l->stride, ROWS, l->stride);
+}
+
+static int compare(const uint8_t *ref, const uint8_t *opt, int start,
+                   int stop, const char *name, const char *kernel,
+                   int iteration, int width)
+{
+    int x;
+
+    for (x = start; x < stop; x++)
+    {
+        if (ref[x] != opt[x])
+        {
+            fprintf(stderr, "%s: %s mismatch at iteration %d (width %d, "
+                    "x %d: %d != %d)\n", name, kernel, iteration, width, x,
+                    ref[x], opt[x]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_cubic(DecombFunctions *opt, const char *name, int iteration)
+{
+    uint8_t ref_dst[MAX_WIDTH], opt_dst[MAX_WIDTH];
+    lines_t src;
+    int     width = kernel_rand_range(1, MAX_WIDTH);
+    int     ret;
+
+    lines_init(&src, width);
+    decomb_cubic_interpolate_line_c(ref_dst,
+                                    src.line - 3 * src.stride,
+                                    src.line - src.stride,
+                                    src.line + src.stride,
+                                    src.line + 3 * src.stride, width);
+    opt->cubic_interpolate_line(opt_dst,
+                                src.line - 3 * src.stride,
+                                src.line - src.stride,
+                                src.line + src.stride,
+                                src.line + 3 * src.stride, width);
+    ret = compare(ref_dst, opt_dst, 0, width, name, "cubic_interpolate_line",
+                  iteration, width);
+    free(src.mem);
+
+    return ret;
+}
+
+static int check_blend(DecombFunctions *opt, const char *name, int iteration)
+{
+    // The taps of decomb and of hb_deinterlace(), then random ones small
+    // enough that the C kernel's crop table covers the results
+    static const int taps[2][5] = { { -1, 2, 6, 2, -1 }, { -1, 4, 2, 4, -1 } };
+    uint8_t          ref_dst[MAX_WIDTH], opt_dst[MAX_WIDTH];
+    const uint8_t  * rows[5];
+    lines_t          src;
+    int              tap[5], k, normalize;
+    int              width = kernel_rand_range(1, MAX_WIDTH);
+    int              ret;
+
+    if (iteration % 3 < 2)
+    {
+        memcpy(tap, taps[iteration % 3], sizeof(tap));
+        normalize = 3;
+    }
+    else
+    {
+        for (k = 0; k < 5; k++)
+        {
+            tap[k] = kernel_rand_range(-4, 4);
+        }
+        normalize = kernel_rand_range(3, 6);
+    }
+
+    lines_init(&src, width);
+    for (k = 0; k < 5; k++)
+    {
+        rows[k] = src.line + (k - 2) * src.stride;
+    }
+    decomb_blend_filter_line_c(ref_dst, rows, tap, normalize, width);
+    opt->blend_filter_line(opt_dst, rows, tap, normalize, width);
+    ret = compare(ref_dst, opt_dst, 0, width, name, "blend_filter_line",
+                  iteration, width);
+    free(src.mem);
+
+    return ret;
+}
+
+static int check_yadif(DecombFunctions *opt, const char *name, int iteration)
+{
+    uint8_t   ref_dst[MAX_WIDTH], opt_dst[MAX_WIDTH];
+    lines_t   prev, cur, next, guess;
+    int       width         = kernel_rand_range(24, MAX_WIDTH);
+    int       cubic         = kernel_rand() & 1;
+    int       vertical_edge = kernel_rand() & 1;
+    int       parity        = kernel_rand() & 1;
+    int       eedi2         = (kernel_rand() & 3) == 0;
+    // Same range as yadif_filter_line() in decomb.c
+    int       start         = cubic ? 4 : 3;
+    int       stop          = width - start;
+    int       ret;
+
+    lines_init(&prev, width);
+    lines_init(&cur, width);
+    lines_init(&next, width);
+    lines_init(&guess, width);
+    // Static and slowly moving content take the spatial branches too
+    if (kernel_rand() & 1)
+    {
+        memcpy(prev.mem, cur.mem, cur.stride * ROWS);
+        memcpy(next.mem, cur.mem, cur.stride * ROWS);
+    }
+    memset(ref_dst, 0, sizeof(ref_dst));
+    memset(opt_dst, 0, sizeof(opt_dst));
+
+    decomb_yadif_filter_line_c(ref_dst, prev.line, cur.line, next.line,
+                               eedi2 ? guess.line : NULL, cubic,
+                               vertical_edge, width, cur.stride, parity,
+                               start, stop);
+    opt->yadif_filter_line(opt_dst, prev.line, cur.line, next.line,
+                           eedi2 ? guess.line : NULL, cubic,
+                           vertical_edge, width, cur.stride, parity,
+                           start, stop);
+    ret = compare(ref_dst, opt_dst, 0, width, name, "yadif_filter_line",
+                  iteration, width);
+    if (ret)
+    {
+        fprintf(stderr, "    cubic %d vertical_edge %d parity %d eedi2 %d\n",
+                cubic, vertical_edge, parity, eedi2);
+    }
+    free(prev.mem);
+    free(cur.mem);
+    free(next.mem);
+    free(guess.mem);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    kernel_tier_t   tiers[KERNEL_TIERS_MAX];
+    DecombFunctions ref;
+    int iterations = argc > 1 ? atoi(argv[1]) : 5000;
+    int count, failed = 0;
+
+    if (argc > 2)
+    {
+        kernel_rand_state = strtoul(argv[2], NULL, 0) | 1;
+    }
+
+    ref.yadif_filter_line      = decomb_yadif_filter_line_c;
+    ref.cubic_interpolate_line = decomb_cubic_interpolate_line_c;
+    ref.blend_filter_line      = decomb_blend_filter_line_c;
+
+    count = kernel_tiers(tiers);
+    for (int t = 0; t < count; t++)
+    {
+        DecombFunctions opt = ref;
+
+        kernel_cpu_flags = tiers[t].cpu_flags;
+#if defined(ARCH_X86)
+        decomb_init_x86(&opt);
+#endif
+        if (!memcmp(&opt, &ref, sizeof(opt)))
+        {
+            continue;
+        }
+
+        int errors = 0;
+        for (int i = 0; i < iterations && errors < 10; i++)
+        {
+            errors += check_cubic(&opt, tiers[t].name, i);
+            errors += check_blend(&opt, tiers[t].name, i);
+            errors += check_yadif(&opt, tiers[t].name, i);
+        }
+        printf("%-8s %s\n", tiers[t].name, errors ? "FAILED" : "ok");
+        failed |= errors;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,380 @@
+/* encchunk_bench.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+    Checks that chunked encoding is faster than a single encoder.
+
+    The frames go through encchunk to a stand-in video encoder that takes
+    a fixed time per frame, so the check measures how far the chunks
+    overlap whatever the number of CPUs.  The same frames are encoded with
+    encode_chunks 1, then with 'chunks' encoders.  Packets must come out
+    complete and in order, and the chunked run must reach
+    'chunks' * 'min_scale' times the frame rate of the single one.
+
+    Needs libhb/encchunk.c, libhb/fifo.c and libhb/ports.c, see
+    kernel_test.h.
+
+    Usage: encchunk_bench [chunks [frames [min_scale]]]
+ */
+
+#include "kernel_test.h"
+
+// Time the stand-in encoder takes per frame
+#define ENCODE_MSEC 2
+// Frames per second of the job, CHUNK_SECONDS of them make a chunk
+#define FRAME_RATE  25
+
+extern hb_work_object_t hb_encchunk;
+
+/*
+ * The libhb functions encchunk, fifo and ports need, other than the
+ * stand-in encoder
+ */
+typedef struct
+{
+    void ** items;
+    int     count;
+    int     alloc;
+} bench_list_t;
+
+hb_list_t * hb_list_init(void)
+{
+    return calloc(1, sizeof(bench_list_t));
+}
+
+void hb_list_add(hb_list_t *_l, void *p)
+{
+    bench_list_t *l = (bench_list_t *)_l;
+
+    if (l->count == l->alloc)
+    {
+        l->alloc = l->alloc ? 2 * l->alloc : 16;
+        l->items = realloc(l->items, l->alloc * sizeof(void *));
+    }
+    l->items[l->count++] = p;
+}
+
+void * hb_list_item(const hb_list_t *_l, int i)
+{
+    const bench_list_t *l = (const bench_list_t *)_l;
+
+    return i >= 0 && i < l->count ? l->items[i] : NULL;
+}
+
+int hb_list_count(const hb_list_t *_l)
+{
+    return ((const bench_list_t *)_l)->count;
+}
+
+void hb_list_rem(hb_list_t *_l, void *p)
+{
+    bench_list_t *l = (bench_list_t *)_l;
+    int           i;
+
+    for (i = 0; i < l->count; i++)
+    {
+        if (l->items[i] == p)
+        {
+            memmove(&l->items[i], &l->items[i + 1],
+                    (l->count - i - 1) * sizeof(void *));
+            l->count--;
+            return;
+        }
+    }
+}
+
+void hb_list_close(hb_list_t **_l)
+{
+    bench_list_t *l = (bench_list_t *)*_l;
+
+    if (l != NULL)
+    {
+        free(l->items);
+        free(l);
+    }
+    *_l = NULL;
+}
+
+void hb_error(char *log, ...)
+{
+    va_list args;
+
+    va_start(args, log);
+    vfprintf(stderr, log, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+void hb_deep_log(hb_debug_level_t level, char *log, ...)
+{
+}
+
+char * hb_strdup_vaprintf(const char *fmt, va_list args)
+{
+    va_list copy;
+    char  * str;
+    int     len;
+
+    va_copy(copy, args);
+    len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    str = len < 0 ? NULL : malloc(len + 1);
+    if (str != NULL)
+    {
+        vsnprintf(str, len + 1, fmt, args);
+    }
+    return str;
+}
+
+char * hb_strdup_printf(const char *fmt, ...)
+{
+    va_list args;
+    char  * str;
+
+    va_start(args, fmt);
+    str = hb_strdup_vaprintf(fmt, args);
+    va_end(args);
+    return str;
+}
+
+void hb_thread_pool_broadcast(void)
+{
+}
+
+void hb_buffer_list_append(hb_buffer_list_t *list, hb_buffer_t *buf)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+    if (list->tail == NULL)
+    {
+        list->head = buf;
+    }
+    else
+    {
+        list->tail->next = buf;
+    }
+    for (list->tail = buf; list->tail->next != NULL;
+         list->tail = list->tail->next)
+    {
+        list->count++;
+    }
+    list->count++;
+}
+
+hb_buffer_t * hb_buffer_list_clear(hb_buffer_list_t *list)
+{
+    hb_buffer_t *head = list->head;
+
+    memset(list, 0, sizeof(*list));
+    return head;
+}
+
+/*
+ * The libavutil functions fifo.c needs, only plain memory is used here
+ */
+void * av_malloc(size_t size)
+{
+    void *ptr = NULL;
+
+    return posix_memalign(&ptr, 64, size ? size : 1) ? NULL : ptr;
+}
+
+void av_free(void *ptr)
+{
+    free(ptr);
+}
+
+AVBufferRef * av_buffer_create(uint8_t *data, int size,
+                               void (*free)(void *opaque, uint8_t *data),
+                               void *opaque, int flags)
+{
+    abort();
+}
+
+AVBufferRef * av_buffer_ref(AVBufferRef *buf)
+{
+    abort();
+}
+
+void av_buffer_unref(AVBufferRef **buf)
+{
+    abort();
+}
+
+int av_buffer_is_writable(const AVBufferRef *buf)
+{
+    abort();
+}
+
+const AVPixFmtDescriptor * av_pix_fmt_desc_get(enum AVPixelFormat pix_fmt)
+{
+    abort();
+}
+
+int av_image_get_linesize(enum AVPixelFormat pix_fmt, int width, int plane)
+{
+    abort();
+}
+
+/*
+ * Stand-in video encoder
+ */
+struct hb_work_private_s
+{
+    int64_t frames;
+};
+
+static int bench_encoder_init(hb_work_object_t *w, hb_job_t *job)
+{
+    w->private_data = calloc(1, sizeof(hb_work_private_t));
+    return w->private_data == NULL;
+}
+
+static int bench_encoder_work(hb_work_object_t *w, hb_buffer_t **buf_in,
+                              hb_buffer_t **buf_out)
+{
+    hb_buffer_t *in = *buf_in, *out;
+
+    if (in->s.flags & HB_BUF_FLAG_EOF)
+    {
+        *buf_out = in;
+        *buf_in  = NULL;
+        return HB_WORK_DONE;
+    }
+
+    hb_snooze(ENCODE_MSEC);
+
+    out = hb_buffer_init(64);
+    out->s              = in->s;
+    out->s.renderOffset = in->s.start - 2 * 90000 / FRAME_RATE;
+    w->private_data->frames++;
+    *buf_out = out;
+    return HB_WORK_OK;
+}
+
+static void bench_encoder_close(hb_work_object_t *w)
+{
+    free(w->private_data);
+    w->private_data = NULL;
+}
+
+static hb_work_object_t bench_encoder =
+{
+    WORK_ENCX264,
+    "Stand-in encoder",
+    bench_encoder_init,
+    bench_encoder_work,
+    bench_encoder_close
+};
+
+hb_work_object_t * hb_video_encoder(hb_handle_t *h, int vcodec)
+{
+    hb_work_object_t *w = calloc(1, sizeof(hb_work_object_t));
+
+    *w = bench_encoder;
+    return w;
+}
+
+/*
+ * Passes 'frames' frames through encchunk like hb_work_loop() does and
+ * returns the frame rate, or -1 if packets are missing or out of order
+ */
+static double bench_run(int chunks, int frames)
+{
+    hb_job_t          job;
+    hb_esconfig_t     config;
+    hb_work_object_t  w = hb_encchunk;
+    volatile int      done = 0, die = 0;
+    hb_buffer_t     * in, * out, * next;
+    int64_t           expect = 0;
+    double            start;
+    int               ii, status = HB_WORK_OK;
+
+    memset(&job, 0, sizeof(job));
+    memset(&config, 0, sizeof(config));
+    job.vrate.num     = FRAME_RATE;
+    job.vrate.den     = 1;
+    job.encode_chunks = chunks;
+    job.die           = &die;
+    w.done            = &done;
+    w.die             = &die;
+    w.config          = &config;
+
+    start = kernel_time();
+    if (w.init(&w, &job))
+    {
+        return -1;
+    }
+    for (ii = 0; ii <= frames && status == HB_WORK_OK; ii++)
+    {
+        in = ii < frames ? hb_buffer_init(64) : hb_buffer_eof_init();
+        in->s.start = in->s.renderOffset = (int64_t)ii * 90000 / FRAME_RATE;
+        in->s.stop  = (int64_t)(ii + 1) * 90000 / FRAME_RATE;
+
+        out    = NULL;
+        status = w.work(&w, &in, &out);
+        for (; out != NULL; out = next)
+        {
+            next      = out->next;
+            out->next = NULL;
+            if (!(out->s.flags & HB_BUF_FLAG_EOF) &&
+                out->s.start != expect++ * 90000 / FRAME_RATE)
+            {
+                fprintf(stderr, "encchunk_bench: packet %"PRId64" out of "
+                        "order\n", expect - 1);
+                status = HB_WORK_ERROR;
+            }
+            hb_buffer_close(&out);
+        }
+    }
+    done = 1;
+    hb_fifo_wake_all();
+    w.close(&w);
+
+    if (status != HB_WORK_DONE || expect != frames)
+    {
+        fprintf(stderr, "encchunk_bench: %"PRId64" of %d packets\n",
+                expect, frames);
+        return -1;
+    }
+    return frames / (kernel_time() - start);
+}
+
+int main(int argc, char **argv)
+{
+    int    chunks    = argc > 1 ? atoi(argv[1]) : 4;
+    int    frames    = argc > 2 ? atoi(argv[2]) : 1000;
+    double min_scale = argc > 3 ? atof(argv[3]) : 0.5;
+    double single, chunked;
+
+    if (chunks < 2 || frames < 1)
+    {
+        fprintf(stderr, "usage: %s [chunks [frames [min_scale]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    hb_buffer_pool_init();
+
+    single  = bench_run(1, frames);
+    chunked = bench_run(chunks, frames);
+    if (single < 0 || chunked < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    printf("single encoder %8.1f fps\n", single);
+    printf("%d chunks       %8.1f fps (%.2fx)\n", chunks, chunked,
+           chunked / single);
+    if (chunked < single * chunks * min_scale)
+    {
+        printf("FAILED, expected at least %.2fx\n", chunks * min_scale);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/* kernel_test.h
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+    Helpers shared by the filter kernel tests and benchmarks.
+
+    The programs in this directory are not part of HandBrakeCLI.  Running
+    "make test.kernels" in the build directory builds and runs them.  Each
+    one is compiled together with the libhb kernel sources it exercises
+    only (see test/module.defs), by hand e.g. from the top of the tree:
+
+    cc -O2 -ffp-contract=off -D__LIBHB__ -DUSE_PTHREAD -DSYS_LINUX -DARCH_X86_64 \
+       -I libhb -I build/libhb -I build/contrib/include \
+       test/kernels/nlmeans_test.c libhb/nlmeans_c.c libhb/nlmeans_x86.c \
+       -o nlmeans_test -lm
+
+    Each source file lists the libhb files it needs.  -ffp-contract=off
+    keeps the compiler from fusing the multiply-adds of the C reference,
+    which the SIMD kernels do not do either.
+
+    av_get_cpu_flags() and hb_log() are provided here so that the kernels
+    link without libavutil and libhb, and so that every instruction set
+    tier the CPU supports can be selected in turn.
+ */
+
+#ifndef HANDBRAKE_KERNEL_TEST_H
+#define HANDBRAKE_KERNEL_TEST_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "handbrake/handbrake.h"
+#include "libavutil/cpu.h"
+
+typedef struct
+{
+    const char * name;
+    int          cpu_flags;
+} kernel_tier_t;
+
+static int kernel_cpu_flags;
+
+int av_get_cpu_flags(void)
+{
+    return kernel_cpu_flags;
+}
+
+void hb_log(char *log, ...)
+{
+    va_list args;
+
+    va_start(args, log);
+    vfprintf(stderr, log, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+/* Tiers from the best to the portable C code, those the CPU lacks are
+ * skipped.  The flags of a tier include those of the tiers below it. */
+static inline int kernel_tiers(kernel_tier_t *tiers)
+{
+    int count = 0;
+
+#if defined(ARCH_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+#if defined(AV_CPU_FLAG_AVX512)
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        tiers[count].name      = "AVX-512";
+        tiers[count].cpu_flags = AV_CPU_FLAG_AVX512 | AV_CPU_FLAG_AVX2 |
+                                 AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE2;
+        count++;
+    }
+#endif
+    if (__builtin_cpu_supports("avx2"))
+    {
+        tiers[count].name      = "AVX2";
+        tiers[count].cpu_flags = AV_CPU_FLAG_AVX2 | AV_CPU_FLAG_SSE4 |
+                                 AV_CPU_FLAG_SSE2;
+        count++;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        tiers[count].name      = "SSE4";
+        tiers[count].cpu_flags = AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE2;
+        count++;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        tiers[count].name      = "SSE2";
+        tiers[count].cpu_flags = AV_CPU_FLAG_SSE2;
+        count++;
+    }
+#endif
+    tiers[count].name      = "C";
+    tiers[count].cpu_flags = 0;
+    count++;
+
+    return count;
+}
+
+#define KERNEL_TIERS_MAX 5
+
+/* xorshift32, the tests must not depend on the libc generator */
+static uint32_t kernel_rand_state = 2463534242u;
+
+static inline uint32_t kernel_rand(void)
+{
+    uint32_t x = kernel_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return kernel_rand_state = x;
+}
+
+static inline int kernel_rand_range(int min, int max)
+{
+    return min + (int)(kernel_rand() % (uint32_t)(max - min + 1));
+}
+
+/* Random picture, smooth areas and edges mixed with noise so that every
+ * branch of the kernels gets taken */
+static inline void kernel_fill(uint8_t *dst, int width, int height, int stride)
+{
+    int x, y;
+    int kind = kernel_rand() % 4;
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            int v;
+
+            switch (kind)
+            {
+                case 0:
+                    v = kernel_rand() & 0xff;
+                    break;
+                case 1:
+                    v = (x * 7 + y * 3) & 0xff;
+                    break;
+                case 2:
+                    v = ((x / 5 + y / 3) & 1) ? 235 : 16;
+                    v += (int)(kernel_rand() % 9) - 4;
+                    break;
+                default:
+                    v = (kernel_rand() & 0x10) ? 255 : 0;
+                    break;
+            }
+            dst[y * stride + x] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+    }
+}
+
+static inline double kernel_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif // HANDBRAKE_KERNEL_TEST_H
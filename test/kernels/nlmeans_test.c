@@ -0,0 +1,175 @@
+/* nlmeans_test.c
+
+   Copyright (c) 2003-2019 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+    Checks that the NLMeans x86 kernels are bit exact against the C kernels
+    on random planes, patch sizes and displacements.
+
+    Needs libhb/nlmeans_c.c and libhb/nlmeans_x86.c, see kernel_test.h.
+
+    Usage: nlmeans_test [iterations [seed]]
+ */
+
+#include <math.h>
+
+#include "kernel_test.h"
+#include "handbrake/nlmeans.h"
+
+#define EXPSIZE 128   // NLMEANS_EXPSIZE
+#define BORDER  16
+
+typedef struct
+{
+    int       w;
+    int       h;
+    int       bw;
+    uint8_t * mem;
+    uint8_t * image;
+} plane_t;
+
+static void plane_init(plane_t *p, int w, int h)
+{
+    p->w     = w;
+    p->h     = h;
+    p->bw    = w + 2 * BORDER;
+    p->mem   = malloc(p->bw * (h + 2 * BORDER));
+    p->image = p->mem + BORDER * p->bw + BORDER;
+    kernel_fill(p->mem, p->bw, h + 2 * BORDER, p->bw);
+}
+
+static int check(NLMeansFunctions *ref, NLMeansFunctions *opt,
+                 const char *name, int iteration)
+{
+    plane_t src, cmp;
+    const int w        = kernel_rand_range(1, 160);
+    const int h        = kernel_rand_range(1, 40);
+    const int n        = kernel_rand_range(0, 4) * 2 + 1;
+    const int r_half   = kernel_rand_range(0, 7);
+    const int dx       = kernel_rand_range(-r_half, r_half);
+    const int dy       = kernel_rand_range(-r_half, r_half);
+    const int strength = kernel_rand_range(1, 50);
+    int ret = 0;
+
+    plane_init(&src, w, h);
+    plane_init(&cmp, w, h);
+
+    // Same tables as nlmeans_init()
+    float exptable[EXPSIZE];
+    const float weight_factor       = 1.0 / n / n / (strength * strength);
+    const float min_weight_in_table = 0.0005;
+    const float stretch             = EXPSIZE / (-log(min_weight_in_table));
+    const float weight_fact_table   = weight_factor * stretch;
+    const int   diff_max            = EXPSIZE / weight_fact_table;
+    for (int i = 0; i < EXPSIZE; i++)
+    {
+        exptable[i] = exp(-i / stretch);
+    }
+    exptable[EXPSIZE - 1] = 0;
+
+    // Same layout as nlmeans_plane()
+    const int integral_stride = ((w + 15) / 16 * 16) + 2 * 16;
+    const size_t integral_size = integral_stride * (h + 1) * sizeof(uint32_t);
+    uint32_t *integral_mem[2];
+    uint32_t *integral[2];
+    struct PixelSum *tmp_data[2];
+
+    for (int k = 0; k < 2; k++)
+    {
+        NLMeansFunctions *f = k ? opt : ref;
+
+        integral_mem[k] = calloc(1, integral_size);
+        integral[k]     = integral_mem[k] + integral_stride + 16;
+        tmp_data[k]     = calloc(w * h, sizeof(struct PixelSum));
+
+        f->build_integral(integral[k], integral_stride,
+                          src.image, src.image, cmp.image, cmp.image,
+                          w, BORDER, w, h, dx, dy);
+
+        for (int y = 0; y <= h - n; y++)
+        {
+            const int yc = y + (n - 1) / 2;
+
+            f->accumulate_weights(tmp_data[k] + yc * w + (n - 1) / 2,
+                                  cmp.image + (yc + dy) * cmp.bw + (n - 1) / 2 + dx,
+                                  integral[k] + (y     - 1) * integral_stride - 1,
+                                  integral[k] + (y + n - 1) * integral_stride - 1,
+                                  n, w - n + 1,
+                                  exptable, weight_fact_table, diff_max);
+        }
+    }
+
+    // The SIMD kernels may write past the width into the stride padding
+    for (int y = 0; y < h && !ret; y++)
+    {
+        if (memcmp(integral[0] + y * integral_stride,
+                   integral[1] + y * integral_stride, w * sizeof(uint32_t)))
+        {
+            fprintf(stderr, "%s: build_integral mismatch at iteration %d "
+                    "(%dx%d dx %d dy %d)\n", name, iteration, w, h, dx, dy);
+            ret = 1;
+        }
+    }
+    if (!ret && memcmp(tmp_data[0], tmp_data[1], w * h * sizeof(struct PixelSum)))
+    {
+        fprintf(stderr, "%s: accumulate_weights mismatch at iteration %d "
+                "(%dx%d n %d strength %d)\n", name, iteration, w, h, n, strength);
+        ret = 1;
+    }
+
+    for (int k = 0; k < 2; k++)
+    {
+        free(integral_mem[k]);
+        free(tmp_data[k]);
+    }
+    free(src.mem);
+    free(cmp.mem);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    kernel_tier_t tiers[KERNEL_TIERS_MAX];
+    NLMeansFunctions ref;
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    int count, failed = 0;
+
+    if (argc > 2)
+    {
+        kernel_rand_state = strtoul(argv[2], NULL, 0) | 1;
+    }
+
+    ref.build_integral     = nlmeans_build_integral_scalar;
+    ref.accumulate_weights = nlmeans_accumulate_weights_scalar;
+
+    count = kernel_tiers(tiers);
+    for (int t = 0; t < count; t++)
+    {
+        NLMeansFunctions opt = ref;
+
+        kernel_cpu_flags = tiers[t].cpu_flags;
+#if defined(ARCH_X86)
+        nlmeans_init_x86(&opt);
+#endif
+        if (!memcmp(&opt, &ref, sizeof(opt)))
+        {
+            continue;
+        }
+
+        int errors = 0;
+        for (int i = 0; i < iterations && errors < 10; i++)
+        {
+            errors += check(&ref, &opt, tiers[t].name, i);
+        }
+        printf("%-8s %s\n", tiers[t].name, errors ? "FAILED" : "ok");
+        failed |= errors;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -64,6 +64,11 @@ static int     json                = 0;
 static int     inline_parameter_sets = -1;
 static int     align_av_start      = -1;
 static int     dvdnav              = 1;
+static int64_t memory_budget       = 0;
+static char *  scan_cache          = NULL;
+static int     encode_chunks       = 0;
+static int     mp4_fragment        = 0;
+static int     mp4_segment_length  = 0;
 static char *  input               = NULL;
 static char *  output              = NULL;
 static char *  format              = NULL;
@@ -509,6 +514,8 @@ int main( int argc, char ** argv )
     hb_register_error_handler(&hb_cli_error_handler);
 
     hb_dvd_set_dvdnav( dvdnav );
+    hb_global_set_memory_budget( memory_budget );
+    hb_global_set_scan_cache( scan_cache );
 
     /* Show version */
     fprintf( stderr, "%s - %s - %s\n",
@@ -636,6 +643,7 @@ cleanup:
     free(preset_export_name);
     free(preset_export_desc);
     free(preset_export_file);
+    free(scan_cache);
 
     // write a carriage return to stdout
     // avoids overlap / line wrapping when stderr is redirected
@@ -1320,6 +1328,18 @@ static void ShowHelp()
 "   --queue-import-file <filename>\n"
 "                           Import an encode queue file created by the GUI\n"
 "       --no-dvdnav         Do not use dvdnav for reading DVDs\n"
+"   --memory-budget <number>\n"
+"                           Limit the frame memory queued between the stages\n"
+"                           of the encode to <number> MiB. Stages wait when\n"
+"                           the limit is reached (default: 0, unlimited)\n"
+"   --scan-cache <directory>\n"
+"                           Keep scan results of files in <directory> and\n"
+"                           reuse them while a file is unchanged\n"
+"   --encode-chunks <number>\n"
+"                           Split the video into consecutive ranges and\n"
+"                           encode up to <number> of them concurrently with\n"
+"                           separate x264/x265 instances. Single pass only.\n"
+"                           (default: 0, disabled)\n"
 "\n"
 "\n"
 "Source Options ---------------------------------------------------------------\n"
@@ -1376,6 +1396,13 @@ static void ShowHelp()
 "   --inline-parameter-sets Create adaptive streaming compatible output.\n"
 "                           Inserts parameter sets (SPS and PPS) inline\n"
 "                           in the video stream before each IDR.\n"
+"       --mp4-fragment      Write fragmented MP4 (CMAF) with a fragment per\n"
+"                           GOP, playable while the encode is running\n"
+"       --mp4-segment-length <seconds>\n"
+"                           Write fragments to separate segment files of\n"
+"                           about <seconds> each plus an HLS playlist.\n"
+"                           The output file holds the init segment.\n"
+"                           Implies --mp4-fragment\n"
 "\n"
 "\n"
 "Video Options ----------------------------------------------------------------\n"
@@ -2161,6 +2188,10 @@ static int ParseOptions( int argc, char ** argv )
     #define FILTER_CHROMA_SMOOTH      322
     #define FILTER_CHROMA_SMOOTH_TUNE 323
     #define FILTER_DEBLOCK_TUNE  324
+    #define MEMORY_BUDGET        325
+    #define ENCODE_CHUNKS        326
+    #define MP4_SEGMENT_LENGTH   327
+    #define SCAN_CACHE           328
 
     for( ;; )
     {
@@ -2171,6 +2202,9 @@ static int ParseOptions( int argc, char ** argv )
             { "describe",    no_argument,       NULL,    DESCRIBE },
             { "verbose",     optional_argument, NULL,    'v' },
             { "no-dvdnav",   no_argument,       NULL,    DVDNAV },
+            { "memory-budget", required_argument, NULL,  MEMORY_BUDGET },
+            { "scan-cache",  required_argument, NULL,    SCAN_CACHE },
+            { "encode-chunks", required_argument, NULL,  ENCODE_CHUNKS },
 
 #if HB_PROJECT_FEATURE_QSV
             { "qsv-baseline",         no_argument,       NULL,        QSV_BASELINE,       },
@@ -2199,6 +2233,8 @@ static int ParseOptions( int argc, char ** argv )
             { "inline-parameter-sets", no_argument, &inline_parameter_sets, 1 },
             { "no-inline-parameter-sets", no_argument, &inline_parameter_sets, 0 },
             { "align-av",    no_argument,       &align_av_start, 1 },
+            { "mp4-fragment", no_argument,      &mp4_fragment, 1 },
+            { "mp4-segment-length", required_argument, NULL, MP4_SEGMENT_LENGTH },
             { "no-align-av", no_argument,       &align_av_start, 0 },
             { "audio-lang-list", required_argument, NULL, AUDIO_LANG_LIST },
             { "all-audio",   no_argument,       &audio_all, 1 },
@@ -2427,6 +2463,20 @@ static int ParseOptions( int argc, char ** argv )
             case DVDNAV:
                 dvdnav = 0;
                 break;
+            case MEMORY_BUDGET:
+                memory_budget = strtoll(optarg, NULL, 0) * 1024 * 1024;
+                break;
+            case SCAN_CACHE:
+                free(scan_cache);
+                scan_cache = strdup(optarg);
+                break;
+            case ENCODE_CHUNKS:
+                encode_chunks = atoi(optarg);
+                break;
+            case MP4_SEGMENT_LENGTH:
+                mp4_segment_length = atoi(optarg);
+                mp4_fragment = 1;
+                break;
 
             case 'f':
                 format = strdup( optarg );
@@ -4632,6 +4682,26 @@ PrepareJob(hb_handle_t *h, hb_title_t *title, hb_dict_t *preset_dict)
         hb_value_get_string(hb_dict_get(dest_dict, "Mux")));
 
     // Now set non-preset settings in the job dict
+    if (encode_chunks > 1)
+    {
+        hb_dict_set(hb_dict_get(job_dict, "Video"), "EncodeChunks",
+                    hb_value_int(encode_chunks));
+    }
+    if (mp4_fragment)
+    {
+        hb_dict_t *mp4_dict = hb_dict_get(dest_dict, "Mp4Options");
+        if (mp4_dict != NULL)
+        {
+            hb_dict_set(mp4_dict, "Fragmented", hb_value_bool(1));
+            hb_dict_set(mp4_dict, "SegmentLength",
+                        hb_value_int(mp4_segment_length));
+        }
+        else
+        {
+            fprintf(stderr, "Fragmented output requires an MP4 container\n");
+        }
+    }
+
     int64_t range_start = 0, range_end = 0, range_seek_points = 0;
     const char *range_type = "chapter";
     if (chapter_start   && chapter_end    &&